@@ -6,8 +6,15 @@
 
 #pragma once
 
+#include <cstddef>
+#include <new>
+
+#include "Memory.h"
+
 namespace createdataset
 {
+  // Allocator of memory aligned to N bytes, from alignedAllocate. Throws std::bad_alloc if there
+  // is not enough memory.
   template <typename T, std::size_t N = 16>
   class AlignmentAllocator {
   public:
@@ -38,11 +45,11 @@ namespace createdataset
     }
 
     inline pointer allocate(size_type n) {
-      return (pointer)_aligned_malloc(n*sizeof(value_type), N);
+      return (pointer)alignedAllocate(n*sizeof(value_type), N);
     }
 
     inline void deallocate(pointer p, size_type) {
-      _aligned_free(p);
+      alignedFree(p);
     }
 
     inline void construct(pointer p, const value_type & wert) {
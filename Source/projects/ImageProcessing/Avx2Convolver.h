@@ -0,0 +1,42 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "RowConvolver.h"
+
+namespace createdataset
+{
+  // Fast convolution of 1D vector with 1D kernel using AVX2 and FMA intrinsics.
+  // The implementation is compiled with /arch:AVX2 in its own translation unit, so it must
+  // only be constructed once getCpuFeatures() has reported both extensions. The constructor
+  // and clone are defined here so that the std::vector code they use is not compiled for AVX2.
+  class Avx2Convolver : public RowConvolver
+  {
+    std::vector<float> kernel_;
+    int length_;
+
+  public:
+    Avx2Convolver(const float* kernel, int kernel_length, int length) :
+      kernel_(kernel, kernel + kernel_length),
+      length_(length)
+    {
+    }
+
+    void convolve(const float* in, float* out) const override;
+
+    void convolveTile(const float* in, float* out) const override;
+
+    void convolveRows(const float* const* rows, float* out, int width) const override;
+
+    std::unique_ptr<RowConvolver> clone() const override
+    {
+      return std::unique_ptr<RowConvolver>(new Avx2Convolver(*this));
+    }
+  };
+}
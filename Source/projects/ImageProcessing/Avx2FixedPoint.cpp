@@ -0,0 +1,50 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+// Compiled with /arch:AVX2 and without the precompiled header, as for Avx2Convolver.cpp.
+
+#include "FixedPointConvolution.h"
+
+#include <immintrin.h>
+
+namespace createdataset
+{
+  void combineRowsFixedPointAvx2(const short* const* rows, const int* pairs, int pairCount, short* out, int width)
+  {
+    const __m256i round = _mm256_set1_epi32(1 << (FixedPointKernel::Shift - 1));
+
+    int u = 0;
+    for (; u + 16 <= width; u += 16)
+    {
+      // As combineRowsFixedPointSse, within each 128 bit lane
+      __m256i low = round, high = round;
+      for (int j = 0; j < pairCount; j++)
+      {
+        const __m256i pair = _mm256_set1_epi32(pairs[j]);
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(rows[2 * j] + u));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(rows[2 * j + 1] + u));
+        low = _mm256_add_epi32(low, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pair));
+        high = _mm256_add_epi32(high, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pair));
+      }
+      low = _mm256_srai_epi32(low, FixedPointKernel::Shift);
+      high = _mm256_srai_epi32(high, FixedPointKernel::Shift);
+      _mm256_storeu_si256((__m256i*)(out + u), _mm256_packs_epi32(low, high));
+    }
+
+    _mm256_zeroupper();
+
+    // Fewer than sixteen outputs remain. Not shared with the other combiners, which are compiled
+    // for the baseline instruction set.
+    for (; u < width; u++)
+    {
+      int sum = 1 << (FixedPointKernel::Shift - 1);
+      for (int j = 0; j < pairCount; j++)
+        sum += (short)(pairs[j] & 0xFFFF) * rows[2 * j][u] + (short)(pairs[j] >> 16) * rows[2 * j + 1][u];
+      sum >>= FixedPointKernel::Shift;
+      out[u] = (short)(sum < -32768 ? -32768 : (sum > 32767 ? 32767 : sum));
+    }
+  }
+}
@@ -0,0 +1,161 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+// Compiled without the precompiled header, as for Avx2Convolver.cpp.
+
+#include "Avx512Convolver.h"
+
+#include <stdexcept>
+#include <immintrin.h>
+
+// AVX-512 intrinsics need Visual Studio 2017 version 15.3 or later.
+#if defined(__AVX512F__) || (defined(_MSC_VER) && _MSC_VER >= 1911)
+#define AVX512_CONVOLVER_AVAILABLE 1
+#else
+#define AVX512_CONVOLVER_AVAILABLE 0
+#endif
+
+namespace createdataset
+{
+  bool Avx512Convolver::isAvailableInBuild()
+  {
+    return AVX512_CONVOLVER_AVAILABLE != 0;
+  }
+
+  Avx512Convolver::Avx512Convolver(const float* kernel, int kernel_length, int length) :
+    kernel_(kernel, kernel + kernel_length),
+    length_(length)
+  {
+  }
+
+#if AVX512_CONVOLVER_AVAILABLE
+  void Avx512Convolver::convolve(const float* in, float* out) const
+  {
+    const int kernel_length = (int)(kernel_.size());
+    const int count = length_ - kernel_length + 1;
+    const float* kernel = kernel_length > 0 ? &kernel_[0] : nullptr;
+
+    int i = 0;
+
+    for (; i + 64 <= count; i += 64)
+    {
+      __m512 accumulator0 = _mm512_setzero_ps();
+      __m512 accumulator1 = _mm512_setzero_ps();
+      __m512 accumulator2 = _mm512_setzero_ps();
+      __m512 accumulator3 = _mm512_setzero_ps();
+      for (int k = 0; k < kernel_length; k++)
+      {
+        const __m512 tap = _mm512_set1_ps(kernel[k]);
+        const float* p = in + i + k;
+        accumulator0 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(p), accumulator0);
+        accumulator1 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(p + 16), accumulator1);
+        accumulator2 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(p + 32), accumulator2);
+        accumulator3 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(p + 48), accumulator3);
+      }
+      _mm512_storeu_ps(out + i, accumulator0);
+      _mm512_storeu_ps(out + i + 16, accumulator1);
+      _mm512_storeu_ps(out + i + 32, accumulator2);
+      _mm512_storeu_ps(out + i + 48, accumulator3);
+    }
+
+    for (; i + 16 <= count; i += 16)
+    {
+      __m512 accumulator = _mm512_setzero_ps();
+      for (int k = 0; k < kernel_length; k++)
+        accumulator = _mm512_fmadd_ps(_mm512_set1_ps(kernel[k]), _mm512_loadu_ps(in + i + k), accumulator);
+      _mm512_storeu_ps(out + i, accumulator);
+    }
+
+    // Masked loads and stores for the outputs at the right hand edge, so that nothing is
+    // read or written beyond the ends of the rows
+    if (i < count)
+    {
+      const __mmask16 mask = (__mmask16)((1u << (count - i)) - 1);
+      __m512 accumulator = _mm512_setzero_ps();
+      for (int k = 0; k < kernel_length; k++)
+        accumulator = _mm512_fmadd_ps(_mm512_set1_ps(kernel[k]), _mm512_maskz_loadu_ps(mask, in + i + k), accumulator);
+      _mm512_mask_storeu_ps(out + i, mask, accumulator);
+    }
+
+    _mm256_zeroupper();
+  }
+
+  void Avx512Convolver::convolveTile(const float* in, float* out) const
+  {
+    static_assert(TileWidth == 32, "Tile must be two vectors wide.");
+
+    const int kernel_length = (int)(kernel_.size());
+    const int count = length_ - kernel_length + 1;
+    const float* kernel = kernel_length > 0 ? &kernel_[0] : nullptr;
+
+    for (int i = 0; i < count; i++)
+    {
+      __m512 accumulator0 = _mm512_setzero_ps();
+      __m512 accumulator1 = _mm512_setzero_ps();
+      for (int k = 0; k < kernel_length; k++)
+      {
+        const __m512 tap = _mm512_set1_ps(kernel[k]);
+        const float* row = in + (i + k) * TileWidth;
+        accumulator0 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(row), accumulator0);
+        accumulator1 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(row + 16), accumulator1);
+      }
+      _mm512_storeu_ps(out + i * TileWidth, accumulator0);
+      _mm512_storeu_ps(out + i * TileWidth + 16, accumulator1);
+    }
+
+    _mm256_zeroupper();
+  }
+
+  void Avx512Convolver::convolveRows(const float* const* rows, float* out, int width) const
+  {
+    const int kernel_length = (int)(kernel_.size());
+    const float* kernel = kernel_length > 0 ? &kernel_[0] : nullptr;
+
+    int u = 0;
+    for (; u + 32 <= width; u += 32)
+    {
+      __m512 accumulator0 = _mm512_setzero_ps();
+      __m512 accumulator1 = _mm512_setzero_ps();
+      for (int k = 0; k < kernel_length; k++)
+      {
+        const __m512 tap = _mm512_set1_ps(kernel[k]);
+        const float* row = rows[k] + u;
+        accumulator0 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(row), accumulator0);
+        accumulator1 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(row + 16), accumulator1);
+      }
+      _mm512_storeu_ps(out + u, accumulator0);
+      _mm512_storeu_ps(out + u + 16, accumulator1);
+    }
+
+    for (; u < width; u += 16)
+    {
+      const int remaining = width - u;
+      const __mmask16 mask = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+      __m512 accumulator = _mm512_setzero_ps();
+      for (int k = 0; k < kernel_length; k++)
+        accumulator = _mm512_fmadd_ps(_mm512_set1_ps(kernel[k]), _mm512_maskz_loadu_ps(mask, rows[k] + u), accumulator);
+      _mm512_mask_storeu_ps(out + u, mask, accumulator);
+    }
+
+    _mm256_zeroupper();
+  }
+#else
+  void Avx512Convolver::convolve(const float*, float*) const
+  {
+    throw std::exception("AVX-512 convolution is not supported by this build.");
+  }
+
+  void Avx512Convolver::convolveTile(const float*, float*) const
+  {
+    throw std::exception("AVX-512 convolution is not supported by this build.");
+  }
+
+  void Avx512Convolver::convolveRows(const float* const*, float*, int) const
+  {
+    throw std::exception("AVX-512 convolution is not supported by this build.");
+  }
+#endif
+}
@@ -0,0 +1,39 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "RowConvolver.h"
+
+namespace createdataset
+{
+  // Fast convolution of 1D vector with 1D kernel using AVX-512F intrinsics.
+  // Only constructed when getCpuFeatures() reports AVX-512F and isAvailableInBuild() is true.
+  class Avx512Convolver : public RowConvolver
+  {
+    std::vector<float> kernel_;
+    int length_;
+
+  public:
+    Avx512Convolver(const float* kernel, int kernel_length, int length);
+
+    void convolve(const float* in, float* out) const override;
+
+    void convolveTile(const float* in, float* out) const override;
+
+    void convolveRows(const float* const* rows, float* out, int width) const override;
+
+    std::unique_ptr<RowConvolver> clone() const override
+    {
+      return std::unique_ptr<RowConvolver>(new Avx512Convolver(*this));
+    }
+
+    // Whether the compiler that built this library supports the AVX-512 intrinsics.
+    static bool isAvailableInBuild();
+  };
+}
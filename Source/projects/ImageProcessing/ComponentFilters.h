@@ -0,0 +1,227 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+#include "connectedComponents.h"
+#include "Memory.h"
+
+namespace createdataset
+{
+  // Filters of a mask by its connected components, as findConnectedComponents3d finds them, that
+  // write the filtered mask directly from the runs of labelComponentRuns, so no volume of labels
+  // is ever made. The output may be the input, and has the same type and layout as it. Each
+  // returns after the whole output has been written, or throws before any of it has.
+
+  // Writes the voxels of the runs whose labels are set in keep with their colour, and every other
+  // voxel with the background colour.
+  template<typename T, typename U>
+  void writeKeptComponents(
+    const ComponentRuns<U>& runs,
+    const std::vector<ComponentStatistics<T, U> >& statistics,
+    const std::vector<char>& keep,
+    T backgroundColor,
+    void* outputBuffer, // of type T
+    int outputLeap,
+    int outputStride)
+  {
+    const int slabCount = (int)runs.slabStart.size() - 1;
+    InstrumentedStage stage("write mask", (long long)runs.width * runs.height * runs.depth, slabCount);
+
+#pragma omp parallel for num_threads(std::max(slabCount, 1)) schedule(static, 1)
+    for (int s = 0; s < slabCount; s++)
+    {
+      for (int w = runs.slabStart[s]; w < runs.slabStart[s + 1]; w++)
+      {
+        for (int v = 0; v < runs.height; v++)
+        {
+          const size_t r = (size_t)w*runs.height + v;
+          T* o = (T*)((unsigned char*)outputBuffer + (size_t)w*outputLeap + (size_t)v*outputStride);
+          int u = 0;
+          for (unsigned int i = runs.rowStart[r]; i < runs.rowStart[r + 1]; i++)
+          {
+            const size_t label = (size_t)runs.labels[i];
+            if (!keep[label])
+              continue;
+            const ComponentRun& run = runs.runs[i];
+            std::fill(o + u, o + run.start, backgroundColor);
+            std::fill(o + run.start, o + run.end, statistics[label].inputLabel_);
+            u = run.end;
+          }
+          std::fill(o + u, o + runs.width, backgroundColor);
+        }
+      }
+    }
+  }
+
+  // Keeps only the largest component of the input, the first in raster order if several are the
+  // largest, writing it to the output as above. Returns its number of voxels, zero if the input is
+  // all background.
+  template<typename T, Connectivity C = Connectivity::Face>
+  size_t keepLargestComponent(
+    int width,
+    int height,
+    int depth,
+    const void* inputBuffer,  // of type T
+    int inputLeap,
+    int inputStride,
+    T backgroundColor,
+    void* outputBuffer, // of type T
+    int outputLeap,
+    int outputStride,
+    int threadCount = 0)
+  {
+    ComponentRuns<unsigned int> runs;
+    const std::vector<ComponentStatistics<T, unsigned int> > statistics = labelComponentRuns<T, unsigned int, C>(
+      width, height, depth, inputBuffer, inputLeap, inputStride, backgroundColor, 0, threadCount, runs);
+
+    std::vector<char> keep(statistics.size(), 0);
+    size_t largest = 0;
+    for (size_t label = 1; label < statistics.size(); label++)
+    {
+      if (largest == 0 || statistics[label].pixelCount_ > statistics[largest].pixelCount_)
+        largest = label;
+    }
+    if (largest != 0)
+      keep[largest] = 1;
+
+    writeKeptComponents(runs, statistics, keep, backgroundColor, outputBuffer, outputLeap, outputStride);
+    return largest == 0 ? 0 : statistics[largest].pixelCount_;
+  }
+
+  // Removes the components of the input with fewer than minimumVoxels voxels, writing the rest to
+  // the output as above. Returns the number of components removed.
+  template<typename T, Connectivity C = Connectivity::Face>
+  size_t removeSmallComponents(
+    int width,
+    int height,
+    int depth,
+    const void* inputBuffer,  // of type T
+    int inputLeap,
+    int inputStride,
+    T backgroundColor,
+    void* outputBuffer, // of type T
+    int outputLeap,
+    int outputStride,
+    size_t minimumVoxels,
+    int threadCount = 0)
+  {
+    ComponentRuns<unsigned int> runs;
+    const std::vector<ComponentStatistics<T, unsigned int> > statistics = labelComponentRuns<T, unsigned int, C>(
+      width, height, depth, inputBuffer, inputLeap, inputStride, backgroundColor, 0, threadCount, runs);
+
+    std::vector<char> keep(statistics.size(), 0);
+    size_t removed = 0;
+    for (size_t label = 1; label < statistics.size(); label++)
+    {
+      keep[label] = statistics[label].pixelCount_ >= minimumVoxels;
+      removed += !keep[label];
+    }
+
+    writeKeptComponents(runs, statistics, keep, backgroundColor, outputBuffer, outputLeap, outputStride);
+    return removed;
+  }
+
+  // Fills the holes of the input, the components of background voxels that do not touch the edge
+  // of the volume, with foregroundColor, and copies every other voxel to the output. The holes are
+  // components with connectivity C, so that with the default Face connectivity a cavity that
+  // meets the outside only at an edge or a corner is filled. Unlike FillPolygon.FloodFillHoles,
+  // which fills each slice on its own, holes are found in 3D. Returns the number of voxels filled.
+  //
+  // Works on a temporary copy of the mask of background voxels, of one byte per voxel.
+  template<typename T, Connectivity C = Connectivity::Face>
+  size_t fillHoles(
+    int width,
+    int height,
+    int depth,
+    const void* inputBuffer,  // of type T
+    int inputLeap,
+    int inputStride,
+    T backgroundColor,
+    T foregroundColor,
+    void* outputBuffer, // of type T
+    int outputLeap,
+    int outputStride,
+    int threadCount = 0)
+  {
+    if (width <= 0 || height <= 0 || depth <= 0)
+      return 0;
+
+    auto inputRow = [&](int v, int w) { return (const T*)((const unsigned char*)inputBuffer + (size_t)w*inputLeap + (size_t)v*inputStride); };
+    auto outputRow = [&](int v, int w) { return (T*)((unsigned char*)outputBuffer + (size_t)w*outputLeap + (size_t)v*outputStride); };
+
+    // One for the background voxels of the input, and zero for the rest
+    threadCount = resolveThreadCount(threadCount, depth);
+    ScratchBuffer<unsigned char> background((size_t)width * height * depth);
+#pragma omp parallel for num_threads(threadCount) schedule(static)
+    for (int w = 0; w < depth; w++)
+    {
+      for (int v = 0; v < height; v++)
+      {
+        const T* p = inputRow(v, w);
+        unsigned char* b = &background[((size_t)w*height + v) * width];
+        for (int u = 0; u < width; u++)
+          b[u] = p[u] == backgroundColor;
+      }
+    }
+
+    ComponentRuns<unsigned int> runs;
+    const std::vector<ComponentStatistics<unsigned char, unsigned int> > statistics = labelComponentRuns<unsigned char, unsigned int, C>(
+      width, height, depth, &background[0], width * height, width, 0, 0, threadCount, runs);
+    background.clear();
+
+    // A component is a hole unless one of its runs is on the edge of the volume
+    std::vector<char> hole(statistics.size(), 1);
+    hole[0] = 0;
+    for (int w = 0; w < depth; w++)
+    {
+      for (int v = 0; v < height; v++)
+      {
+        const size_t r = (size_t)w*height + v;
+        const bool edge = w == 0 || w == depth - 1 || v == 0 || v == height - 1;
+        for (unsigned int i = runs.rowStart[r]; i < runs.rowStart[r + 1]; i++)
+        {
+          if (edge || runs.runs[i].start == 0 || runs.runs[i].end == width)
+            hole[(size_t)runs.labels[i]] = 0;
+        }
+      }
+    }
+
+    size_t filled = 0;
+    for (size_t label = 1; label < statistics.size(); label++)
+    {
+      if (hole[label])
+        filled += statistics[label].pixelCount_;
+    }
+
+    const int slabCount = (int)runs.slabStart.size() - 1;
+#pragma omp parallel for num_threads(slabCount) schedule(static, 1)
+    for (int s = 0; s < slabCount; s++)
+    {
+      for (int w = runs.slabStart[s]; w < runs.slabStart[s + 1]; w++)
+      {
+        for (int v = 0; v < height; v++)
+        {
+          const size_t r = (size_t)w*height + v;
+          T* o = outputRow(v, w);
+          if ((const void*)o != (const void*)inputRow(v, w))
+            memcpy(o, inputRow(v, w), width * sizeof(T));
+          for (unsigned int i = runs.rowStart[r]; i < runs.rowStart[r + 1]; i++)
+          {
+            if (hole[(size_t)runs.labels[i]])
+              std::fill(o + runs.runs[i].start, o + runs.runs[i].end, foregroundColor);
+          }
+        }
+      }
+    }
+
+    return filled;
+  }
+}
@@ -0,0 +1,96 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "StdAfx.h"
+#include "ConvolutionPlan.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace createdataset
+{
+  ConvolutionPlan::ConvolutionPlan(int width, int height, int depth,
+    const std::vector<int>& directions, const std::vector<float>& sigmas,
+    const ConvolutionOptions& options, GaussianSampling sampling, GaussianMethod method) :
+    width_(width), height_(height), depth_(depth), options_(options), fused_(false),
+    directions_(directions), sigmas_(sigmas)
+  {
+    InstrumentedStage stage("kernels");
+    if (directions.size() != sigmas.size())
+      throw std::exception("Arrays of directions and sigmas should be of the same length.");
+
+    std::vector<bool> recursive(directions.size());
+    for (size_t d = 0; d < directions.size(); d++)
+    {
+      if (directions[d] < 0 || directions[d] > 2)
+        throw std::exception("Direction was out of range.");
+      recursive[d] = isRecursiveGaussian(method, sigmas[d]);
+    }
+
+    // Fixed when the plan is made so that every execution uses the same backend
+    options_.mode = resolveConvolutionMode(options.mode);
+
+    // Kernels wider than the volume are folded to fit it
+    const int extents[3] = { width, height, depth };
+
+    // Smoothing along all three axes is done in one pass over the volume, in float. With
+    // fixedPoint the steps along each direction are set up as well, for the pixel types that
+    // execute convolves in fixed point instead.
+    if (directions.size() == 3)
+    {
+      int found[3] = { -1, -1, -1 };
+      for (int d = 0; d < 3; d++)
+        found[directions[d]] = d;
+      fused_ = found[0] >= 0 && found[1] >= 0 && found[2] >= 0 && !recursive[0] && !recursive[1] && !recursive[2];
+
+      if (fused_)
+      {
+        for (int axis = 0; axis < 3; axis++)
+          fusedKernels_.push_back(GaussianKernel1D::get(sigmas[found[axis]], 0.001f, sampling, extents[axis]));
+        if (!options.fixedPoint)
+          return;
+      }
+    }
+
+    for (size_t d = 0; d < directions.size(); d++)
+    {
+      kernels_.push_back(recursive[d] ? std::shared_ptr<const GaussianKernel1D>() :
+        GaussianKernel1D::get(sigmas[d], 0.001f, sampling, extents[directions[d]]));
+    }
+    workspaces_.resize(directions.size());
+
+    if (options.fixedPoint)
+    {
+      for (size_t d = 0; d < directions.size(); d++)
+      {
+        fixedPointKernels_.push_back(std::unique_ptr<FixedPointKernel>(kernels_[d] ?
+          new FixedPointKernel(kernels_[d]->getData(), kernels_[d]->getRadius()) : nullptr));
+      }
+      fixedPointWorkspaces_.resize(directions.size());
+    }
+  }
+
+  const char* ConvolutionPlan::getStageName(size_t d, bool fixedPointType) const
+  {
+    static const char* const direct[3] = { "convolve x", "convolve y", "convolve z" };
+    static const char* const recursive[3] = { "recursive x", "recursive y", "recursive z" };
+    static const char* const fixedPoint[3] = { "fixed point x", "fixed point y", "fixed point z" };
+    if (!kernels_[d])
+      return recursive[directions_[d]];
+    return fixedPointType && !fixedPointKernels_.empty() && fixedPointKernels_[d] ? fixedPoint[directions_[d]] : direct[directions_[d]];
+  }
+
+  Region3d ConvolutionPlan::getInputRegion(const Region3d& region) const
+  {
+    int margin[3] = { 0, 0, 0 };
+    for (size_t d = 0; d < directions_.size(); d++)
+      margin[directions_[d]] += kernels_[d] ? kernels_[d]->getRadius() : RecursiveGaussianConvolver::getPadding(sigmas_[d]);
+
+    return Region3d(
+      std::max(0, region.minimumX - margin[0]), std::max(0, region.minimumY - margin[1]), std::max(0, region.minimumZ - margin[2]),
+      std::min(width_ - 1, region.maximumX + margin[0]), std::min(height_ - 1, region.maximumY + margin[1]), std::min(depth_ - 1, region.maximumZ + margin[2]));
+  }
+}
@@ -0,0 +1,211 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string.h>
+
+#include "convolution.h"
+#include "smoothing.h"
+#include "GaussianKernel1D.h"
+#include "RecursiveGaussian.h"
+#include "FixedPointConvolution.h"
+#include "Instrumentation.h"
+
+namespace createdataset
+{
+  // Gaussian smoothing of volumes of one size along a fixed list of directions, set up once and
+  // executed many times. The plan holds the kernels, the resolved SIMD backend and thread count,
+  // and the aligned scratch memory of every thread, so executing it does no setup beyond the
+  // first call. As with convolve1d, smoothing along each of X, Y and Z exactly once is done in
+  // a single pass by gaussianSmooth3d, unless any of them uses the recursive filter, chosen for
+  // each direction by method and its sigma. With options.fixedPoint, unsigned char and short
+  // volumes are instead convolved in fixed point along each direction in turn, except those
+  // that use the recursive filter; float volumes are smoothed as without it.
+  //
+  // Scratch memory is shared between calls, so a plan must not be executed on several threads
+  // at once. Use one plan per thread instead. Likewise options.progress, if set, is that of every
+  // execution of the plan.
+  class ConvolutionPlan
+  {
+  public:
+    ConvolutionPlan(int width, int height, int depth,
+      const std::vector<int>& directions, const std::vector<float>& sigmas,
+      const ConvolutionOptions& options = ConvolutionOptions(),
+      GaussianSampling sampling = GaussianSampling::Point,
+      GaussianMethod method = GaussianMethod::Auto);
+
+    int getWidth() const { return width_; }
+    int getHeight() const { return height_; }
+    int getDepth() const { return depth_; }
+    const ConvolutionOptions& getOptions() const { return options_; }
+
+    // Smooths the volume of pixel type T at buffer in place.
+    template<typename T>
+    void execute(unsigned char* buffer, int leap, int stride, int hop)
+    {
+      execute<T>(buffer, leap, stride, hop, buffer, leap, stride, hop, Region3d(width_, height_, depth_));
+    }
+
+    // Smooths region of the volume of pixel type T at source, writing the result to destination,
+    // which is addressed as for gaussianSmooth3d. Only voxels near the region are read. Where the
+    // recursive filter is used the result differs slightly from that for the whole volume, as
+    // its impulse response is cut off beyond RecursiveGaussianConvolver::getPadding.
+    template<typename T>
+    void execute(
+      const unsigned char* source, int leap, int stride, int hop,
+      unsigned char* destination, int destinationLeap, int destinationStride, int destinationHop,
+      const Region3d& region)
+    {
+      if (!region.isInside(width_, height_, depth_))
+        throw std::exception("Region was out of range.");
+      if (region.isEmpty())
+        return;
+
+      const long long voxels = (long long)region.getWidth() * region.getHeight() * region.getDepth();
+      if (fused_ && !isFixedPoint<T>())
+      {
+        InstrumentedStage stage("smooth xyz", voxels, resolveThreadCount(options_.threadCount, region.getDepth()));
+        gaussianSmooth3d<T, readerT<T>, writerT<T>>(width_, height_, depth_, source, leap, stride, hop,
+          destination, destinationLeap, destinationStride, destinationHop, region,
+          *fusedKernels_[0], *fusedKernels_[1], *fusedKernels_[2], options_, smoothingWorkspace_);
+        return;
+      }
+
+      if (region.isWhole(width_, height_, depth_))
+      {
+        if (source != destination || leap != destinationLeap || stride != destinationStride || hop != destinationHop)
+        {
+          InstrumentedStage stage("copy", voxels);
+          copyBox<T>(width_, height_, depth_, source, leap, stride, hop, destination, destinationLeap, destinationStride, destinationHop);
+        }
+        convolveAll<T>(width_, height_, depth_, destination, destinationLeap, destinationStride, destinationHop);
+        return;
+      }
+
+      // Each convolution along an axis gives exact results only further than its radius from
+      // the ends of its input along that axis (unless an end is the edge of the volume), so the
+      // box that is copied and convolved is the region grown by the radii of every convolution
+      const Region3d box = getInputRegion(region);
+      const int boxStride = box.getWidth() * sizeof(T), boxLeap = box.getHeight() * boxStride, boxHop = sizeof(T);
+      boxBuffer_.resize((size_t)box.getDepth() * boxLeap);
+
+      {
+        InstrumentedStage stage("copy", (long long)box.getWidth() * box.getHeight() * box.getDepth());
+        copyBox<T>(box.getWidth(), box.getHeight(), box.getDepth(),
+          source + (size_t)box.minimumZ*leap + (size_t)box.minimumY*stride + (size_t)box.minimumX*hop, leap, stride, hop,
+          &boxBuffer_[0], boxLeap, boxStride, boxHop);
+      }
+      convolveAll<T>(box.getWidth(), box.getHeight(), box.getDepth(), &boxBuffer_[0], boxLeap, boxStride, boxHop);
+      InstrumentedStage stage("copy", voxels);
+      copyBox<T>(region.getWidth(), region.getHeight(), region.getDepth(),
+        &boxBuffer_[0] + (size_t)(region.minimumZ - box.minimumZ)*boxLeap + (size_t)(region.minimumY - box.minimumY)*boxStride + (size_t)(region.minimumX - box.minimumX)*boxHop,
+        boxLeap, boxStride, boxHop,
+        destination, destinationLeap, destinationStride, destinationHop);
+    }
+
+  private:
+    ConvolutionPlan(const ConvolutionPlan&);
+    ConvolutionPlan& operator=(const ConvolutionPlan&);
+
+    // Whether volumes of pixel type T are convolved in fixed point along each direction in turn.
+    template<typename T>
+    bool isFixedPoint() const
+    {
+      return IsFixedPointType<T>::value && !fixedPointKernels_.empty();
+    }
+
+    // Convolves a volume along each direction in turn, with progress counted in directions.
+    template<typename T>
+    void convolveAll(int width, int height, int depth, unsigned char* buffer, int leap, int stride, int hop)
+    {
+      OperationProgress* const progress = options_.progress;
+      if (progress != nullptr)
+        progress->expect((long long)directions_.size());
+
+      const int extents[3] = { width, height, depth };
+      for (size_t d = 0; d < directions_.size(); d++)
+      {
+        if (progress != nullptr)
+          progress->throwIfCancelled();
+
+        // The lines along the direction are shared between the threads
+        const long long voxels = (long long)width * height * depth;
+        InstrumentedStage stage(getStageName(d, IsFixedPointType<T>::value), voxels,
+          resolveThreadCount(options_.threadCount, (int)std::min<long long>(voxels / extents[directions_[d]], 1 << 30)));
+        convolveStep<T>(d, width, height, depth, buffer, leap, stride, hop, IsFixedPointType<T>());
+        if (progress != nullptr)
+          progress->advance(1);
+      }
+    }
+
+    template<typename T>
+    void convolveStep(size_t d, int width, int height, int depth, unsigned char* buffer, int leap, int stride, int hop, std::true_type)
+    {
+      if (fixedPointKernels_.empty() || !fixedPointKernels_[d])
+        convolveStep<T>(d, width, height, depth, buffer, leap, stride, hop, std::false_type());
+      else
+        fixedPointConvolve1d<T>(width, height, depth, buffer, leap, stride, hop, directions_[d],
+          *fixedPointKernels_[d], options_, fixedPointWorkspaces_[d]);
+    }
+
+    template<typename T>
+    void convolveStep(size_t d, int width, int height, int depth, unsigned char* buffer, int leap, int stride, int hop, std::false_type)
+    {
+      if (kernels_[d])
+        convolve1d<T>(width, height, depth, buffer, leap, stride, hop, directions_[d],
+          kernels_[d]->getData(), kernels_[d]->getRadius(), options_, workspaces_[d]);
+      else
+        recursiveGaussian1d<T>(width, height, depth, buffer, leap, stride, hop, directions_[d],
+          sigmas_[d], options_, workspaces_[d]);
+    }
+
+    template<typename T>
+    static void copyBox(int width, int height, int depth,
+      const unsigned char* source, int leap, int stride, int hop,
+      unsigned char* destination, int destinationLeap, int destinationStride, int destinationHop)
+    {
+      for (int z = 0; z < depth; z++)
+      {
+        for (int y = 0; y < height; y++)
+        {
+          const unsigned char* p = source + (size_t)z*leap + (size_t)y*stride;
+          unsigned char* q = destination + (size_t)z*destinationLeap + (size_t)y*destinationStride;
+          if (hop == sizeof(T) && destinationHop == sizeof(T))
+          {
+            memcpy(q, p, width * sizeof(T));
+            continue;
+          }
+          for (int x = 0; x < width; x++)
+            *(T*)(q + (size_t)x*destinationHop) = *(const T*)(p + (size_t)x*hop);
+        }
+      }
+    }
+
+    // The voxels needed to smooth region when convolving along each direction in turn.
+    Region3d getInputRegion(const Region3d& region) const;
+
+    // The name of the step along directions_[d] for InstrumentedStage, for a volume whose type can
+    // be convolved in fixed point if fixedPointType is set.
+    const char* getStageName(size_t d, bool fixedPointType) const;
+
+    int width_, height_, depth_;
+    ConvolutionOptions options_;
+    bool fused_; // if so volumes not convolved in fixed point are smoothed in one pass
+
+    std::vector<int> directions_;
+    std::vector<float> sigmas_;
+    std::vector<std::shared_ptr<const GaussianKernel1D>> fusedKernels_; // if fused_, the X, Y and Z kernels in that order
+    std::vector<std::shared_ptr<const GaussianKernel1D>> kernels_; // one per direction unless only fused, null where the recursive filter is used
+    std::vector<ConvolutionWorkspace> workspaces_; // one per direction
+    std::vector<std::unique_ptr<FixedPointKernel>> fixedPointKernels_; // if options_.fixedPoint, one per direction, null where recursive
+    std::vector<FixedPointWorkspace> fixedPointWorkspaces_;
+    SmoothingWorkspace smoothingWorkspace_;
+    std::vector<unsigned char> boxBuffer_; // copy of the voxels around a region
+  };
+}
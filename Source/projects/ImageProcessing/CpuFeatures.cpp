@@ -0,0 +1,84 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "stdafx.h"
+#include "CpuFeatures.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace createdataset
+{
+  namespace
+  {
+    void cpuid(int leaf, int subleaf, int registers[4])
+    {
+#ifdef _MSC_VER
+      __cpuidex(registers, leaf, subleaf);
+#else
+      unsigned int a = 0, b = 0, c = 0, d = 0;
+      __cpuid_count(leaf, subleaf, a, b, c, d);
+      registers[0] = (int)a; registers[1] = (int)b; registers[2] = (int)c; registers[3] = (int)d;
+#endif
+    }
+
+    // Which register state the operating system saves on a context switch (XCR0).
+    unsigned long long xgetbv0()
+    {
+#ifdef _MSC_VER
+      return _xgetbv(0);
+#else
+      unsigned int lo = 0, hi = 0;
+      __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+      return ((unsigned long long)hi << 32) | lo;
+#endif
+    }
+
+    CpuFeatures detectCpuFeatures()
+    {
+      CpuFeatures features = { false, false, false, false };
+
+      int registers[4];
+      cpuid(0, 0, registers);
+      const int maxLeaf = registers[0];
+      if (maxLeaf < 1)
+        return features;
+
+      cpuid(1, 0, registers);
+      const int ecx1 = registers[2];
+      features.sse3 = (ecx1 & (1 << 0)) != 0;
+
+      const bool osxsave = (ecx1 & (1 << 27)) != 0;
+      const bool avx = (ecx1 & (1 << 28)) != 0;
+      if (!osxsave || !avx)
+        return features;
+
+      // The OS must save the XMM and YMM registers (and the opmask and ZMM registers for AVX-512)
+      const unsigned long long xcr0 = xgetbv0();
+      const bool osAvx = (xcr0 & 0x6) == 0x6;
+      const bool osAvx512 = (xcr0 & 0xE6) == 0xE6;
+      if (!osAvx || maxLeaf < 7)
+        return features;
+
+      cpuid(7, 0, registers);
+      const int ebx7 = registers[1];
+      features.fma = (ecx1 & (1 << 12)) != 0;
+      features.avx2 = (ebx7 & (1 << 5)) != 0;
+      features.avx512f = osAvx512 && (ebx7 & (1 << 16)) != 0;
+
+      return features;
+    }
+  }
+
+  const CpuFeatures& getCpuFeatures()
+  {
+    static const CpuFeatures features = detectCpuFeatures();
+    return features;
+  }
+}
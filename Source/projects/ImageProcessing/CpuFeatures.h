@@ -0,0 +1,22 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+namespace createdataset
+{
+  // Instruction set extensions that are supported by both the processor and the operating system.
+  struct CpuFeatures
+  {
+    bool sse3;
+    bool avx2;
+    bool fma;
+    bool avx512f;
+  };
+
+  // Queries CPUID the first time it is called, and returns the cached result thereafter.
+  const CpuFeatures& getCpuFeatures();
+}
@@ -0,0 +1,151 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "stdafx.h"
+#include "FixedPointConvolution.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include <emmintrin.h>
+
+namespace createdataset
+{
+  FixedPointKernel::FixedPointKernel(const float* kernel, int kernelRadius) :
+    radius(kernelRadius), taps(2 * kernelRadius + 1), pairs(kernelRadius + 1)
+  {
+    const int count = 2 * kernelRadius + 1;
+    const int scale = 1 << Shift;
+
+    double total = 0.0;
+    for (int k = 0; k < count; k++)
+      total += kernel[k];
+
+    // Round down, then round up the taps with the largest remainders until the taps sum to
+    // exactly scale, which leaves every tap within one unit of the exact value. Ties go to the
+    // taps nearest the centre, which keeps a symmetric kernel symmetric where possible.
+    std::vector<double> remainders(count);
+    std::vector<int> order(count);
+    int sum = 0;
+    for (int k = 0; k < count; k++)
+    {
+      const double exact = kernel[k] / total * scale;
+      taps[k] = (short)floor(exact);
+      remainders[k] = exact - taps[k];
+      order[k] = k;
+      sum += taps[k];
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+    {
+      if (remainders[a] != remainders[b])
+        return remainders[a] > remainders[b];
+      return abs(a - kernelRadius) < abs(b - kernelRadius);
+    });
+    for (int i = 0; sum < scale; i++, sum++)
+      taps[order[i % count]]++;
+
+    for (int j = 0; j <= kernelRadius; j++)
+    {
+      const int low = taps[2 * j];
+      const int high = 2 * j + 1 < count ? taps[2 * j + 1] : 0;
+      pairs[j] = (low & 0xFFFF) | (high << 16);
+    }
+  }
+
+  namespace
+  {
+    // Outputs begin to end of combineRowsFixedPointReference.
+    void combineRange(const short* const* rows, const int* pairs, int pairCount, short* out, int begin, int end)
+    {
+      const int round = 1 << (FixedPointKernel::Shift - 1);
+      for (int u = begin; u < end; u++)
+      {
+        int sum = round;
+        for (int j = 0; j < pairCount; j++)
+          sum += (short)(pairs[j] & 0xFFFF) * rows[2 * j][u] + (short)(pairs[j] >> 16) * rows[2 * j + 1][u];
+        sum >>= FixedPointKernel::Shift;
+        out[u] = (short)std::max(-32768, std::min(32767, sum));
+      }
+    }
+  }
+
+  void combineRowsFixedPointReference(const short* const* rows, const int* pairs, int pairCount, short* out, int width)
+  {
+    combineRange(rows, pairs, pairCount, out, 0, width);
+  }
+
+  void combineRowsFixedPointSse(const short* const* rows, const int* pairs, int pairCount, short* out, int width)
+  {
+    const __m128i round = _mm_set1_epi32(1 << (FixedPointKernel::Shift - 1));
+
+    int u = 0;
+    for (; u + 8 <= width; u += 8)
+    {
+      // Interleaving the samples of two rows lines each one up with its tap in the pair; the
+      // results for the low and high halves come out in order when they are packed together
+      __m128i low = round, high = round;
+      for (int j = 0; j < pairCount; j++)
+      {
+        const __m128i pair = _mm_set1_epi32(pairs[j]);
+        const __m128i a = _mm_loadu_si128((const __m128i*)(rows[2 * j] + u));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(rows[2 * j + 1] + u));
+        low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pair));
+        high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pair));
+      }
+      low = _mm_srai_epi32(low, FixedPointKernel::Shift);
+      high = _mm_srai_epi32(high, FixedPointKernel::Shift);
+      _mm_storeu_si128((__m128i*)(out + u), _mm_packs_epi32(low, high));
+    }
+
+    combineRange(rows, pairs, pairCount, out, u, width);
+  }
+
+  void widenFixedPointRow(const unsigned char* in, int count, short* out)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    int u = 0;
+    for (; u + 16 <= count; u += 16)
+    {
+      const __m128i bytes = _mm_loadu_si128((const __m128i*)(in + u));
+      _mm_storeu_si128((__m128i*)(out + u), _mm_unpacklo_epi8(bytes, zero));
+      _mm_storeu_si128((__m128i*)(out + u + 8), _mm_unpackhi_epi8(bytes, zero));
+    }
+    for (; u < count; u++)
+      out[u] = in[u];
+  }
+
+  void narrowFixedPointRow(const short* in, int count, unsigned char* out)
+  {
+    int u = 0;
+    for (; u + 16 <= count; u += 16)
+    {
+      const __m128i low = _mm_loadu_si128((const __m128i*)(in + u));
+      const __m128i high = _mm_loadu_si128((const __m128i*)(in + u + 8));
+      _mm_storeu_si128((__m128i*)(out + u), _mm_packus_epi16(low, high));
+    }
+    for (; u < count; u++)
+      writeFixedPoint<unsigned char>(in[u], out + u);
+  }
+
+  FixedPointRowCombiner getFixedPointRowCombiner(ConvolutionMode mode)
+  {
+    switch (resolveConvolutionMode(mode))
+    {
+    case ConvolutionMode::Reference:
+      return combineRowsFixedPointReference;
+    case ConvolutionMode::Sse:
+      return combineRowsFixedPointSse;
+    case ConvolutionMode::Avx2:
+    case ConvolutionMode::Avx512:
+      return combineRowsFixedPointAvx2;
+    default:
+      throw std::exception("Convolution mode was out of range.");
+    }
+  }
+}
@@ -0,0 +1,306 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include <string.h>
+
+#include <omp.h>
+
+#include "AlignmentAllocator.h"
+#include "RowConvolver.h"
+#include "convolution.h"
+
+namespace createdataset
+{
+  // Convolution of 8 and 16 bit volumes in integer arithmetic, which keeps samples as 16 bit
+  // integers rather than floats and multiplies and adds pairs of them in one instruction
+  // (pmaddwd): sixteen voxels per instruction with AVX2, and eight with SSE2.
+  //
+  // The kernel is quantised to taps that are multiples of 1/16384 summing to exactly one, each
+  // within 1/16384 of the normalised kernel, so a constant image is unchanged. Each output is
+  // rounded once to the nearest integer and differs from the exact convolution with the kernel
+  // by less than 0.5 + taps * (maximum - minimum) / 32768, where maximum and minimum are the
+  // extremes of the input under the kernel. For bytes and kernels of up to 128 taps (sigma up
+  // to about 17 voxels) that is less than one and a half, so the result is within one of the
+  // result of convolving in float.
+
+  // Kernel taps in fixed point with Shift fractional bits, stored as pairs for pmaddwd.
+  struct FixedPointKernel
+  {
+    static const int Shift = 14;
+
+    FixedPointKernel(const float* kernel, int kernelRadius);
+
+    int radius;
+    std::vector<short> taps; // 2*radius+1 of them, summing to 1 << Shift
+
+    // Taps 2j and 2j+1 in the low and high halves of pairs[j], with a zero tap after the last
+    // if there is an odd number of them.
+    std::vector<int> pairs;
+  };
+
+  // out[u] = sum over k of taps[k] * rows[k][u], rounded and shifted down by
+  // FixedPointKernel::Shift and saturated to short, where pairs holds pairCount pairs of taps as
+  // in FixedPointKernel and rows holds 2*pairCount rows.
+  typedef void(*FixedPointRowCombiner)(const short* const* rows, const int* pairs, int pairCount, short* out, int width);
+
+  // The combiner for the instruction set selected by mode, the 32 bit AVX-512 convolvers
+  // sharing the AVX2 one. Throws if the mode is not supported.
+  FixedPointRowCombiner getFixedPointRowCombiner(ConvolutionMode mode);
+
+  void combineRowsFixedPointReference(const short* const* rows, const int* pairs, int pairCount, short* out, int width);
+  void combineRowsFixedPointSse(const short* const* rows, const int* pairs, int pairCount, short* out, int width);
+  void combineRowsFixedPointAvx2(const short* const* rows, const int* pairs, int pairCount, short* out, int width); // in Avx2FixedPoint.cpp
+
+  // The pixel types that can be convolved in fixed point.
+  template<typename T>
+  struct IsFixedPointType : std::false_type
+  {
+  };
+
+  template<>
+  struct IsFixedPointType<unsigned char> : std::true_type
+  {
+  };
+
+  template<>
+  struct IsFixedPointType<short> : std::true_type
+  {
+  };
+
+  // Templates used only via explicit instantiation, as for readerT and writerT.
+  template<typename T>
+  inline void writeFixedPoint(short x, T* iterator);
+
+  template<>
+  inline void writeFixedPoint<unsigned char>(short x, unsigned char* iterator)
+  {
+    *iterator = x <= 0 ? 0 : (x > 255 ? 255 : (unsigned char)x);
+  }
+
+  template<>
+  inline void writeFixedPoint<short>(short x, short* iterator)
+  {
+    *iterator = x;
+  }
+
+  // Conversions between contiguous bytes and 16 bit samples, with SSE2.
+  void widenFixedPointRow(const unsigned char* in, int count, short* out);
+  void narrowFixedPointRow(const short* in, int count, unsigned char* out); // saturating
+
+  // Reads count samples of type T hop bytes apart.
+  template<typename T>
+  inline void readFixedPointRow(const unsigned char* row, int hop, int count, short* out);
+
+  template<>
+  inline void readFixedPointRow<unsigned char>(const unsigned char* row, int hop, int count, short* out)
+  {
+    if (hop == 1)
+    {
+      widenFixedPointRow(row, count, out);
+      return;
+    }
+    for (int u = 0; u < count; u++)
+      out[u] = row[(size_t)u*hop];
+  }
+
+  template<>
+  inline void readFixedPointRow<short>(const unsigned char* row, int hop, int count, short* out)
+  {
+    if (hop == sizeof(short))
+    {
+      memcpy(out, row, count * sizeof(short));
+      return;
+    }
+    for (int u = 0; u < count; u++)
+      out[u] = *(const short*)(row + (size_t)u*hop);
+  }
+
+  // Writes count samples of type T hop bytes apart.
+  template<typename T>
+  inline void writeFixedPointRow(const short* in, int count, unsigned char* row, int hop);
+
+  template<>
+  inline void writeFixedPointRow<unsigned char>(const short* in, int count, unsigned char* row, int hop)
+  {
+    if (hop == 1)
+    {
+      narrowFixedPointRow(in, count, row);
+      return;
+    }
+    for (int u = 0; u < count; u++)
+      writeFixedPoint<unsigned char>(in[u], row + (size_t)u*hop);
+  }
+
+  template<>
+  inline void writeFixedPointRow<short>(const short* in, int count, unsigned char* row, int hop)
+  {
+    if (hop == sizeof(short))
+    {
+      memcpy(row, in, count * sizeof(short));
+      return;
+    }
+    for (int u = 0; u < count; u++)
+      *(short*)(row + (size_t)u*hop) = in[u];
+  }
+
+  // Scratch space for one thread of fixed point convolution.
+  struct FixedPointScratch
+  {
+    std::vector<short, AlignmentAllocator<short, 32>> input;
+    std::vector<short, AlignmentAllocator<short, 32>> output;
+    std::vector<const short*> rows;
+  };
+
+  // Memory used by fixed point convolution, indexed by OpenMP thread number as for ConvolutionWorkspace.
+  typedef std::vector<std::unique_ptr<FixedPointScratch>> FixedPointWorkspace;
+
+  // Sizes the scratch of threadCount threads in workspace, before the parallel region as for
+  // ConvolutionWorkspace.
+  inline void prepareWorkspace(FixedPointWorkspace& workspace, int threadCount, size_t inputSize, size_t outputSize, size_t rowCount)
+  {
+    if ((int)workspace.size() < threadCount)
+      workspace.resize(threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+      std::unique_ptr<FixedPointScratch>& t = workspace[i];
+      if (!t)
+        t.reset(new FixedPointScratch());
+      t->input.resize(inputSize);
+      t->output.resize(outputSize);
+      t->rows.resize(rowCount);
+    }
+  }
+
+  // Fills in the rows after the last tap, for the zero tap that pads an odd number of them, with
+  // the last row so that the combiner reads only memory that it would read anyway.
+  inline void padFixedPointRows(const FixedPointKernel& kernel, std::vector<const short*>& rows)
+  {
+    for (size_t k = kernel.taps.size(); k < rows.size(); k++)
+      rows[k] = rows[kernel.taps.size() - 1];
+  }
+
+  // Convolve the rows of a stack of 2D images of pixel type T in fixed point, as convolveRows.
+  template<typename T>
+  void fixedPointConvolveRows(
+    int length, int rows, int images,
+    unsigned char* buffer, int hop, int stride, int pitch,
+    const FixedPointKernel& kernel, FixedPointRowCombiner combiner,
+    int threadCount, FixedPointWorkspace& workspace)
+  {
+    if (length <= 0 || rows <= 0 || images <= 0)
+      return;
+
+    const int radius = kernel.radius;
+    const int count = rows * images;
+    threadCount = resolveThreadCount(threadCount, count);
+    prepareWorkspace(workspace, threadCount, length + 2 * radius, length, kernel.pairs.size() * 2);
+    for (int i = 0; i < threadCount; i++)
+    {
+      FixedPointScratch& t = *workspace[i];
+      for (int k = 0; k < (int)kernel.taps.size(); k++)
+        t.rows[k] = &t.input[k];
+      padFixedPointRows(kernel, t.rows);
+    }
+
+#pragma omp parallel num_threads(threadCount)
+    {
+      std::unique_ptr<FixedPointScratch>& t = workspace[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+      for (int i = 0; i < count; i++)
+      {
+        unsigned char* row = buffer + (size_t)(i / rows)*pitch + (size_t)(i % rows)*stride;
+
+        // Gather the row with a kernel radius either side, reflected about its ends
+        short* p = &t->input[radius];
+        readFixedPointRow<T>(row, hop, length, p);
+        for (int u = 0; u < radius; u++)
+        {
+          p[-1 - u] = p[mirrorIndex(-1 - u, length)];
+          p[length + u] = p[mirrorIndex(length + u, length)];
+        }
+
+        combiner(&t->rows[0], &kernel.pairs[0], (int)kernel.pairs.size(), &t->output[0], length);
+
+        writeFixedPointRow<T>(&t->output[0], length, row, hop);
+      }
+    }
+  }
+
+  // Convolve the columns of a stack of 2D images of pixel type T in fixed point, as
+  // convolveTiles. Each thread copies a whole image and then combines rows of it, so the
+  // innermost loop runs along the rows, which are contiguous for the Y and Z directions.
+  template<typename T>
+  void fixedPointConvolveColumns(
+    int length, int columns, int images,
+    unsigned char* buffer, int step, int hop, int pitch,
+    const FixedPointKernel& kernel, FixedPointRowCombiner combiner,
+    int threadCount, FixedPointWorkspace& workspace)
+  {
+    if (length <= 0 || columns <= 0 || images <= 0)
+      return;
+
+    const int radius = kernel.radius;
+    threadCount = resolveThreadCount(threadCount, images);
+    prepareWorkspace(workspace, threadCount, (size_t)length * columns, columns, kernel.pairs.size() * 2);
+
+#pragma omp parallel num_threads(threadCount)
+    {
+      std::unique_ptr<FixedPointScratch>& t = workspace[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+      for (int s = 0; s < images; s++)
+      {
+        unsigned char* image = buffer + (size_t)s*pitch;
+
+        for (int u = 0; u < length; u++)
+          readFixedPointRow<T>(image + (size_t)u*step, hop, columns, &t->input[(size_t)u * columns]);
+
+        for (int u = 0; u < length; u++)
+        {
+          for (int k = 0; k < (int)kernel.taps.size(); k++)
+            t->rows[k] = &t->input[(size_t)mirrorIndex(u - radius + k, length) * columns];
+          padFixedPointRows(kernel, t->rows);
+
+          combiner(&t->rows[0], &kernel.pairs[0], (int)kernel.pairs.size(), &t->output[0], columns);
+
+          writeFixedPointRow<T>(&t->output[0], columns, image + (size_t)u*step, hop);
+        }
+      }
+    }
+  }
+
+  // Convolves a 3D volume of pixel type T in place along one direction in fixed point, addressed
+  // as for convolve1d. options.mode selects the instruction set and options.tiled is ignored.
+  template<typename T>
+  void fixedPointConvolve1d(
+    int width, int height, int depth, unsigned char* buffer, int leap, int stride, int hop,
+    int direction, const FixedPointKernel& kernel, const ConvolutionOptions& options, FixedPointWorkspace& workspace)
+  {
+    static_assert(IsFixedPointType<T>::value, "Fixed point convolution supports only unsigned char and short.");
+
+    const FixedPointRowCombiner combiner = getFixedPointRowCombiner(options.mode);
+    switch (direction)
+    {
+    case 0:
+      fixedPointConvolveRows<T>(width, height, depth, buffer, hop, stride, leap, kernel, combiner, options.threadCount, workspace);
+      break;
+    case 1:
+      fixedPointConvolveColumns<T>(height, width, depth, buffer, stride, hop, leap, kernel, combiner, options.threadCount, workspace);
+      break;
+    case 2:
+      fixedPointConvolveColumns<T>(depth, width, height, buffer, leap, hop, stride, kernel, combiner, options.threadCount, workspace);
+      break;
+    default:
+      throw std::exception("Direction was out of range.");
+    }
+  }
+}
@@ -8,11 +8,13 @@
 #include "GaussianKernel1D.h"
 
 #include <math.h>
-#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 namespace createdataset
 {
-  GaussianKernel1D::GaussianKernel1D(float sigma, float tol)
+  GaussianKernel1D::GaussianKernel1D(float sigma, float tol, GaussianSampling sampling, int extent)
   {
     if (sigma < 0.0f)
       sigma = -sigma;
@@ -20,20 +22,95 @@ namespace createdataset
     if (tol < 0.0f)
       tol = -tol;
 
-    // Because the chances are high that someone has #define'd PI.
-    const float PACKAGE_PI = 3.141592f;
-
     _radius = static_cast<int>(floor(sigma * sqrt(2 * log(1 / tol))));
-    _data.resize(2 * _radius + 1);
 
-    float sum = 0.0;
+    // Coefficients are computed in double precision and normalised so that smoothing preserves
+    // the mean intensity, however small sigma is.
+    std::vector<double> weights(2 * _radius + 1);
+    double sum = 0.0;
     for (int x = -_radius; x <= _radius; x++)
     {
-      _data[_radius + x]
-        = static_cast<float>((1 / (sigma*sqrt(2 * PACKAGE_PI))) * exp(-0.5 * pow(x / sigma, 2)));
+      double weight;
+      if (sigma == 0.0f)
+        weight = 1.0;
+      else if (sampling == GaussianSampling::Integral)
+        weight = erf((x + 0.5) / (sigma * sqrt(2.0))) - erf((x - 0.5) / (sigma * sqrt(2.0)));
+      else
+        weight = exp(-0.5 * (x / sigma) * (x / sigma));
+
+      weights[_radius + x] = weight;
+      sum += weight;
+    }
+
+    // A reflected row of extent pixels repeats with period 2*extent, so coefficients a whole
+    // number of periods apart always multiply the same pixel and can be added together. Offset
+    // -extent is the same distance from offset 0 in both directions; its sum is split equally
+    // between -extent and +extent to keep the kernel symmetric.
+    if (extent > 0 && _radius > extent)
+    {
+      const int period = 2 * extent;
+      std::vector<double> folded(2 * extent + 1);
+      for (int x = -_radius; x <= _radius; x++)
+      {
+        int m = (x + extent) % period;
+        if (m < 0)
+          m += period;
+        m -= extent;
+
+        if (m == -extent)
+        {
+          folded[0] += 0.5 * weights[_radius + x];
+          folded[2 * extent] += 0.5 * weights[_radius + x];
+        }
+        else
+        {
+          folded[extent + m] += weights[_radius + x];
+        }
+      }
 
-      sum += _data[_radius + x];
+      _radius = extent;
+      weights.swap(folded);
     }
+
+    _data.resize(2 * _radius + 1);
+    for (int x = -_radius; x <= _radius; x++)
+      _data[_radius + x] = static_cast<float>(weights[_radius + x] / sum);
+  }
+
+  std::shared_ptr<const GaussianKernel1D> GaussianKernel1D::get(float sigma, float tol, GaussianSampling sampling, int extent)
+  {
+    typedef std::tuple<float, float, int, int> Key;
+
+    // Kernels are small, and callers use few distinct sigmas, so the cache is only emptied if
+    // something asks for a great many different kernels.
+    const size_t capacity = 1024;
+
+    static std::mutex mutex;
+    static std::map<Key, std::shared_ptr<const GaussianKernel1D>> cache;
+
+    if (sigma < 0.0f)
+      sigma = -sigma;
+    if (tol < 0.0f)
+      tol = -tol;
+
+    // The extent only changes kernels that are folded, so other rows share the same entry
+    if (extent >= static_cast<int>(floor(sigma * sqrt(2 * log(1 / tol)))))
+      extent = 0;
+
+    const Key key(sigma, tol, (int)sampling, extent > 0 ? extent : 0);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = cache.find(key);
+    if (found != cache.end())
+      return found->second;
+
+    if (cache.size() >= capacity)
+      cache.clear();
+
+    std::shared_ptr<const GaussianKernel1D> kernel(new GaussianKernel1D(sigma, tol, sampling, extent));
+    cache[key] = kernel;
+    return kernel;
   }
 
   int GaussianKernel1D::getRadius() const
@@ -45,4 +122,4 @@ namespace createdataset
   {
     return &_data[0];
   }
-}
\ No newline at end of file
+}
@@ -7,14 +7,30 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 
 namespace createdataset
 {
+  // How the coefficients of a Gaussian kernel are computed from the continuous Gaussian.
+  enum class GaussianSampling
+  {
+    Point,   // the density at the centre of each pixel
+    Integral // the integral of the density over each pixel, which is better for small sigma
+  };
+
   class GaussianKernel1D
   {
   public:
     // Creates a Gaussian kernel with the specified sigma, truncates coefficients less than faction tol of max.
-    GaussianKernel1D(float sigma, float tol = 0.001);
+    // The coefficients sum to one, and a sigma of zero gives the identity kernel. If extent is
+    // greater than zero, the kernel is for rows of extent pixels that are reflected about their
+    // ends, and is folded so that its radius is at most extent: this gives the same result as
+    // the full kernel at less cost when sigma is large compared with the row.
+    GaussianKernel1D(float sigma, float tol = 0.001, GaussianSampling sampling = GaussianSampling::Point, int extent = 0);
+
+    // Returns a kernel as constructed above, computing it only the first time it is asked for.
+    // Safe to call from several threads at once.
+    static std::shared_ptr<const GaussianKernel1D> get(float sigma, float tol = 0.001f, GaussianSampling sampling = GaussianSampling::Point, int extent = 0);
 
     // The radius of the kernel (array length size is 2*radius + 1)
     int getRadius() const;
@@ -27,4 +43,4 @@ namespace createdataset
     int _radius;
     std::vector<float> _data;
   };
-}
\ No newline at end of file
+}
@@ -0,0 +1,98 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "stdafx.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string.h>
+
+namespace createdataset
+{
+  namespace
+  {
+    std::atomic<bool> enabled(false);
+    std::atomic<long long> scratchBytes(0);
+
+    std::mutex countersMutex;
+    std::vector<StageCounters> counters;
+
+    thread_local const char* currentEntryPoint = nullptr;
+  }
+
+  bool isInstrumentationEnabled()
+  {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  void setInstrumentationEnabled(bool value)
+  {
+    enabled.store(value);
+  }
+
+  std::vector<StageCounters> getInstrumentationCounters()
+  {
+    std::lock_guard<std::mutex> lock(countersMutex);
+    return counters;
+  }
+
+  void resetInstrumentationCounters()
+  {
+    std::lock_guard<std::mutex> lock(countersMutex);
+    counters.clear();
+  }
+
+  void recordStage(const char* stage, double milliseconds, long long voxels, int threads, long long scratch)
+  {
+    const char* entryPoint = currentEntryPoint != nullptr ? currentEntryPoint : "";
+    try
+    {
+      std::lock_guard<std::mutex> lock(countersMutex);
+      auto found = std::find_if(counters.begin(), counters.end(), [=](const StageCounters& c)
+      {
+        return strcmp(c.entryPoint.c_str(), entryPoint) == 0 && strcmp(c.stage.c_str(), stage) == 0;
+      });
+      if (found == counters.end())
+      {
+        const StageCounters zero = { entryPoint, stage, 0, 0, 0, 0, 0 };
+        found = counters.insert(counters.end(), zero);
+      }
+
+      found->calls++;
+      found->milliseconds += milliseconds;
+      found->voxels += voxels;
+      found->threads = std::max(found->threads, threads);
+      found->scratchBytes += scratch;
+    }
+    catch (std::bad_alloc&)
+    {
+      // Called from destructors, so a stage that cannot be stored is dropped
+    }
+  }
+
+  void countScratchBytes(size_t bytes)
+  {
+    if (isInstrumentationEnabled())
+      scratchBytes.fetch_add((long long)bytes, std::memory_order_relaxed);
+  }
+
+  long long getScratchBytesCounted()
+  {
+    return scratchBytes.load(std::memory_order_relaxed);
+  }
+
+  const char* getInstrumentedEntryPoint()
+  {
+    return currentEntryPoint;
+  }
+
+  void setInstrumentedEntryPoint(const char* entryPoint)
+  {
+    currentEntryPoint = entryPoint;
+  }
+}
@@ -0,0 +1,194 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "Stopwatch.h"
+
+// Defined as 0, every InstrumentedCall and InstrumentedStage compiles to nothing. Otherwise they
+// cost one test of a flag while instrumentation is disabled, which it is by default.
+#ifndef CREATEDATASET_INSTRUMENTATION
+#define CREATEDATASET_INSTRUMENTATION 1
+#endif
+
+namespace createdataset
+{
+  // The totals of one stage of one entry point since the counters were last reset. The stage
+  // "total" is the whole of each call of the entry point. Stages that run on several threads
+  // at once, such as the volumes of a batch, add up to more than the wall time of the call.
+  struct StageCounters
+  {
+    std::string entryPoint; // empty for stages that ran outside any InstrumentedCall
+    std::string stage;
+    long long calls;
+    double milliseconds;
+    long long voxels;
+    int threads; // the most used by any call
+    long long scratchBytes; // acquired with acquireScratch, by any thread, while the stage ran
+  };
+
+  bool isInstrumentationEnabled();
+
+  // Starts or stops recording. Calls and stages that are under way when this is called are not
+  // recorded.
+  void setInstrumentationEnabled(bool enabled);
+
+  // The counters of every stage in the order that each was first recorded.
+  std::vector<StageCounters> getInstrumentationCounters();
+
+  void resetInstrumentationCounters();
+
+  // Adds to the counters of stage of the entry point of the calling thread.
+  void recordStage(const char* stage, double milliseconds, long long voxels, int threads, long long scratchBytes);
+
+  // Counts bytes of scratch memory acquired, while instrumentation is enabled.
+  void countScratchBytes(size_t bytes);
+
+  // Bytes counted by countScratchBytes since the process started.
+  long long getScratchBytesCounted();
+
+  // The entry point that the stages of the calling thread are recorded under, or null.
+  const char* getInstrumentedEntryPoint();
+
+  void setInstrumentedEntryPoint(const char* entryPoint);
+
+  // Records the wall time, voxels, threads and scratch memory of a stage from construction to
+  // destruction, or to stop, if instrumentation was enabled at construction. stage must be a
+  // literal, or otherwise outlive the object, and a null stage records nothing.
+  class InstrumentedStage
+  {
+  public:
+#if CREATEDATASET_INSTRUMENTATION
+    explicit InstrumentedStage(const char* stage, long long voxels = 0, int threads = 1) :
+      stage_(stage != nullptr && isInstrumentationEnabled() ? stage : nullptr), voxels_(voxels), threads_(threads), scratchBytes_(0)
+    {
+      if (stage_ != nullptr)
+      {
+        scratchBytes_ = getScratchBytesCounted();
+        stopwatch_.Start();
+      }
+    }
+
+    ~InstrumentedStage()
+    {
+      stop();
+    }
+
+    // Records the stage now rather than at destruction.
+    void stop()
+    {
+      if (stage_ == nullptr)
+        return;
+      stopwatch_.Stop();
+      recordStage(stage_, stopwatch_.MilliSeconds(), voxels_, threads_, getScratchBytesCounted() - scratchBytes_);
+      stage_ = nullptr;
+    }
+
+    void setVoxels(long long voxels) { voxels_ = voxels; }
+    void setThreads(int threads) { threads_ = threads; }
+
+  private:
+    const char* stage_;
+    long long voxels_;
+    int threads_;
+    long long scratchBytes_;
+    Stopwatch stopwatch_;
+#else
+    explicit InstrumentedStage(const char*, long long = 0, int = 1)
+    {
+    }
+
+    void stop() {}
+    void setVoxels(long long) {}
+    void setThreads(int) {}
+#endif
+
+  private:
+    InstrumentedStage(const InstrumentedStage&);
+    InstrumentedStage& operator=(const InstrumentedStage&);
+  };
+
+  // Records the stages of the calling thread under entryPoint, and the whole call as its stage
+  // "total", from construction to destruction. A call made inside another on the same thread is
+  // recorded as part of the outer one.
+  class InstrumentedCall
+  {
+  public:
+#if CREATEDATASET_INSTRUMENTATION
+    InstrumentedCall(const char* entryPoint, long long voxels = 0, int threads = 1) :
+      outermost_(begin(entryPoint)), total_(outermost_ ? "total" : nullptr, voxels, threads)
+    {
+    }
+
+    ~InstrumentedCall()
+    {
+      if (!outermost_)
+        return;
+      total_.stop();
+      setInstrumentedEntryPoint(nullptr);
+    }
+
+    void setVoxels(long long voxels) { total_.setVoxels(voxels); }
+    void setThreads(int threads) { total_.setThreads(threads); }
+
+  private:
+    static bool begin(const char* entryPoint)
+    {
+      if (!isInstrumentationEnabled() || getInstrumentedEntryPoint() != nullptr)
+        return false;
+      setInstrumentedEntryPoint(entryPoint);
+      return true;
+    }
+
+    bool outermost_;
+    InstrumentedStage total_;
+#else
+    InstrumentedCall(const char*, long long = 0, int = 1)
+    {
+    }
+
+    void setVoxels(long long) {}
+    void setThreads(int) {}
+#endif
+
+  private:
+    InstrumentedCall(const InstrumentedCall&);
+    InstrumentedCall& operator=(const InstrumentedCall&);
+  };
+
+  // Records the stages of a worker thread under the entry point of the thread that started it,
+  // for the lifetime of the object.
+  class InstrumentedThread
+  {
+  public:
+#if CREATEDATASET_INSTRUMENTATION
+    explicit InstrumentedThread(const char* entryPoint) : previous_(getInstrumentedEntryPoint())
+    {
+      setInstrumentedEntryPoint(entryPoint);
+    }
+
+    ~InstrumentedThread()
+    {
+      setInstrumentedEntryPoint(previous_);
+    }
+
+  private:
+    const char* previous_;
+#else
+    explicit InstrumentedThread(const char*)
+    {
+    }
+#endif
+
+  private:
+    InstrumentedThread(const InstrumentedThread&);
+    InstrumentedThread& operator=(const InstrumentedThread&);
+  };
+}
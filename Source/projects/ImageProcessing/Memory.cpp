@@ -0,0 +1,262 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "stdafx.h"
+#include "Memory.h"
+#include "Instrumentation.h"
+#include "parallel.h"
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace createdataset
+{
+  namespace
+  {
+    const size_t HugePageBytes = (size_t)2 << 20;
+
+    std::mutex optionsMutex;
+    ScratchMemoryOptions options = { false, (size_t)256 << 20 };
+
+    size_t roundUp(size_t bytes, size_t multiple)
+    {
+      return (bytes + multiple - 1) / multiple * multiple;
+    }
+
+    // Whole pages of at least bytes, setting bytes to the number allocated.
+    void* allocatePages(size_t& bytes, bool hugePages)
+    {
+#ifdef _WIN32
+      // Large pages are committed, and so placed, when they are allocated rather than when they
+      // are first written
+      if (hugePages)
+      {
+        const size_t largePage = GetLargePageMinimum();
+        if (largePage > 0)
+        {
+          const size_t rounded = roundUp(bytes, largePage);
+          void* pointer = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+          if (pointer != nullptr)
+          {
+            bytes = rounded;
+            return pointer;
+          }
+        }
+      }
+
+      bytes = roundUp(bytes, (size_t)64 << 10);
+      void* pointer = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+      if (pointer == nullptr)
+        throw std::bad_alloc();
+      return pointer;
+#else
+      bytes = roundUp(bytes, hugePages ? HugePageBytes : (size_t)4096);
+      void* pointer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (pointer == MAP_FAILED)
+        throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+      if (hugePages)
+        madvise(pointer, bytes, MADV_HUGEPAGE);
+#endif
+      return pointer;
+#endif
+    }
+
+    void freePages(void* pointer, size_t bytes)
+    {
+#ifdef _WIN32
+      VirtualFree(pointer, 0, MEM_RELEASE);
+#else
+      munmap(pointer, bytes);
+#endif
+    }
+
+    struct ScratchBlock
+    {
+      void* pointer;
+      size_t bytes;
+    };
+
+    // Bytes cached by the arenas of every thread, which options.cachedBytes limits.
+    std::atomic<size_t> totalCachedBytes(0);
+
+    struct ScratchArena;
+
+    // Every arena of a live thread, so that trimScratch can empty them all.
+    std::mutex arenasMutex;
+    std::vector<ScratchArena*> arenas;
+
+    // The large blocks released by one thread, for reuse by that thread. The mutex is only
+    // contended while another thread trims the arena.
+    struct ScratchArena
+    {
+      std::mutex mutex;
+      std::vector<ScratchBlock> blocks;
+
+      ScratchArena()
+      {
+        std::lock_guard<std::mutex> lock(arenasMutex);
+        arenas.push_back(this);
+      }
+
+      ~ScratchArena()
+      {
+        {
+          std::lock_guard<std::mutex> lock(arenasMutex);
+          arenas.erase(std::find(arenas.begin(), arenas.end(), this));
+        }
+        trim();
+      }
+
+      void trim()
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+          freePages(blocks[i].pointer, blocks[i].bytes);
+          totalCachedBytes -= blocks[i].bytes;
+        }
+        blocks.clear();
+      }
+    };
+
+    ScratchArena& getScratchArena()
+    {
+      thread_local ScratchArena arena;
+      return arena;
+    }
+  }
+
+  void* alignedAllocate(size_t bytes, size_t alignment)
+  {
+#ifdef _WIN32
+    void* pointer = _aligned_malloc(bytes > 0 ? bytes : 1, alignment);
+#else
+    void* pointer = nullptr;
+    if (posix_memalign(&pointer, alignment < sizeof(void*) ? sizeof(void*) : alignment, bytes > 0 ? bytes : 1) != 0)
+      pointer = nullptr;
+#endif
+    if (pointer == nullptr)
+      throw std::bad_alloc();
+    return pointer;
+  }
+
+  void alignedFree(void* pointer)
+  {
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+  }
+
+  void zeroBlocks(void* buffer, int count, size_t bytes, int threadCount)
+  {
+#pragma omp parallel for num_threads(resolveThreadCount(threadCount, count)) schedule(static)
+    for (int i = 0; i < count; i++)
+      memset((unsigned char*)buffer + (size_t)i * bytes, 0, bytes);
+  }
+
+  ScratchMemoryOptions getScratchMemoryOptions()
+  {
+    std::lock_guard<std::mutex> lock(optionsMutex);
+    return options;
+  }
+
+  void setScratchMemoryOptions(const ScratchMemoryOptions& value)
+  {
+    std::lock_guard<std::mutex> lock(optionsMutex);
+    options = value;
+  }
+
+  void* acquireScratch(size_t& bytes)
+  {
+    countScratchBytes(bytes);
+    if (bytes < LargeScratchBytes)
+      return alignedAllocate(bytes, 64);
+
+    // The smallest cached block that fits, unless it is more than twice the size wanted, which
+    // leaves big blocks for big arrays
+    ScratchArena& arena = getScratchArena();
+    std::unique_lock<std::mutex> lock(arena.mutex);
+    size_t best = arena.blocks.size();
+    for (size_t i = 0; i < arena.blocks.size(); i++)
+    {
+      const size_t size = arena.blocks[i].bytes;
+      if (size >= bytes && size / 2 <= bytes && (best == arena.blocks.size() || size < arena.blocks[best].bytes))
+        best = i;
+    }
+
+    if (best < arena.blocks.size())
+    {
+      const ScratchBlock block = arena.blocks[best];
+      arena.blocks[best] = arena.blocks.back();
+      arena.blocks.pop_back();
+      totalCachedBytes -= block.bytes;
+      bytes = block.bytes;
+      return block.pointer;
+    }
+
+    lock.unlock();
+    return allocatePages(bytes, getScratchMemoryOptions().hugePages);
+  }
+
+  void releaseScratch(void* pointer, size_t bytes)
+  {
+    if (pointer == nullptr)
+      return;
+    if (bytes < LargeScratchBytes)
+    {
+      alignedFree(pointer);
+      return;
+    }
+
+    // Counted before it is cached, so that threads releasing at once cannot pass the limit together
+    const size_t limit = getScratchMemoryOptions().cachedBytes;
+    if (totalCachedBytes.fetch_add(bytes) + bytes > limit)
+    {
+      totalCachedBytes -= bytes;
+      freePages(pointer, bytes);
+      return;
+    }
+
+    ScratchArena& arena = getScratchArena();
+    std::lock_guard<std::mutex> lock(arena.mutex);
+    const ScratchBlock block = { pointer, bytes };
+    try
+    {
+      arena.blocks.push_back(block);
+    }
+    catch (std::bad_alloc&)
+    {
+      totalCachedBytes -= bytes;
+      freePages(pointer, bytes);
+    }
+  }
+
+  void trimScratch()
+  {
+    std::lock_guard<std::mutex> lock(arenasMutex);
+    for (size_t i = 0; i < arenas.size(); i++)
+      arenas[i]->trim();
+  }
+
+  size_t getCachedScratchBytes()
+  {
+    return totalCachedBytes.load();
+  }
+}
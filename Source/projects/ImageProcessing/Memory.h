@@ -0,0 +1,147 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <utility>
+
+namespace createdataset
+{
+  // Bytes aligned to alignment, a power of two, on any platform, freed with alignedFree. Throws
+  // std::bad_alloc if there is not enough memory.
+  void* alignedAllocate(size_t bytes, size_t alignment);
+
+  void alignedFree(void* pointer);
+
+  // Sets count blocks of bytes each, one after another from buffer, to zero, in parallel over the
+  // blocks with up to threadCount threads, or one per processor for 0. A volume zeroed by slice
+  // this way has its pages placed as by the parallel loops over slices that later use it.
+  void zeroBlocks(void* buffer, int count, size_t bytes, int threadCount = 0);
+
+  // Process-wide settings of scratch memory, which apply to blocks acquired after they are set.
+  struct ScratchMemoryOptions
+  {
+    // Back large blocks with 2 MB pages where the operating system gives them: on Windows if the
+    // process holds SeLockMemoryPrivilege, and on Linux by transparent huge pages. Blocks have
+    // ordinary pages otherwise. Off by default.
+    bool hugePages;
+
+    // Most bytes of released large blocks that the threads of the process keep for reuse between
+    // them. A block released beyond that is returned to the operating system. 256 MB by default.
+    size_t cachedBytes;
+  };
+
+  ScratchMemoryOptions getScratchMemoryOptions();
+
+  void setScratchMemoryOptions(const ScratchMemoryOptions& options);
+
+  // Blocks of at least this many bytes are large, and the rest small.
+  static const size_t LargeScratchBytes = (size_t)1 << 20;
+
+  // Scratch memory for working arrays, such as the forest of connected component analysis, that
+  // are needed only for the duration of a call. Large blocks are whole pages from the operating
+  // system, kept in an arena of the thread that releases them and handed out again to that thread
+  // by a later acquireScratch that fits, so repeated calls reuse pages that are already mapped
+  // rather than faulting in new ones. Small blocks come from alignedAllocate. Either is aligned to
+  // at least 64 bytes.
+  //
+  // The pages of a new block are placed on the NUMA node of the thread that first writes each of
+  // them, so a large array is best first written in the parallel loop that later works on it.
+  //
+  // Acquires a block of at least bytes, setting bytes to its actual size, which must be passed
+  // to releaseScratch. Throws std::bad_alloc if there is not enough memory.
+  void* acquireScratch(size_t& bytes);
+
+  void releaseScratch(void* pointer, size_t bytes);
+
+  // Releases every block cached by the arena of any thread, such as the OpenMP workers of a batch.
+  void trimScratch();
+
+  // Bytes of released large blocks cached by the arenas of every thread.
+  size_t getCachedScratchBytes();
+
+  // An array of size elements of a trivially copyable type T in scratch memory. Unlike std::vector
+  // the elements are not initialised, so each page is first written where the caller first writes
+  // its elements.
+  template<typename T>
+  class ScratchBuffer
+  {
+  public:
+    ScratchBuffer() : data_(nullptr), size_(0), bytes_(0)
+    {
+    }
+
+    explicit ScratchBuffer(size_t size) : data_(nullptr), size_(0), bytes_(0)
+    {
+      reset(size);
+    }
+
+    ScratchBuffer(ScratchBuffer&& other) : data_(nullptr), size_(0), bytes_(0)
+    {
+      swap(other);
+    }
+
+    ScratchBuffer& operator=(ScratchBuffer&& other)
+    {
+      swap(other);
+      return *this;
+    }
+
+    ~ScratchBuffer()
+    {
+      clear();
+    }
+
+    // Makes room for size elements, whose values are undefined, keeping the block if it is big
+    // enough.
+    void reset(size_t size)
+    {
+      if (size * sizeof(T) > bytes_)
+      {
+        clear();
+        size_t bytes = size * sizeof(T);
+        data_ = (T*)acquireScratch(bytes);
+        bytes_ = bytes;
+      }
+      size_ = size;
+    }
+
+    // Releases the block.
+    void clear()
+    {
+      if (data_ != nullptr)
+        releaseScratch(data_, bytes_);
+      data_ = nullptr;
+      size_ = 0;
+      bytes_ = 0;
+    }
+
+    void swap(ScratchBuffer& other)
+    {
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+      std::swap(bytes_, other.bytes_);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+
+  private:
+    ScratchBuffer(const ScratchBuffer&) = delete;
+    ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+    T* data_;
+    size_t size_;
+    size_t bytes_;
+  };
+}
@@ -0,0 +1,137 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "stdafx.h"
+#include "RecursiveGaussian.h"
+
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include <xmmintrin.h>
+
+namespace createdataset
+{
+  const float RecursiveGaussianConvolver::MinimumSigma = 0.5f;
+
+  RecursiveGaussianConvolver::RecursiveGaussianConvolver(float sigma, int length) :
+    length_(length),
+    padding_(getPadding(sigma)),
+    forward_((size_t)(length > 0 ? length : 0) * TileWidth)
+  {
+    if (!(sigma >= MinimumSigma))
+      throw std::exception("Sigma is too small for the recursive Gaussian filter.");
+
+    // Equations 11b and 8c of Young and van Vliet
+    const double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * sqrt(1.0 - 0.26891 * sigma);
+    const double q2 = q * q, q3 = q2 * q;
+    const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    const double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+    const double b2 = -(1.4281 * q2 + 1.26661 * q3);
+    const double b3 = 0.422205 * q3;
+
+    a1_ = static_cast<float>(b1 / b0);
+    a2_ = static_cast<float>(b2 / b0);
+    a3_ = static_cast<float>(b3 / b0);
+    b_ = static_cast<float>(1.0 - (b1 + b2 + b3) / b0);
+  }
+
+  int RecursiveGaussianConvolver::getPadding(float sigma)
+  {
+    // The impulse response has fallen below a thousandth of its peak by four sigma
+    return std::max(3, static_cast<int>(ceil(4.0f * sigma)));
+  }
+
+  void RecursiveGaussianConvolver::convolve(const float* in, float* out) const
+  {
+    const int n = length_;
+    if (n - 2 * padding_ <= 0)
+      return;
+
+    float* w = &forward_[0];
+
+    float w1 = in[0], w2 = w1, w3 = w1;
+    for (int i = 0; i < n; i++)
+    {
+      const float v = b_ * in[i] + a1_ * w1 + a2_ * w2 + a3_ * w3;
+      w[i] = v;
+      w3 = w2; w2 = w1; w1 = v;
+    }
+
+    float y1 = w[n - 1], y2 = y1, y3 = y1;
+    for (int i = n - 1; i >= padding_; i--)
+    {
+      const float v = b_ * w[i] + a1_ * y1 + a2_ * y2 + a3_ * y3;
+      if (i < n - padding_)
+        out[i - padding_] = v;
+      y3 = y2; y2 = y1; y1 = v;
+    }
+  }
+
+  void RecursiveGaussianConvolver::convolveTile(const float* in, float* out) const
+  {
+    const int n = length_;
+    if (n - 2 * padding_ <= 0)
+      return;
+
+    const int W = TileWidth;
+    float* w = &forward_[0];
+
+    const __m128 b = _mm_set1_ps(b_), a1 = _mm_set1_ps(a1_), a2 = _mm_set1_ps(a2_), a3 = _mm_set1_ps(a3_);
+
+    // Each step of the recursion depends on the last, so the columns are filtered eight at a time
+    // as two vectors whose recursions are interleaved, to keep the multipliers busy
+    for (int j = 0; j < W; j += 8)
+    {
+      __m128 u1 = _mm_loadu_ps(in + j), u2 = u1, u3 = u1;
+      __m128 v1 = _mm_loadu_ps(in + j + 4), v2 = v1, v3 = v1;
+      for (int i = 0; i < n; i++)
+      {
+        const float* x = in + i * W + j;
+        const __m128 u = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(b, _mm_loadu_ps(x)), _mm_mul_ps(a1, u1)),
+          _mm_add_ps(_mm_mul_ps(a2, u2), _mm_mul_ps(a3, u3)));
+        const __m128 v = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(b, _mm_loadu_ps(x + 4)), _mm_mul_ps(a1, v1)),
+          _mm_add_ps(_mm_mul_ps(a2, v2), _mm_mul_ps(a3, v3)));
+        _mm_store_ps(w + i * W + j, u);
+        _mm_store_ps(w + i * W + j + 4, v);
+        u3 = u2; u2 = u1; u1 = u;
+        v3 = v2; v2 = v1; v1 = v;
+      }
+
+      u1 = _mm_load_ps(w + (n - 1) * W + j), u2 = u1, u3 = u1;
+      v1 = _mm_load_ps(w + (n - 1) * W + j + 4), v2 = v1, v3 = v1;
+      for (int i = n - 1; i >= padding_; i--)
+      {
+        const float* x = w + i * W + j;
+        const __m128 u = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(b, _mm_load_ps(x)), _mm_mul_ps(a1, u1)),
+          _mm_add_ps(_mm_mul_ps(a2, u2), _mm_mul_ps(a3, u3)));
+        const __m128 v = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(b, _mm_load_ps(x + 4)), _mm_mul_ps(a1, v1)),
+          _mm_add_ps(_mm_mul_ps(a2, v2), _mm_mul_ps(a3, v3)));
+        if (i < n - padding_)
+        {
+          _mm_storeu_ps(out + (i - padding_) * W + j, u);
+          _mm_storeu_ps(out + (i - padding_) * W + j + 4, v);
+        }
+        u3 = u2; u2 = u1; u1 = u;
+        v3 = v2; v2 = v1; v1 = v;
+      }
+    }
+  }
+
+  void RecursiveGaussianConvolver::convolveRows(const float* const*, float*, int) const
+  {
+    throw std::exception("The recursive Gaussian filter cannot combine separate rows.");
+  }
+
+  std::unique_ptr<RowConvolver> RecursiveGaussianConvolver::clone() const
+  {
+    return std::unique_ptr<RowConvolver>(new RecursiveGaussianConvolver(*this));
+  }
+}
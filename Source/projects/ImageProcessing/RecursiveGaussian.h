@@ -0,0 +1,126 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "AlignmentAllocator.h"
+#include "RowConvolver.h"
+#include "convolution.h"
+
+namespace createdataset
+{
+  // Approximate Gaussian smoothing by the third order recursive filter of Young and van Vliet
+  // ("Recursive implementation of the Gaussian filter", Signal Processing 44, 1995), run forwards
+  // and then backwards along each row. The cost per sample is the same for any sigma, so this is
+  // much faster than convolution with a GaussianKernel1D for large sigma. The impulse response
+  // differs from a sampled Gaussian by up to 3% of its peak for sigma above 4, falling with sigma,
+  // and by up to 10% for smaller sigma.
+  //
+  // Presents the same interface as convolution with a kernel of radius getPadding(sigma): an input
+  // of length samples yields length - 2 * getPadding(sigma) outputs. The padding samples either
+  // side, reflected about the ends of the row as for a kernel, let the filter settle from its
+  // initial state, which treats the row as constant beyond the first and last padding sample.
+  //
+  // Each instance has its own scratch space, so one instance must not be used by several threads
+  // at once; clone gives each thread a copy.
+  class RecursiveGaussianConvolver : public RowConvolver
+  {
+  public:
+    // The smallest sigma for which the coefficients of the filter are defined.
+    static const float MinimumSigma;
+
+    RecursiveGaussianConvolver(float sigma, int length);
+
+    // The number of samples needed either side of each row.
+    static int getPadding(float sigma);
+
+    void convolve(const float* in, float* out) const override;
+
+    void convolveTile(const float* in, float* out) const override;
+
+    // Not supported, because a recursive filter has no finite set of taps. Throws.
+    void convolveRows(const float* const* rows, float* out, int width) const override;
+
+    std::unique_ptr<RowConvolver> clone() const override;
+
+  private:
+    float b_, a1_, a2_, a3_; // w[n] = b * x[n] + a1 * w[n-1] + a2 * w[n-2] + a3 * w[n-3]
+    int length_;
+    int padding_;
+    mutable std::vector<float, AlignmentAllocator<float, 16>> forward_; // result of the forward pass
+  };
+
+  // How Gaussian smoothing is done along each axis: by convolution with a sampled kernel, by the
+  // recursive filter above, or by whichever is faster for the sigma.
+  enum class GaussianMethod
+  {
+    Auto,
+    Direct,
+    Recursive
+  };
+
+  // The sigma in voxels above which GaussianMethod::Auto uses the recursive filter. Direct
+  // convolution with AVX-512 is faster for smaller sigma, and more accurate.
+  const float RecursiveGaussianThreshold = 6.0f;
+
+  // Whether smoothing with sigma by method uses the recursive filter.
+  inline bool isRecursiveGaussian(GaussianMethod method, float sigma)
+  {
+    switch (method)
+    {
+    case GaussianMethod::Auto:
+      return sigma > RecursiveGaussianThreshold;
+    case GaussianMethod::Direct:
+      return false;
+    case GaussianMethod::Recursive:
+      return sigma >= RecursiveGaussianConvolver::MinimumSigma; // too small a sigma has no recursive form
+    default:
+      throw std::exception("Gaussian method was out of range.");
+    }
+  }
+
+  // Smooths a 3D volume of pixel type T in place along one direction with the recursive filter,
+  // addressed as for convolve1d. Every direction, including X, is done in tiles of neighbouring
+  // rows so that the recursion runs in the SIMD lanes of several rows at once.
+  template<typename T>
+  void recursiveGaussian1d(
+    int width, int height, int depth, unsigned char* buffer, int leap, int stride, int hop,
+    int direction, float sigma, const ConvolutionOptions& options, ConvolutionWorkspace& workspace)
+  {
+    if (width <= 0 || height <= 0 || depth <= 0)
+      return;
+
+    const int padding = RecursiveGaussianConvolver::getPadding(sigma);
+    switch (direction)
+    {
+    case 0:
+      createdataset::convolveTiles<T, readerT<T>, writerT<T>>(width, height, depth, buffer, hop, stride, leap,
+        RecursiveGaussianConvolver(sigma, width + 2 * padding), padding, options.threadCount, workspace);
+      break;
+    case 1:
+      createdataset::convolveTiles<T, readerT<T>, writerT<T>>(height, width, depth, buffer, stride, hop, leap,
+        RecursiveGaussianConvolver(sigma, height + 2 * padding), padding, options.threadCount, workspace);
+      break;
+    case 2:
+      createdataset::convolveTiles<T, readerT<T>, writerT<T>>(depth, width, height, buffer, leap, hop, stride,
+        RecursiveGaussianConvolver(sigma, depth + 2 * padding), padding, options.threadCount, workspace);
+      break;
+    default:
+      throw std::exception("Direction was out of range.");
+    }
+  }
+
+  template<typename T>
+  void recursiveGaussian1d(
+    int width, int height, int depth, unsigned char* buffer, int leap, int stride, int hop,
+    int direction, float sigma, const ConvolutionOptions& options = ConvolutionOptions())
+  {
+    ConvolutionWorkspace workspace;
+    recursiveGaussian1d<T>(width, height, depth, buffer, leap, stride, hop, direction, sigma, options, workspace);
+  }
+}
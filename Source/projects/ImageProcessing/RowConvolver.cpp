@@ -0,0 +1,129 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "stdafx.h"
+#include "RowConvolver.h"
+
+#include <stdexcept>
+
+#include "convolution.h"
+#include "SseConvolver.h"
+#include "Avx2Convolver.h"
+#include "Avx512Convolver.h"
+#include "CpuFeatures.h"
+
+namespace createdataset
+{
+  namespace
+  {
+    class ReferenceConvolver : public RowConvolver
+    {
+      std::vector<float> kernel_;
+      int length_;
+
+    public:
+      ReferenceConvolver(const float* kernel, int kernel_length, int length) :
+        kernel_(kernel, kernel + kernel_length),
+        length_(length)
+      {
+      }
+
+      void convolve(const float* in, float* out) const override
+      {
+        convolve_reference(in, length_, &kernel_[0], (int)(kernel_.size()) / 2, out);
+      }
+
+      void convolveTile(const float* in, float* out) const override
+      {
+        const int kernel_length = (int)(kernel_.size());
+        for (int i = 0; i < length_ - kernel_length + 1; i++)
+        {
+          for (int j = 0; j < TileWidth; j++)
+          {
+            float sum = 0.0f;
+            for (int k = 0; k < kernel_length; k++)
+              sum += kernel_[k] * in[(i + k) * TileWidth + j];
+            out[i * TileWidth + j] = sum;
+          }
+        }
+      }
+
+      void convolveRows(const float* const* rows, float* out, int width) const override
+      {
+        for (int u = 0; u < width; u++)
+        {
+          float sum = 0.0f;
+          for (int k = 0; k < (int)(kernel_.size()); k++)
+            sum += kernel_[k] * rows[k][u];
+          out[u] = sum;
+        }
+      }
+
+      std::unique_ptr<RowConvolver> clone() const override
+      {
+        return std::unique_ptr<RowConvolver>(new ReferenceConvolver(*this));
+      }
+    };
+
+    ConvolutionMode detectBestConvolutionMode()
+    {
+      const CpuFeatures& features = getCpuFeatures();
+      if (features.avx512f && Avx512Convolver::isAvailableInBuild())
+        return ConvolutionMode::Avx512;
+      if (features.avx2 && features.fma)
+        return ConvolutionMode::Avx2;
+      return ConvolutionMode::Sse;
+    }
+  }
+
+  bool isConvolutionModeSupported(ConvolutionMode mode)
+  {
+    const CpuFeatures& features = getCpuFeatures();
+    switch (mode)
+    {
+    case ConvolutionMode::Auto:
+    case ConvolutionMode::Reference:
+    case ConvolutionMode::Sse:
+      return true;
+    case ConvolutionMode::Avx2:
+      return features.avx2 && features.fma;
+    case ConvolutionMode::Avx512:
+      return features.avx512f && Avx512Convolver::isAvailableInBuild();
+    default:
+      return false;
+    }
+  }
+
+  ConvolutionMode resolveConvolutionMode(ConvolutionMode mode)
+  {
+    static const ConvolutionMode best = detectBestConvolutionMode();
+
+    if (mode == ConvolutionMode::Auto)
+      return best;
+
+    if (!isConvolutionModeSupported(mode))
+      throw std::exception("Convolution mode is not supported on this processor.");
+
+    return mode;
+  }
+
+  std::unique_ptr<RowConvolver> createRowConvolver(ConvolutionMode mode, const float* kernel, int kernel_length, int length)
+  {
+    switch (resolveConvolutionMode(mode))
+    {
+    case ConvolutionMode::Reference:
+      return std::unique_ptr<RowConvolver>(new ReferenceConvolver(kernel, kernel_length, length));
+    case ConvolutionMode::Sse:
+      return std::unique_ptr<RowConvolver>(new SseConvolver(kernel, kernel_length, length));
+    case ConvolutionMode::Avx2:
+      return std::unique_ptr<RowConvolver>(new Avx2Convolver(kernel, kernel_length, length));
+    case ConvolutionMode::Avx512:
+      return std::unique_ptr<RowConvolver>(new Avx512Convolver(kernel, kernel_length, length));
+    default:
+      throw std::exception("Convolution mode was out of range.");
+    }
+  }
+}
@@ -0,0 +1,57 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace createdataset
+{
+  // Implementation used for the 1D convolution of each row.
+  enum class ConvolutionMode
+  {
+    Auto,      // the fastest implementation supported by this processor, chosen once at startup
+    Reference, // convolve_reference, one multiply-add per tap
+    Sse,       // SseConvolver, four outputs per instruction
+    Avx2,      // Avx2Convolver, eight outputs per fused multiply-add
+    Avx512     // Avx512Convolver, sixteen outputs per fused multiply-add
+  };
+
+  // Interface shared by the 1D convolvers for the different instruction sets. Each convolver
+  // is constructed for a fixed kernel and input length: an input of length samples yields
+  // length - kernel_length + 1 outputs, one for each position at which the kernel fits
+  // completely within the input (as for convolve_reference).
+  class RowConvolver
+  {
+  public:
+    // Number of neighbouring columns that convolveTile processes together.
+    static const int TileWidth = 32;
+
+    virtual ~RowConvolver() {}
+
+    virtual void convolve(const float* in, float* out) const = 0;
+
+    // Convolves TileWidth columns at once, vectorising across the columns. The input holds
+    // length rows of TileWidth floats and the output receives length - kernel_length + 1 rows.
+    virtual void convolveTile(const float* in, float* out) const = 0;
+
+    // Weighted sum of kernel_length rows of width floats: out[u] = sum over k of kernel[k] * rows[k][u].
+    // Convolves across rows that are not evenly spaced in memory, such as slices in a ring buffer.
+    virtual void convolveRows(const float* const* rows, float* out, int width) const = 0;
+
+    // A copy of this convolver, so that each thread can have its own.
+    virtual std::unique_ptr<RowConvolver> clone() const = 0;
+  };
+
+  // Returns whether the given mode can be used on this processor.
+  bool isConvolutionModeSupported(ConvolutionMode mode);
+
+  // Maps Auto onto the fastest supported mode, and checks that any other mode is supported.
+  ConvolutionMode resolveConvolutionMode(ConvolutionMode mode);
+
+  // Creates a convolver of the specified kind. Throws if the mode is not supported.
+  std::unique_ptr<RowConvolver> createRowConvolver(ConvolutionMode mode, const float* kernel, int kernel_length, int length);
+}
@@ -13,89 +13,138 @@
 #include <immintrin.h>
 
 #include "AlignmentAllocator.h"
+#include "RowConvolver.h"
 
 namespace createdataset
 {
   // Fast convolution of 1D vector with 1D kernel using SSE intrinsics.
-  class SseConvolver
+  // Produces the same results as convolve_reference: an input of length samples yields
+  // length - kernel_length + 1 outputs, one for each position at which the kernel fits
+  // completely within the input. Works for any kernel length and for input and output
+  // pointers of any alignment.
+  class SseConvolver : public RowConvolver
   {
-    std::vector<std::vector<float, AlignmentAllocator<float, 32>>> in_aligned;
-    std::vector<__m128, AlignmentAllocator<__m128, 32>> kernel_aligned_;
+    std::vector<__m128, AlignmentAllocator<__m128, 16>> kernel_aligned_; // each tap broadcast across a vector
     std::vector<float> kernel_;
-    int kernel_radius_;
-    int padBytes_;
     int length_;
 
   public:
     SseConvolver(const float* kernel, int kernel_length, int length) :
-      in_aligned(4),
-      kernel_radius_(kernel_length / 2),
+      kernel_aligned_(kernel_length),
+      kernel_(kernel, kernel + kernel_length),
       length_(length)
     {
-      if (length <= kernel_length)
-        throw std::exception("Kernel too big for image.");
+      for (int k = 0; k < kernel_length; k++)
+        kernel_aligned_[k] = _mm_set1_ps(kernel[k]);
+    }
 
-      // Pad kernel to multiple of 4 bytes
-      padBytes_ = (4 - kernel_length % 4) % 4;
-      kernel_.resize(kernel_length + padBytes_, 0.0f);
-      memcpy(&kernel_[0], kernel, kernel_length*sizeof(float));
+    void convolve(const float* in, float* out) const override
+    {
+      const int kernel_length = (int)(kernel_.size());
+      const int count = length_ - kernel_length + 1; // kernel too big for the input gives no outputs
+      const __m128* kernel = kernel_length > 0 ? &kernel_aligned_[0] : nullptr;
 
-      // Allocate aligned storage for the kernel
-      kernel_aligned_.resize(kernel_.size());
+      int i = 0;
 
-      // Repeat the kernel across the vector
-      std::vector<float, AlignmentAllocator<float, 32>> kernel_block(4);
-      for (int i = 0; i < kernel_length; i++)
+      // Two independent accumulators per iteration to hide the latency of the adds
+      for (; i + 8 <= count; i += 8)
       {
-        kernel_block[0] = kernel[i];
-        kernel_block[1] = kernel[i];
-        kernel_block[2] = kernel[i];
-        kernel_block[3] = kernel[i];
+        __m128 accumulator0 = _mm_setzero_ps();
+        __m128 accumulator1 = _mm_setzero_ps();
+        for (int k = 0; k < kernel_length; k++)
+        {
+          accumulator0 = _mm_add_ps(accumulator0, _mm_mul_ps(kernel[k], _mm_loadu_ps(in + i + k)));
+          accumulator1 = _mm_add_ps(accumulator1, _mm_mul_ps(kernel[k], _mm_loadu_ps(in + i + k + 4)));
+        }
+        _mm_storeu_ps(out + i, accumulator0);
+        _mm_storeu_ps(out + i + 4, accumulator1);
+      }
 
-        kernel_aligned_[i] = _mm_load_ps(&kernel_block[0]);
+      for (; i + 4 <= count; i += 4)
+      {
+        __m128 accumulator = _mm_setzero_ps();
+        for (int k = 0; k < kernel_length; k++)
+          accumulator = _mm_add_ps(accumulator, _mm_mul_ps(kernel[k], _mm_loadu_ps(in + i + k)));
+        _mm_storeu_ps(out + i, accumulator);
       }
 
-      // Allocate aligned storage for 4 copies of input data, padded by same amount as kernel
-      for (int l = 0; l < 4; l++)
-        in_aligned[l].resize(length + padBytes_, 0.0f);
+      // Remaining outputs at the right hand edge that don't fill a whole vector
+      for (; i < count; i++)
+      {
+        float sum = 0.0f;
+        for (int k = 0; k < kernel_length; k++)
+          sum += kernel_[k] * in[i + k];
+        out[i] = sum;
+      }
     }
 
-    void convolve(const float* in, float* out)
+    void convolveTile(const float* in, float* out) const override
     {
-      // Must make four copies of the data for four different memory alignments
-      for (int i = 0; i < 4; i++)
-        memcpy(&(in_aligned[i][0]), in + i, (length_ - i)*sizeof(float));
+      static_assert(TileWidth == 32, "Tile must be eight SSE vectors wide.");
 
-      // Need to do the left hand side as a special case
+      const int kernel_length = (int)(kernel_.size());
+      const int count = length_ - kernel_length + 1;
 
-      // Now perform the convolution using SSE
-      for (int i = 0; i < length_ + padBytes_ - (int)(kernel_.size()); i += 4)
+      for (int i = 0; i < count; i++)
       {
-        __m128 accumulator = _mm_setzero_ps();
+        __m128 accumulator[8];
+        for (int j = 0; j < 8; j++)
+          accumulator[j] = _mm_setzero_ps();
 
-        for (int k = 0; k < (int)(kernel_.size()); k += 4)
+        for (int k = 0; k < kernel_length; k++)
         {
-          int data_offset = i + k;
+          const float* row = in + (i + k) * TileWidth;
+          for (int j = 0; j < 8; j++) // compiler will unroll
+            accumulator[j] = _mm_add_ps(accumulator[j], _mm_mul_ps(kernel_aligned_[k], _mm_loadu_ps(row + 4 * j)));
+        }
 
-          for (int l = 0; l < 4; l++) // compiler will unroll
-          {
-            // TODO: Compare a version where we shift the kernel and't don't make four copies of data
-            __m128 data_block = _mm_load_ps(&(in_aligned[l][0]) + data_offset);
-            __m128 products = _mm_mul_ps(kernel_aligned_[k + l], data_block);
+        for (int j = 0; j < 8; j++)
+          _mm_storeu_ps(out + i * TileWidth + 4 * j, accumulator[j]);
+      }
+    }
 
-            accumulator = _mm_add_ps(accumulator, products);
-          }
+    void convolveRows(const float* const* rows, float* out, int width) const override
+    {
+      const int kernel_length = (int)(kernel_.size());
+
+      int u = 0;
+      for (; u + TileWidth <= width; u += TileWidth)
+      {
+        __m128 accumulator[8];
+        for (int j = 0; j < 8; j++)
+          accumulator[j] = _mm_setzero_ps();
+
+        for (int k = 0; k < kernel_length; k++)
+        {
+          const float* row = rows[k] + u;
+          for (int j = 0; j < 8; j++)
+            accumulator[j] = _mm_add_ps(accumulator[j], _mm_mul_ps(kernel_aligned_[k], _mm_loadu_ps(row + 4 * j)));
         }
-        _mm_storeu_ps(out + kernel_radius_ + i, accumulator); // offset by original kernel width
 
-        // NB. Could deal with non multiple of 4 kernel as special case here instead of padding in constructor
+        for (int j = 0; j < 8; j++)
+          _mm_storeu_ps(out + u + 4 * j, accumulator[j]);
       }
 
-      // Need to do the last value as a special case
-      int i = length_ - (int)(kernel_.size());
-      out[i] = 0.0;
-      for (int k = 0; k < (int)(kernel_.size()); k++)
-        out[i + kernel_radius_] += in_aligned[0][i + k] * kernel_[kernel_.size() - k - 1];
+      for (; u + 4 <= width; u += 4)
+      {
+        __m128 accumulator = _mm_setzero_ps();
+        for (int k = 0; k < kernel_length; k++)
+          accumulator = _mm_add_ps(accumulator, _mm_mul_ps(kernel_aligned_[k], _mm_loadu_ps(rows[k] + u)));
+        _mm_storeu_ps(out + u, accumulator);
+      }
+
+      for (; u < width; u++)
+      {
+        float sum = 0.0f;
+        for (int k = 0; k < kernel_length; k++)
+          sum += kernel_[k] * rows[k][u];
+        out[u] = sum;
+      }
+    }
+
+    std::unique_ptr<RowConvolver> clone() const override
+    {
+      return std::unique_ptr<RowConvolver>(new SseConvolver(*this));
     }
   };
 
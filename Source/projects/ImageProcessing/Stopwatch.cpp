@@ -8,21 +8,31 @@
 
 #include "Stopwatch.h"
 
+#include <chrono>
+
 namespace createdataset
 {
-  Stopwatch::Stopwatch() {
-    if (!::QueryPerformanceFrequency(&frequency_)) throw "Error with QueryPerformanceFrequency";
+  namespace
+  {
+    long long now()
+    {
+      return (long long)std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+  }
+
+  Stopwatch::Stopwatch() : startTicks_(0), stopTicks_(0) {
   }
 
   void Stopwatch::Start() {
-    ::QueryPerformanceCounter(&startTime_);
+    startTicks_ = now();
   }
 
   void Stopwatch::Stop() {
-    ::QueryPerformanceCounter(&stopTime_);
+    stopTicks_ = now();
   }
 
   float Stopwatch::MilliSeconds() const {
-    return (float)(stopTime_.QuadPart - startTime_.QuadPart) / (float)frequency_.QuadPart * 1000;
+    typedef std::chrono::steady_clock::period Period;
+    return (float)((double)(stopTicks_ - startTicks_) * Period::num / Period::den * 1000);
   }
 }
\ No newline at end of file
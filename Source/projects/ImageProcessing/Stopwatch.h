@@ -6,14 +6,13 @@
 
 #pragma once
 
-#include <windows.h> // TODO: Preferable to remove this from header
-
 namespace createdataset
 {
+  // Wall time between Start and Stop, from the steady clock of the C++ library, which is the
+  // performance counter on Windows.
   class Stopwatch {
-    LARGE_INTEGER frequency_;
-    LARGE_INTEGER startTime_;
-    LARGE_INTEGER stopTime_;
+    long long startTicks_;
+    long long stopTicks_;
 
   public:
     Stopwatch();
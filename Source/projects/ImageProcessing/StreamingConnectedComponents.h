@@ -0,0 +1,324 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+#include "connectedComponents.h"
+
+namespace createdataset
+{
+  // A run of foreground voxels, from start to end exclusive along its row, and its provisional label.
+  struct ProvisionalRun
+  {
+    int start, end;
+    unsigned int label;
+  };
+
+  // Connected components of a volume that is given one slice at a time, for volumes whose input
+  // and output do not fit in memory at once. Each call to addSlice labels a slice with provisional
+  // labels, which the caller keeps; once every slice has been added, finish works out which
+  // provisional labels belong to the same component, and resolveSlice turns each slice of
+  // provisional labels into the labels that findConnectedComponents3d would give the volume.
+  //
+  // Besides the provisional labels the memory used is the runs of two slices, a copy of the
+  // previous slice and a table of 16 bytes per provisional label. A new provisional label is made
+  // for each part of a slice that does not touch the slice before, so there are at most as many
+  // as there are runs, and for most masks few more than there are components.
+  template<typename T, typename U, Connectivity C = Connectivity::Face>
+  class StreamingConnectedComponents
+  {
+  public:
+    // Provisional label of background voxels.
+    static const unsigned int Background = 0xFFFFFFFFu;
+
+    StreamingConnectedComponents(int width, int height, T backgroundColor, U backgroundLabel) :
+      width_(width), height_(height), depth_(0),
+      backgroundColor_(backgroundColor), backgroundLabel_(backgroundLabel),
+      previous_((size_t)width * height), previousRowStart_(height + 1, 0), rowStart_(height + 1, 0),
+      finished_(false)
+    {
+      if (width <= 0 || height <= 0)
+        throw std::exception("Slice dimensions must be positive.");
+    }
+
+    // Labels the next slice, with stride bytes between rows, writing its provisional labels to
+    // output, with outputStride bytes between rows.
+    void addSlice(const void* slice, int stride, unsigned int* output, int outputStride)
+    {
+      const unsigned int first = labelSlice(slice, stride);
+      for (int v = 0; v < height_; v++)
+      {
+        unsigned int* o = (unsigned int*)((unsigned char*)output + (size_t)v*outputStride);
+        int u = 0;
+        for (unsigned int i = rowStart_[v]; i < rowStart_[v + 1]; i++)
+        {
+          const ComponentRun& run = runs_[i];
+          const unsigned int label = keepRun(i, first);
+          std::fill(o + u, o + run.start, Background);
+          std::fill(o + run.start, o + run.end, label);
+          u = run.end;
+        }
+        std::fill(o + u, o + width_, Background);
+      }
+      endSlice(slice, stride, first);
+    }
+
+    // Labels the next slice as above, appending the foreground runs of each of its rows to runs,
+    // and after each row the number of runs by then to rowEnds, rather than writing a slice of
+    // provisional labels. For masks with long runs this keeps far less than a label per voxel.
+    void addSlice(const void* slice, int stride, std::vector<ProvisionalRun>& runs, std::vector<size_t>& rowEnds)
+    {
+      const unsigned int first = labelSlice(slice, stride);
+      for (int v = 0; v < height_; v++)
+      {
+        for (unsigned int i = rowStart_[v]; i < rowStart_[v + 1]; i++)
+        {
+          const ProvisionalRun run = { runs_[i].start, runs_[i].end, keepRun(i, first) };
+          runs.push_back(run);
+        }
+        rowEnds.push_back(runs.size());
+      }
+      endSlice(slice, stride, first);
+    }
+
+    // Works out the final label of each provisional label, after the last slice has been added,
+    // and returns the statistics of the labels as for findConnectedComponents3d.
+    std::vector<ComponentStatistics<T, U> > finish()
+    {
+      if (finished_)
+        throw std::exception("Connected components have already been finished.");
+      finished_ = true;
+
+      // Every provisional label is linked beneath the smallest of its set, which was made for the
+      // set's first run in raster order, so the roots in ascending order are the components in the
+      // order that findConnectedComponents3d numbers them
+      const long long background = (long long)backgroundLabel_;
+      const long long maximum = (long long)std::numeric_limits<U>::max();
+      long long label = 0;
+      if (label == background)
+        label++;
+
+      std::vector<ComponentStatistics<T, U> > statistics;
+      finalLabels_.resize(labelParent_.size());
+      for (size_t i = 0; i < labelParent_.size(); i++)
+      {
+        const unsigned int root = findRoot(&labelParent_[0], (unsigned int)i);
+        if (root == i)
+        {
+          if (label >= maximum || (label + 1 == background && background == maximum))
+            throw std::exception("Too many components during connected component analysis.");
+          finalLabels_[i] = (U)label;
+          label++;
+          if (label == background)
+            label++;
+        }
+        else
+        {
+          finalLabels_[i] = finalLabels_[root];
+        }
+      }
+
+      statistics.resize((size_t)label, { 0, backgroundColor_ });
+      for (size_t i = 0; i < labelParent_.size(); i++)
+      {
+        ComponentStatistics<T, U>& s = statistics[(size_t)finalLabels_[i]];
+        if (labelParent_[i] == i)
+          s.inputLabel_ = inputLabels_[i];
+        s.pixelCount_ += pixelCounts_[i];
+      }
+      if (background >= 0 && background < (long long)statistics.size())
+        statistics[(size_t)background].pixelCount_ = (unsigned long)((size_t)width_ * height_ * depth_ - foregroundCount());
+
+      return statistics;
+    }
+
+    // Converts a slice of provisional labels, with provisionalStride bytes between rows, into final
+    // labels of type U, with outputStride bytes between rows, after finish. Throws out_of_range for
+    // a provisional label that addSlice did not give.
+    void resolveSlice(const unsigned int* provisional, int provisionalStride, void* output, int outputStride) const
+    {
+      if (!finished_)
+        throw std::exception("Connected components have not been finished.");
+
+      const size_t labelCount = finalLabels_.size();
+      for (int v = 0; v < height_; v++)
+      {
+        const unsigned int* p = (const unsigned int*)((const unsigned char*)provisional + (size_t)v*provisionalStride);
+        U* o = (U*)((unsigned char*)output + (size_t)v*outputStride);
+        for (int u = 0; u < width_; u++)
+        {
+          if (p[u] == Background)
+            o[u] = backgroundLabel_;
+          else if (p[u] < labelCount)
+            o[u] = finalLabels_[p[u]];
+          else
+            throw std::out_of_range("Provisional label was out of range.");
+        }
+      }
+    }
+
+    // The final label of a provisional label that is not Background, after finish. Throws
+    // out_of_range for a provisional label that addSlice did not give.
+    U resolveLabel(unsigned int provisional) const
+    {
+      if (provisional >= finalLabels_.size())
+        throw std::out_of_range("Provisional label was out of range.");
+      return finalLabels_[provisional];
+    }
+
+    int getDepth() const
+    {
+      return depth_;
+    }
+
+  private:
+    const T* sliceRow(const void* slice, int stride, int v) const
+    {
+      return (const T*)((const unsigned char*)slice + (size_t)v*stride);
+    }
+
+    // Finds the runs of the next slice and their provisional labels, making new ones where needed,
+    // and returns the index in runs_ of the first run of the slice.
+    unsigned int labelSlice(const void* slice, int stride)
+    {
+      if (finished_)
+        throw std::exception("Slices cannot be added after finish.");
+
+      auto row = [this, slice, stride](int v) { return sliceRow(slice, stride, v); };
+      auto previousRow = [this](int v) { return &previous_[(size_t)v * width_]; };
+
+      // The runs of this slice follow those of the previous one, so that a run of either slice can
+      // be addressed by its index in runs_
+      const unsigned int first = (unsigned int)runs_.size();
+      for (int v = 0; v < height_; v++)
+      {
+        rowStart_[v] = (unsigned int)runs_.size();
+        extractRuns(row(v), width_, backgroundColor_, runs_);
+      }
+      rowStart_[height_] = (unsigned int)runs_.size();
+      const unsigned int count = (unsigned int)runs_.size() - first;
+      const ComponentRun* runs = runs_.empty() ? nullptr : &runs_[0];
+
+      // Unite the runs within the slice, in a forest indexed from the first run of the slice
+      const int reach = C == Connectivity::Face ? 0 : 1;
+      const int diagonalReach = C == Connectivity::Face ? -1 : (C == Connectivity::Edge ? 0 : 1);
+
+      parent_.resize(count);
+      for (unsigned int i = 0; i < count; i++)
+        parent_[i] = i;
+      unsigned int* parent = parent_.empty() ? nullptr : &parent_[0];
+      auto unite = [parent, first](unsigned int i, unsigned int j) { uniteRoots(parent, i - first, j - first); };
+      for (int v = 1; v < height_; v++)
+        uniteOverlappingRuns(runs, row(v), rowStart_[v], rowStart_[v + 1], row(v - 1), rowStart_[v - 1], rowStart_[v], reach, unite);
+
+      // Each set of runs takes the provisional label of the runs it touches in the previous slice,
+      // and the provisional labels of those runs are united
+      provisional_.assign(count, Background);
+      if (depth_ > 0)
+      {
+        auto link = [this, parent, first](unsigned int i, unsigned int j)
+        {
+          const unsigned int root = findRoot(parent, i - first);
+          const unsigned int label = findRoot(&labelParent_[0], previousLabels_[j]);
+          if (provisional_[root] == Background)
+            provisional_[root] = label;
+          else
+            uniteRoots(&labelParent_[0], provisional_[root], label);
+        };
+
+        for (int v = 0; v < height_; v++)
+        {
+          const T* p = row(v);
+          uniteOverlappingRuns(runs, p, rowStart_[v], rowStart_[v + 1], previousRow(v), previousRowStart_[v], previousRowStart_[v + 1], reach, link);
+          if (diagonalReach >= 0 && v > 0)
+            uniteOverlappingRuns(runs, p, rowStart_[v], rowStart_[v + 1], previousRow(v - 1), previousRowStart_[v - 1], previousRowStart_[v], diagonalReach, link);
+          if (diagonalReach >= 0 && v + 1 < height_)
+            uniteOverlappingRuns(runs, p, rowStart_[v], rowStart_[v + 1], previousRow(v + 1), previousRowStart_[v + 1], previousRowStart_[v + 2], diagonalReach, link);
+        }
+      }
+
+      // Sets that touch nothing in the previous slice start new provisional labels, in raster
+      // order of their first run
+      for (int v = 0; v < height_; v++)
+      {
+        for (unsigned int i = rowStart_[v]; i < rowStart_[v + 1]; i++)
+        {
+          const unsigned int k = i - first;
+          if (parent_[k] != k || provisional_[k] != Background)
+            continue;
+          if (labelParent_.size() >= Background)
+            throw std::exception("Too many provisional labels during connected component analysis.");
+          provisional_[k] = (unsigned int)labelParent_.size();
+          labelParent_.push_back(provisional_[k]);
+          pixelCounts_.push_back(0);
+          inputLabels_.push_back(row(v)[runs_[i].start]);
+        }
+      }
+
+      previousLabels_.assign(first + count, Background);
+      return first;
+    }
+
+    // Returns the provisional label of run i of the slice, and counts and keeps it for the next.
+    unsigned int keepRun(unsigned int i, unsigned int first)
+    {
+      const ComponentRun& run = runs_[i];
+      const unsigned int label = provisional_[findRoot(&parent_[0], i - first)];
+      pixelCounts_[label] += run.end - run.start;
+      previousLabels_[i] = label;
+      return label;
+    }
+
+    // Keeps the slice and its runs for the next one, once the runs have been kept.
+    void endSlice(const void* slice, int stride, unsigned int first)
+    {
+      for (int v = 0; v < height_; v++)
+        memcpy(&previous_[(size_t)v * width_], sliceRow(slice, stride, v), width_ * sizeof(T));
+
+      runs_.erase(runs_.begin(), runs_.begin() + first);
+      previousLabels_.erase(previousLabels_.begin(), previousLabels_.begin() + first);
+      for (int v = 0; v <= height_; v++)
+        previousRowStart_[v] = rowStart_[v] - first;
+      depth_++;
+    }
+
+    size_t foregroundCount() const
+    {
+      size_t total = 0;
+      for (size_t i = 0; i < pixelCounts_.size(); i++)
+        total += pixelCounts_[i];
+      return total;
+    }
+
+    int width_, height_, depth_;
+    T backgroundColor_;
+    U backgroundLabel_;
+
+    std::vector<T> previous_;                  // the previous slice, without padding
+    std::vector<ComponentRun> runs_;           // the runs of the previous slice, then of this one
+    std::vector<unsigned int> previousRowStart_, rowStart_;
+    std::vector<unsigned int> previousLabels_; // provisional label of each run of the previous slice
+    std::vector<unsigned int> parent_;         // forest of the runs of this slice
+    std::vector<unsigned int> provisional_;    // provisional label of each set of runs of this slice
+
+    // Per provisional label
+    std::vector<unsigned int> labelParent_;
+    std::vector<unsigned long long> pixelCounts_;
+    std::vector<T> inputLabels_;
+    std::vector<U> finalLabels_;
+
+    bool finished_;
+  };
+
+  template<typename T, typename U, Connectivity C>
+  const unsigned int StreamingConnectedComponents<T, U, C>::Background;
+}
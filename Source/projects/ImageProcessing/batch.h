@@ -0,0 +1,247 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <exception>
+#include <limits>
+
+#include "parallel.h"
+#include "ConvolutionPlan.h"
+#include "connectedComponents.h"
+#include "ComponentFilters.h"
+#include "Instrumentation.h"
+
+namespace createdataset
+{
+  // A volume of a batch: voxel x, y, z is at buffer + z*leap + y*stride + x*sizeof(T).
+  struct BatchVolume
+  {
+    int width, height, depth;
+    unsigned char* buffer;
+    int leap, stride;
+
+    size_t voxels() const { return (size_t)width * height * depth; }
+  };
+
+  // Runs job(i, threads, worker) for each of the jobs of a batch, where voxels[i] is the size of
+  // job i, with up to threadCount threads in all (zero for one per processor). A job with at least
+  // its share of the voxels of the batch runs on its own with every thread, parallel within the
+  // volume; the rest run at the same time with one thread each, largest first, each worker taking
+  // the next job as it finishes one, so that many small volumes keep every core busy where each
+  // alone would leave most idle. Worker is below the number of threads and differs between jobs
+  // that run at the same time, so jobs can keep state for each worker. Labels and smoothing do not
+  // depend on the number of threads, so neither does the result.
+  //
+  // Every job runs even if some throw; the first failure, in the order of the jobs, is then
+  // raised. If progress is not null, the voxels of each job are added to it as the job finishes,
+  // and once it is cancelled no more jobs are started and OperationCancelled is raised. The stages
+  // of the jobs are recorded under the entry point of the calling thread.
+  template<typename Job>
+  void runBatch(const std::vector<size_t>& voxels, int threadCount, Job job, OperationProgress* progress = nullptr)
+  {
+    const int count = (int)voxels.size();
+    if (count == 0)
+      return;
+
+    const int threads = resolveThreadCount(threadCount, std::numeric_limits<int>::max());
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+      total += voxels[i];
+    if (progress != nullptr)
+      progress->expect((long long)total);
+
+    std::vector<int> large, small;
+    for (int i = 0; i < count; i++)
+    {
+      if (threads == 1 || (double)voxels[i] * threads >= (double)total)
+        large.push_back(i);
+      else
+        small.push_back(i);
+    }
+    std::stable_sort(small.begin(), small.end(), [&](int a, int b) { return voxels[a] > voxels[b]; });
+
+    // Exceptions must not leave a parallel region, so failures are raised after it
+    std::vector<char> failed(count, 0);
+    std::vector<std::string> messages(count);
+    const char* const entryPoint = getInstrumentedEntryPoint();
+    auto run = [&](int i, int jobThreads, int worker)
+    {
+      if (progress != nullptr && progress->isCancelled())
+        return;
+      InstrumentedThread instrumented(entryPoint);
+      try
+      {
+        job(i, jobThreads, worker);
+      }
+      catch (std::exception& oops)
+      {
+        failed[i] = 1;
+        messages[i] = oops.what();
+      }
+      if (progress != nullptr)
+        progress->advance((long long)voxels[i]);
+    };
+
+    for (size_t k = 0; k < large.size(); k++)
+      run(large[k], threads, 0);
+
+    const int smallCount = (int)small.size();
+#pragma omp parallel for num_threads(resolveThreadCount(threads, smallCount)) schedule(dynamic, 1)
+    for (int k = 0; k < smallCount; k++)
+      run(small[k], 1, omp_get_thread_num());
+
+    if (progress != nullptr)
+      progress->throwIfCancelled();
+    for (int i = 0; i < count; i++)
+    {
+      if (failed[i])
+        throw std::exception(messages[i].c_str());
+    }
+  }
+
+  // The sizes of the volumes of a batch.
+  inline std::vector<size_t> batchVoxels(const std::vector<BatchVolume>& volumes)
+  {
+    std::vector<size_t> voxels(volumes.size());
+    for (size_t i = 0; i < volumes.size(); i++)
+      voxels[i] = volumes[i].voxels();
+    return voxels;
+  }
+
+  // Smooths each volume of pixel type T in place along directions with sigmas, as
+  // ConvolutionPlan does, scheduled by runBatch with options.threadCount threads. Each worker
+  // keeps its plan while the volumes it takes have the same dimensions, as the structures of one
+  // subject do, so kernels and scratch memory are set up once per worker rather than per volume.
+  // Options.progress is that of the batch, as for runBatch.
+  template<typename T>
+  void convolveBatch(
+    const std::vector<BatchVolume>& volumes,
+    const std::vector<int>& directions, const std::vector<float>& sigmas,
+    const ConvolutionOptions& options,
+    GaussianSampling sampling = GaussianSampling::Point,
+    GaussianMethod method = GaussianMethod::Auto)
+  {
+    struct WorkerPlan
+    {
+      std::unique_ptr<ConvolutionPlan> plan;
+      int threads;
+    };
+
+    const int threads = resolveThreadCount(options.threadCount, std::numeric_limits<int>::max());
+    std::vector<WorkerPlan> plans(threads);
+    runBatch(batchVoxels(volumes), options.threadCount, [&](int i, int jobThreads, int worker)
+    {
+      const BatchVolume& volume = volumes[i];
+      if (volume.voxels() == 0)
+        return;
+
+      WorkerPlan& cached = plans[worker];
+      if (!cached.plan || cached.threads != jobThreads || cached.plan->getWidth() != volume.width
+        || cached.plan->getHeight() != volume.height || cached.plan->getDepth() != volume.depth)
+      {
+        ConvolutionOptions jobOptions = options;
+        jobOptions.threadCount = jobThreads;
+        jobOptions.progress = nullptr;
+        cached.plan.reset(new ConvolutionPlan(volume.width, volume.height, volume.depth, directions, sigmas, jobOptions, sampling, method));
+        cached.threads = jobThreads;
+      }
+      cached.plan->template execute<T>(volume.buffer, volume.leap, volume.stride, sizeof(T));
+    }, options.progress);
+  }
+
+  // Labels each image of pixel type T into the output of the same index, of label type U, with
+  // backgroundLabel for the background, as findConnectedComponents3dParallel does, scheduled by
+  // runBatch. Returns the statistics of the
+  // components of each image, and if geometry is not null the geometry of them in it, as
+  // ComponentGeometryStatistics finds it without intensities. Progress is as for runBatch.
+  template<typename T, typename U, Connectivity C>
+  std::vector<std::vector<ComponentStatistics<T, U> > > findConnectedComponentsBatch(
+    const std::vector<BatchVolume>& images,
+    T backgroundColor,
+    const std::vector<BatchVolume>& outputs,
+    U backgroundLabel,
+    std::vector<std::vector<ComponentGeometry> >* geometry,
+    int threadCount = 0,
+    OperationProgress* progress = nullptr)
+  {
+    std::vector<std::vector<ComponentStatistics<T, U> > > statistics(images.size());
+    if (geometry != nullptr)
+      geometry->assign(images.size(), std::vector<ComponentGeometry>());
+    runBatch(batchVoxels(images), threadCount, [&](int i, int jobThreads, int)
+    {
+      const BatchVolume& image = images[i];
+      const BatchVolume& output = outputs[i];
+      if (geometry == nullptr)
+      {
+        std::vector<NoComponentStatistics::Value> values;
+        statistics[i] = findConnectedComponents3dParallel<T, U, C>(image.width, image.height, image.depth,
+          image.buffer, image.leap, image.stride, backgroundColor,
+          output.buffer, output.leap, output.stride, backgroundLabel, jobThreads, NoComponentStatistics(), values);
+        return;
+      }
+
+      ComponentGeometryStatistics<T, short> policy(image.width, image.height, image.depth,
+        image.buffer, image.leap, image.stride, backgroundColor);
+      statistics[i] = findConnectedComponents3dParallel<T, U, C>(image.width, image.height, image.depth,
+        image.buffer, image.leap, image.stride, backgroundColor,
+        output.buffer, output.leap, output.stride, backgroundLabel, jobThreads, policy, (*geometry)[i]);
+    }, progress);
+    return statistics;
+  }
+
+  // Which of the filters of ComponentFilters.h filterComponentsBatch applies.
+  enum class ComponentFilter
+  {
+    KeepLargest = 0,
+    RemoveSmall = 1,
+    FillHoles = 2
+  };
+
+  // Applies filter to each mask of pixel type T, writing the output of the same index, which may
+  // be the mask itself, scheduled by runBatch. minimumVoxels is for RemoveSmall and
+  // foregroundColor for FillHoles. Returns what the filter returns for each mask: the voxels
+  // kept, the components removed or the voxels filled.
+  template<typename T, Connectivity C>
+  std::vector<size_t> filterComponentsBatch(
+    const std::vector<BatchVolume>& masks,
+    ComponentFilter filter,
+    T backgroundColor,
+    T foregroundColor,
+    size_t minimumVoxels,
+    const std::vector<BatchVolume>& outputs,
+    int threadCount = 0)
+  {
+    std::vector<size_t> results(masks.size(), 0);
+    runBatch(batchVoxels(masks), threadCount, [&](int i, int jobThreads, int)
+    {
+      const BatchVolume& mask = masks[i];
+      const BatchVolume& output = outputs[i];
+      switch (filter)
+      {
+      case ComponentFilter::KeepLargest:
+        results[i] = keepLargestComponent<T, C>(mask.width, mask.height, mask.depth, mask.buffer, mask.leap, mask.stride,
+          backgroundColor, output.buffer, output.leap, output.stride, jobThreads);
+        break;
+      case ComponentFilter::RemoveSmall:
+        results[i] = removeSmallComponents<T, C>(mask.width, mask.height, mask.depth, mask.buffer, mask.leap, mask.stride,
+          backgroundColor, output.buffer, output.leap, output.stride, minimumVoxels, jobThreads);
+        break;
+      case ComponentFilter::FillHoles:
+        results[i] = fillHoles<T, C>(mask.width, mask.height, mask.depth, mask.buffer, mask.leap, mask.stride,
+          backgroundColor, foregroundColor, output.buffer, output.leap, output.stride, jobThreads);
+        break;
+      default:
+        throw std::exception("Filter was out of range.");
+      }
+    });
+    return results;
+  }
+}
@@ -7,6 +7,9 @@
 #include "stdafx.h"
 #include "connectedComponents.h"
 
+#include <intrin.h>
+#include <algorithm>
+
 namespace createdataset
 {
   void test_Set()
@@ -34,6 +37,28 @@ namespace createdataset
   }
 
 
+  void uniteRootsConcurrently(unsigned int* parent, unsigned int a, unsigned int b)
+  {
+    // Other threads only ever replace the parent of a root, with a smaller index, so a walk up
+    // the tree sees a valid ancestor whichever value it reads
+    volatile long* forest = (volatile long*)parent;
+    for (;;)
+    {
+      while ((unsigned int)forest[a] != a)
+        a = (unsigned int)forest[a];
+      while ((unsigned int)forest[b] != b)
+        b = (unsigned int)forest[b];
+      if (a == b)
+        return;
+      if (a < b)
+        std::swap(a, b);
+
+      // Link the larger root a beneath b, unless another thread has linked a in the meantime
+      if (_InterlockedCompareExchange(&forest[a], (long)b, (long)a) == (long)a)
+        return;
+    }
+  }
+
   template<>
   void printImage<unsigned char>(int width, int height, void* buffer, int stride)
   {
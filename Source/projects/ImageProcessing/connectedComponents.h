@@ -8,8 +8,17 @@
 
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <limits>
 #include <iostream>
+#include <stdexcept>
+
+#include <emmintrin.h>
+
+#include "parallel.h"
+#include "Memory.h"
+#include "progress.h"
+#include "Instrumentation.h"
 
 namespace createdataset
 {
@@ -112,130 +121,722 @@ struct ComponentStatistics
   T inputLabel_;
 };
 
-// Find connected components in 3D volume using one pass unite-find approach and
-// label associated voxels in output volume. Voxels with the specified background colour
-// are all assigned the background label.
-// Returns a vector of statistics per connected component.
-template<typename T, typename U>
-std::vector<ComponentStatistics<T, U> > findConnectedComponents3d(
+// Statistics policies for findConnectedComponents3dParallel, which accumulate statistics of each
+// component beyond ComponentStatistics while its voxels are labelled, rather than in another pass
+// over the volume. A policy has a type Value holding the statistics of one component, whose
+// default constructor gives those of no voxels; a const member addRun(value, start, end, v, w),
+// called from several threads at once, that adds the voxels from start to end exclusive of row v
+// of slice w to value; and a static merge(value, other) that adds to value the statistics of
+// voxels that come after them in raster order.
+struct NoComponentStatistics
+{
+  struct Value
+  {
+  };
+
+  void addRun(Value&, int, int, int, int) const
+  {
+  }
+
+  static void merge(Value&, const Value&)
+  {
+  }
+};
+
+// Bounding box, centroid, intensity sum and first surface voxel of a component.
+struct ComponentGeometry
+{
+  ComponentGeometry() :
+    minimumX(std::numeric_limits<int>::max()), minimumY(std::numeric_limits<int>::max()), minimumZ(std::numeric_limits<int>::max()),
+    maximumX(-1), maximumY(-1), maximumZ(-1),
+    sumX(0), sumY(0), sumZ(0), intensitySum(0),
+    surfaceX(-1), surfaceY(-1), surfaceZ(-1)
+  {
+  }
+
+  // Inclusive, with minimum greater than maximum if there are no voxels
+  int minimumX, minimumY, minimumZ;
+  int maximumX, maximumY, maximumZ;
+
+  // Sums of the coordinates of the voxels, which divided by the pixel count give the centroid
+  double sumX, sumY, sumZ;
+
+  double intensitySum;
+
+  // The first voxel in raster order that is a surface voxel, -1 if there is none
+  int surfaceX, surfaceY, surfaceZ;
+};
+
+// Statistics policy accumulating ComponentGeometry, for an input volume of pixel type T and an
+// optional intensity volume of pixel type I of the same dimensions. A surface voxel is one with
+// a background voxel, or the edge of the volume, among its 26 neighbours, as for
+// MorphologicalExtensions.IsSurfacePoint in the managed code.
+template<typename T, typename I>
+class ComponentGeometryStatistics
+{
+  int width_, height_, depth_;
+  const unsigned char* input_;
+  int inputLeap_, inputStride_;
+  T backgroundColor_;
+  const unsigned char* intensity_;
+  int intensityLeap_, intensityStride_;
+
+  const T* inputRow(int v, int w) const
+  {
+    return (const T*)(input_ + (size_t)w*inputLeap_ + (size_t)v*inputStride_);
+  }
+
+  // The first surface voxel from start to end exclusive along row v of slice w, or -1 if none
+  int findSurfaceVoxel(int start, int end, int v, int w) const
+  {
+    if (v == 0 || w == 0 || v == height_ - 1 || w == depth_ - 1 || start == 0)
+      return start;
+
+    const T* rows[9];
+    for (int j = 0; j < 9; j++)
+      rows[j] = inputRow(v + j % 3 - 1, w + j / 3 - 1);
+
+    for (int u = start; u < end; u++)
+    {
+      if (u == width_ - 1)
+        return u;
+      for (int j = 0; j < 9; j++)
+      {
+        if (rows[j][u - 1] == backgroundColor_ || rows[j][u] == backgroundColor_ || rows[j][u + 1] == backgroundColor_)
+          return u;
+      }
+    }
+    return -1;
+  }
+
+public:
+  typedef ComponentGeometry Value;
+
+  // Intensity may be null, for zero intensity sums.
+  ComponentGeometryStatistics(
+    int width, int height, int depth,
+    const void* inputBuffer, int inputLeap, int inputStride, T backgroundColor,
+    const void* intensityBuffer = nullptr, int intensityLeap = 0, int intensityStride = 0) :
+    width_(width), height_(height), depth_(depth),
+    input_((const unsigned char*)inputBuffer), inputLeap_(inputLeap), inputStride_(inputStride), backgroundColor_(backgroundColor),
+    intensity_((const unsigned char*)intensityBuffer), intensityLeap_(intensityLeap), intensityStride_(intensityStride)
+  {
+  }
+
+  void addRun(ComponentGeometry& value, int start, int end, int v, int w) const
+  {
+    const int count = end - start;
+    value.minimumX = std::min(value.minimumX, start);
+    value.minimumY = std::min(value.minimumY, v);
+    value.minimumZ = std::min(value.minimumZ, w);
+    value.maximumX = std::max(value.maximumX, end - 1);
+    value.maximumY = std::max(value.maximumY, v);
+    value.maximumZ = std::max(value.maximumZ, w);
+    value.sumX += 0.5 * ((double)start + end - 1) * count;
+    value.sumY += (double)v * count;
+    value.sumZ += (double)w * count;
+
+    if (intensity_ != nullptr)
+    {
+      const I* row = (const I*)(intensity_ + (size_t)w*intensityLeap_ + (size_t)v*intensityStride_);
+      double sum = 0;
+      for (int u = start; u < end; u++)
+        sum += row[u];
+      value.intensitySum += sum;
+    }
+
+    if (value.surfaceX < 0)
+    {
+      const int u = findSurfaceVoxel(start, end, v, w);
+      if (u >= 0)
+      {
+        value.surfaceX = u;
+        value.surfaceY = v;
+        value.surfaceZ = w;
+      }
+    }
+  }
+
+  static void merge(ComponentGeometry& value, const ComponentGeometry& other)
+  {
+    value.minimumX = std::min(value.minimumX, other.minimumX);
+    value.minimumY = std::min(value.minimumY, other.minimumY);
+    value.minimumZ = std::min(value.minimumZ, other.minimumZ);
+    value.maximumX = std::max(value.maximumX, other.maximumX);
+    value.maximumY = std::max(value.maximumY, other.maximumY);
+    value.maximumZ = std::max(value.maximumZ, other.maximumZ);
+    value.sumX += other.sumX;
+    value.sumY += other.sumY;
+    value.sumZ += other.sumZ;
+    value.intensitySum += other.intensitySum;
+    if (value.surfaceX < 0)
+    {
+      value.surfaceX = other.surfaceX;
+      value.surfaceY = other.surfaceY;
+      value.surfaceZ = other.surfaceZ;
+    }
+  }
+};
+
+// Union-find over a forest of indices in which every set is a tree whose root is its
+// smallest index: unions link the larger root beneath the smaller, and parent[i] <= i always.
+// For a forest of voxels in raster order the root of each component is therefore its first
+// voxel in raster order, which is where findConnectedComponents3d gives it its label. This is
+// the linking of the SAUF algorithm of Wu et al., and needs no ranks.
+inline unsigned int findRoot(unsigned int* parent, unsigned int a)
+{
+  while (parent[a] != a)
+  {
+    parent[a] = parent[parent[a]]; // path halving, which keeps the trees flat
+    a = parent[a];
+  }
+  return a;
+}
+
+inline void uniteRoots(unsigned int* parent, unsigned int a, unsigned int b)
+{
+  a = findRoot(parent, a);
+  b = findRoot(parent, b);
+  if (a < b)
+    parent[b] = a;
+  else if (b < a)
+    parent[a] = b;
+}
+
+// As uniteRoots, but safe for several threads to call at once on the same forest: roots are
+// linked with an atomic compare and swap, retried if another thread linked the root first.
+void uniteRootsConcurrently(unsigned int* parent, unsigned int a, unsigned int b);
+
+// A maximal span of voxels of one colour other than the background along a row, from start to
+// end exclusive.
+struct ComponentRun
+{
+  int start;
+  int end;
+};
+
+// The first position from u on at which row differs from value, or width if there is none.
+template<typename T>
+inline int skipEqual(const T* row, int u, int width, T value)
+{
+  while (u < width && row[u] == value)
+    u++;
+  return u;
+}
+
+// SSE2 versions for 8 and 16 bit pixels, which compare a vector of voxels at a time and finish
+// within the vector that differs one voxel at a time. Most rows of a mask are background for most
+// of their length, so this is where extracting runs spends its time.
+template<>
+inline int skipEqual<unsigned char>(const unsigned char* row, int u, int width, unsigned char value)
+{
+  const __m128i v = _mm_set1_epi8((char)value);
+  while (u + 16 <= width && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(row + u)), v)) == 0xFFFF)
+    u += 16;
+  while (u < width && row[u] == value)
+    u++;
+  return u;
+}
+
+template<>
+inline int skipEqual<short>(const short* row, int u, int width, short value)
+{
+  const __m128i v = _mm_set1_epi16(value);
+  while (u + 8 <= width && _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(row + u)), v)) == 0xFFFF)
+    u += 8;
+  while (u < width && row[u] == value)
+    u++;
+  return u;
+}
+
+template<>
+inline int skipEqual<unsigned short>(const unsigned short* row, int u, int width, unsigned short value)
+{
+  return skipEqual<short>((const short*)row, u, width, (short)value);
+}
+
+// Appends the runs of row to runs and returns how many there are.
+template<typename T>
+inline unsigned int extractRuns(const T* row, int width, T backgroundColor, std::vector<ComponentRun>& runs)
+{
+  const size_t before = runs.size();
+  int u = skipEqual(row, 0, width, backgroundColor);
+  while (u < width)
+  {
+    const int start = u;
+    u = skipEqual(row, u + 1, width, row[start]);
+    runs.push_back({ start, u });
+    u = skipEqual(row, u, width, backgroundColor);
+  }
+  return (unsigned int)(runs.size() - before);
+}
+
+// Which neighbours of a voxel are in the same component as it when they have the same colour:
+// the 6 that share a face with it, the 18 that share a face or an edge, or all 26.
+enum class Connectivity
+{
+  Face = 6,
+  Edge = 18,
+  Vertex = 26
+};
+
+// Calls unite(i, j) for each run i of row, from first to end, and each run j of other, from
+// otherFirst to otherEnd, that have the same colour and overlap when the runs of other are
+// extended by reach voxels at each end. The runs of each row are in ascending order and do not
+// overlap, so the first run of other that can touch each run of row only moves forwards.
+template<typename T, typename Unite>
+inline void uniteOverlappingRuns(
+  const ComponentRun* runs,
+  const T* row, unsigned int first, unsigned int end,
+  const T* other, unsigned int otherFirst, unsigned int otherEnd,
+  int reach, Unite unite)
+{
+  unsigned int j = otherFirst;
+  for (unsigned int i = first; i < end; i++)
+  {
+    const ComponentRun& a = runs[i];
+    while (j < otherEnd && runs[j].end + reach <= a.start)
+      j++;
+    for (unsigned int k = j; k < otherEnd && runs[k].start < a.end + reach; k++)
+    {
+      if (row[a.start] == other[runs[k].start])
+        unite(i, k);
+    }
+  }
+}
+
+// Flag marking the entries of the forest of labelComponentRuns that hold the label of a
+// component rather than the index of a parent.
+static const unsigned int LabelledRoot = 0x80000000u;
+
+// The runs of a volume and the label of each, from labelComponentRuns.
+template<typename U>
+struct ComponentRuns
+{
+  int width, height, depth;
+
+  // First slice of each slab that the volume was labelled in, then the depth
+  std::vector<int> slabStart;
+
+  // Index of the first run of each row, with row v of slice w at w*height + v, then the number of runs
+  ScratchBuffer<unsigned int> rowStart;
+
+  ScratchBuffer<ComponentRun> runs;
+  ScratchBuffer<U> labels;
+};
+
+// Finds the connected components of a volume as for findConnectedComponents3d, using up to
+// threadCount threads (zero for one per processor), giving the label of every run of the volume
+// rather than of every voxel. Returns the same statistics as findConnectedComponents3d.
+//
+// Each row is first reduced to its runs of voxels of one colour, and the forest has one entry per
+// run, in raster order, so the work and scratch memory of everything after that grow with the
+// number of runs rather than the number of voxels. Runs are united with the runs of the same
+// colour that they touch in the row above and the row behind and, for Edge and Vertex
+// connectivity, the rows above and below the row behind. Touching means overlapping, or for the
+// neighbours that Connectivity adds, being one voxel apart along the row. So the only tests of
+// the edges of the volume are whether each of those rows exists. Scratch memory is 12 bytes per
+// run and 4 per row, against 16 per voxel for Set.
+//
+// The volume is cut into slabs of slices, one per thread. Each slab is united on its own, then
+// the slices either side of each cut between slabs are united with uniteRootsConcurrently.
+// Labels are then numbered in raster order of the first voxel of each component, using the
+// number of components that start in each slab.
+//
+// If progress is not null, three units of work per slab are added to it, and cancellation is
+// checked between the steps.
+template<typename T, typename U, Connectivity C>
+std::vector<ComponentStatistics<T, U> > labelComponentRuns(
   int width,
   int height,
   int depth,
-  void* inputBuffer,  // of type T
+  const void* inputBuffer,  // of type T
   int inputLeap,
   int inputStride,
-  T backgroundColor, // TODO: Allow for no background color with a seperate function?
-  void* outputBuffer, // of type U
-  int outputLeap,
-  int outputStride,
-  U backgroundLabel)
+  T backgroundColor,
+  U backgroundLabel,
+  int threadCount,
+  ComponentRuns<U>& result,
+  OperationProgress* progress = nullptr)
 {
-  // This version faster, apparently because compiler doesn't realize that Set constructor
-  // is just zeroing memory.
-  std::vector<unsigned char> components_(width*height*depth*sizeof(Set<U>), 0);
-  Set<U>* components = (Set<U>*)(&components_[0]);
+  std::vector<ComponentStatistics<T, U> > statistics;
+  result.width = width;
+  result.height = height;
+  result.depth = depth;
+  if (width <= 0 || height <= 0 || depth <= 0)
+  {
+    result.slabStart.assign(1, 0);
+    result.rowStart.reset(1);
+    result.rowStart[0] = 0;
+    result.runs.clear();
+    result.labels.clear();
+    if (backgroundLabel == 0)
+      statistics.push_back({ 0, backgroundColor });
+    return statistics;
+  }
 
-  //std::vector<Set<U>> components_(width*height*depth);
-  //Set<U>* components = &components_[0];
+  auto inputRow = [&](int v, int w) { return (const T*)((const unsigned char*)inputBuffer + (size_t)w*inputLeap + (size_t)v*inputStride); };
 
-  // Vertex/edge/face connectivity version
-  //const int N = 13;
-  //const int du[] = { -1,  0,  1, -1,  0,  1, -1,  0,  1, -1, -1,  0,  1 };
-  //const int dv[] = { -1, -1, -1,  0,  0,  0,  1,  1,  1,  0, -1, -1, -1 };
-  //const int dw[] = { -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  0,  0,  0 };
+  const int slabCount = resolveThreadCount(threadCount, depth);
+  if (progress != nullptr)
+    progress->expect(3 * (long long)slabCount);
+  const long long voxels = (long long)width * height * depth;
+  InstrumentedStage runsStage("runs", voxels, slabCount);
+  std::vector<int>& slabStart = result.slabStart;
+  slabStart.resize(slabCount + 1);
+  for (int s = 0; s <= slabCount; s++)
+    slabStart[s] = (int)((long long)depth * s / slabCount);
 
-  // Face connectivity
-  const int N = 3; // back, left, up
-  const int du[] = { 0, -1,  0 };
-  const int dv[] = { 0,  0, -1 };
-  const int dw[] = { -1,  0,  0 };
+  // Index of the first run of each row, with row v of slice w at w*height + v, and the number of
+  // runs at the end. Like the other arrays of runs, it is first written by the thread of each
+  // slab, so that its pages are on the memory of the processor that uses them.
+  const size_t rowCount = (size_t)height * depth;
+  ScratchBuffer<unsigned int>& rowStart = result.rowStart;
+  rowStart.reset(rowCount + 1);
+  rowStart[0] = 0;
+  std::vector<std::vector<ComponentRun>> slabRuns(slabCount);
 
-  for (int w = 0; w < depth; w++)
+#pragma omp parallel num_threads(slabCount)
   {
-    for (int v = 0; v < height; v++)
+#pragma omp for schedule(static, 1)
+    for (int s = 0; s < slabCount; s++)
     {
-      T* p = (T*)((unsigned char*)inputBuffer + w*inputLeap + v*inputStride);
-      auto s = &components[w*width*height + v*width];
-      for (int u = 0; u < width; u++)
+      for (int w = slabStart[s]; w < slabStart[s + 1]; w++)
       {
-        if (*p != backgroundColor)
-        {
-          for (int i = 0; i < N; i++)
-          {
-            if (u + du[i] >= 0 && u + du[i] < width && v + dv[i] >= 0 && v + dv[i] < height && w + dw[i] >= 0 && w + dw[i] < depth) //  in range?
-            {
-              if (*((T*)((unsigned char*)p + dw[i] * inputLeap + dv[i] * inputStride) + du[i]) == *p)
-                s->unite(&components[(w + dw[i])*width*height + (v + dv[i])*width + u + du[i]]);
-              // DO NOT bail out here
-            }
-          }
-        }
-
-        p++;
-        s++;
+        for (int v = 0; v < height; v++)
+          rowStart[(size_t)w*height + v + 1] = extractRuns(inputRow(v, w), width, backgroundColor, slabRuns[s]);
       }
+      if (progress != nullptr)
+        progress->advance(1);
     }
   }
+  runsStage.stop();
 
-  // As a temporary measure, we'll generate a vector of counts over labels.
-  // Would probably be better to allow the caller to provide a generic
-  // statistics aggregation method e.g. f(x,y,z,label)
-  std::vector<ComponentStatistics<T,U> > statistics;
-
-  U label = 0;
+  if (progress != nullptr)
+    progress->throwIfCancelled();
 
-  if (label == backgroundLabel) // skip over reserved background label
+  InstrumentedStage uniteStage("union-find", voxels, slabCount);
+  size_t runCount = 0;
+  for (size_t r = 0; r < rowCount; r++)
   {
-    label++;
-    statistics.push_back({ 0,backgroundColor });
+    runCount += rowStart[r + 1];
+    if (runCount >= LabelledRoot)
+      throw std::exception("Volume is too large for connected component analysis.");
+    rowStart[r + 1] = (unsigned int)runCount;
   }
-  
-  for (int w = 0; w < depth; w++)
+
+  result.runs.reset(std::max<size_t>(runCount, 1));
+  result.labels.reset(result.runs.size());
+  ScratchBuffer<unsigned int> forest(result.runs.size());
+  ComponentRun* runs = &result.runs[0];
+  unsigned int* parent = &forest[0];
+
+  // Number of components whose first voxel is in each slab
+  std::vector<size_t> rootCount(slabCount + 1, 0);
+
+  auto unite = [parent](unsigned int i, unsigned int j) { uniteRoots(parent, i, j); };
+
+  // How far the runs of the row above and the row behind reach along the row, and that of the
+  // rows above and below the row behind, -1 if they are not neighbours
+  const int reach = C == Connectivity::Face ? 0 : 1;
+  const int diagonalReach = C == Connectivity::Face ? -1 : (C == Connectivity::Edge ? 0 : 1);
+
+  // Unites the runs of row v of slice w with those of the slice before that they touch, with
+  // uniteRootsConcurrently if concurrently is set
+  auto uniteBehind = [&](int v, int w, bool concurrently)
+  {
+    auto unite = [parent, concurrently](unsigned int i, unsigned int j)
+    {
+      if (concurrently)
+        uniteRootsConcurrently(parent, i, j);
+      else
+        uniteRoots(parent, i, j);
+    };
+    const size_t r = (size_t)w*height + v;
+    const T* p = inputRow(v, w);
+    uniteOverlappingRuns(runs, p, rowStart[r], rowStart[r + 1], inputRow(v, w - 1), rowStart[r - height], rowStart[r - height + 1], reach, unite);
+    if (diagonalReach >= 0 && v > 0)
+      uniteOverlappingRuns(runs, p, rowStart[r], rowStart[r + 1], inputRow(v - 1, w - 1), rowStart[r - height - 1], rowStart[r - height], diagonalReach, unite);
+    if (diagonalReach >= 0 && v + 1 < height)
+      uniteOverlappingRuns(runs, p, rowStart[r], rowStart[r + 1], inputRow(v + 1, w - 1), rowStart[r - height + 1], rowStart[r - height + 2], diagonalReach, unite);
+  };
+
+#pragma omp parallel num_threads(slabCount)
   {
-    for (int v = 0; v < height; v++)
+    // Unite each run with the runs it touches in the rows behind and the row above, within the slab
+#pragma omp for schedule(static, 1)
+    for (int s = 0; s < slabCount; s++)
     {
-      T* o = (T*)((unsigned char*)inputBuffer + w*inputLeap + v*inputStride);
-      U* p = (U*)((unsigned char*)outputBuffer + w*outputLeap + v*outputStride);
-      auto c = &components[w*width*height + v*width];
+      const unsigned int first = rowStart[(size_t)slabStart[s] * height];
+      std::copy(slabRuns[s].begin(), slabRuns[s].end(), runs + first);
+      std::vector<ComponentRun>().swap(slabRuns[s]);
 
-      for (int u = 0; u < width; u++)
+      for (int w = slabStart[s]; w < slabStart[s + 1]; w++)
       {
-        if (*o == backgroundColor)
+        for (int v = 0; v < height; v++)
         {
-          *p = backgroundLabel; // special reserved label
+          const size_t r = (size_t)w*height + v;
+          for (unsigned int i = rowStart[r]; i < rowStart[r + 1]; i++)
+            parent[i] = i;
+          if (w > slabStart[s])
+            uniteBehind(v, w, false);
+          if (v > 0)
+            uniteOverlappingRuns(runs, inputRow(v, w), rowStart[r], rowStart[r + 1], inputRow(v - 1, w), rowStart[r - 1], rowStart[r], reach, unite);
         }
-        else
+      }
+      if (progress != nullptr)
+        progress->advance(1);
+    }
+
+    // Unite the first slice of each slab with the last slice of the one before
+#pragma omp for schedule(static, 1)
+    for (int s = 1; s < slabCount; s++)
+    {
+      for (int v = 0; v < height; v++)
+        uniteBehind(v, slabStart[s], true);
+    }
+
+    // A run that is its own parent is the first run of a component
+#pragma omp for schedule(static, 1)
+    for (int s = 0; s < slabCount; s++)
+    {
+      const unsigned int first = rowStart[(size_t)slabStart[s] * height], end = rowStart[(size_t)slabStart[s + 1] * height];
+      size_t roots = 0;
+      for (unsigned int i = first; i < end; i++)
+        roots += parent[i] == i;
+      rootCount[s + 1] = roots;
+    }
+  }
+  uniteStage.stop();
+
+  if (progress != nullptr)
+    progress->throwIfCancelled();
+
+  InstrumentedStage relabelStage("relabel", voxels, slabCount);
+
+  // Labels in the order of the serial version, which skips the background label
+  for (int s = 0; s < slabCount; s++)
+    rootCount[s + 1] += rootCount[s];
+  const size_t componentCount = rootCount[slabCount];
+  const long long background = (long long)backgroundLabel;
+  auto labelOf = [background](size_t k) { return background >= 0 && (long long)k >= background ? (long long)k + 1 : (long long)k; };
+
+  const long long maximum = (long long)std::numeric_limits<U>::max();
+  if (componentCount > 0)
+  {
+    const long long last = labelOf(componentCount - 1);
+    if (last >= maximum || (last + 1 == background && background == maximum))
+      throw std::exception("Too many components during connected component analysis.");
+  }
+
+  const size_t labelCount = (size_t)labelOf(componentCount);
+  statistics.resize(labelCount, { 0, backgroundColor });
+
+  std::vector<std::vector<unsigned long>> counts(slabCount);
+
+#pragma omp parallel num_threads(slabCount)
+  {
+    // Replace the parent of each root with its label, and the parent of each run whose parent is
+    // in the same slab with that parent's entry. Ascending order means that the entry has already
+    // been replaced, so what is left is either a label or the index of a run in an earlier slab.
+    // Only entries of this slab are read or written.
+#pragma omp for schedule(static, 1)
+    for (int s = 0; s < slabCount; s++)
+    {
+      const unsigned int first = rowStart[(size_t)slabStart[s] * height];
+      size_t k = rootCount[s];
+      for (int w = slabStart[s]; w < slabStart[s + 1]; w++)
+      {
+        for (int v = 0; v < height; v++)
         {
-          auto root = c->find();
-          if (root->hasLabel_ == false)
+          const size_t r = (size_t)w*height + v;
+          const T* p = inputRow(v, w);
+          for (unsigned int i = rowStart[r]; i < rowStart[r + 1]; i++)
           {
-            root->label_ = label; // take the next available label
-            root->hasLabel_ = true;
-
-            if (label == std::numeric_limits<U>::max())
-              throw std::exception("Too many components during connected component analysis.");
-            label++;
-            statistics.push_back({ 0, *o });
-            if (label == backgroundLabel)
+            const unsigned int q = parent[i];
+            if (q == i)
             {
-              if (label == std::numeric_limits<U>::max())
-                throw std::exception("Too many components during connected component analysis.");
-              label++;
-              statistics.push_back({ 0,backgroundColor });
+              const size_t label = (size_t)labelOf(k++);
+              parent[i] = LabelledRoot | (unsigned int)label;
+              statistics[label].inputLabel_ = p[runs[i].start];
+            }
+            else if (q >= first)
+            {
+              parent[i] = parent[q];
             }
           }
-          *p = root->label_;
         }
+      }
+    }
+
+    // Every run takes the label at the end of its chain of entries, which is at most one step
+    // per slab long, and the voxels between runs are background
+#pragma omp for schedule(static, 1)
+    for (int s = 0; s < slabCount; s++)
+    {
+      std::vector<unsigned long>& count = counts[s];
+      count.resize(labelCount, 0);
+      size_t foregroundCount = 0;
+
+      const unsigned int first = rowStart[(size_t)slabStart[s] * height], end = rowStart[(size_t)slabStart[s + 1] * height];
+      for (unsigned int i = first; i < end; i++)
+      {
+        unsigned int q = parent[i];
+        while ((q & LabelledRoot) == 0)
+          q = parent[q];
+        const U label = (U)(q & ~LabelledRoot);
+        result.labels[i] = label;
+
+        const unsigned long length = runs[i].end - runs[i].start;
+        count[(size_t)label] += length;
+        foregroundCount += length;
+      }
+
+      if (background >= 0 && background < (long long)labelCount)
+        count[(size_t)background] += (unsigned long)((size_t)(slabStart[s + 1] - slabStart[s]) * height * width - foregroundCount);
+      if (progress != nullptr)
+        progress->advance(1);
+    }
+
+    // Total the counts of the slabs
+#pragma omp for schedule(static)
+    for (long long label = 0; label < (long long)labelCount; label++)
+    {
+      unsigned long total = 0;
+      for (int s = 0; s < slabCount; s++)
+        total += counts[s][(size_t)label];
+      statistics[(size_t)label].pixelCount_ = total;
+    }
+  }
+
+  return statistics;
+}
+
+// As findConnectedComponents3d, giving identical labels and statistics, using up to threadCount
+// threads (zero for one per processor), with labelComponentRuns. The statistics of policy S for
+// each label are returned in values, as for the vector returned. If progress is not null, four
+// units of work per slab are added to it, and cancellation is checked between the steps.
+template<typename T, typename U, Connectivity C, typename S>
+std::vector<ComponentStatistics<T, U> > findConnectedComponents3dParallel(
+  int width,
+  int height,
+  int depth,
+  void* inputBuffer,  // of type T
+  int inputLeap,
+  int inputStride,
+  T backgroundColor,
+  void* outputBuffer, // of type U
+  int outputLeap,
+  int outputStride,
+  U backgroundLabel,
+  int threadCount,
+  const S& policy,
+  std::vector<typename S::Value>& values,
+  OperationProgress* progress = nullptr)
+{
+  // Expected before labelComponentRuns adds its own, so that the fraction done only grows
+  if (progress != nullptr && width > 0 && height > 0 && depth > 0)
+    progress->expect(resolveThreadCount(threadCount, depth));
 
-        statistics[*p].pixelCount_++; // Could do more interesting statistics here such as centroid, rotational inertia, etc....
+  ComponentRuns<U> runs;
+  std::vector<ComponentStatistics<T, U> > statistics = labelComponentRuns<T, U, C>(
+    width, height, depth, inputBuffer, inputLeap, inputStride, backgroundColor, backgroundLabel, threadCount, runs, progress);
 
-        o++;
-        p++;
-        c++;
+  const int slabCount = (int)runs.slabStart.size() - 1;
+  const size_t labelCount = statistics.size();
+  if (slabCount <= 0)
+  {
+    values.assign(labelCount, typename S::Value());
+    return statistics;
+  }
+  if (progress != nullptr)
+    progress->throwIfCancelled();
+
+  std::vector<std::vector<typename S::Value>> slabValues(slabCount);
+  InstrumentedStage writeStage("write labels", (long long)width * height * depth, slabCount);
+
+  // Each run is written with its label, and the voxels between runs with the background label
+#pragma omp parallel for num_threads(slabCount) schedule(static, 1)
+  for (int s = 0; s < slabCount; s++)
+  {
+    std::vector<typename S::Value>& value = slabValues[s];
+    value.resize(labelCount);
+
+    for (int w = runs.slabStart[s]; w < runs.slabStart[s + 1]; w++)
+    {
+      for (int v = 0; v < height; v++)
+      {
+        const size_t r = (size_t)w*height + v;
+        U* o = (U*)((unsigned char*)outputBuffer + (size_t)w*outputLeap + (size_t)v*outputStride);
+        int u = 0;
+        for (unsigned int i = runs.rowStart[r]; i < runs.rowStart[r + 1]; i++)
+        {
+          const ComponentRun& run = runs.runs[i];
+          const U label = runs.labels[i];
+          std::fill(o + u, o + run.start, backgroundLabel);
+          std::fill(o + run.start, o + run.end, label);
+          policy.addRun(value[(size_t)label], run.start, run.end, v, w);
+          u = run.end;
+        }
+        std::fill(o + u, o + width, backgroundLabel);
       }
     }
+    if (progress != nullptr)
+      progress->advance(1);
+  }
+
+  // Merge the values of the slabs in raster order
+  values.swap(slabValues[0]);
+  for (int s = 1; s < slabCount; s++)
+  {
+    for (size_t label = 0; label < labelCount; label++)
+      S::merge(values[label], slabValues[s][label]);
   }
 
   return statistics;
 }
+
+template<typename T, typename U, Connectivity C = Connectivity::Face>
+std::vector<ComponentStatistics<T, U> > findConnectedComponents3dParallel(
+  int width,
+  int height,
+  int depth,
+  void* inputBuffer,  // of type T
+  int inputLeap,
+  int inputStride,
+  T backgroundColor,
+  void* outputBuffer, // of type U
+  int outputLeap,
+  int outputStride,
+  U backgroundLabel,
+  int threadCount = 0)
+{
+  std::vector<NoComponentStatistics::Value> values;
+  return findConnectedComponents3dParallel<T, U, C>(width, height, depth, inputBuffer, inputLeap, inputStride,
+    backgroundColor, outputBuffer, outputLeap, outputStride, backgroundLabel, threadCount, NoComponentStatistics(), values);
+}
+
+// Find connected components in 3D volume using one pass unite-find approach and
+// label associated voxels in output volume. Voxels with the specified background colour
+// are all assigned the background label. Components are numbered in raster order of their
+// first voxel. Voxels are connected to the neighbours given by C. Runs on one thread, with the run
+// based forest of findConnectedComponents3dParallel.
+// Returns a vector of statistics per connected component.
+template<typename T, typename U, Connectivity C = Connectivity::Face>
+std::vector<ComponentStatistics<T, U> > findConnectedComponents3d(
+  int width,
+  int height,
+  int depth,
+  void* inputBuffer,  // of type T
+  int inputLeap,
+  int inputStride,
+  T backgroundColor, // TODO: Allow for no background color with a seperate function?
+  void* outputBuffer, // of type U
+  int outputLeap,
+  int outputStride,
+  U backgroundLabel)
+{
+  return findConnectedComponents3dParallel<T, U, C>(width, height, depth, inputBuffer, inputLeap, inputStride,
+    backgroundColor, outputBuffer, outputLeap, outputStride, backgroundLabel, 1);
+}
 }
\ No newline at end of file
@@ -0,0 +1,506 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <math.h>
+
+#include "parallel.h"
+
+namespace createdataset
+{
+  // Contours of masks slice by slice, and the filling of polygons back into volumes, as
+  // ExtractContours and FillPolygon in InnerEye.CreateDataset.Contours do them, with the same
+  // points and the same filled voxels. Slices are read and written in place, where pixel x, y of
+  // a slice is at buffer + y*stride + x*hop, and processed in parallel.
+
+  // The orientation of slices through a volume: axial slices are x by y at fixed z, coronal x by
+  // z at fixed y, and sagittal y by z at fixed x, as for ExtractSlice.
+  enum class SliceAxis
+  {
+    Axial,
+    Coronal,
+    Sagittal
+  };
+
+  // The first pixel, row stride and pixel hop of slice index of a volume where voxel x, y, z is at
+  // buffer + z*leap + y*stride + x*hop, and the width and height of the slice.
+  inline void sliceLayout(
+    int width, int height, int depth, int leap, int stride, int hop,
+    SliceAxis axis, int index,
+    size_t& offset, size_t& sliceStride, size_t& sliceHop, int& sliceWidth, int& sliceHeight)
+  {
+    switch (axis)
+    {
+    case SliceAxis::Axial:
+      offset = (size_t)index * leap; sliceStride = stride; sliceHop = hop; sliceWidth = width; sliceHeight = height;
+      break;
+    case SliceAxis::Coronal:
+      offset = (size_t)index * stride; sliceStride = leap; sliceHop = hop; sliceWidth = width; sliceHeight = depth;
+      break;
+    default:
+      offset = (size_t)index * hop; sliceStride = leap; sliceHop = stride; sliceWidth = height; sliceHeight = depth;
+      break;
+    }
+  }
+
+  // Scanline filling of polygons with float vertices, after http://alienryderflex.com/polygon_fill/.
+  // Each row y is cut at y - epsilon and y + epsilon, so that pixels on horizontal edges and at
+  // vertices are inside, and the pixels between merged pairs of cuts are spans of the polygon.
+  class PolygonScanner
+  {
+  public:
+    // Calls span(y, first, last) for each span of pixels of the rows from 0 to height - 1 that
+    // the polygon of count points xs, ys covers, clipped to 0 to width - 1.
+    template<typename Span>
+    void scan(const float* xs, const float* ys, int count, int width, int height, Span span)
+    {
+      if (count <= 0)
+        throw std::exception("The polygon does not contain any points.");
+
+      float minimumY = std::numeric_limits<float>::max(), maximumY = std::numeric_limits<float>::lowest();
+      for (int i = 0; i < count; i++)
+      {
+        minimumY = std::min(minimumY, ys[i]);
+        maximumY = std::max(maximumY, ys[i]);
+      }
+      // As RectangleF.Bottom finds it
+      const float top = minimumY, bottom = minimumY + (maximumY - minimumY);
+
+      const float epsilon = 0.01f;
+      cuts_.resize((size_t)count * 2);
+      nodes_.resize(count);
+      for (int y = 0; y < height; y++)
+      {
+        const float plusEpsilon = y + epsilon, minusEpsilon = y - epsilon;
+        if ((plusEpsilon < top && minusEpsilon < top) || (plusEpsilon > bottom && minusEpsilon > bottom))
+          continue;
+
+        const int nodeCount = merge(intersect(xs, ys, count, (float)y, plusEpsilon, minusEpsilon));
+        for (int i = 0; i < nodeCount; i += 2)
+        {
+          const int first = std::max(0, (int)ceil(nodes_[i] - (double)epsilon));
+          int last = (int)(nodes_[i + 1] + (double)epsilon);
+          if (first >= width)
+            break;
+          if (last >= 0)
+          {
+            if (last >= width)
+              last = width - 1;
+            if (first <= last)
+              span(y, first, last);
+          }
+        }
+      }
+    }
+
+  private:
+    struct Cut
+    {
+      float x;
+      bool plusEpsilon;
+    };
+
+    // The cuts of the edges of the polygon by the lines y + epsilon and y - epsilon, sorted by x
+    // with ties in the order found
+    int intersect(const float* xs, const float* ys, int count, float y, float plusEpsilon, float minusEpsilon)
+    {
+      int cutCount = 0;
+      float xj = xs[count - 1], yj = ys[count - 1];
+      for (int i = 0; i < count; i++)
+      {
+        const float xi = xs[i], yi = ys[i];
+        if (yi != yj)
+        {
+          if ((yi < plusEpsilon && yj >= plusEpsilon) || (yj < plusEpsilon && yi >= plusEpsilon))
+          {
+            cuts_[cutCount].x = xi + (y - yi) / (yj - yi) * (xj - xi);
+            cuts_[cutCount++].plusEpsilon = true;
+          }
+          if ((yi < minusEpsilon && yj >= minusEpsilon) || (yj < minusEpsilon && yi >= minusEpsilon))
+          {
+            cuts_[cutCount].x = xi + (y - yi) / (yj - yi) * (xj - xi);
+            cuts_[cutCount++].plusEpsilon = false;
+          }
+        }
+        xj = xi;
+        yj = yi;
+      }
+
+      std::stable_sort(cuts_.begin(), cuts_.begin() + cutCount, [](const Cut& a, const Cut& b) { return a.x < b.x; });
+      return cutCount;
+    }
+
+    // Pairs of cuts into the nodes that start and end spans: a span starts at the first cut of
+    // either line and ends where both lines have been crossed back out
+    int merge(int cutCount)
+    {
+      enum State { Background, Bottom, Top, Inside };
+      State state = Background;
+      int nodeCount = 0;
+      for (int i = 0; i < cutCount; i++)
+      {
+        const Cut& cut = cuts_[i];
+        switch (state)
+        {
+        case Background:
+          nodes_[nodeCount++] = cut.x;
+          state = cut.plusEpsilon ? Top : Bottom;
+          break;
+        case Bottom:
+          if (cut.plusEpsilon)
+            state = Inside;
+          else
+          {
+            nodes_[nodeCount++] = cut.x;
+            state = Background;
+          }
+          break;
+        case Top:
+          if (cut.plusEpsilon)
+          {
+            nodes_[nodeCount++] = cut.x;
+            state = Background;
+          }
+          else
+            state = Inside;
+          break;
+        case Inside:
+          state = cut.plusEpsilon ? Bottom : Top;
+          break;
+        }
+      }
+      return nodeCount;
+    }
+
+    std::vector<Cut> cuts_;
+    std::vector<float> nodes_;
+  };
+
+  // A closed polygon traced around a region of a slice, as PolygonPoints holds it.
+  struct TracedPolygon
+  {
+    std::vector<int> points;   // x and y of each point in turn
+    unsigned int foreground;   // voxels inside, on the polygon or within, of the region's own value
+    unsigned int other;        // and of the other value, so holes or inserts if non-zero
+    unsigned short id;         // numbered from one in the order found
+    unsigned short insideOf;   // the polygon inside which it was found, or zero
+    bool inner;                // true for the boundary of a hole, which runs counterclockwise
+    int startX, startY;        // the first point, at the least y
+    int nestingLevel;          // zero for the outermost polygons
+    int outer;                 // for a hole, the index of its outer polygon; -1 otherwise
+  };
+
+  // Traces the polygons around the regions of pixels of a slice equal to a foreground value, with
+  // the polygons round holes within them and round inserts within those holes in turn, exactly as
+  // ExtractContours.PolygonsWithHoles does: the same points, counts and order of polygons. Each
+  // instance keeps the image of polygon ids of one slice, so one instance serves one thread.
+  class PolygonTracer
+  {
+  public:
+    // Fills polygons with those of the slice of width * height pixels, where pixel x, y is at
+    // buffer + y*stride + x*hop, up to maxNestingLevel levels of holes and inserts. Polygons in
+    // the order of ExtractContours: outer polygons are those with outer -1, each followed in
+    // order of the list by the holes that name it.
+    void trace(
+      int width, int height,
+      const unsigned char* buffer, size_t stride, size_t hop,
+      unsigned char foregroundColor,
+      int maxNestingLevel,
+      std::vector<TracedPolygon>& polygons)
+    {
+      width_ = width;
+      height_ = height;
+      buffer_ = buffer;
+      stride_ = stride;
+      hop_ = hop;
+      foreground_ = foregroundColor;
+      polygons.clear();
+      found_.assign((size_t)width * height, 0);
+      if (width <= 0 || height <= 0)
+        return;
+
+      // Ids of the polygons with holes or inserts left to search, last found first
+      std::vector<unsigned short> withHoles;
+      const auto pushIfHolesPresent = [&](size_t first)
+      {
+        for (size_t i = first; i < polygons.size(); i++)
+        {
+          if (polygons[i].other > 0)
+            withHoles.push_back(polygons[i].id);
+        }
+      };
+
+      extractPolygons(0, false, polygons);
+      pushIfHolesPresent(0);
+      while (!withHoles.empty())
+      {
+        const unsigned short parentId = withHoles.back();
+        withHoles.pop_back();
+        const TracedPolygon& parent = polygons[parentId - 1];
+        if (parent.nestingLevel >= maxNestingLevel)
+          continue;
+
+        // Inside the polygon, what is background in it is now foreground
+        const int nestingLevel = parent.nestingLevel + 1;
+        const bool inner = !parent.inner;
+        const size_t first = polygons.size();
+        extractPolygons(parentId, inner, polygons);
+        for (size_t i = first; i < polygons.size(); i++)
+        {
+          polygons[i].nestingLevel = nestingLevel;
+          polygons[i].outer = inner ? parentId - 1 : -1;
+        }
+        pushIfHolesPresent(first);
+      }
+    }
+
+  private:
+    // 1 for the foreground, 0 for the rest
+    unsigned char binary(int x, int y) const
+    {
+      return buffer_[(size_t)y * stride_ + (size_t)x * hop_] == foreground_ ? 1 : 0;
+    }
+
+    // Adds the polygons found inside polygon searchInside (or anywhere, for zero), around
+    // regions of value 0 if inner and 1 otherwise, numbering them on from the last
+    void extractPolygons(unsigned short searchInside, bool inner, std::vector<TracedPolygon>& polygons)
+    {
+      const unsigned char foreground = inner ? 0 : 1;
+      for (int y = 0; y < height_; y++)
+      {
+        for (int x = 0; x < width_; x++)
+        {
+          if (binary(x, y) != foreground || found_[(size_t)y * width_ + x] != searchInside)
+            continue;
+
+          if (polygons.size() >= std::numeric_limits<unsigned short>::max())
+            throw std::exception("There are too many polygons in a slice.");
+
+          TracedPolygon polygon;
+          polygon.id = (unsigned short)(polygons.size() + 1);
+          polygon.insideOf = searchInside;
+          polygon.inner = inner;
+          polygon.startX = x;
+          polygon.startY = inner ? y - 1 : y;
+          polygon.nestingLevel = 0;
+          polygon.outer = -1;
+          if (inner)
+          {
+            // The hole is filled by the polygon round its own pixels, and its contour runs round
+            // it through the foreground pixels, starting in the row above
+            findPolygon(searchInside, x, y, 1, true, points_);
+            fillAndCount(points_, polygon.id, 0, polygon.foreground, polygon.other);
+            findPolygon(searchInside, x, y - 1, 0, false, polygon.points);
+          }
+          else
+          {
+            findPolygon(searchInside, x, y, 0, true, polygon.points);
+            fillAndCount(polygon.points, polygon.id, foreground, polygon.foreground, polygon.other);
+          }
+          polygons.push_back(std::move(polygon));
+        }
+      }
+    }
+
+    // Walks the boundary from the start point through the 8 neighbours that are not background
+    // and lie in polygon searchInside, clockwise or counterclockwise, until back at the start
+    void findPolygon(unsigned short searchInside, int startX, int startY, unsigned char background, bool clockwise, std::vector<int>& contour) const
+    {
+      static const int dx[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+      static const int dy[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+      contour.clear();
+      int direction = clockwise ? 0 : 2;
+      int currentX = startX, currentY = startY;
+      for (;;)
+      {
+        contour.push_back(currentX);
+        contour.push_back(currentY);
+
+        int nextX = currentX, nextY = currentY;
+        for (int i = 0; i < 7; i++)
+        {
+          const int x = currentX + dx[direction], y = currentY + dy[direction];
+          if (x < 0 || x >= width_ || y < 0 || y >= height_ || binary(x, y) == background || found_[(size_t)y * width_ + x] != searchInside)
+          {
+            direction = (direction + 1) % 8;
+          }
+          else
+          {
+            nextX = x;
+            nextY = y;
+            break;
+          }
+        }
+
+        // Back two from the direction found, for the next search
+        direction = (direction + 6) % 8;
+        const bool done = nextX == startX && nextY == startY;
+        currentX = nextX;
+        currentY = nextY;
+        if (done)
+          break;
+      }
+    }
+
+    // Marks the pixels on and within the polygon with id, counting those newly marked of binary
+    // value foreground and of the other value, as FillPolygon.FillPolygonAndCount does
+    void fillAndCount(const std::vector<int>& points, unsigned short id, unsigned char foreground, unsigned int& foregroundCount, unsigned int& otherCount)
+    {
+      foregroundCount = 0;
+      otherCount = 0;
+      const auto mark = [&](int x, int y)
+      {
+        unsigned short& f = found_[(size_t)y * width_ + x];
+        if (f != id)
+        {
+          f = id;
+          if (binary(x, y) == foreground)
+            foregroundCount++;
+          else
+            otherCount++;
+        }
+      };
+
+      const int count = (int)points.size() / 2;
+      xs_.resize(count);
+      ys_.resize(count);
+      for (int i = 0; i < count; i++)
+      {
+        mark(points[2 * i], points[2 * i + 1]);
+        xs_[i] = (float)points[2 * i];
+        ys_[i] = (float)points[2 * i + 1];
+      }
+
+      scanner_.scan(&xs_[0], &ys_[0], count, width_, height_, [&](int y, int first, int last)
+      {
+        for (int x = first; x <= last; x++)
+          mark(x, y);
+      });
+    }
+
+    int width_ = 0, height_ = 0;
+    const unsigned char* buffer_ = nullptr;
+    size_t stride_ = 0, hop_ = 0;
+    unsigned char foreground_ = 0;
+    std::vector<unsigned short> found_;
+    std::vector<int> points_;
+    std::vector<float> xs_, ys_;
+    PolygonScanner scanner_;
+  };
+
+  // The polygons of each of the slices from firstSlice to lastSlice along axis of a byte volume
+  // where voxel x, y, z is at buffer + z*leap + y*stride + x*hop, traced by PolygonTracer, in
+  // parallel over slices with up to threadCount threads. polygons[i] is those of slice
+  // firstSlice + i.
+  inline void tracePolygonsPerSlice(
+    int width, int height, int depth,
+    const unsigned char* buffer, int leap, int stride, int hop,
+    SliceAxis axis, int firstSlice, int lastSlice,
+    unsigned char foregroundColor,
+    int maxNestingLevel,
+    std::vector<std::vector<TracedPolygon>>& polygons,
+    int threadCount = 0)
+  {
+    const int slices = std::max(lastSlice - firstSlice + 1, 0);
+    polygons.assign(slices, std::vector<TracedPolygon>());
+
+    // Exceptions must not leave a parallel region, so the first failure is raised after it
+    std::vector<char> failed(slices, 0);
+    std::vector<std::string> messages(slices);
+#pragma omp parallel num_threads(resolveThreadCount(threadCount, slices))
+    {
+      PolygonTracer tracer;
+
+#pragma omp for schedule(dynamic)
+      for (int i = 0; i < slices; i++)
+      {
+        size_t offset, sliceStride, sliceHop;
+        int sliceWidth, sliceHeight;
+        sliceLayout(width, height, depth, leap, stride, hop, axis, firstSlice + i, offset, sliceStride, sliceHop, sliceWidth, sliceHeight);
+        try
+        {
+          tracer.trace(sliceWidth, sliceHeight, buffer + offset, sliceStride, sliceHop, foregroundColor, maxNestingLevel, polygons[i]);
+        }
+        catch (std::exception& oops)
+        {
+          failed[i] = 1;
+          messages[i] = oops.what();
+        }
+      }
+    }
+
+    for (int i = 0; i < slices; i++)
+    {
+      if (failed[i])
+        throw std::exception(messages[i].c_str());
+    }
+  }
+
+  // Writes value to every voxel of axial slice slices[p] of a volume of type T, where voxel
+  // x, y, z is at buffer + z*leap + y*stride + x*hop, on or within polygon p for each of
+  // polygonCount polygons, as FillPolygon.Fill does. Polygon p has the points from
+  // starts[p] to starts[p + 1] - 1 of xs and ys. Slices are filled in parallel with up to
+  // threadCount threads, and the polygons of one slice in order.
+  template<typename T>
+  void fillPolygonsPerSlice(
+    int width, int height, int depth,
+    unsigned char* buffer, int leap, int stride, int hop,
+    const float* xs, const float* ys,
+    const int* starts, const int* slices, int polygonCount,
+    T value,
+    int threadCount = 0)
+  {
+    for (int p = 0; p < polygonCount; p++)
+    {
+      if (slices[p] < 0 || slices[p] >= depth)
+        throw std::exception("The slice of a polygon must be within the volume.");
+      if (starts[p + 1] <= starts[p])
+        throw std::exception("The polygon does not contain any points.");
+    }
+
+    // The polygons grouped by slice, keeping their order within each
+    std::vector<int> order(polygonCount);
+    for (int p = 0; p < polygonCount; p++)
+      order[p] = p;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return slices[a] < slices[b]; });
+    std::vector<int> groups;
+    for (int i = 0; i < polygonCount; i++)
+    {
+      if (i == 0 || slices[order[i]] != slices[order[i - 1]])
+        groups.push_back(i);
+    }
+    const int groupCount = (int)groups.size();
+    groups.push_back(polygonCount);
+
+#pragma omp parallel num_threads(resolveThreadCount(threadCount, groupCount))
+    {
+      PolygonScanner scanner;
+
+#pragma omp for schedule(dynamic)
+      for (int g = 0; g < groupCount; g++)
+      {
+        for (int i = groups[g]; i < groups[g + 1]; i++)
+        {
+          const int p = order[i];
+          unsigned char* slice = buffer + (size_t)slices[p] * leap;
+          scanner.scan(xs + starts[p], ys + starts[p], starts[p + 1] - starts[p], width, height, [&](int y, int first, int last)
+          {
+            unsigned char* row = slice + (size_t)y * stride;
+            for (int x = first; x <= last; x++)
+              *(T*)(row + (size_t)x * hop) = value;
+          });
+        }
+      }
+    }
+  }
+}
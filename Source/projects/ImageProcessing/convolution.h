@@ -13,7 +13,10 @@
 
 #include <omp.h>
 
-#include "SseConvolver.h"
+#include "AlignmentAllocator.h"
+#include "RowConvolver.h"
+#include "parallel.h"
+#include "progress.h"
 
 namespace createdataset
 {
@@ -78,95 +81,392 @@ namespace createdataset
     }
   }
 
-  // Convolve 2D image of pixel type T with 1D kernel using multiple threads
-  template<typename T, typename float(*Reader)(const T*) = readerT<T>, typename void(*Writer)(float, T*)=writerT<T> >
-  void convolve(
-    int width, int height,
-    unsigned char* buffer, int hop, int stride,
-    const float* kernel, int kernelRadius  )
+  // Maps position u onto [0, length) by reflecting about the edges of the row (so that -1 maps
+  // to 0 and length maps to length-1), repeatedly if the row is shorter than the kernel.
+  inline int mirrorIndex(int u, int length)
   {
-    const int threadCount = omp_get_max_threads();
+    const int period = 2 * length;
+    u %= period;
+    if (u < 0)
+      u += period;
+    return u < length ? u : period - 1 - u;
+  }
 
-    struct ThreadData {
-      ThreadData(int width, const float* kernel, int kernelRadius) :
-        inputRow(width+2*kernelRadius), outputRow(width) /*, convolver(kernel, 2 * kernelRadius + 1, width)*/
-      {
-      }
+  // A box of voxels from minimum to maximum inclusive along each axis, as Region3D in C#. The
+  // region is empty if any maximum is less than the corresponding minimum.
+  struct Region3d
+  {
+    Region3d(int minimumX, int minimumY, int minimumZ, int maximumX, int maximumY, int maximumZ) :
+      minimumX(minimumX), minimumY(minimumY), minimumZ(minimumZ), maximumX(maximumX), maximumY(maximumY), maximumZ(maximumZ)
+    {
+    }
 
-      std::vector<float> inputRow;
-      std::vector<float> outputRow;
-      //SseConvolver convolver;
-    };
+    // The whole of a volume of the given dimensions.
+    Region3d(int width, int height, int depth) :
+      minimumX(0), minimumY(0), minimumZ(0), maximumX(width - 1), maximumY(height - 1), maximumZ(depth - 1)
+    {
+    }
 
-    std::vector<std::shared_ptr<ThreadData>> data(threadCount);
-    for (int i = 0; i < threadCount; i++)
-      data[i] = std::shared_ptr<ThreadData>(new ThreadData(width, kernel, kernelRadius));
+    int getWidth() const { return maximumX - minimumX + 1; }
+    int getHeight() const { return maximumY - minimumY + 1; }
+    int getDepth() const { return maximumZ - minimumZ + 1; }
+
+    bool isEmpty() const { return getWidth() <= 0 || getHeight() <= 0 || getDepth() <= 0; }
+
+    // True if the region is empty or lies inside a volume of the given dimensions.
+    bool isInside(int width, int height, int depth) const
+    {
+      return isEmpty() || (minimumX >= 0 && minimumY >= 0 && minimumZ >= 0 && maximumX < width && maximumY < height && maximumZ < depth);
+    }
+
+    bool isWhole(int width, int height, int depth) const
+    {
+      return minimumX == 0 && minimumY == 0 && minimumZ == 0 && maximumX == width - 1 && maximumY == height - 1 && maximumZ == depth - 1;
+    }
+
+    int minimumX, minimumY, minimumZ, maximumX, maximumY, maximumZ;
+  };
+
+  // Scratch space for one thread convolving rows or tiles of length samples with one kernel.
+  // Allocated once per thread for a whole image or volume, rather than once per slice.
+  struct ConvolutionScratch
+  {
+    ConvolutionScratch(int length, const float* kernel, int kernelRadius, ConvolutionMode mode, bool tiled) :
+      inputRow(tiled ? 0 : length + 2 * kernelRadius), outputRow(tiled ? 0 : length),
+      inputTile(tiled ? (length + 2 * kernelRadius) * RowConvolver::TileWidth : 0), outputTile(tiled ? length * RowConvolver::TileWidth : 0),
+      convolver(createRowConvolver(mode, kernel, 2 * kernelRadius + 1, length + 2 * kernelRadius)),
+      length(length), kernelRadius(kernelRadius), tiled(tiled)
+    {
+    }
+
+    // As above, with a copy of a convolver for rows of length + 2 * kernelRadius samples.
+    ConvolutionScratch(int length, int kernelRadius, const RowConvolver& prototype, bool tiled) :
+      inputRow(tiled ? 0 : length + 2 * kernelRadius), outputRow(tiled ? 0 : length),
+      inputTile(tiled ? (length + 2 * kernelRadius) * RowConvolver::TileWidth : 0), outputTile(tiled ? length * RowConvolver::TileWidth : 0),
+      convolver(prototype.clone()),
+      length(length), kernelRadius(kernelRadius), tiled(tiled)
+    {
+    }
+
+    // Whether the buffers are the size for rows or tiles of length samples and this kernel radius.
+    // The convolver may still be for another kernel or mode.
+    bool fits(int length, int kernelRadius, bool tiled) const
+    {
+      return this->length == length && this->kernelRadius == kernelRadius && this->tiled == tiled;
+    }
 
-#pragma omp parallel for num_threads(threadCount)
-    for (int v = 0; v < height; v++)
+    std::vector<float> inputRow;
+    std::vector<float> outputRow;
+    std::vector<float, AlignmentAllocator<float, 64>> inputTile;
+    std::vector<float, AlignmentAllocator<float, 64>> outputTile;
+    std::unique_ptr<RowConvolver> convolver;
+    int length;
+    int kernelRadius;
+    bool tiled;
+  };
+
+  // Convolve one row of length pixels of type T, hop bytes apart, in place.
+  template<typename T, typename float(*Reader)(const T*), typename void(*Writer)(float, T*)>
+  void convolveRow(ConvolutionScratch& t, int length, unsigned char* row, int hop, int kernelRadius)
+  {
+    float* p = &(t.inputRow[kernelRadius]);
+    const unsigned char* q = row;
+    for (int u = 0; u < length; u++)
     {
-      int rank = omp_get_thread_num();
-      ThreadData& t = *data[rank];
+      *p++ = Reader((T*)(q));
+      q += hop;
+    }
+    // mirror edges
+    for (int u = 0; u < kernelRadius; u++)
+    {
+      t.inputRow[kernelRadius - 1 - u] = t.inputRow[kernelRadius + mirrorIndex(-1 - u, length)];
+      t.inputRow[kernelRadius + length + u] = t.inputRow[kernelRadius + mirrorIndex(length + u, length)];
+    }
+
+    // Do the 1D convolution
+    t.convolver->convolve(&(t.inputRow[0]), &(t.outputRow[0]));
 
-      float* p = &(t.inputRow[kernelRadius]);
-      const unsigned char* q = buffer + v*stride;
-      for (int u = 0; u < width; u++)
+    // Copy the result back to the input volume
+    unsigned char* r = row;
+    const float * s = &t.outputRow[0];
+    for (int u = 0; u < length; u++)
+    {
+      Writer(*s++, (T*)(r));
+      r += hop;
+    }
+  }
+
+  // Convolve up to RowConvolver::TileWidth neighbouring columns of length pixels of type T in
+  // place, starting at first. Pixels are step bytes apart along a column and hop bytes apart
+  // across it. Each tile is gathered into a buffer with the columns side by side, so every
+  // read from the image touches a run of contiguous pixels rather than a single pixel per
+  // cache line when step is large.
+  template<typename T, typename float(*Reader)(const T*), typename void(*Writer)(float, T*)>
+  void convolveTile(ConvolutionScratch& t, int length, int columns, unsigned char* first, int step, int hop, int kernelRadius)
+  {
+    const int W = RowConvolver::TileWidth;
+
+    for (int u = 0; u < length; u++)
+    {
+      float* p = &(t.inputTile[(kernelRadius + u) * W]);
+      const unsigned char* q = first + u*step;
+      for (int j = 0; j < columns; j++)
       {
         *p++ = Reader((T*)(q));
         q += hop;
       }
-      // mirror edges
-      for (int u = 0; u < kernelRadius; u++)
+    }
+    // mirror edges; lanes beyond columns in a partial tile are ignored
+    for (int u = 0; u < kernelRadius; u++)
+    {
+      std::copy_n(&t.inputTile[(kernelRadius + mirrorIndex(-1 - u, length)) * W], W, &t.inputTile[(kernelRadius - 1 - u) * W]);
+      std::copy_n(&t.inputTile[(kernelRadius + mirrorIndex(length + u, length)) * W], W, &t.inputTile[(kernelRadius + length + u) * W]);
+    }
+
+    t.convolver->convolveTile(&(t.inputTile[0]), &(t.outputTile[0]));
+
+    // Copy the result back to the input volume
+    for (int u = 0; u < length; u++)
+    {
+      unsigned char* r = first + u*step;
+      const float* s = &t.outputTile[u * W];
+      for (int j = 0; j < columns; j++)
+      {
+        Writer(*s++, (T*)(r));
+        r += hop;
+      }
+    }
+  }
+
+  // Scratch space for each thread of a parallel loop, indexed by OpenMP thread number. Each
+  // thread creates its own entry the first time it needs one, or when the length, kernel radius or
+  // layout changes, and otherwise keeps its buffers and takes a fresh copy of the prototype, so a
+  // workspace can be kept and reused by later calls with any kernel, filter or mode.
+  typedef std::vector<std::unique_ptr<ConvolutionScratch>> ConvolutionWorkspace;
+
+  // Makes the entries of workspace for threadCount threads ready to convolve rows or tiles of
+  // length samples with a copy of prototype. Called before the parallel region, since memory that
+  // cannot be allocated inside one ends the process rather than throwing to the caller.
+  inline void prepareWorkspace(ConvolutionWorkspace& workspace, int threadCount,
+    int length, int kernelRadius, const RowConvolver& prototype, bool tiled)
+  {
+    if ((int)workspace.size() < threadCount)
+      workspace.resize(threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+      std::unique_ptr<ConvolutionScratch>& t = workspace[i];
+      if (!t || !t->fits(length, kernelRadius, tiled))
+        t.reset(new ConvolutionScratch(length, kernelRadius, prototype, tiled));
+      else
+        t->convolver = prototype.clone();
+    }
+  }
+
+  // Convolve the rows of a stack of 2D images of pixel type T using multiple threads, with a copy
+  // of prototype for each thread, which must be for rows of length + 2 * kernelRadius samples.
+  // Row v of image s starts at buffer + s*pitch + v*stride and has length pixels hop bytes apart.
+  // All rows of all images are shared out in one parallel loop, so there is one fork and join and
+  // one set of scratch buffers per thread for the whole stack.
+  template<typename T, typename float(*Reader)(const T*), typename void(*Writer)(float, T*)>
+  void convolveRows(
+    int length, int rows, int images,
+    unsigned char* buffer, int hop, int stride, int pitch,
+    const RowConvolver& prototype, int kernelRadius,
+    int threadCount, ConvolutionWorkspace& workspace)
+  {
+    if (length <= 0 || rows <= 0 || images <= 0)
+      return;
+
+    const int count = rows * images;
+    threadCount = resolveThreadCount(threadCount, count);
+    prepareWorkspace(workspace, threadCount, length, kernelRadius, prototype, false);
+
+#pragma omp parallel num_threads(threadCount)
+    {
+      ConvolutionScratch& t = *workspace[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+      for (int i = 0; i < count; i++)
       {
-        t.inputRow[kernelRadius - 1 - u] = t.inputRow[kernelRadius + u ];
-        t.inputRow[kernelRadius + width + u] = t.inputRow[kernelRadius + width - 1 - u];
+        const int s = i / rows, v = i % rows;
+        convolveRow<T, Reader, Writer>(t, length, buffer + (size_t)s*pitch + (size_t)v*stride, hop, kernelRadius);
       }
+    }
+  }
+
+  // As above with the 1D kernel of the given radius.
+  template<typename T, typename float(*Reader)(const T*), typename void(*Writer)(float, T*)>
+  void convolveRows(
+    int length, int rows, int images,
+    unsigned char* buffer, int hop, int stride, int pitch,
+    const float* kernel, int kernelRadius,
+    ConvolutionMode mode, int threadCount, ConvolutionWorkspace& workspace)
+  {
+    // Created here so that an unsupported mode throws outside the parallel region
+    std::unique_ptr<RowConvolver> prototype = createRowConvolver(mode, kernel, 2 * kernelRadius + 1, length + 2 * kernelRadius);
+    convolveRows<T, Reader, Writer>(length, rows, images, buffer, hop, stride, pitch, *prototype, kernelRadius, threadCount, workspace);
+  }
 
-      // Do the 1D convolution
+  template<typename T, typename float(*Reader)(const T*) = readerT<T>, typename void(*Writer)(float, T*)=writerT<T> >
+  void convolveRows(
+    int length, int rows, int images,
+    unsigned char* buffer, int hop, int stride, int pitch,
+    const float* kernel, int kernelRadius,
+    ConvolutionMode mode = ConvolutionMode::Auto, int threadCount = 0)
+  {
+    ConvolutionWorkspace workspace;
+    convolveRows<T, Reader, Writer>(length, rows, images, buffer, hop, stride, pitch, kernel, kernelRadius, mode, threadCount, workspace);
+  }
 
-      // SSE version: t.convolver.convolve(&(t.inputRow[0]), &(t.outputRow[0]));
+  // Convolve 2D image of pixel type T with 1D kernel using multiple threads
+  template<typename T, typename float(*Reader)(const T*) = readerT<T>, typename void(*Writer)(float, T*)=writerT<T> >
+  void convolve(
+    int width, int height,
+    unsigned char* buffer, int hop, int stride,
+    const float* kernel, int kernelRadius,
+    ConvolutionMode mode = ConvolutionMode::Auto, int threadCount = 0)
+  {
+    convolveRows<T, Reader, Writer>(width, height, 1, buffer, hop, stride, 0, kernel, kernelRadius, mode, threadCount);
+  }
+
+  // Convolve the columns of a stack of 2D images of pixel type T, RowConvolver::TileWidth
+  // neighbouring columns at a time (see convolveTile), using multiple threads with a copy of
+  // prototype each. Column j of image s starts at buffer + s*pitch + j*hop and has length pixels
+  // step bytes apart. All tiles of all images are shared out in one parallel loop.
+  template<typename T, typename float(*Reader)(const T*), typename void(*Writer)(float, T*)>
+  void convolveTiles(
+    int length, int columns, int images,
+    unsigned char* buffer, int step, int hop, int pitch,
+    const RowConvolver& prototype, int kernelRadius,
+    int threadCount, ConvolutionWorkspace& workspace)
+  {
+    if (length <= 0 || columns <= 0 || images <= 0)
+      return;
 
-      convolve_reference(
-        &(t.inputRow[0]),
-        width + 2*kernelRadius,
-        kernel, kernelRadius,
-        &(t.outputRow[0]));
+    const int W = RowConvolver::TileWidth;
+    const int tileCount = (columns + W - 1) / W;
+    const int count = tileCount * images;
+    threadCount = resolveThreadCount(threadCount, count);
+    prepareWorkspace(workspace, threadCount, length, kernelRadius, prototype, true);
 
-      // Copy the result back to the input volume
-      unsigned char* r = buffer + v*stride;
-      const float * s = &t.outputRow[0];
-      for (int u = 0; u < width; u++)
+#pragma omp parallel num_threads(threadCount)
+    {
+      ConvolutionScratch& t = *workspace[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+      for (int i = 0; i < count; i++)
       {
-        Writer(*s++, (T*)(r));
-        r += hop;
+        const int s = i / tileCount, first = (i % tileCount) * W;
+        convolveTile<T, Reader, Writer>(t, length, std::min(W, columns - first),
+          buffer + (size_t)s*pitch + (size_t)first*hop, step, hop, kernelRadius);
       }
     }
   }
 
-  // Convolve a 3D volume of pixel type T with a 1D kernel.
+  // As above with the 1D kernel of the given radius.
+  template<typename T, typename float(*Reader)(const T*), typename void(*Writer)(float, T*)>
+  void convolveTiles(
+    int length, int columns, int images,
+    unsigned char* buffer, int step, int hop, int pitch,
+    const float* kernel, int kernelRadius,
+    ConvolutionMode mode, int threadCount, ConvolutionWorkspace& workspace)
+  {
+    std::unique_ptr<RowConvolver> prototype = createRowConvolver(mode, kernel, 2 * kernelRadius + 1, length + 2 * kernelRadius);
+    convolveTiles<T, Reader, Writer>(length, columns, images, buffer, step, hop, pitch, *prototype, kernelRadius, threadCount, workspace);
+  }
+
+  template<typename T, typename float(*Reader)(const T*) = readerT<T>, typename void(*Writer)(float, T*)=writerT<T> >
+  void convolveTiles(
+    int length, int columns, int images,
+    unsigned char* buffer, int step, int hop, int pitch,
+    const float* kernel, int kernelRadius,
+    ConvolutionMode mode = ConvolutionMode::Auto, int threadCount = 0)
+  {
+    ConvolutionWorkspace workspace;
+    convolveTiles<T, Reader, Writer>(length, columns, images, buffer, step, hop, pitch, kernel, kernelRadius, mode, threadCount, workspace);
+  }
+
+  // Convolve the columns of a 2D image of pixel type T with 1D kernel, RowConvolver::TileWidth
+  // neighbouring columns at a time, using multiple threads.
+  template<typename T, typename float(*Reader)(const T*) = readerT<T>, typename void(*Writer)(float, T*)=writerT<T> >
+  void convolveTiled(
+    int length, int columns,
+    unsigned char* buffer, int step, int hop,
+    const float* kernel, int kernelRadius,
+    ConvolutionMode mode = ConvolutionMode::Auto, int threadCount = 0)
+  {
+    convolveTiles<T, Reader, Writer>(length, columns, 1, buffer, step, hop, 0, kernel, kernelRadius, mode, threadCount);
+  }
+
+  // Settings for convolve1d.
+  struct ConvolutionOptions
+  {
+    ConvolutionOptions() : mode(ConvolutionMode::Auto), tiled(true), threadCount(0), fixedPoint(false), progress(nullptr)
+    {
+    }
+
+    ConvolutionMode mode;
+
+    // Convolve blocks of neighbouring columns together in the Y and Z directions (see convolveTiled)
+    // rather than gathering one strided row at a time.
+    bool tiled;
+
+    // Maximum number of threads to use, or zero for one per processor. Lets concurrent jobs
+    // share the cores of one machine.
+    int threadCount;
+
+    // Convolve unsigned char and short volumes in 16 bit fixed point (see FixedPointConvolution.h)
+    // rather than float. Used only by ConvolutionPlan.
+    bool fixedPoint;
+
+    // If not null, the progress of ConvolutionPlan and gaussianSmooth3d, which check for
+    // cancellation between the directions of a plan and the output slices of a single pass.
+    OperationProgress* progress;
+  };
+
+  // Convolve a 3D volume of pixel type T with a 1D kernel. The rows or tiles of every slice are
+  // convolved in a single parallel loop over the whole volume, using scratch space from workspace.
   template<typename T>
   void convolve1d(
     int width, int height, int depth,
     unsigned char* buffer, int leap, int stride, int hop,
     int direction,
-    const float* kernel, int kernelWidth)
+    const float* kernel, int kernelWidth,
+    const ConvolutionOptions& options, ConvolutionWorkspace& workspace)
   {
+    const ConvolutionMode mode = options.mode;
+    const int threadCount = options.threadCount;
     switch (direction)
     {
     case 0:
-      for (int z = 0; z < depth; z++)
-        createdataset::convolve<T>(width, height, &buffer[z*leap], hop, stride, kernel, kernelWidth);
-            break;
+      createdataset::convolveRows<T, readerT<T>, writerT<T>>(width, height, depth, buffer, hop, stride, leap, kernel, kernelWidth, mode, threadCount, workspace);
+      break;
     case 1:
-      for (int z = 0; z < depth; z++)
-        createdataset::convolve<T>(height, width, &buffer[z*leap], stride, hop, kernel, kernelWidth);
+      if (options.tiled)
+        createdataset::convolveTiles<T, readerT<T>, writerT<T>>(height, width, depth, buffer, stride, hop, leap, kernel, kernelWidth, mode, threadCount, workspace);
+      else
+        createdataset::convolveRows<T, readerT<T>, writerT<T>>(height, width, depth, buffer, stride, hop, leap, kernel, kernelWidth, mode, threadCount, workspace);
       break;
     case 2:
-      for (int y = 0; y < height; y++)
-        createdataset::convolve<T>(depth, width, &buffer[y*stride], leap, hop, kernel, kernelWidth);
+      if (options.tiled)
+        createdataset::convolveTiles<T, readerT<T>, writerT<T>>(depth, width, height, buffer, leap, hop, stride, kernel, kernelWidth, mode, threadCount, workspace);
+      else
+        createdataset::convolveRows<T, readerT<T>, writerT<T>>(depth, width, height, buffer, leap, hop, stride, kernel, kernelWidth, mode, threadCount, workspace);
       break;
     default:
       throw std::exception("Direction was out of range.");
     }
   }
+
+  template<typename T>
+  void convolve1d(
+    int width, int height, int depth,
+    unsigned char* buffer, int leap, int stride, int hop,
+    int direction,
+    const float* kernel, int kernelWidth,
+    const ConvolutionOptions& options = ConvolutionOptions())
+  {
+    ConvolutionWorkspace workspace;
+    convolve1d<T>(width, height, depth, buffer, leap, stride, hop, direction, kernel, kernelWidth, options, workspace);
+  }
 }
\ No newline at end of file
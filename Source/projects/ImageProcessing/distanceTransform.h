@@ -0,0 +1,178 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <math.h>
+
+#include "parallel.h"
+#include "Memory.h"
+
+namespace createdataset
+{
+  // Exact Euclidean distance transforms by the separable algorithm of Meijster, Roerdink and
+  // Hesselink: a squared distance along each axis in turn, where each pass is the lower envelope
+  // of one parabola per point of a line, so the cost is linear in the number of voxels.
+
+  inline long long floorDivide(long long numerator, long long denominator)
+  {
+    return numerator >= 0 ? numerator / denominator : -((-numerator + denominator - 1) / denominator);
+  }
+
+  inline double floorDivide(double numerator, double denominator)
+  {
+    return floor(numerator / denominator);
+  }
+
+  // The squared distance of every point of a line of length values of g to the nearest point of
+  // it, for a squared distance of weight times the square of the number of steps between them,
+  // so g[x] becomes the least of g[i] + weight*(x - i)*(x - i). Values are clamped to outside,
+  // which stands for no point, so that integer arithmetic stays within range. D is long long for
+  // exact integer metrics or double. f, s and t are scratch space of length elements.
+  template<typename D>
+  void squaredDistanceLine(int length, D* g, D weight, D outside, D* f, int* s, int* t)
+  {
+    for (int u = 0; u < length; u++)
+      f[u] = g[u];
+
+    auto value = [&](int x, int i) { return weight*(D)(x - i)*(D)(x - i) + f[i]; };
+
+    // s[q] is the point whose parabola is lowest from t[q] up to t[q + 1]
+    int q = 0;
+    s[0] = 0;
+    t[0] = 0;
+    for (int u = 1; u < length; u++)
+    {
+      while (q >= 0 && value(t[q], s[q]) > value(t[q], u))
+        q--;
+      if (q < 0)
+      {
+        q = 0;
+        s[0] = u;
+      }
+      else
+      {
+        // The first x at which the parabola of u is below that of s[q], which is after t[q] but
+        // for rounding when they are equal there
+        const int i = s[q];
+        const D w = std::max(1 + floorDivide(weight*((D)u*u - (D)i*i) + f[u] - f[i], 2 * weight*(D)(u - i)), (D)(t[q] + 1));
+        if (w < length)
+        {
+          q++;
+          s[q] = u;
+          t[q] = (int)w;
+        }
+      }
+    }
+
+    for (int u = length - 1; u >= 0; u--)
+    {
+      g[u] = std::min(value(u, s[q]), outside);
+      if (u == t[q])
+        q--;
+    }
+  }
+
+  // squaredDistanceLine along each of the lines of columns * images values of g of length
+  // points, in one parallel loop over them all. Point i of column j of image k is at
+  // g + k*pitch + j*hop + i*step.
+  template<typename D>
+  void squaredDistanceLines(
+    int length, int columns, int images,
+    D* g, size_t step, size_t hop, size_t pitch,
+    D weight, D outside, int threadCount)
+  {
+    const int count = columns * images;
+#pragma omp parallel num_threads(resolveThreadCount(threadCount, count))
+    {
+      std::vector<D> line(length), f(length);
+      std::vector<int> s(length), t(length);
+
+#pragma omp for schedule(static)
+      for (int i = 0; i < count; i++)
+      {
+        D* first = g + (size_t)(i / columns)*pitch + (size_t)(i % columns)*hop;
+        for (int u = 0; u < length; u++)
+          line[u] = first[u * step];
+        squaredDistanceLine(length, &line[0], weight, outside, &f[0], &s[0], &t[0]);
+        for (int u = 0; u < length; u++)
+          first[u * step] = line[u];
+      }
+    }
+  }
+
+  // Writes to each voxel of the output, of floats, the distance from its centre to the centre of
+  // the nearest voxel of the input of type T other than backgroundColor, where voxels are
+  // spacingX, spacingY and spacingZ apart along the axes; zero for those voxels themselves, and
+  // the largest float for every voxel if there are none. Image voxel x, y, z is at
+  // buffer + z*leap + y*stride + x*hop, as for convolve1d, and passes are parallel over all the
+  // lines of the volume along each axis, with up to threadCount threads.
+  //
+  // Works on a temporary volume of 8 bytes per voxel.
+  template<typename T>
+  void euclideanDistanceTransform(
+    int width, int height, int depth,
+    const unsigned char* inputBuffer, int inputLeap, int inputStride, int inputHop,
+    T backgroundColor,
+    double spacingX, double spacingY, double spacingZ,
+    unsigned char* outputBuffer, int outputLeap, int outputStride, int outputHop,
+    int threadCount = 0)
+  {
+    if (!(spacingX > 0 && spacingY > 0 && spacingZ > 0))
+      throw std::exception("The spacing must be positive.");
+    if (width <= 0 || height <= 0 || depth <= 0)
+      return;
+
+    const double outside = std::numeric_limits<float>::max();
+    const int rows = height * depth;
+    ScratchBuffer<double> g((size_t)width * rows);
+
+    // Seeds and the pass along X together, with the nearest seed of each row found by a sweep each way
+    const double weightX = spacingX * spacingX;
+#pragma omp parallel for num_threads(resolveThreadCount(threadCount, rows)) schedule(static)
+    for (int r = 0; r < rows; r++)
+    {
+      const int v = r % height, w = r / height;
+      const unsigned char* input = inputBuffer + (size_t)w*inputLeap + (size_t)v*inputStride;
+      double* row = &g[(size_t)r * width];
+      int nearest = -1;
+      for (int u = 0; u < width; u++)
+      {
+        if (*(const T*)(input + (size_t)u*inputHop) != backgroundColor)
+          nearest = u;
+        row[u] = nearest < 0 ? outside : weightX*(double)(u - nearest)*(u - nearest);
+      }
+      nearest = -1;
+      for (int u = width - 1; u >= 0; u--)
+      {
+        if (row[u] == 0)
+          nearest = u;
+        else if (nearest >= 0)
+          row[u] = std::min(row[u], weightX*(double)(nearest - u)*(nearest - u));
+      }
+    }
+
+    const size_t slice = (size_t)width * height;
+    if (height > 1)
+      squaredDistanceLines(height, width, depth, &g[0], width, 1, slice, spacingY * spacingY, outside, threadCount);
+    if (depth > 1)
+      squaredDistanceLines(depth, width, height, &g[0], slice, 1, width, spacingZ * spacingZ, outside, threadCount);
+
+#pragma omp parallel for num_threads(resolveThreadCount(threadCount, rows)) schedule(static)
+    for (int r = 0; r < rows; r++)
+    {
+      const int v = r % height, w = r / height;
+      const double* row = &g[(size_t)r * width];
+      unsigned char* output = outputBuffer + (size_t)w*outputLeap + (size_t)v*outputStride;
+      for (int u = 0; u < width; u++)
+        *(float*)(output + (size_t)u*outputHop) = row[u] >= outside ? std::numeric_limits<float>::max() : (float)sqrt(row[u]);
+    }
+  }
+}
@@ -0,0 +1,158 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "stdafx.h"
+#include "histogram.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <emmintrin.h>
+
+namespace createdataset
+{
+  namespace
+  {
+    // Elements per parallel chunk, so that each thread has a long contiguous run to itself
+    const size_t ChunkSize = 1 << 16;
+
+    // Minimum and maximum of a contiguous run, eight values at a time
+    void findMinMaxContiguous(const short* data, size_t count, short& minimum, short& maximum)
+    {
+      size_t i = 0;
+      __m128i low = _mm_set1_epi16(minimum), high = _mm_set1_epi16(maximum);
+      for (; i + 8 <= count; i += 8)
+      {
+        const __m128i values = _mm_loadu_si128((const __m128i*)(data + i));
+        low = _mm_min_epi16(low, values);
+        high = _mm_max_epi16(high, values);
+      }
+
+      short lows[8], highs[8];
+      _mm_storeu_si128((__m128i*)lows, low);
+      _mm_storeu_si128((__m128i*)highs, high);
+      for (int k = 0; k < 8; k++)
+      {
+        minimum = std::min(minimum, lows[k]);
+        maximum = std::max(maximum, highs[k]);
+      }
+      for (; i < count; i++)
+      {
+        minimum = std::min(minimum, data[i]);
+        maximum = std::max(maximum, data[i]);
+      }
+    }
+  }
+
+  void findMinMax(const short* data, size_t count, size_t step, short& minimum, short& maximum, int threadCount)
+  {
+    if (step == 0)
+      throw std::exception("The step must be positive.");
+
+    minimum = std::numeric_limits<short>::max();
+    maximum = std::numeric_limits<short>::min();
+    const size_t samples = (count + step - 1) / step;
+    if (samples == 0)
+      return;
+
+    const int chunks = (int)((samples + ChunkSize - 1) / ChunkSize);
+    std::vector<short> minima(chunks, minimum), maxima(chunks, maximum);
+#pragma omp parallel for num_threads(resolveThreadCount(threadCount, chunks)) schedule(static)
+    for (int c = 0; c < chunks; c++)
+    {
+      const size_t first = (size_t)c * ChunkSize, last = std::min(first + ChunkSize, samples);
+      short low = minima[c], high = maxima[c];
+      if (step == 1)
+      {
+        findMinMaxContiguous(data + first, last - first, low, high);
+      }
+      else
+      {
+        for (size_t i = first; i < last; i++)
+        {
+          low = std::min(low, data[i * step]);
+          high = std::max(high, data[i * step]);
+        }
+      }
+      minima[c] = low;
+      maxima[c] = high;
+    }
+
+    minimum = *std::min_element(minima.begin(), minima.end());
+    maximum = *std::max_element(maxima.begin(), maxima.end());
+  }
+
+  void histogram(const short* data, size_t count, size_t step, short minimum, short maximum, int bins, int* counts, int threadCount)
+  {
+    if (step == 0)
+      throw std::exception("The step must be positive.");
+    if (bins < 1)
+      throw std::exception("The histogram must have at least 1 bin.");
+
+    std::fill(counts, counts + bins, 0);
+    const double range = (double)maximum - minimum;
+    const size_t samples = (count + step - 1) / step;
+    if (range <= 0 || samples == 0)
+      return;
+
+    // Counts of every short value, offset by 32768, summed over threads
+    const int values = 1 << 16;
+    const int chunks = (int)((samples + ChunkSize - 1) / ChunkSize);
+    const int threads = resolveThreadCount(threadCount, chunks);
+    std::vector<long long> total(values, 0);
+#pragma omp parallel num_threads(threads)
+    {
+      std::vector<unsigned int> local(values, 0);
+
+#pragma omp for schedule(static)
+      for (int c = 0; c < chunks; c++)
+      {
+        const size_t first = (size_t)c * ChunkSize, last = std::min(first + ChunkSize, samples);
+        for (size_t i = first; i < last; i++)
+          local[data[i * step] + 32768]++;
+      }
+
+#pragma omp critical
+      for (int v = 0; v < values; v++)
+        total[v] += local[v];
+    }
+
+    // Each value into its bin, as AutoWindowLevelHelper.CreateHistogram finds it
+    const double binSize = range / bins;
+    for (int v = 0; v < values; v++)
+    {
+      if (total[v] == 0)
+        continue;
+      const double position = ((v - 32768) - minimum) / binSize;
+      const int bin = position < 0 ? 0 : position >= bins ? bins - 1 : (int)position;
+      counts[bin] += (int)total[v];
+    }
+  }
+
+  int percentileBin(const int* counts, int bins, double fraction)
+  {
+    if (!(fraction >= 0 && fraction <= 1))
+      throw std::exception("The fraction must be from 0 to 1.");
+
+    long long total = 0;
+    for (int b = 0; b < bins; b++)
+      total += counts[b];
+    if (total == 0)
+      return -1;
+
+    const double target = fraction * total;
+    long long sum = 0;
+    for (int b = 0; b < bins; b++)
+    {
+      sum += counts[b];
+      if (sum >= target && sum > 0)
+        return b;
+    }
+    return bins - 1;
+  }
+}
@@ -0,0 +1,30 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace createdataset
+{
+  // Statistics of short volumes for automatic windowing, as AutoWindowLevelHelper computes them,
+  // over every step-th element of count values from data, with up to threadCount threads (zero
+  // for one per processor).
+
+  // The least and greatest of the values; short.MaxValue and short.MinValue if there are none.
+  void findMinMax(const short* data, size_t count, size_t step, short& minimum, short& maximum, int threadCount = 0);
+
+  // Counts the values into bins equal bins spanning minimum to maximum, where value v is in bin
+  // (int)((v - minimum) / ((maximum - minimum) / (double)bins)), clamped to the first and last
+  // bin. Counts are all zero if maximum is not above minimum. Each thread counts every short
+  // value into private counts, which are merged and then binned, so there is no division and no
+  // contention per value.
+  void histogram(const short* data, size_t count, size_t step, short minimum, short maximum, int bins, int* counts, int threadCount = 0);
+
+  // The first bin at which the running total of counts reaches fraction of the total, for
+  // fraction from 0 to 1, in one pass over the bins; -1 if every count is zero.
+  int percentileBin(const int* counts, int bins, double fraction);
+}
@@ -0,0 +1,260 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+#include "parallel.h"
+#include "Memory.h"
+#include "distanceTransform.h"
+
+namespace createdataset
+{
+  // Binary dilation and erosion of masks by an ellipsoid with radii of whole voxels, the
+  // structuring element of MorphologicalExtensions.DilateErode. Rather than painting the
+  // ellipsoid around each voxel of the surface, which costs the area of the surface times the
+  // volume of the ellipsoid, each finds the voxels within the ellipsoid of a seed with the three
+  // separable passes of squaredDistanceLines, one along each axis, in exact integers, so the cost
+  // is linear in the number of voxels whatever the radii.
+  //
+  // Image voxel x, y, z is at buffer + z*leap + y*stride + x*hop, as for convolve1d. The output
+  // may be the input.
+
+  // The ellipsoid with radii rx, ry and rz, where a radius of zero leaves that axis out, is the
+  // offsets with dx*dx*wx + dy*dy*wy + dz*dz*wz <= limit in 64 bit integers, so membership is
+  // exact with no rounding.
+  struct EllipsoidMetric
+  {
+    EllipsoidMetric(int rx, int ry, int rz)
+    {
+      if (rx < 0 || ry < 0 || rz < 0)
+        throw std::exception("The radii must not be negative.");
+
+      const double big = 1e17;
+      const long long sx = rx > 0 ? (long long)rx*rx : 1, sy = ry > 0 ? (long long)ry*ry : 1, sz = rz > 0 ? (long long)rz*rz : 1;
+      if ((double)sx*sy*sz > big)
+        throw std::exception("The radii are too large.");
+
+      radius[0] = rx; radius[1] = ry; radius[2] = rz;
+      weight[0] = sy*sz; weight[1] = sx*sz; weight[2] = sx*sy;
+      limit = sx*sy*sz;
+    }
+
+    int radius[3];
+    long long weight[3];
+    long long limit;
+  };
+
+  // Sets g, of width * height * depth values in raster order, to zero at each voxel where seed
+  // returns true and limit + 1 elsewhere, and then to the squared distance of metric to the
+  // nearest seed, clamped to limit + 1. Seed is called with x, y and z from many threads. The
+  // passes along Y and Z cover just the box of the seeds grown by the radii, outside which every
+  // value is limit + 1, so a small mask in a large volume costs little more than one sweep.
+  template<typename Seed>
+  void squaredDistanceToSeeds(
+    int width, int height, int depth,
+    const EllipsoidMetric& metric, Seed seed,
+    ScratchBuffer<long long>& g,
+    int threadCount)
+  {
+    // The parabolas of the passes reach across the whole of each line
+    const int lengths[3] = { width, height, depth };
+    for (int a = 0; a < 3; a++)
+    {
+      if (metric.radius[a] > 0 && (double)metric.weight[a] * lengths[a] * lengths[a] + 2.0 * metric.limit > 4e18)
+        throw std::exception("The radii are too large for the volume.");
+    }
+
+    const long long outside = metric.limit + 1;
+    const int rows = height * depth;
+    g.reset((size_t)width * rows);
+
+    // Seeds and the pass along X together, row by row, with the nearest seed found by a sweep each
+    // way, noting the first and last seed of each row
+    std::vector<int> firstSeed(rows), lastSeed(rows);
+#pragma omp parallel for num_threads(resolveThreadCount(threadCount, rows)) schedule(static)
+    for (int r = 0; r < rows; r++)
+    {
+      const int v = r % height, w = r / height;
+      long long* row = &g[(size_t)r * width];
+      int first = width, last = -1;
+      for (int u = 0; u < width; u++)
+      {
+        row[u] = outside;
+        if (seed(u, v, w))
+        {
+          row[u] = 0;
+          first = std::min(first, u);
+          last = u;
+        }
+      }
+      firstSeed[r] = first;
+      lastSeed[r] = last;
+
+      if (metric.radius[0] == 0 || last < 0)
+        continue;
+
+      const long long weight = metric.weight[0];
+      const int end = std::min(last + metric.radius[0], width - 1);
+      int nearest = first;
+      for (int u = first + 1; u <= end; u++)
+      {
+        if (row[u] == 0)
+          nearest = u;
+        else if (u - nearest <= metric.radius[0])
+          row[u] = weight*(long long)(u - nearest)*(u - nearest);
+      }
+      const int start = std::max(first - metric.radius[0], 0);
+      nearest = last;
+      for (int u = last - 1; u >= start; u--)
+      {
+        if (row[u] == 0)
+          nearest = u;
+        else if (nearest - u <= metric.radius[0])
+          row[u] = std::min(row[u], weight*(long long)(nearest - u)*(nearest - u));
+      }
+    }
+
+    // The box of the seeds, grown by the radii and clipped to the volume
+    int box[6] = { width, height, depth, -1, -1, -1 };
+    for (int r = 0; r < rows; r++)
+    {
+      if (lastSeed[r] < 0)
+        continue;
+      const int v = r % height, w = r / height;
+      box[0] = std::min(box[0], firstSeed[r]); box[3] = std::max(box[3], lastSeed[r]);
+      box[1] = std::min(box[1], v); box[4] = std::max(box[4], v);
+      box[2] = std::min(box[2], w); box[5] = std::max(box[5], w);
+    }
+    if (box[3] < 0)
+      return;
+    for (int a = 0; a < 3; a++)
+    {
+      box[a] = std::max(box[a] - metric.radius[a], 0);
+      box[a + 3] = std::min(box[a + 3] + metric.radius[a], lengths[a] - 1) + 1;
+    }
+
+    const size_t slice = (size_t)width * height;
+    if (metric.radius[1] > 0 && height > 1)
+    {
+      squaredDistanceLines(box[4] - box[1], box[3] - box[0], box[5] - box[2],
+        &g[box[2] * slice + (size_t)box[1] * width + box[0]], width, 1, slice, metric.weight[1], outside, threadCount);
+    }
+    if (metric.radius[2] > 0 && depth > 1)
+    {
+      squaredDistanceLines(box[5] - box[2], box[3] - box[0], box[4] - box[1],
+        &g[box[2] * slice + (size_t)box[1] * width + box[0]], slice, 1, width, metric.weight[2], outside, threadCount);
+    }
+  }
+
+  // Dilates the mask of voxels of the input of type T other than backgroundColor by the
+  // ellipsoid with radii rx, ry and rz voxels, writing foregroundColor to each voxel of the
+  // output in the mask or within the ellipsoid of it, and backgroundColor to the rest. If
+  // restriction is not null, it is bytes with the same layout as the input and the mask grows
+  // only into its voxels of restrictionColor; voxels of the mask itself are kept whatever the
+  // restriction.
+  //
+  // Works on a temporary volume of 8 bytes per voxel.
+  template<typename T>
+  void dilate(
+    int width, int height, int depth,
+    const unsigned char* inputBuffer, int inputLeap, int inputStride, int inputHop,
+    T backgroundColor, T foregroundColor,
+    int rx, int ry, int rz,
+    const unsigned char* restrictionBuffer, int restrictionLeap, int restrictionStride, int restrictionHop, unsigned char restrictionColor,
+    unsigned char* outputBuffer, int outputLeap, int outputStride, int outputHop,
+    int threadCount = 0)
+  {
+    const EllipsoidMetric metric(rx, ry, rz);
+    if (width <= 0 || height <= 0 || depth <= 0)
+      return;
+
+    auto input = [&](int u, int v, int w) { return *(const T*)(inputBuffer + (size_t)w*inputLeap + (size_t)v*inputStride + (size_t)u*inputHop); };
+
+    ScratchBuffer<long long> g;
+    squaredDistanceToSeeds(width, height, depth, metric, [&](int u, int v, int w) { return input(u, v, w) != backgroundColor; }, g, threadCount);
+
+    const int rows = height * depth;
+#pragma omp parallel for num_threads(resolveThreadCount(threadCount, rows)) schedule(static)
+    for (int r = 0; r < rows; r++)
+    {
+      const int v = r % height, w = r / height;
+      const long long* row = &g[(size_t)r * width];
+      const unsigned char* restriction = restrictionBuffer == nullptr ? nullptr : restrictionBuffer + (size_t)w*restrictionLeap + (size_t)v*restrictionStride;
+      unsigned char* output = outputBuffer + (size_t)w*outputLeap + (size_t)v*outputStride;
+      for (int u = 0; u < width; u++)
+      {
+        const bool inside = row[u] == 0 || (row[u] <= metric.limit && (restriction == nullptr || restriction[(size_t)u*restrictionHop] == restrictionColor));
+        *(T*)(output + (size_t)u*outputHop) = inside ? foregroundColor : backgroundColor;
+      }
+    }
+  }
+
+  // Erodes the mask of voxels of the input of type T other than backgroundColor, as
+  // MorphologicalExtensions.Erode does. The surface of the mask is its voxels with a neighbour,
+  // among the 26 along just the axes with a non-zero radius, that is background or outside the
+  // volume. Each voxel of the surface, and each voxel within the ellipsoid with radii one less
+  // than rx, ry and rz of one, is removed, so the mask loses close to the ellipsoid of the radii
+  // all round. Writes foregroundColor to each voxel of the output left in the mask and
+  // backgroundColor to the rest.
+  //
+  // Works on a temporary volume of 8 bytes per voxel.
+  template<typename T>
+  void erode(
+    int width, int height, int depth,
+    const unsigned char* inputBuffer, int inputLeap, int inputStride, int inputHop,
+    T backgroundColor, T foregroundColor,
+    int rx, int ry, int rz,
+    unsigned char* outputBuffer, int outputLeap, int outputStride, int outputHop,
+    int threadCount = 0)
+  {
+    const EllipsoidMetric metric(std::max(rx - 1, 0), std::max(ry - 1, 0), std::max(rz - 1, 0));
+    if (width <= 0 || height <= 0 || depth <= 0)
+      return;
+
+    auto input = [&](int u, int v, int w) { return *(const T*)(inputBuffer + (size_t)w*inputLeap + (size_t)v*inputStride + (size_t)u*inputHop); };
+    const int sx = rx > 0 ? 1 : 0, sy = ry > 0 ? 1 : 0, sz = rz > 0 ? 1 : 0;
+    auto surface = [&](int u, int v, int w)
+    {
+      if (input(u, v, w) == backgroundColor)
+        return false;
+      for (int z = w - sz; z <= w + sz; z++)
+      {
+        for (int y = v - sy; y <= v + sy; y++)
+        {
+          for (int x = u - sx; x <= u + sx; x++)
+          {
+            if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth || input(x, y, z) == backgroundColor)
+              return true;
+          }
+        }
+      }
+      return false;
+    };
+
+    ScratchBuffer<long long> g;
+    if (sx + sy + sz > 0)
+      squaredDistanceToSeeds(width, height, depth, metric, surface, g, threadCount);
+
+    // With every radius zero there is no surface, and the mask is copied
+    const int rows = height * depth;
+#pragma omp parallel for num_threads(resolveThreadCount(threadCount, rows)) schedule(static)
+    for (int r = 0; r < rows; r++)
+    {
+      const int v = r % height, w = r / height;
+      const long long* row = g.empty() ? nullptr : &g[(size_t)r * width];
+      unsigned char* output = outputBuffer + (size_t)w*outputLeap + (size_t)v*outputStride;
+      for (int u = 0; u < width; u++)
+      {
+        const bool inside = input(u, v, w) != backgroundColor && (row == nullptr || row[u] > metric.limit);
+        *(T*)(output + (size_t)u*outputHop) = inside ? foregroundColor : backgroundColor;
+      }
+    }
+  }
+}
@@ -0,0 +1,22 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include <omp.h>
+
+namespace createdataset
+{
+  // Number of threads to use for a parallel loop of the given number of iterations, given the
+  // number requested (zero or less for one per processor).
+  inline int resolveThreadCount(int requested, int iterations)
+  {
+    const int threadCount = requested > 0 ? requested : omp_get_max_threads();
+    return std::max(1, std::min(threadCount, iterations));
+  }
+}
@@ -0,0 +1,80 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <exception>
+
+namespace createdataset
+{
+  // Thrown by an operation that stopped early because its OperationProgress was cancelled.
+  class OperationCancelled : public std::exception
+  {
+  public:
+    OperationCancelled() : std::exception("The operation was cancelled.")
+    {
+    }
+  };
+
+  // The progress of a long operation, and a request to stop it. The operation adds the units of
+  // work it will do with expect and those it has done with advance, from any of its threads, and
+  // the callback, if any, is given the fraction done each time that grows by a hundredth, one call
+  // at a time on whichever thread advanced it, so it must be quick and must not throw. Cancel may
+  // be called at any time on any thread; the operation then throws OperationCancelled the next time
+  // it checks, between slices or slabs, leaving its output partly written.
+  class OperationProgress
+  {
+  public:
+    typedef void(*Callback)(void* context, double fraction);
+
+    explicit OperationProgress(Callback callback = nullptr, void* context = nullptr) :
+      callback_(callback), context_(context), cancelled_(false), total_(0), done_(0), reported_(-1)
+    {
+    }
+
+    void cancel() { cancelled_ = true; }
+
+    bool isCancelled() const { return cancelled_; }
+
+    void throwIfCancelled() const
+    {
+      if (cancelled_)
+        throw OperationCancelled();
+    }
+
+    void expect(long long units)
+    {
+#pragma omp critical(createdatasetOperationProgress)
+      total_ += units;
+    }
+
+    void advance(long long units)
+    {
+#pragma omp critical(createdatasetOperationProgress)
+      {
+        done_ += units;
+        const double fraction = total_ > 0 ? (double)std::min(done_, total_) / total_ : 1.0;
+        const int percent = (int)(fraction * 100);
+        if (callback_ != nullptr && percent > reported_)
+        {
+          reported_ = percent;
+          callback_(context_, fraction);
+        }
+      }
+    }
+
+  private:
+    OperationProgress(const OperationProgress&);
+    OperationProgress& operator=(const OperationProgress&);
+
+    Callback callback_;
+    void* context_;
+    volatile bool cancelled_;
+    long long total_, done_;
+    int reported_; // percentage last given to the callback
+  };
+}
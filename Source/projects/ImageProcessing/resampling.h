@@ -0,0 +1,165 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+#include "parallel.h"
+#include "convolution.h"
+
+namespace createdataset
+{
+  // The input voxels and weights of one output voxel along one axis: the value there is
+  // (1 - fraction) times that at first plus fraction times that at second. Outside the input,
+  // inside is false.
+  struct ResamplingTap
+  {
+    int first;
+    int second;
+    double fraction;
+    bool inside;
+  };
+
+  // The taps along an axis of outputLength voxels, where output voxel i is at input position
+  // i*factor + shift, as the managed ResamplingExtensions.ResampleLinear finds them: a position
+  // within half a voxel of either end is clamped to it, and a position beyond that is outside.
+  inline std::vector<ResamplingTap> resamplingTaps(int inputLength, int outputLength, double factor, double shift)
+  {
+    std::vector<ResamplingTap> taps(outputLength);
+    for (int i = 0; i < outputLength; i++)
+    {
+      const double p = i * factor + shift;
+      ResamplingTap& tap = taps[i];
+      tap.inside = !(p < -0.5 || p >= inputLength - 0.5);
+      if (!tap.inside || p < 0)
+      {
+        tap.first = 0;
+        tap.second = 0;
+        tap.fraction = 0;
+      }
+      else if (p >= inputLength - 1)
+      {
+        tap.first = inputLength - 1;
+        tap.second = inputLength - 1;
+        tap.fraction = 0;
+      }
+      else
+      {
+        tap.first = (int)p;
+        tap.second = tap.first + 1;
+        tap.fraction = p - tap.first;
+      }
+    }
+    return taps;
+  }
+
+  // Writes x rounded to the nearest T, with halves to even as Math.Round does, and clamped to the
+  // range of T. Unlike writerT, which rounds halves up and truncates negative values towards zero,
+  // this gives the same voxels as the managed resampling.
+  template<typename T>
+  inline void resamplingWriter(double x, T* iterator)
+  {
+    const double minimum = (double)std::numeric_limits<T>::lowest(), maximum = (double)std::numeric_limits<T>::max();
+    const double rounded = nearbyint(x);
+    *iterator = rounded <= minimum ? std::numeric_limits<T>::lowest() : (rounded >= maximum ? std::numeric_limits<T>::max() : (T)rounded);
+  }
+
+  template<>
+  inline void resamplingWriter<float>(double x, float* iterator)
+  {
+    *iterator = (float)x;
+  }
+
+  // Trilinear resampling of a volume of pixel type T onto a grid of outputWidth * outputHeight *
+  // outputDepth voxels, where output voxel x, y, z is at input pixel position
+  // (x*factorX + shiftX, y*factorY + shiftY, z*factorZ + shiftZ), as GenericResampling.ResampleImage
+  // maps them. Voxels outside the input, as resamplingTaps finds them, are outsideValue.
+  //
+  // Separable: the index and weight tables of each axis are found once; then each output row is
+  // the blend of four input rows, by the weights along Y and Z, into a row of doubles, which is
+  // then interpolated along X. That is four contiguous reads per input voxel of the row and two per
+  // output voxel, rather than eight scattered reads per output voxel, and the blend vectorises.
+  // Parallel over output slices with up to threadCount threads.
+  template<typename T>
+  void resampleLinear(
+    int inputWidth, int inputHeight, int inputDepth,
+    const unsigned char* inputBuffer, int inputLeap, int inputStride,
+    int outputWidth, int outputHeight, int outputDepth,
+    unsigned char* outputBuffer, int outputLeap, int outputStride,
+    double factorX, double factorY, double factorZ,
+    double shiftX, double shiftY, double shiftZ,
+    T outsideValue,
+    int threadCount = 0)
+  {
+    if (outputWidth <= 0 || outputHeight <= 0 || outputDepth <= 0)
+      return;
+    if (inputWidth <= 0 || inputHeight <= 0 || inputDepth <= 0)
+      throw std::exception("The input must not be empty.");
+
+    const std::vector<ResamplingTap> tapsX = resamplingTaps(inputWidth, outputWidth, factorX, shiftX);
+    const std::vector<ResamplingTap> tapsY = resamplingTaps(inputHeight, outputHeight, factorY, shiftY);
+    const std::vector<ResamplingTap> tapsZ = resamplingTaps(inputDepth, outputDepth, factorZ, shiftZ);
+
+    // Just the span of input columns that some output voxel reads
+    int firstColumn = inputWidth, lastColumn = -1;
+    for (int x = 0; x < outputWidth; x++)
+    {
+      if (tapsX[x].inside)
+      {
+        firstColumn = std::min(firstColumn, tapsX[x].first);
+        lastColumn = std::max(lastColumn, tapsX[x].second);
+      }
+    }
+
+    auto inputRow = [&](int v, int w) { return (const T*)(inputBuffer + (size_t)w*inputLeap + (size_t)v*inputStride); };
+
+#pragma omp parallel num_threads(resolveThreadCount(threadCount, outputDepth))
+    {
+      std::vector<double> blend(inputWidth);
+
+#pragma omp for schedule(static)
+      for (int z = 0; z < outputDepth; z++)
+      {
+        const ResamplingTap& tz = tapsZ[z];
+        for (int y = 0; y < outputHeight; y++)
+        {
+          const ResamplingTap& ty = tapsY[y];
+          T* output = (T*)(outputBuffer + (size_t)z*outputLeap + (size_t)y*outputStride);
+          if (!tz.inside || !ty.inside || lastColumn < 0)
+          {
+            std::fill(output, output + outputWidth, outsideValue);
+            continue;
+          }
+
+          const double w00 = (1.0 - ty.fraction) * (1.0 - tz.fraction), w10 = ty.fraction * (1.0 - tz.fraction);
+          const double w01 = (1.0 - ty.fraction) * tz.fraction, w11 = ty.fraction * tz.fraction;
+          const T* r00 = inputRow(ty.first, tz.first);
+          const T* r10 = inputRow(ty.second, tz.first);
+          const T* r01 = inputRow(ty.first, tz.second);
+          const T* r11 = inputRow(ty.second, tz.second);
+          for (int u = firstColumn; u <= lastColumn; u++)
+          {
+            blend[u] = readerT<T>(r00 + u) * w00 + readerT<T>(r10 + u) * w10
+              + readerT<T>(r01 + u) * w01 + readerT<T>(r11 + u) * w11;
+          }
+
+          for (int x = 0; x < outputWidth; x++)
+          {
+            const ResamplingTap& tx = tapsX[x];
+            if (tx.inside)
+              resamplingWriter<T>(blend[tx.first] * (1.0 - tx.fraction) + blend[tx.second] * tx.fraction, output + x);
+            else
+              output[x] = outsideValue;
+          }
+        }
+      }
+    }
+  }
+}
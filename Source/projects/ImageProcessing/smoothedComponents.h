@@ -0,0 +1,195 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <memory>
+
+#include "smoothing.h"
+#include "StreamingConnectedComponents.h"
+#include "Instrumentation.h"
+
+namespace createdataset
+{
+  // The sink of gaussianSmooth3dRows for findSmoothedComponents3d. Each row of the smoothed
+  // slice is rounded to T, as gaussianSmooth3d would write it, and thresholded into a mask of one
+  // slice, which is labelled once the slice is complete.
+  template<typename T, typename void(*Writer)(float, T*), typename U, Connectivity C>
+  class SmoothedComponentsSink
+  {
+  public:
+    enum { EndsSlices = 1 };
+
+    SmoothedComponentsSink(int width, int height, T lower, T upper,
+      StreamingConnectedComponents<unsigned char, U, C>& components, std::vector<ProvisionalRun>& runs, std::vector<size_t>& rowEnds) :
+      width_(width), lower_(lower), upper_(upper), mask_((size_t)width * height), components_(components), runs_(runs), rowEnds_(rowEnds)
+    {
+    }
+
+    void writeRow(int, int v, const float* row)
+    {
+      unsigned char* m = &mask_[(size_t)v * width_];
+      for (int u = 0; u < width_; u++)
+      {
+        T value;
+        Writer(row[u], &value);
+        m[u] = value >= lower_ && value <= upper_ ? 1 : 0;
+      }
+    }
+
+    // Called inside the parallel region of the smoothing, so an exception is kept until after it
+    bool endSlice(int)
+    {
+      try
+      {
+        components_.addSlice(&mask_[0], width_, runs_, rowEnds_);
+        return true;
+      }
+      catch (...)
+      {
+        error_ = std::current_exception();
+        return false;
+      }
+    }
+
+    void rethrowError() const
+    {
+      if (error_)
+        std::rethrow_exception(error_);
+    }
+
+  private:
+    SmoothedComponentsSink(const SmoothedComponentsSink&);
+    SmoothedComponentsSink& operator=(const SmoothedComponentsSink&);
+
+    int width_;
+    T lower_, upper_;
+    std::vector<unsigned char> mask_;
+    StreamingConnectedComponents<unsigned char, U, C>& components_;
+    std::vector<ProvisionalRun>& runs_;
+    std::vector<size_t>& rowEnds_;
+    std::exception_ptr error_;
+  };
+
+  // Smooths a volume of type T as gaussianSmooth3d, thresholds the result to the voxels from lower
+  // to upper inclusive, and labels the connected components of those, writing labels of type U.
+  // The labels and statistics are those that findConnectedComponents3d gives a mask of the
+  // thresholded voxels with foreground 1 and background 0, so the input label of each component
+  // is 1, and bit for bit those of the three steps one after the other.
+  //
+  // Neither the smoothed volume nor the mask is stored. Each smoothed row is thresholded into a
+  // mask of one slice, which StreamingConnectedComponents labels as soon as it is complete, keeping
+  // only its runs, and once every slice is labelled each row of labels is written once from them.
+  // The runs are the only memory that grows with the volume, 12 bytes per run and 8 per row.
+  //
+  // Smoothing uses up to options.threadCount threads, and the labelling of each slice one of them
+  // while the others wait. If options.progress is not null, a unit of work is added to it for each
+  // slice smoothed and each slice of labels written, and cancellation is checked after each slice
+  // is smoothed.
+  template<typename T, typename U, Connectivity C = Connectivity::Face>
+  std::vector<ComponentStatistics<unsigned char, U> > findSmoothedComponents3d(
+    int width,
+    int height,
+    int depth,
+    const void* inputBuffer, // of type T
+    int inputLeap,
+    int inputStride,
+    const GaussianKernel1D& kernelX,
+    const GaussianKernel1D& kernelY,
+    const GaussianKernel1D& kernelZ,
+    T lower,
+    T upper,
+    void* outputBuffer, // of type U
+    int outputLeap,
+    int outputStride,
+    U backgroundLabel,
+    const ConvolutionOptions& options = ConvolutionOptions())
+  {
+    std::vector<ComponentStatistics<unsigned char, U> > statistics;
+    if (width <= 0 || height <= 0 || depth <= 0)
+    {
+      if (backgroundLabel == 0)
+        statistics.push_back({ 0, (unsigned char)0 });
+      return statistics;
+    }
+
+    const long long voxels = (long long)width * height * depth;
+    OperationProgress* const progress = options.progress;
+    if (progress != nullptr)
+      progress->expect(depth);
+
+    StreamingConnectedComponents<unsigned char, U, C> components(width, height, 0, backgroundLabel);
+    std::vector<ProvisionalRun> runs;
+    std::vector<size_t> rowEnds;
+    rowEnds.reserve((size_t)height * depth);
+    {
+      InstrumentedStage stage("smooth and label", voxels, resolveThreadCount(options.threadCount, height));
+      SmoothedComponentsSink<T, writerT<T>, U, C> sink(width, height, lower, upper, components, runs, rowEnds);
+      SmoothingWorkspace workspace;
+      gaussianSmooth3dRows<T, readerT<T>>(width, height, depth, (const unsigned char*)inputBuffer, inputLeap, inputStride, sizeof(T),
+        Region3d(width, height, depth), kernelX, kernelY, kernelZ, options, workspace, sink);
+      sink.rethrowError();
+    }
+    statistics = components.finish();
+
+    // Each run is written with its label, and the voxels between runs with the background label
+    const int threadCount = resolveThreadCount(options.threadCount, depth);
+    InstrumentedStage stage("write labels", voxels, threadCount);
+#pragma omp parallel for num_threads(threadCount) schedule(static)
+    for (int w = 0; w < depth; w++)
+    {
+      for (int v = 0; v < height; v++)
+      {
+        const size_t r = (size_t)w*height + v;
+        U* o = (U*)((unsigned char*)outputBuffer + (size_t)w*outputLeap + (size_t)v*outputStride);
+        int u = 0;
+        for (size_t i = r == 0 ? 0 : rowEnds[r - 1]; i < rowEnds[r]; i++)
+        {
+          const ProvisionalRun& run = runs[i];
+          std::fill(o + u, o + run.start, backgroundLabel);
+          std::fill(o + run.start, o + run.end, components.resolveLabel(run.label));
+          u = run.end;
+        }
+        std::fill(o + u, o + width, backgroundLabel);
+      }
+      if (progress != nullptr)
+        progress->advance(1);
+    }
+
+    return statistics;
+  }
+
+  // As above, with the Gaussian kernels for the standard deviation along each axis in voxels, from
+  // the cache kept by GaussianKernel1D.
+  template<typename T, typename U, Connectivity C = Connectivity::Face>
+  std::vector<ComponentStatistics<unsigned char, U> > findSmoothedComponents3d(
+    int width,
+    int height,
+    int depth,
+    const void* inputBuffer, // of type T
+    int inputLeap,
+    int inputStride,
+    float sigmaX,
+    float sigmaY,
+    float sigmaZ,
+    T lower,
+    T upper,
+    void* outputBuffer, // of type U
+    int outputLeap,
+    int outputStride,
+    U backgroundLabel,
+    const ConvolutionOptions& options = ConvolutionOptions())
+  {
+    std::shared_ptr<const GaussianKernel1D> kernelX = GaussianKernel1D::get(sigmaX, 0.001f, GaussianSampling::Point, std::max(width, 1));
+    std::shared_ptr<const GaussianKernel1D> kernelY = GaussianKernel1D::get(sigmaY, 0.001f, GaussianSampling::Point, std::max(height, 1));
+    std::shared_ptr<const GaussianKernel1D> kernelZ = GaussianKernel1D::get(sigmaZ, 0.001f, GaussianSampling::Point, std::max(depth, 1));
+    return findSmoothedComponents3d<T, U, C>(width, height, depth, inputBuffer, inputLeap, inputStride,
+      *kernelX, *kernelY, *kernelZ, lower, upper, outputBuffer, outputLeap, outputStride, backgroundLabel, options);
+  }
+}
@@ -0,0 +1,313 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+
+#include <omp.h>
+
+#include "convolution.h"
+#include "GaussianKernel1D.h"
+
+namespace createdataset
+{
+  // Scratch space for one thread of gaussianSmooth3d.
+  struct SmoothingScratch
+  {
+    SmoothingScratch(int width, int height,
+      const GaussianKernel1D& kernelX, const GaussianKernel1D& kernelY, const GaussianKernel1D& kernelZ,
+      ConvolutionMode mode) :
+      x(width, kernelX.getData(), kernelX.getRadius(), mode, false),
+      y(height, kernelY.getData(), kernelY.getRadius(), mode, true),
+      convolverZ(createRowConvolver(mode, kernelZ.getData(), 2 * kernelZ.getRadius() + 1, 2 * kernelZ.getRadius() + 1)),
+      rows(2 * kernelZ.getRadius() + 1), sum(width),
+      weightsX(kernelX.getData(), kernelX.getData() + 2 * kernelX.getRadius() + 1),
+      weightsY(kernelY.getData(), kernelY.getData() + 2 * kernelY.getRadius() + 1),
+      weightsZ(kernelZ.getData(), kernelZ.getData() + 2 * kernelZ.getRadius() + 1),
+      mode(mode)
+    {
+    }
+
+    // Whether this was made for the same dimensions, kernels and mode, comparing the weights of
+    // the kernels rather than their addresses, which may be reused by another kernel.
+    bool isFor(int width, int height,
+      const GaussianKernel1D& kernelX, const GaussianKernel1D& kernelY, const GaussianKernel1D& kernelZ,
+      ConvolutionMode mode) const
+    {
+      return x.length == width && y.length == height && this->mode == mode &&
+        hasWeights(weightsX, kernelX) && hasWeights(weightsY, kernelY) && hasWeights(weightsZ, kernelZ);
+    }
+
+    ConvolutionScratch x;
+    ConvolutionScratch y;
+    std::unique_ptr<RowConvolver> convolverZ;
+    std::vector<const float*> rows;
+    std::vector<float> sum;
+
+  private:
+    static bool hasWeights(const std::vector<float>& weights, const GaussianKernel1D& kernel)
+    {
+      return weights.size() == (size_t)(2 * kernel.getRadius() + 1) && std::equal(weights.begin(), weights.end(), kernel.getData());
+    }
+
+    std::vector<float> weightsX, weightsY, weightsZ;
+    ConvolutionMode mode;
+  };
+
+  // Memory used by gaussianSmooth3d, which can be kept and reused by later calls. Entries of
+  // threads are indexed by OpenMP thread number, and each is rebuilt when the dimensions, kernels
+  // or mode differ from those it was made for.
+  struct SmoothingWorkspace
+  {
+    std::vector<float, AlignmentAllocator<float, 64>> ring;
+    std::vector<std::unique_ptr<SmoothingScratch>> threads;
+  };
+
+  // Smooths the region of a 3D volume of pixel type T with a separable Gaussian kernel in a single
+  // streaming pass, as gaussianSmooth3d below, giving each row of the result to a sink rather than
+  // writing it. The sink has a member writeRow(z, v, row), called from several threads at once,
+  // that takes the width of the region of float results for row v of slice z, both counted from
+  // the corner of the region. If the enum EndsSlices of the sink is nonzero, its member
+  // endSlice(z) is called on one thread once every row of slice z has been given, and returns
+  // false to stop before the next slice. Only slices within a kernel radius of one that a row was
+  // given for have been read by then.
+  template<typename T, typename float(*Reader)(const T*), typename Sink>
+  void gaussianSmooth3dRows(
+    int width, int height, int depth,
+    const unsigned char* source, int leap, int stride, int hop,
+    const Region3d& region,
+    const GaussianKernel1D& kernelX, const GaussianKernel1D& kernelY, const GaussianKernel1D& kernelZ,
+    const ConvolutionOptions& options, SmoothingWorkspace& workspace, Sink& sink)
+  {
+    if (width <= 0 || height <= 0 || depth <= 0)
+      return;
+    if (!region.isInside(width, height, depth))
+      throw std::exception("Region was out of range.");
+    if (region.isEmpty())
+      return;
+
+    const int W = RowConvolver::TileWidth;
+    const ConvolutionMode mode = resolveConvolutionMode(options.mode); // throws here rather than inside the parallel region
+    const int radiusX = kernelX.getRadius(), radiusY = kernelY.getRadius(), radiusZ = kernelZ.getRadius();
+
+    // Output dimensions, and the rows and slices that are read to produce them
+    const int outputWidth = region.getWidth(), outputHeight = region.getHeight();
+    const int firstRow = std::max(0, region.minimumY - radiusY), lastRow = std::min(height - 1, region.maximumY + radiusY);
+    const int firstSlice = std::max(0, region.minimumZ - radiusZ), lastSlice = std::min(depth - 1, region.maximumZ + radiusZ);
+    const int rowCount = lastRow - firstRow + 1, sliceCount = lastSlice - firstSlice + 1;
+
+    const int tileCount = (outputWidth + W - 1) / W;
+    const size_t sliceSize = (size_t)outputWidth * rowCount;
+    const int threadCount = resolveThreadCount(options.threadCount, std::max(rowCount, tileCount));
+
+    // A window of 2*radiusZ+1 consecutive slices, or every slice read if that is fewer, contains
+    // every slice needed for one output slice, even when the edges are reflected more than once.
+    const int ringSize = std::min(2 * radiusZ + 1, sliceCount);
+    std::vector<float, AlignmentAllocator<float, 64>>& ring = workspace.ring;
+    ring.resize(sliceSize * ringSize);
+    // The scratch of each thread is made here rather than inside the parallel region, where
+    // memory that cannot be allocated would end the process rather than throw
+    if ((int)workspace.threads.size() < threadCount)
+      workspace.threads.resize(threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+      std::unique_ptr<SmoothingScratch>& scratch = workspace.threads[i];
+      if (!scratch || !scratch->isFor(outputWidth, outputHeight, kernelX, kernelY, kernelZ, mode))
+        scratch.reset(new SmoothingScratch(outputWidth, outputHeight, kernelX, kernelY, kernelZ, mode));
+    }
+
+    // Progress is counted in output slices. Cancellation is checked by one thread after each
+    // slice, behind a barrier, so that every thread leaves the loop over slices at the same one.
+    OperationProgress* const progress = options.progress;
+    if (progress != nullptr)
+      progress->expect(region.getDepth());
+    const bool endsSlices = Sink::EndsSlices != 0;
+    bool cancelled = false, stopped = false;
+
+    // One parallel region for the whole volume. Every thread steps through the slices together,
+    // sharing out the rows and tiles of each one, and the barrier at the end of each loop keeps
+    // them in step.
+#pragma omp parallel num_threads(threadCount)
+    {
+      std::unique_ptr<SmoothingScratch>& scratch = workspace.threads[omp_get_thread_num()];
+      ConvolutionScratch& x = scratch->x;
+      ConvolutionScratch& y = scratch->y;
+      std::vector<const float*>& rows = scratch->rows;
+      std::vector<float>& sum = scratch->sum;
+
+      for (int z = region.minimumZ; z <= region.maximumZ; z++)
+      {
+        // Read ahead until the ring holds every slice within radiusZ of this one
+        const int begin = z == region.minimumZ ? firstSlice : std::min(lastSlice + 1, z + radiusZ);
+        const int end = std::min(lastSlice + 1, z + radiusZ + 1);
+        for (int j = begin; j < end; j++)
+        {
+          float* slice = &ring[((j - firstSlice) % ringSize) * sliceSize];
+          const unsigned char* input = source + (size_t)j * leap;
+
+#pragma omp for schedule(static)
+          for (int v = firstRow; v <= lastRow; v++)
+          {
+            // Gather the row with a kernel radius either side, reflected about the edges of the volume
+            float* p = &(x.inputRow[0]);
+            const unsigned char* q = input + (size_t)v*stride;
+            for (int u = region.minimumX - radiusX; u <= region.maximumX + radiusX; u++)
+            {
+              const int mirrored = u < 0 || u >= width ? mirrorIndex(u, width) : u;
+              *p++ = Reader((const T*)(q + (size_t)mirrored*hop));
+            }
+
+            x.convolver->convolve(&(x.inputRow[0]), slice + (size_t)(v - firstRow) * outputWidth);
+          }
+
+#pragma omp for schedule(static)
+          for (int tile = 0; tile < tileCount; tile++)
+          {
+            const int first = tile * W;
+            const int columns = std::min(W, outputWidth - first);
+
+            for (int i = 0; i < outputHeight + 2 * radiusY; i++)
+            {
+              const int v = mirrorIndex(region.minimumY - radiusY + i, height) - firstRow;
+              std::copy_n(slice + (size_t)v * outputWidth + first, columns, &y.inputTile[i * W]);
+            }
+
+            y.convolver->convolveTile(&(y.inputTile[0]), &(y.outputTile[0]));
+
+            for (int v = 0; v < outputHeight; v++)
+              std::copy_n(&y.outputTile[v * W], columns, slice + (size_t)(region.minimumY - firstRow + v) * outputWidth + first);
+          }
+        }
+
+#pragma omp for schedule(static)
+        for (int v = 0; v < outputHeight; v++)
+        {
+          for (int k = -radiusZ; k <= radiusZ; k++)
+          {
+            const int j = mirrorIndex(z + k, depth);
+            rows[radiusZ + k] = &ring[((j - firstSlice) % ringSize) * sliceSize + (size_t)(region.minimumY - firstRow + v) * outputWidth];
+          }
+          scratch->convolverZ->convolveRows(&(rows[0]), &(sum[0]), outputWidth);
+          sink.writeRow(z - region.minimumZ, v, &(sum[0]));
+        }
+
+        if (progress != nullptr || endsSlices)
+        {
+#pragma omp single
+          {
+            if (endsSlices && !sink.endSlice(z - region.minimumZ))
+              stopped = true;
+            if (progress != nullptr)
+            {
+              progress->advance(1);
+              cancelled = progress->isCancelled();
+            }
+          }
+          if (cancelled || stopped)
+            break;
+        }
+      }
+    }
+
+    if (cancelled && !stopped)
+      throw OperationCancelled();
+  }
+
+  // The sink of gaussianSmooth3dRows that writes each voxel of the result as T with Writer.
+  template<typename T, typename void(*Writer)(float, T*)>
+  struct SmoothedVolumeWriter
+  {
+    enum { EndsSlices = 0 };
+
+    void writeRow(int z, int v, const float* row) const
+    {
+      unsigned char* r = destination + (size_t)z*leap + (size_t)v*stride;
+      for (int u = 0; u < width; u++)
+      {
+        Writer(row[u], (T*)(r));
+        r += hop;
+      }
+    }
+
+    bool endSlice(int) const
+    {
+      return true;
+    }
+
+    unsigned char* destination;
+    int leap, stride, hop, width;
+  };
+
+  // Smooths a 3D volume of pixel type T with a separable Gaussian kernel in a single streaming
+  // pass. Each input slice is read once, smoothed in X and Y into a float slice held in a ring
+  // buffer of 2*radiusZ+1 slices, and each output slice is written once as the weighted sum of
+  // the slices around it. Compared with three convolve1d sweeps this reads and writes the volume
+  // once rather than three times, and there is no rounding to T between the axes.
+  //
+  // Only the voxels in region are written, and only those within a kernel radius of it are read.
+  // The result is the same as smoothing the whole volume, which is reflected about its own edges.
+  // Voxel (x, y, z) of the region is written to destination + (z - region.minimumZ)*destinationLeap
+  // + (y - region.minimumY)*destinationStride + (x - region.minimumX)*destinationHop, so the
+  // destination may be a buffer the size of the region or the source volume itself: every input
+  // slice that an output slice depends on has been read before it is written.
+  template<typename T, typename float(*Reader)(const T*), typename void(*Writer)(float, T*)>
+  void gaussianSmooth3d(
+    int width, int height, int depth,
+    const unsigned char* source, int leap, int stride, int hop,
+    unsigned char* destination, int destinationLeap, int destinationStride, int destinationHop,
+    const Region3d& region,
+    const GaussianKernel1D& kernelX, const GaussianKernel1D& kernelY, const GaussianKernel1D& kernelZ,
+    const ConvolutionOptions& options, SmoothingWorkspace& workspace)
+  {
+    SmoothedVolumeWriter<T, Writer> writer = { destination, destinationLeap, destinationStride, destinationHop, region.getWidth() };
+    gaussianSmooth3dRows<T, Reader>(width, height, depth, source, leap, stride, hop, region,
+      kernelX, kernelY, kernelZ, options, workspace, writer);
+  }
+
+  template<typename T, typename float(*Reader)(const T*) = readerT<T>, typename void(*Writer)(float, T*) = writerT<T> >
+  void gaussianSmooth3d(
+    int width, int height, int depth,
+    const unsigned char* source, int leap, int stride, int hop,
+    unsigned char* destination, int destinationLeap, int destinationStride, int destinationHop,
+    const Region3d& region,
+    const GaussianKernel1D& kernelX, const GaussianKernel1D& kernelY, const GaussianKernel1D& kernelZ,
+    const ConvolutionOptions& options = ConvolutionOptions())
+  {
+    SmoothingWorkspace workspace;
+    gaussianSmooth3d<T, Reader, Writer>(width, height, depth, source, leap, stride, hop,
+      destination, destinationLeap, destinationStride, destinationHop, region, kernelX, kernelY, kernelZ, options, workspace);
+  }
+
+  // Smooths the whole of a volume in place.
+  template<typename T, typename float(*Reader)(const T*) = readerT<T>, typename void(*Writer)(float, T*) = writerT<T> >
+  void gaussianSmooth3d(
+    int width, int height, int depth,
+    unsigned char* buffer, int leap, int stride, int hop,
+    const GaussianKernel1D& kernelX, const GaussianKernel1D& kernelY, const GaussianKernel1D& kernelZ,
+    const ConvolutionOptions& options = ConvolutionOptions())
+  {
+    gaussianSmooth3d<T, Reader, Writer>(width, height, depth, buffer, leap, stride, hop,
+      buffer, leap, stride, hop, Region3d(width, height, depth), kernelX, kernelY, kernelZ, options);
+  }
+
+  // As above, with the Gaussian kernels for the standard deviation along each axis in voxels, from
+  // the cache kept by GaussianKernel1D.
+  template<typename T>
+  void gaussianSmooth3d(
+    int width, int height, int depth,
+    unsigned char* buffer, int leap, int stride, int hop,
+    float sigmaX, float sigmaY, float sigmaZ,
+    const ConvolutionOptions& options = ConvolutionOptions())
+  {
+    std::shared_ptr<const GaussianKernel1D> kernelX = GaussianKernel1D::get(sigmaX, 0.001f, GaussianSampling::Point, width);
+    std::shared_ptr<const GaussianKernel1D> kernelY = GaussianKernel1D::get(sigmaY, 0.001f, GaussianSampling::Point, height);
+    std::shared_ptr<const GaussianKernel1D> kernelZ = GaussianKernel1D::get(sigmaZ, 0.001f, GaussianSampling::Point, depth);
+    gaussianSmooth3d<T>(width, height, depth, buffer, leap, stride, hop, *kernelX, *kernelY, *kernelZ, options);
+  }
+}
@@ -0,0 +1,47 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include "parallel.h"
+
+namespace createdataset
+{
+  // Writes foreground to the output for each voxel of the input of type T from lower to upper
+  // inclusive, and background for the rest, with up to threadCount threads (zero for one per
+  // processor). The output is bytes, and may be the input if T is unsigned char.
+  template<typename T>
+  void threshold(
+    int width,
+    int height,
+    int depth,
+    const void* inputBuffer,  // of type T
+    int inputLeap,
+    int inputStride,
+    T lower,
+    T upper,
+    unsigned char foreground,
+    unsigned char background,
+    void* outputBuffer,  // of type unsigned char
+    int outputLeap,
+    int outputStride,
+    int threadCount = 0)
+  {
+    if (width <= 0 || height <= 0 || depth <= 0)
+      return;
+
+    const int count = height * depth;
+#pragma omp parallel for num_threads(resolveThreadCount(threadCount, depth)) schedule(static)
+    for (int i = 0; i < count; i++)
+    {
+      const int v = i % height, w = i / height;
+      const T* p = (const T*)((const unsigned char*)inputBuffer + (size_t)w*inputLeap + (size_t)v*inputStride);
+      unsigned char* o = (unsigned char*)outputBuffer + (size_t)w*outputLeap + (size_t)v*outputStride;
+      for (int u = 0; u < width; u++)
+        o[u] = p[u] >= lower && p[u] <= upper ? foreground : background;
+    }
+  }
+}
@@ -0,0 +1,121 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+
+#include "Stopwatch.h"
+
+namespace createdataset { namespace benchmark
+{
+  std::vector<BenchmarkResult> runBenchmarks(const std::vector<BenchmarkCase>& cases, const BenchmarkOptions& options)
+  {
+    std::vector<BenchmarkResult> results;
+    printf("%-56s %10s %12s %10s\n", "case", "ms", "Mvoxel/s", "GB/s");
+    for (size_t c = 0; c < cases.size(); c++)
+    {
+      const BenchmarkCase& benchmark = cases[c];
+      if (benchmark.name.find(options.filter) == std::string::npos)
+        continue;
+
+      std::vector<double> times;
+      {
+        std::function<void()> run = benchmark.prepare();
+
+        // The first run pages in the inputs and fills the caches of kernels and scratch memory
+        run();
+        Stopwatch stopwatch;
+        for (int r = 0; r < std::max(1, options.repetitions); r++)
+        {
+          stopwatch.Start();
+          run();
+          stopwatch.Stop();
+          times.push_back(stopwatch.MilliSeconds());
+        }
+      }
+
+      // The median is steadier than the mean against the odd run that is interrupted
+      std::sort(times.begin(), times.end());
+      const size_t n = times.size();
+      const double milliseconds = n % 2 == 1 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+      const double seconds = std::max(milliseconds, 1e-6) / 1000;
+
+      BenchmarkResult result = { benchmark.name, milliseconds, benchmark.voxels / seconds, benchmark.bytes / seconds };
+      printf("%-56s %10.3f %12.1f %10.2f\n", result.name.c_str(), result.milliseconds, result.voxelsPerSecond / 1e6, result.bytesPerSecond / 1e9);
+      fflush(stdout);
+      results.push_back(result);
+    }
+    return results;
+  }
+
+  std::map<std::string, BenchmarkResult> readBaseline(const std::string& path)
+  {
+    std::ifstream file(path.c_str());
+    if (!file)
+      throw std::exception("Cannot read the baseline.");
+
+    std::map<std::string, BenchmarkResult> baseline;
+    std::string line;
+    while (std::getline(file, line))
+    {
+      if (line.empty() || line[0] == '#')
+        continue;
+
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::istringstream fields(line);
+      BenchmarkResult result;
+      if (!(fields >> result.name >> result.milliseconds >> result.voxelsPerSecond >> result.bytesPerSecond))
+        throw std::exception("The baseline has a line that is not name, milliseconds, voxels per second and bytes per second.");
+      baseline[result.name] = result;
+    }
+    return baseline;
+  }
+
+  void writeBaseline(const std::string& path, const std::vector<BenchmarkResult>& results, const std::string& comment)
+  {
+    std::ofstream file(path.c_str());
+    if (!file)
+      throw std::exception("Cannot write the baseline.");
+
+    file << "# " << comment << "\n";
+    file << "# name,milliseconds,voxelsPerSecond,bytesPerSecond\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const BenchmarkResult& result = results[i];
+      char values[128];
+      sprintf_s(values, ",%.4f,%.6g,%.6g", result.milliseconds, result.voxelsPerSecond, result.bytesPerSecond);
+      file << result.name << values << "\n";
+    }
+  }
+
+  int compareWithBaseline(const std::vector<BenchmarkResult>& results, const std::map<std::string, BenchmarkResult>& baseline, const BenchmarkOptions& options)
+  {
+    int regressions = 0;
+    printf("\n%-56s %12s %12s %8s\n", "case", "Mvoxel/s", "baseline", "ratio");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const BenchmarkResult& result = results[i];
+      auto found = baseline.find(result.name);
+      if (found == baseline.end())
+      {
+        printf("%-56s %12.1f %12s\n", result.name.c_str(), result.voxelsPerSecond / 1e6, "none");
+        continue;
+      }
+
+      const double ratio = result.voxelsPerSecond / found->second.voxelsPerSecond;
+      const bool regression = ratio < 1 - options.tolerance;
+      regressions += regression;
+      printf("%-56s %12.1f %12.1f %8.2f%s\n", result.name.c_str(), result.voxelsPerSecond / 1e6,
+        found->second.voxelsPerSecond / 1e6, ratio, regression ? "  REGRESSION" : "");
+    }
+    return regressions;
+  }
+} }
@@ -0,0 +1,78 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+namespace createdataset { namespace benchmark
+{
+  // One case of the benchmark suite. Prepare makes the inputs, untimed, and returns the operation
+  // that is timed, which may be run many times on them; the inputs are freed before the next case,
+  // so only those of one case are in memory at once. Voxels and bytes are the work of one run,
+  // with bytes counting every voxel read and written once, from which the rates are found.
+  struct BenchmarkCase
+  {
+    std::string name;
+    double voxels;
+    double bytes;
+    std::function<std::function<void()>()> prepare;
+  };
+
+  // The speed of one case: the median time of its runs, and the rates at that time.
+  struct BenchmarkResult
+  {
+    std::string name;
+    double milliseconds;
+    double voxelsPerSecond;
+    double bytesPerSecond;
+  };
+
+  // Which cases to make and how to run them.
+  struct BenchmarkOptions
+  {
+    BenchmarkOptions() : repetitions(5), full(false), tolerance(0.1)
+    {
+    }
+
+    // Cases whose names do not contain this are skipped
+    std::string filter;
+
+    // Timed runs of each case, after one untimed run
+    int repetitions;
+
+    // Add larger volumes and the rarer parameters to the sweep
+    bool full;
+
+    // A case is a regression if its voxels per second are below the baseline by more than this fraction
+    double tolerance;
+  };
+
+  // Adds the cases of the convolution backends, of ConvolutionPlan along each direction and of
+  // gaussianSmooth3d, over pixel type, sigma, backend and thread count.
+  void addConvolutionBenchmarks(const BenchmarkOptions& options, std::vector<BenchmarkCase>& cases);
+
+  // Adds the cases of connected components and the component filters on synthetic sparse and
+  // dense masks, over connectivity and thread count.
+  void addComponentBenchmarks(const BenchmarkOptions& options, std::vector<BenchmarkCase>& cases);
+
+  // Runs each case whose name matches options.filter, printing each result as it is found.
+  std::vector<BenchmarkResult> runBenchmarks(const std::vector<BenchmarkCase>& cases, const BenchmarkOptions& options);
+
+  // Reads a baseline written by writeBaseline, by case name. Throws if the file cannot be read.
+  std::map<std::string, BenchmarkResult> readBaseline(const std::string& path);
+
+  // Writes results as comma separated lines of name, milliseconds, voxels per second and bytes per
+  // second, after comment, a line starting with #.
+  void writeBaseline(const std::string& path, const std::vector<BenchmarkResult>& results, const std::string& comment);
+
+  // Prints each result against its baseline, and returns the number of regressions beyond
+  // options.tolerance. Cases missing from the baseline are listed but are not regressions.
+  int compareWithBaseline(const std::vector<BenchmarkResult>& results, const std::map<std::string, BenchmarkResult>& baseline, const BenchmarkOptions& options);
+} }
@@ -0,0 +1,197 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "Benchmark.h"
+
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include "connectedComponents.h"
+#include "ComponentFilters.h"
+#include "smoothedComponents.h"
+#include "threshold.h"
+
+namespace createdataset { namespace benchmark
+{
+  namespace
+  {
+    typedef std::shared_ptr<std::vector<unsigned char>> Mask;
+
+    // Balls of radius 3 to 8 voxels at random, covering a few percent of the volume, like the
+    // structures of a segmentation: few runs and few components.
+    Mask sparseMask(int width, int height, int depth)
+    {
+      std::mt19937 random(4321);
+      Mask mask(new std::vector<unsigned char>((size_t)width * height * depth, 0));
+      const int balls = (int)((size_t)width * height * depth / 20000);
+      for (int b = 0; b < balls; b++)
+      {
+        const int r = 3 + (int)(random() % 6);
+        const int cx = (int)(random() % width), cy = (int)(random() % height), cz = (int)(random() % depth);
+        for (int z = std::max(0, cz - r); z <= std::min(depth - 1, cz + r); z++)
+          for (int y = std::max(0, cy - r); y <= std::min(height - 1, cy + r); y++)
+            for (int x = std::max(0, cx - r); x <= std::min(width - 1, cx + r); x++)
+            {
+              if ((x - cx)*(x - cx) + (y - cy)*(y - cy) + (z - cz)*(z - cz) <= r*r)
+                (*mask)[((size_t)z*height + y)*width + x] = 1;
+            }
+      }
+      return mask;
+    }
+
+    // Every voxel foreground with probability one half: a run every two voxels and a great many
+    // components, the worst case for labelling.
+    Mask denseMask(int width, int height, int depth)
+    {
+      std::mt19937 random(8765);
+      Mask mask(new std::vector<unsigned char>((size_t)width * height * depth));
+      for (size_t i = 0; i < mask->size(); i++)
+        (*mask)[i] = (unsigned char)(random() & 1);
+      return mask;
+    }
+
+    std::string caseName(const char* operation, const char* maskName, int width, int height, int depth, const char* connectivity, int threadCount)
+    {
+      std::ostringstream name;
+      name << operation << "/" << maskName << "/" << width << "x" << height << "x" << depth << "/" << connectivity
+        << "/threads" << (threadCount == 0 ? std::string("All") : std::to_string(threadCount));
+      return name.str();
+    }
+
+    template<Connectivity C>
+    void addCases(
+      int width, int height, int depth,
+      const char* maskName, Mask(*makeMask)(int, int, int),
+      const char* connectivity, std::vector<BenchmarkCase>& cases)
+    {
+      const size_t voxels = (size_t)width * height * depth;
+      const int threadCounts[] = { 1, 0 };
+      const int leap = width * height, stride = width;
+
+      // The serial labelling, with 32 bit labels so that the dense mask does not run out of them
+      {
+        BenchmarkCase benchmark;
+        benchmark.name = caseName("components/serial", maskName, width, height, depth, connectivity, 1);
+        benchmark.voxels = (double)voxels;
+        benchmark.bytes = (double)voxels * (1 + sizeof(unsigned int));
+        benchmark.prepare = [=]()
+        {
+          Mask mask = makeMask(width, height, depth);
+          std::shared_ptr<std::vector<unsigned int>> labels(new std::vector<unsigned int>(voxels));
+          return std::function<void()>([=]()
+          {
+            findConnectedComponents3d<unsigned char, unsigned int, C>(width, height, depth,
+              &(*mask)[0], leap, stride, (unsigned char)0, &(*labels)[0], leap * 4, stride * 4, 0u);
+          });
+        };
+        cases.push_back(benchmark);
+      }
+
+      for (int threadCount : threadCounts)
+      {
+        BenchmarkCase benchmark;
+        benchmark.name = caseName("components/parallel", maskName, width, height, depth, connectivity, threadCount);
+        benchmark.voxels = (double)voxels;
+        benchmark.bytes = (double)voxels * (1 + sizeof(unsigned int));
+        benchmark.prepare = [=]()
+        {
+          Mask mask = makeMask(width, height, depth);
+          std::shared_ptr<std::vector<unsigned int>> labels(new std::vector<unsigned int>(voxels));
+          return std::function<void()>([=]()
+          {
+            findConnectedComponents3dParallel<unsigned char, unsigned int, C>(width, height, depth,
+              &(*mask)[0], leap, stride, (unsigned char)0, &(*labels)[0], leap * 4, stride * 4, 0u, threadCount);
+          });
+        };
+        cases.push_back(benchmark);
+
+        // The filter of the mask that most pipelines apply, which needs no label volume
+        benchmark.name = caseName("filters/keeplargest", maskName, width, height, depth, connectivity, threadCount);
+        benchmark.bytes = (double)voxels * 2;
+        benchmark.prepare = [=]()
+        {
+          Mask mask = makeMask(width, height, depth);
+          std::shared_ptr<std::vector<unsigned char>> output(new std::vector<unsigned char>(voxels));
+          return std::function<void()>([=]()
+          {
+            keepLargestComponent<unsigned char, C>(width, height, depth, &(*mask)[0], leap, stride, (unsigned char)0,
+              &(*output)[0], leap, stride, threadCount);
+          });
+        };
+        cases.push_back(benchmark);
+      }
+    }
+
+    // Smoothing a mask, thresholding it back to binary and labelling it, the most common sequence
+    // of the pipelines, fused by findSmoothedComponents3d and as three steps over whole volumes.
+    void addSmoothedCases(int width, int height, int depth, std::vector<BenchmarkCase>& cases)
+    {
+      const size_t voxels = (size_t)width * height * depth;
+      const int threadCounts[] = { 1, 0 };
+      const int leap = width * height, stride = width;
+      const float sigma = 1.0f;
+
+      for (int threadCount : threadCounts)
+      {
+        BenchmarkCase benchmark;
+        benchmark.name = caseName("smoothed/fused", "sparse", width, height, depth, "face", threadCount);
+        benchmark.voxels = (double)voxels;
+        benchmark.bytes = (double)voxels * (1 + sizeof(unsigned short));
+        benchmark.prepare = [=]()
+        {
+          Mask mask = sparseMask(width, height, depth);
+          std::shared_ptr<std::vector<unsigned short>> labels(new std::vector<unsigned short>(voxels));
+          return std::function<void()>([=]()
+          {
+            ConvolutionOptions options;
+            options.threadCount = threadCount;
+            findSmoothedComponents3d<unsigned char, unsigned short>(width, height, depth, &(*mask)[0], leap, stride,
+              sigma, sigma, sigma, (unsigned char)128, (unsigned char)255, &(*labels)[0], leap * 2, stride * 2, (unsigned short)0, options);
+          });
+        };
+        cases.push_back(benchmark);
+
+        // The smoothed copy and the thresholded mask are each written and read again
+        benchmark.name = caseName("smoothed/separate", "sparse", width, height, depth, "face", threadCount);
+        benchmark.bytes = (double)voxels * (2 + 2 + 1 + sizeof(unsigned short));
+        benchmark.prepare = [=]()
+        {
+          Mask mask = sparseMask(width, height, depth);
+          std::shared_ptr<std::vector<unsigned char>> smoothed(new std::vector<unsigned char>(voxels));
+          std::shared_ptr<std::vector<unsigned short>> labels(new std::vector<unsigned short>(voxels));
+          return std::function<void()>([=]()
+          {
+            ConvolutionOptions options;
+            options.threadCount = threadCount;
+            *smoothed = *mask;
+            gaussianSmooth3d<unsigned char>(width, height, depth, &(*smoothed)[0], leap, stride, 1, sigma, sigma, sigma, options);
+            threshold<unsigned char>(width, height, depth, &(*smoothed)[0], leap, stride, 128, 255, 1, 0, &(*smoothed)[0], leap, stride, threadCount);
+            findConnectedComponents3dParallel<unsigned char, unsigned short, Connectivity::Face>(width, height, depth,
+              &(*smoothed)[0], leap, stride, (unsigned char)0, &(*labels)[0], leap * 2, stride * 2, (unsigned short)0, threadCount);
+          });
+        };
+        cases.push_back(benchmark);
+      }
+    }
+
+    void addSizeCases(int width, int height, int depth, std::vector<BenchmarkCase>& cases)
+    {
+      addCases<Connectivity::Face>(width, height, depth, "sparse", &sparseMask, "face", cases);
+      addCases<Connectivity::Face>(width, height, depth, "dense", &denseMask, "face", cases);
+      addCases<Connectivity::Vertex>(width, height, depth, "sparse", &sparseMask, "vertex", cases);
+      addCases<Connectivity::Vertex>(width, height, depth, "dense", &denseMask, "vertex", cases);
+      addSmoothedCases(width, height, depth, cases);
+    }
+  }
+
+  void addComponentBenchmarks(const BenchmarkOptions& options, std::vector<BenchmarkCase>& cases)
+  {
+    addSizeCases(256, 256, 64, cases);
+    if (options.full)
+      addSizeCases(512, 512, 128, cases);
+  }
+} }
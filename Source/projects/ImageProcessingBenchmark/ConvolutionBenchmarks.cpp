@@ -0,0 +1,214 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "Benchmark.h"
+
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include "RowConvolver.h"
+#include "GaussianKernel1D.h"
+#include "ConvolutionPlan.h"
+
+namespace createdataset { namespace benchmark
+{
+  namespace
+  {
+    struct Mode
+    {
+      ConvolutionMode mode;
+      const char* name;
+    };
+
+    // Every backend this processor supports, so that a new one is benchmarked once it is added here
+    std::vector<Mode> supportedModes()
+    {
+      const Mode all[] =
+      {
+        { ConvolutionMode::Reference, "reference" },
+        { ConvolutionMode::Sse, "sse" },
+        { ConvolutionMode::Avx2, "avx2" },
+        { ConvolutionMode::Avx512, "avx512" },
+      };
+      std::vector<Mode> modes;
+      for (size_t m = 0; m < sizeof(all) / sizeof(all[0]); m++)
+      {
+        if (isConvolutionModeSupported(all[m].mode))
+          modes.push_back(all[m]);
+      }
+      return modes;
+    }
+
+    template<typename T> const char* typeName();
+    template<> const char* typeName<unsigned char>() { return "byte"; }
+    template<> const char* typeName<short>() { return "short"; }
+    template<> const char* typeName<float>() { return "float"; }
+
+    template<typename T>
+    std::shared_ptr<std::vector<T>> randomVolume(size_t voxels)
+    {
+      std::mt19937 random(1234);
+      std::uniform_int_distribution<int> values(0, 255);
+      std::shared_ptr<std::vector<T>> volume(new std::vector<T>(voxels));
+      for (size_t i = 0; i < voxels; i++)
+        (*volume)[i] = (T)values(random);
+      return volume;
+    }
+
+    std::string threadName(int threadCount)
+    {
+      return threadCount == 0 ? "All" : std::to_string(threadCount);
+    }
+
+    // One kernel convolved along outputs * rows samples with RowConvolver::convolve, or with
+    // convolveTile over tiles of TileWidth columns, all in cache, for the speed of the backend alone.
+    void addRowCases(const Mode& mode, float sigma, bool tiles, std::vector<BenchmarkCase>& cases)
+    {
+      const int outputs = 512, rows = 16384;
+      std::ostringstream name;
+      name << (tiles ? "tiles/" : "rows/") << mode.name << "/sigma" << sigma;
+
+      BenchmarkCase benchmark;
+      benchmark.name = name.str();
+      benchmark.voxels = (double)outputs * rows;
+      benchmark.bytes = benchmark.voxels * 2 * sizeof(float);
+      benchmark.prepare = [=]()
+      {
+        std::shared_ptr<const GaussianKernel1D> kernel = GaussianKernel1D::get(sigma, 0.001f, GaussianSampling::Point, 1 << 20);
+        const int length = outputs + 2 * kernel->getRadius();
+        std::shared_ptr<RowConvolver> convolver(createRowConvolver(mode.mode, kernel->getData(), 2 * kernel->getRadius() + 1, length).release());
+
+        const int width = tiles ? RowConvolver::TileWidth : 1;
+        std::shared_ptr<std::vector<float>> input(new std::vector<float>((size_t)length * width));
+        std::shared_ptr<std::vector<float>> output(new std::vector<float>((size_t)outputs * width));
+        for (size_t i = 0; i < input->size(); i++)
+          (*input)[i] = (float)(i % 97);
+
+        return std::function<void()>([=]()
+        {
+          for (int r = 0; r < rows / width; r++)
+          {
+            if (tiles)
+              convolver->convolveTile(&(*input)[0], &(*output)[0]);
+            else
+              convolver->convolve(&(*input)[0], &(*output)[0]);
+          }
+        });
+      };
+      cases.push_back(benchmark);
+    }
+
+    // A plan along directions executed in place on a volume of random voxels of type T.
+    template<typename T>
+    void addPlanCase(
+      int width, int height, int depth,
+      const std::vector<int>& directions, const char* directionName, float sigma,
+      const Mode& mode, bool fixedPoint, GaussianMethod method, int threadCount,
+      std::vector<BenchmarkCase>& cases)
+    {
+      std::ostringstream name;
+      name << "convolve/" << typeName<T>() << "/" << width << "x" << height << "x" << depth << "/" << directionName
+        << "/sigma" << sigma << "/" << (fixedPoint ? "fixed" : mode.name)
+        << (method == GaussianMethod::Recursive ? "/recursive" : "") << "/threads" << threadName(threadCount);
+
+      // Smoothing along all three axes at once reads and writes the volume once; otherwise once per direction
+      const size_t voxels = (size_t)width * height * depth;
+      const double passes = directions.size() == 3 && !fixedPoint && method != GaussianMethod::Recursive ? 1 : (double)directions.size();
+
+      BenchmarkCase benchmark;
+      benchmark.name = name.str();
+      benchmark.voxels = (double)voxels;
+      benchmark.bytes = passes * voxels * 2 * sizeof(T);
+      benchmark.prepare = [=]()
+      {
+        ConvolutionOptions options;
+        options.mode = mode.mode;
+        options.fixedPoint = fixedPoint;
+        options.threadCount = threadCount;
+        std::shared_ptr<ConvolutionPlan> plan(new ConvolutionPlan(width, height, depth, directions,
+          std::vector<float>(directions.size(), sigma), options, GaussianSampling::Point, method));
+        std::shared_ptr<std::vector<T>> volume = randomVolume<T>(voxels);
+
+        return std::function<void()>([=]()
+        {
+          plan->template execute<T>((unsigned char*)&(*volume)[0], width * height * (int)sizeof(T), width * (int)sizeof(T), sizeof(T));
+        });
+      };
+      cases.push_back(benchmark);
+    }
+
+    template<typename T>
+    void addPlanCases(int width, int height, int depth, const BenchmarkOptions& options, std::vector<BenchmarkCase>& cases)
+    {
+      struct Directions
+      {
+        std::vector<int> directions;
+        const char* name;
+      };
+      const Directions sweeps[] =
+      {
+        { { 0 }, "x" },
+        { { 1 }, "y" },
+        { { 2 }, "z" },
+        { { 0, 1, 2 }, "xyz" },
+      };
+
+      const std::vector<Mode> modes = supportedModes();
+      const Mode automatic = { ConvolutionMode::Auto, "auto" };
+      const float sigmas[] = { 1.0f, 3.0f };
+      const int threadCounts[] = { 1, 0 };
+
+      for (const Directions& sweep : sweeps)
+      {
+        for (float sigma : sigmas)
+        {
+          for (int threadCount : threadCounts)
+          {
+            for (const Mode& mode : modes)
+              addPlanCase<T>(width, height, depth, sweep.directions, sweep.name, sigma, mode, false, GaussianMethod::Direct, threadCount, cases);
+            if (IsFixedPointType<T>::value)
+              addPlanCase<T>(width, height, depth, sweep.directions, sweep.name, sigma, automatic, true, GaussianMethod::Direct, threadCount, cases);
+          }
+        }
+
+        // Wide kernels, where the recursive filter takes over from direct convolution
+        if (options.full)
+        {
+          for (int threadCount : threadCounts)
+          {
+            addPlanCase<T>(width, height, depth, sweep.directions, sweep.name, 8.0f, automatic, false, GaussianMethod::Direct, threadCount, cases);
+            addPlanCase<T>(width, height, depth, sweep.directions, sweep.name, 8.0f, automatic, false, GaussianMethod::Recursive, threadCount, cases);
+          }
+        }
+      }
+    }
+  }
+
+  void addConvolutionBenchmarks(const BenchmarkOptions& options, std::vector<BenchmarkCase>& cases)
+  {
+    const std::vector<Mode> modes = supportedModes();
+    const float sigmas[] = { 1.0f, 2.0f, 4.0f, 8.0f };
+    for (const Mode& mode : modes)
+    {
+      for (float sigma : sigmas)
+      {
+        addRowCases(mode, sigma, false, cases);
+        addRowCases(mode, sigma, true, cases);
+      }
+    }
+
+    addPlanCases<unsigned char>(256, 256, 64, options, cases);
+    addPlanCases<short>(256, 256, 64, options, cases);
+    addPlanCases<float>(256, 256, 64, options, cases);
+    if (options.full)
+    {
+      addPlanCases<unsigned char>(512, 512, 128, options, cases);
+      addPlanCases<short>(512, 512, 128, options, cases);
+      addPlanCases<float>(512, 512, 128, options, cases);
+    }
+  }
+} }
@@ -0,0 +1,96 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+// Microbenchmarks of the native image processing kernels. Each case is timed over several runs
+// and reported in voxels and bytes per second, and compared with a baseline if one is given.
+//
+//   ImageProcessingBenchmark [--filter text] [--repetitions n] [--full]
+//                            [--baseline file] [--tolerance fraction] [--record file] [--list]
+//
+// --filter runs only the cases whose names contain text, such as "convolve/float" or "threadsAll".
+// --full adds the 512x512x128 volumes and sigma 8. --baseline compares with a file written by
+// --record, and the exit code is the number of cases slower than it by more than --tolerance
+// (0.1 by default). Baselines depend on the machine and on its core count, which the threadsAll
+// cases use, so each is recorded with --record on the machine that compares against it. The
+// build compares with the baseline named by its benchmarkBaseline variable, and skips the
+// comparison where that is not set, as on the hosted agents, for which none is kept.
+
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <exception>
+
+using namespace createdataset::benchmark;
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    BenchmarkOptions options;
+    std::string baselinePath, recordPath;
+    bool list = false;
+    for (int i = 1; i < argc; i++)
+    {
+      const bool hasValue = i + 1 < argc;
+      if (strcmp(argv[i], "--filter") == 0 && hasValue)
+        options.filter = argv[++i];
+      else if (strcmp(argv[i], "--repetitions") == 0 && hasValue)
+        options.repetitions = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--full") == 0)
+        options.full = true;
+      else if (strcmp(argv[i], "--baseline") == 0 && hasValue)
+        baselinePath = argv[++i];
+      else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+        options.tolerance = atof(argv[++i]);
+      else if (strcmp(argv[i], "--record") == 0 && hasValue)
+        recordPath = argv[++i];
+      else if (strcmp(argv[i], "--list") == 0)
+        list = true;
+      else
+      {
+        fprintf(stderr, "Unknown argument %s.\n", argv[i]);
+        return -1;
+      }
+    }
+
+    std::vector<BenchmarkCase> cases;
+    addConvolutionBenchmarks(options, cases);
+    addComponentBenchmarks(options, cases);
+
+    if (list)
+    {
+      for (size_t c = 0; c < cases.size(); c++)
+      {
+        if (cases[c].name.find(options.filter) != std::string::npos)
+          printf("%s\n", cases[c].name.c_str());
+      }
+      return 0;
+    }
+
+    // Read first, so that a missing baseline is found before the cases are run
+    std::map<std::string, BenchmarkResult> baseline;
+    if (!baselinePath.empty())
+      baseline = readBaseline(baselinePath);
+
+    const std::vector<BenchmarkResult> results = runBenchmarks(cases, options);
+
+    if (!recordPath.empty())
+      writeBaseline(recordPath, results, "Recorded by ImageProcessingBenchmark" + std::string(options.full ? " --full" : ""));
+
+    if (baselinePath.empty())
+      return 0;
+    const int regressions = compareWithBaseline(results, baseline, options);
+    printf("\n%d of %d cases slower than the baseline by more than %.0f%%.\n", regressions, (int)results.size(), options.tolerance * 100);
+    return regressions;
+  }
+  catch (std::exception& oops)
+  {
+    fprintf(stderr, "%s\n", oops.what());
+    return -1;
+  }
+}
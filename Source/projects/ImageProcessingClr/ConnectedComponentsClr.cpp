@@ -5,35 +5,489 @@
  */
 
 #include "ConnectedComponentsClr.h"
+#include "NativeBatch.h"
+#include "NativeOperation.h"
 
 #include <cliext/vector>
 
 #pragma managed(push, off)
 #include "connectedComponents.h"
+#include "StreamingConnectedComponents.h"
+#include "ComponentFilters.h"
+#include "Instrumentation.h"
+#include "smoothedComponents.h"
 #pragma managed(pop)
 
 namespace InnerEye {  namespace CreateDataset { namespace ImageProcessing {
+      typedef createdataset::ComponentStatistics<unsigned char, unsigned short> NativeComponentStatistics;
+
+      // Labels image into output with the connectivity of options, accumulating the statistics of
+      // policy in values.
+      template<typename T, typename U, typename S>
+      static std::vector<createdataset::ComponentStatistics<T, U> > Label(
+        T* image,
+        int width, int height, int depth,
+        T backgroundColour,
+        U* output,
+        ConnectedComponentsOptions options,
+        const S& policy, std::vector<typename S::Value>& values,
+        createdataset::OperationProgress* progress)
+      {
+        int inputLeap = width*height*sizeof(T), inputStride = width*sizeof(T);
+        int outputLeap = width*height*sizeof(U), outputStride = width*sizeof(U);
+
+        switch (options.Connectivity)
+        {
+        case ComponentConnectivity::Edge:
+          return createdataset::findConnectedComponents3dParallel<T, U, createdataset::Connectivity::Edge>(
+            width, height, depth,
+            image, inputLeap, inputStride, backgroundColour,
+            output, outputLeap, outputStride,
+            (U)options.BackgroundLabel, options.ThreadCount, policy, values, progress);
+        case ComponentConnectivity::Vertex:
+          return createdataset::findConnectedComponents3dParallel<T, U, createdataset::Connectivity::Vertex>(
+            width, height, depth,
+            image, inputLeap, inputStride, backgroundColour,
+            output, outputLeap, outputStride,
+            (U)options.BackgroundLabel, options.ThreadCount, policy, values, progress);
+        default:
+          return createdataset::findConnectedComponents3dParallel<T, U, createdataset::Connectivity::Face>(
+            width, height, depth,
+            image, inputLeap, inputStride, backgroundColour,
+            output, outputLeap, outputStride,
+            (U)options.BackgroundLabel, options.ThreadCount, policy, values, progress);
+        }
+      }
+
+      static void CheckOptions(ConnectedComponentsOptions options)
+      {
+        if (options.ThreadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("options", "ThreadCount must not be negative.");
+        if (options.Connectivity != ComponentConnectivity::Face && options.Connectivity != ComponentConnectivity::Edge && options.Connectivity != ComponentConnectivity::Vertex)
+          throw gcnew System::ArgumentOutOfRangeException("options", "Connectivity was out of range.");
+      }
+
+      // Throws unless options.BackgroundLabel is a label of type U.
+      template<typename U>
+      static void CheckBackgroundLabel(ConnectedComponentsOptions options)
+      {
+        if ((unsigned long long)options.BackgroundLabel > (unsigned long long)std::numeric_limits<U>::max())
+          throw gcnew System::ArgumentOutOfRangeException("options", "BackgroundLabel does not fit the type of the labels.");
+      }
+
+      // Labels image into output, which hold at least one voxel. If geometry is not null, the
+      // geometry of each component is returned in it, with intensity sums from intensities if that
+      // is not null. If progress is not null it is advanced, and checked for cancellation.
+      template<typename T, typename U>
+      static std::vector<createdataset::ComponentStatistics<T, U> > LabelBuffers(
+        T* image,
+        int width, int height, int depth,
+        T backgroundColour,
+        U* output,
+        ConnectedComponentsOptions options,
+        short* intensities,
+        std::vector<createdataset::ComponentGeometry>* geometry,
+        createdataset::OperationProgress* progress = nullptr)
+      {
+        try
+        {
+          if (geometry == nullptr)
+          {
+            std::vector<createdataset::NoComponentStatistics::Value> values;
+            return Label<T, U>(image, width, height, depth, backgroundColour, output, options, createdataset::NoComponentStatistics(), values, progress);
+          }
+
+          createdataset::ComponentGeometryStatistics<T, short> policy(
+            width, height, depth,
+            image, width*height*sizeof(T), width*sizeof(T), backgroundColour,
+            intensities, width*height*sizeof(short), width*sizeof(short));
+          return Label<T, U>(image, width, height, depth, backgroundColour, output, options, policy, *geometry, progress);
+        }
+        catch (createdataset::OperationCancelled&)
+        {
+          throw gcnew System::OperationCanceledException();
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      // The statistics of a volume without voxels, which have an entry for the background only if
+      // its label is 0, as for findConnectedComponents3dParallel.
+      template<typename T, typename U>
+      static std::vector<createdataset::ComponentStatistics<T, U> > EmptyStatistics(T backgroundColour, ConnectedComponentsOptions options, std::vector<createdataset::ComponentGeometry>* geometry)
+      {
+        const size_t count = options.BackgroundLabel == 0 ? 1 : 0;
+        if (geometry != nullptr)
+          geometry->assign(count, createdataset::ComponentGeometry());
+        return std::vector<createdataset::ComponentStatistics<T, U> >(count, { 0, backgroundColour });
+      }
+
+      // Labels image into output, checking the arguments, as LabelBuffers.
+      template<typename T, typename U>
+      static std::vector<createdataset::ComponentStatistics<T, U> > Find3dT(
+        array<T>^ image,
+        int width, int height, int depth,
+        T backgroundColour,
+        array<U>^ output,
+        ConnectedComponentsOptions options,
+        array<short>^ intensities,
+        std::vector<createdataset::ComponentGeometry>* geometry)
+      {
+        if (image == nullptr || output == nullptr)
+          throw gcnew System::ArgumentNullException(image == nullptr ? "image" : "result");
+        if (width < 0 || height < 0 || depth < 0)
+          throw gcnew System::ArgumentOutOfRangeException("width", "Dimensions must not be negative.");
+        CheckOptions(options);
+        CheckBackgroundLabel<U>(options);
+
+        const long long voxelCount = (long long)width * height * depth;
+        if (image->LongLength != voxelCount || output->LongLength != voxelCount)
+          throw gcnew System::ArgumentException("The image and result arrays should have width * height * depth elements.");
+        if (intensities != nullptr && intensities->LongLength != voxelCount)
+          throw gcnew System::ArgumentException("The intensities array should have width * height * depth elements.");
+        createdataset::InstrumentedCall call("ConnectedComponents.Find3d", voxelCount, createdataset::resolveThreadCount(options.ThreadCount, depth));
+        if (voxelCount == 0)
+          return EmptyStatistics<T, U>(backgroundColour, options, geometry);
+
+        createdataset::InstrumentedStage pin("pin");
+        pin_ptr<T> inputBuffer = &image[0];
+        pin_ptr<U> outputBuffer = &output[0];
+        pin_ptr<short> intensityBuffer = nullptr;
+        if (intensities != nullptr)
+          intensityBuffer = &intensities[0];
+        pin.stop();
+        return LabelBuffers<T, U>(inputBuffer, width, height, depth, backgroundColour, outputBuffer, options, intensityBuffer, geometry);
+      }
+
+      // Throws unless a and b are volumes of the same dimensions.
+      template<typename A, typename B>
+      static void CheckVolumes(NativeVolume<A>^ a, System::String^ aName, NativeVolume<B>^ b, System::String^ bName)
+      {
+        if (a == nullptr)
+          throw gcnew System::ArgumentNullException(aName);
+        if (b == nullptr)
+          throw gcnew System::ArgumentNullException(bName);
+        if (a->DimX != b->DimX || a->DimY != b->DimY || a->DimZ != b->DimZ)
+          throw gcnew System::ArgumentException("The volumes should have the same dimensions.", bName);
+      }
+
+      // Labels native volume image into output as LabelBuffers.
+      template<typename T, typename U>
+      static std::vector<createdataset::ComponentStatistics<T, U> > Find3dVolume(
+        NativeVolume<T>^ image,
+        T backgroundColour,
+        NativeVolume<U>^ output,
+        ConnectedComponentsOptions options,
+        std::vector<createdataset::ComponentGeometry>* geometry,
+        createdataset::OperationProgress* progress = nullptr)
+      {
+        CheckVolumes(image, "image", output, "result");
+        CheckOptions(options);
+        CheckBackgroundLabel<U>(options);
+        createdataset::InstrumentedCall call("ConnectedComponents.Find3d", image->Length, createdataset::resolveThreadCount(options.ThreadCount, image->DimZ));
+        T* inputBuffer = (T*)image->GetBuffer();
+        U* outputBuffer = (U*)output->GetBuffer();
+        if (image->Length == 0)
+          return EmptyStatistics<T, U>(backgroundColour, options, geometry);
+
+        auto result = LabelBuffers<T, U>(inputBuffer, image->DimX, image->DimY, image->DimZ, backgroundColour, outputBuffer, options, nullptr, geometry, progress);
+        System::GC::KeepAlive(image);
+        System::GC::KeepAlive(output);
+        return result;
+      }
+
+      // Converts the statistics of Find3dT, and geometry if that is not null, to managed ones.
+      template<typename T, typename U>
+      static array<ComponentStatistics>^ ToManaged(
+        const std::vector<createdataset::ComponentStatistics<T, U> >& statistics,
+        const std::vector<createdataset::ComponentGeometry>* geometry,
+        T backgroundColour)
+      {
+        createdataset::InstrumentedStage stage("statistics");
+        auto result = gcnew array<ComponentStatistics>((int)statistics.size());
+        for (int i = 0; i < result->Length; i++)
+        {
+          result[i].PixelCount = statistics[i].pixelCount_;
+          result[i].InputLabel = statistics[i].inputLabel_;
+          if (geometry == nullptr || statistics[i].inputLabel_ == backgroundColour)
+            continue;
+
+          const createdataset::ComponentGeometry& g = (*geometry)[i];
+          result[i].MinimumX = g.minimumX;
+          result[i].MinimumY = g.minimumY;
+          result[i].MinimumZ = g.minimumZ;
+          result[i].MaximumX = g.maximumX;
+          result[i].MaximumY = g.maximumY;
+          result[i].MaximumZ = g.maximumZ;
+          if (statistics[i].pixelCount_ > 0)
+          {
+            result[i].CentroidX = g.sumX / statistics[i].pixelCount_;
+            result[i].CentroidY = g.sumY / statistics[i].pixelCount_;
+            result[i].CentroidZ = g.sumZ / statistics[i].pixelCount_;
+          }
+          result[i].IntensitySum = g.intensitySum;
+          result[i].SurfaceX = g.surfaceX;
+          result[i].SurfaceY = g.surfaceY;
+          result[i].SurfaceZ = g.surfaceZ;
+        }
+
+        return result;
+      }
+
+      // Labels image into output and returns the managed statistics, with the geometry of each
+      // component if withGeometry is set.
+      template<typename T, typename U>
+      static array<ComponentStatistics>^ Find3dWithStatisticsT(
+        array<T>^ image,
+        int width, int height, int depth,
+        T backgroundColour,
+        array<U>^ output,
+        ConnectedComponentsOptions options,
+        array<short>^ intensities,
+        bool withGeometry)
+      {
+        createdataset::InstrumentedCall call("ConnectedComponents.Find3dWithStatistics", (long long)width * height * depth,
+          createdataset::resolveThreadCount(options.ThreadCount, depth));
+        if (!withGeometry)
+          return ToManaged<T, U>(Find3dT<T, U>(image, width, height, depth, backgroundColour, output, options, nullptr, nullptr), nullptr, backgroundColour);
+
+        std::vector<createdataset::ComponentGeometry> geometry;
+        auto result_ = Find3dT<T, U>(image, width, height, depth, backgroundColour, output, options, intensities, &geometry);
+        return ToManaged<T, U>(result_, &geometry, backgroundColour);
+      }
+
+      // Labels native volume image into output and returns the managed statistics, with the
+      // geometry of each component if options.Geometry is set.
+      template<typename T, typename U>
+      static array<ComponentStatistics>^ Find3dWithStatisticsVolume(
+        NativeVolume<T>^ image,
+        T backgroundColour,
+        NativeVolume<U>^ output,
+        ConnectedComponentsOptions options,
+        createdataset::OperationProgress* progress)
+      {
+        CheckVolumes(image, "image", output, "result");
+        createdataset::InstrumentedCall call("ConnectedComponents.Find3dWithStatistics", image->Length,
+          createdataset::resolveThreadCount(options.ThreadCount, image->DimZ));
+        std::vector<createdataset::ComponentGeometry> geometry;
+        auto statistics = Find3dVolume<T, U>(image, backgroundColour, output, options, options.Geometry ? &geometry : nullptr, progress);
+        return ToManaged<T, U>(statistics, options.Geometry ? &geometry : nullptr, backgroundColour);
+      }
+
       int ConnectedComponents::Find3d(
         array<unsigned char>^ image,
         int width, int height, int depth,
         unsigned char backgroundColour,
         array<unsigned short>^ output)
       {
-        try
+        return Find3d(image, width, height, depth, backgroundColour, output, ConnectedComponentsOptions());
+      }
+
+      int ConnectedComponents::Find3d(
+        array<unsigned char>^ image,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        array<unsigned short>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return (int)(Find3dT<unsigned char, unsigned short>(image, width, height, depth, backgroundColour, output, options, nullptr, nullptr).size());
+      }
+
+      int ConnectedComponents::Find3d(
+        array<unsigned char>^ image,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        array<unsigned int>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return (int)(Find3dT<unsigned char, unsigned int>(image, width, height, depth, backgroundColour, output, options, nullptr, nullptr).size());
+      }
+
+      int ConnectedComponents::Find3d(
+        array<short>^ image,
+        int width, int height, int depth,
+        short backgroundColour,
+        array<unsigned short>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return (int)(Find3dT<short, unsigned short>(image, width, height, depth, backgroundColour, output, options, nullptr, nullptr).size());
+      }
+
+      int ConnectedComponents::Find3d(
+        array<short>^ image,
+        int width, int height, int depth,
+        short backgroundColour,
+        array<unsigned int>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return (int)(Find3dT<short, unsigned int>(image, width, height, depth, backgroundColour, output, options, nullptr, nullptr).size());
+      }
+
+      int ConnectedComponents::Find3d(
+        array<unsigned short>^ image,
+        int width, int height, int depth,
+        unsigned short backgroundColour,
+        array<unsigned short>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return (int)(Find3dT<unsigned short, unsigned short>(image, width, height, depth, backgroundColour, output, options, nullptr, nullptr).size());
+      }
+
+      int ConnectedComponents::Find3d(
+        array<unsigned short>^ image,
+        int width, int height, int depth,
+        unsigned short backgroundColour,
+        array<unsigned int>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return (int)(Find3dT<unsigned short, unsigned int>(image, width, height, depth, backgroundColour, output, options, nullptr, nullptr).size());
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        array<unsigned char>^ image,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        array<unsigned short>^ output)
+      {
+        return Find3dWithStatistics(image, width, height, depth, backgroundColour, output, ConnectedComponentsOptions());
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        array<unsigned char>^ image,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        array<unsigned short>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsT<unsigned char, unsigned short>(image, width, height, depth, backgroundColour, output, options, nullptr, options.Geometry);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        array<unsigned char>^ image,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        array<unsigned short>^ output,
+        ConnectedComponentsOptions options,
+        array<short>^ intensities)
+      {
+        return Find3dWithStatisticsT<unsigned char, unsigned short>(image, width, height, depth, backgroundColour, output, options, intensities, true);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        array<unsigned char>^ image,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        array<unsigned int>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsT<unsigned char, unsigned int>(image, width, height, depth, backgroundColour, output, options, nullptr, options.Geometry);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        array<short>^ image,
+        int width, int height, int depth,
+        short backgroundColour,
+        array<unsigned short>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsT<short, unsigned short>(image, width, height, depth, backgroundColour, output, options, nullptr, options.Geometry);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        array<short>^ image,
+        int width, int height, int depth,
+        short backgroundColour,
+        array<unsigned int>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsT<short, unsigned int>(image, width, height, depth, backgroundColour, output, options, nullptr, options.Geometry);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        array<unsigned short>^ image,
+        int width, int height, int depth,
+        unsigned short backgroundColour,
+        array<unsigned short>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsT<unsigned short, unsigned short>(image, width, height, depth, backgroundColour, output, options, nullptr, options.Geometry);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        array<unsigned short>^ image,
+        int width, int height, int depth,
+        unsigned short backgroundColour,
+        array<unsigned int>^ output,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsT<unsigned short, unsigned int>(image, width, height, depth, backgroundColour, output, options, nullptr, options.Geometry);
+      }
+
+      System::Collections::Generic::Dictionary<int, System::Collections::Generic::List<int>^>^ ConnectedComponents::LabelsByClass(
+        array<ComponentStatistics>^ statistics)
+      {
+        if (statistics == nullptr)
+          throw gcnew System::ArgumentNullException("statistics");
+
+        auto result = gcnew System::Collections::Generic::Dictionary<int, System::Collections::Generic::List<int>^>();
+        for (int label = 1; label < statistics->Length; label++)
         {
-          pin_ptr<unsigned char> inputBuffer = &image[0];
-          pin_ptr<unsigned short> outputBuffer = &output[0];
+          System::Collections::Generic::List<int>^ labels;
+          if (!result->TryGetValue(statistics[label].InputLabel, labels))
+          {
+            labels = gcnew System::Collections::Generic::List<int>();
+            result->Add(statistics[label].InputLabel, labels);
+          }
+          labels->Add(label);
+        }
 
-          int inputLeap = width*height*sizeof(unsigned char), inputStride = width*sizeof(unsigned char);
-          int outputLeap = width*height*sizeof(unsigned short), outputStride = width*sizeof(unsigned short);
+        return result;
+      }
 
-          auto result = createdataset::findConnectedComponents3d<unsigned char, unsigned short>(
-            width, height, depth,
-            inputBuffer, inputLeap, inputStride, backgroundColour,
-            outputBuffer, outputLeap, outputStride,
-            0);
+      // Checks the arguments of the mask filters, returning false if the volume is empty.
+      static bool CheckMask(
+        array<unsigned char>^ mask,
+        int width, int height, int depth,
+        array<unsigned char>^ result,
+        ConnectedComponentsOptions options)
+      {
+        if (mask == nullptr || result == nullptr)
+          throw gcnew System::ArgumentNullException(mask == nullptr ? "mask" : "result");
+        if (width < 0 || height < 0 || depth < 0)
+          throw gcnew System::ArgumentOutOfRangeException("width", "Dimensions must not be negative.");
+        CheckOptions(options);
 
-          return (int)(result.size());
+        const long long voxelCount = (long long)width * height * depth;
+        if (mask->LongLength != voxelCount || result->LongLength != voxelCount)
+          throw gcnew System::ArgumentException("The mask and result arrays should have width * height * depth elements.");
+        return voxelCount > 0;
+      }
+
+      static long long KeepLargestComponentBuffers(
+        unsigned char* mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        unsigned char* result,
+        ConnectedComponentsOptions options)
+      {
+        createdataset::InstrumentedCall call("ConnectedComponents.KeepLargestComponent", (long long)width * height * depth, createdataset::resolveThreadCount(options.ThreadCount, depth));
+        const int leap = width*height*sizeof(unsigned char), stride = width*sizeof(unsigned char);
+        try
+        {
+          switch (options.Connectivity)
+          {
+          case ComponentConnectivity::Edge:
+            return createdataset::keepLargestComponent<unsigned char, createdataset::Connectivity::Edge>(
+              width, height, depth, mask, leap, stride, backgroundColour, result, leap, stride, options.ThreadCount);
+          case ComponentConnectivity::Vertex:
+            return createdataset::keepLargestComponent<unsigned char, createdataset::Connectivity::Vertex>(
+              width, height, depth, mask, leap, stride, backgroundColour, result, leap, stride, options.ThreadCount);
+          default:
+            return createdataset::keepLargestComponent<unsigned char, createdataset::Connectivity::Face>(
+              width, height, depth, mask, leap, stride, backgroundColour, result, leap, stride, options.ThreadCount);
+          }
         }
         catch (std::exception& oops)
         {
@@ -41,31 +495,686 @@ namespace InnerEye {  namespace CreateDataset { namespace ImageProcessing {
         }
       }
 
-      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
-        array<unsigned char>^ image,
+      static int RemoveSmallComponentsBuffers(
+        unsigned char* mask,
         int width, int height, int depth,
         unsigned char backgroundColour,
-        array<unsigned short>^ output)
+        unsigned char* result,
+        ConnectedComponentsOptions options,
+        long long minimumVoxels)
+      {
+        createdataset::InstrumentedCall call("ConnectedComponents.RemoveSmallComponents", (long long)width * height * depth, createdataset::resolveThreadCount(options.ThreadCount, depth));
+        const int leap = width*height*sizeof(unsigned char), stride = width*sizeof(unsigned char);
+        try
+        {
+          switch (options.Connectivity)
+          {
+          case ComponentConnectivity::Edge:
+            return (int)createdataset::removeSmallComponents<unsigned char, createdataset::Connectivity::Edge>(
+              width, height, depth, mask, leap, stride, backgroundColour, result, leap, stride, (size_t)minimumVoxels, options.ThreadCount);
+          case ComponentConnectivity::Vertex:
+            return (int)createdataset::removeSmallComponents<unsigned char, createdataset::Connectivity::Vertex>(
+              width, height, depth, mask, leap, stride, backgroundColour, result, leap, stride, (size_t)minimumVoxels, options.ThreadCount);
+          default:
+            return (int)createdataset::removeSmallComponents<unsigned char, createdataset::Connectivity::Face>(
+              width, height, depth, mask, leap, stride, backgroundColour, result, leap, stride, (size_t)minimumVoxels, options.ThreadCount);
+          }
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      static long long FillHolesBuffers(
+        unsigned char* mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        unsigned char foregroundColour,
+        unsigned char* result,
+        ConnectedComponentsOptions options)
       {
+        createdataset::InstrumentedCall call("ConnectedComponents.FillHoles", (long long)width * height * depth, createdataset::resolveThreadCount(options.ThreadCount, depth));
+        const int leap = width*height*sizeof(unsigned char), stride = width*sizeof(unsigned char);
         try
         {
-          pin_ptr<unsigned char> inputBuffer = &image[0];
-          pin_ptr<unsigned short> outputBuffer = &output[0];
+          switch (options.Connectivity)
+          {
+          case ComponentConnectivity::Edge:
+            return createdataset::fillHoles<unsigned char, createdataset::Connectivity::Edge>(
+              width, height, depth, mask, leap, stride, backgroundColour, foregroundColour, result, leap, stride, options.ThreadCount);
+          case ComponentConnectivity::Vertex:
+            return createdataset::fillHoles<unsigned char, createdataset::Connectivity::Vertex>(
+              width, height, depth, mask, leap, stride, backgroundColour, foregroundColour, result, leap, stride, options.ThreadCount);
+          default:
+            return createdataset::fillHoles<unsigned char, createdataset::Connectivity::Face>(
+              width, height, depth, mask, leap, stride, backgroundColour, foregroundColour, result, leap, stride, options.ThreadCount);
+          }
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
 
-          int inputLeap = width*height*sizeof(unsigned char), inputStride = width*sizeof(unsigned char);
-          int outputLeap = width*height*sizeof(unsigned short), outputStride = width*sizeof(unsigned short);
+      long long ConnectedComponents::KeepLargestComponent(
+        array<unsigned char>^ mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        array<unsigned char>^ result,
+        ConnectedComponentsOptions options)
+      {
+        if (!CheckMask(mask, width, height, depth, result, options))
+          return 0;
 
-          auto result_ = createdataset::findConnectedComponents3d<unsigned char, unsigned short>(
-            width, height, depth,
-            inputBuffer, inputLeap, inputStride, backgroundColour,
-            outputBuffer, outputLeap, outputStride,
-            0);
+        pin_ptr<unsigned char> inputBuffer = &mask[0];
+        pin_ptr<unsigned char> outputBuffer = &result[0];
+        return KeepLargestComponentBuffers(inputBuffer, width, height, depth, backgroundColour, outputBuffer, options);
+      }
+
+      int ConnectedComponents::RemoveSmallComponents(
+        array<unsigned char>^ mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        array<unsigned char>^ result,
+        ConnectedComponentsOptions options,
+        long long minimumVoxels)
+      {
+        if (minimumVoxels < 0)
+          throw gcnew System::ArgumentOutOfRangeException("minimumVoxels", "Minimum size must not be negative.");
+        if (!CheckMask(mask, width, height, depth, result, options))
+          return 0;
+
+        pin_ptr<unsigned char> inputBuffer = &mask[0];
+        pin_ptr<unsigned char> outputBuffer = &result[0];
+        return RemoveSmallComponentsBuffers(inputBuffer, width, height, depth, backgroundColour, outputBuffer, options, minimumVoxels);
+      }
+
+      long long ConnectedComponents::FillHoles(
+        array<unsigned char>^ mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        unsigned char foregroundColour,
+        array<unsigned char>^ result,
+        ConnectedComponentsOptions options)
+      {
+        if (!CheckMask(mask, width, height, depth, result, options))
+          return 0;
 
-          auto result = gcnew array<ComponentStatistics>(result_.size());
-          pin_ptr<ComponentStatistics> p = &result[0];
-          ::memcpy(p, &result_[0], result_.size()*sizeof(createdataset::ComponentStatistics<unsigned char,unsigned short>));
+        pin_ptr<unsigned char> inputBuffer = &mask[0];
+        pin_ptr<unsigned char> outputBuffer = &result[0];
+        return FillHolesBuffers(inputBuffer, width, height, depth, backgroundColour, foregroundColour, outputBuffer, options);
+      }
 
-          return result;
+      int ConnectedComponents::Find3d(
+        NativeVolume<unsigned char>^ image,
+        unsigned char backgroundColour,
+        NativeVolume<unsigned short>^ result,
+        ConnectedComponentsOptions options)
+      {
+        return (int)Find3dVolume<unsigned char, unsigned short>(image, backgroundColour, result, options, nullptr).size();
+      }
+
+      int ConnectedComponents::Find3d(
+        NativeVolume<unsigned char>^ image,
+        unsigned char backgroundColour,
+        NativeVolume<unsigned int>^ result,
+        ConnectedComponentsOptions options)
+      {
+        return (int)Find3dVolume<unsigned char, unsigned int>(image, backgroundColour, result, options, nullptr).size();
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        NativeVolume<unsigned char>^ image,
+        unsigned char backgroundColour,
+        NativeVolume<unsigned short>^ result,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsVolume<unsigned char, unsigned short>(image, backgroundColour, result, options, nullptr);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dWithStatistics(
+        NativeVolume<unsigned char>^ image,
+        unsigned char backgroundColour,
+        NativeVolume<unsigned int>^ result,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsVolume<unsigned char, unsigned int>(image, backgroundColour, result, options, nullptr);
+      }
+
+      // Smooths, thresholds and labels native volume image into output with findSmoothedComponents3d.
+      template<typename T, typename U>
+      static array<ComponentStatistics>^ Find3dOfSmoothedVolume(
+        NativeVolume<T>^ image,
+        float sigmaX, float sigmaY, float sigmaZ,
+        T lower, T upper,
+        NativeVolume<U>^ output,
+        ConnectedComponentsOptions options)
+      {
+        CheckVolumes(image, "image", output, "result");
+        CheckOptions(options);
+        CheckBackgroundLabel<U>(options);
+        if (!(sigmaX > 0 && sigmaY > 0 && sigmaZ > 0))
+          throw gcnew System::ArgumentOutOfRangeException("sigmaX", "Sigma must be positive.");
+        if (options.Geometry)
+          throw gcnew System::ArgumentException("The geometry of the components of a smoothed volume is not computed.", "options");
+        createdataset::InstrumentedCall call("ConnectedComponents.Find3dOfSmoothed", image->Length,
+          createdataset::resolveThreadCount(options.ThreadCount, image->DimZ));
+
+        const unsigned char* inputBuffer = image->GetBuffer();
+        unsigned char* outputBuffer = output->GetBuffer();
+        const int width = image->DimX, height = image->DimY, depth = image->DimZ;
+        createdataset::ConvolutionOptions convolution;
+        convolution.threadCount = options.ThreadCount;
+
+        std::vector<createdataset::ComponentStatistics<unsigned char, U> > statistics;
+        try
+        {
+          switch (options.Connectivity)
+          {
+          case ComponentConnectivity::Edge:
+            statistics = createdataset::findSmoothedComponents3d<T, U, createdataset::Connectivity::Edge>(width, height, depth,
+              inputBuffer, image->Leap, image->Stride, sigmaX, sigmaY, sigmaZ, lower, upper, outputBuffer, output->Leap, output->Stride, (U)options.BackgroundLabel, convolution);
+            break;
+          case ComponentConnectivity::Vertex:
+            statistics = createdataset::findSmoothedComponents3d<T, U, createdataset::Connectivity::Vertex>(width, height, depth,
+              inputBuffer, image->Leap, image->Stride, sigmaX, sigmaY, sigmaZ, lower, upper, outputBuffer, output->Leap, output->Stride, (U)options.BackgroundLabel, convolution);
+            break;
+          default:
+            statistics = createdataset::findSmoothedComponents3d<T, U, createdataset::Connectivity::Face>(width, height, depth,
+              inputBuffer, image->Leap, image->Stride, sigmaX, sigmaY, sigmaZ, lower, upper, outputBuffer, output->Leap, output->Stride, (U)options.BackgroundLabel, convolution);
+            break;
+          }
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+
+        System::GC::KeepAlive(image);
+        System::GC::KeepAlive(output);
+        return ToManaged<unsigned char, U>(statistics, nullptr, (unsigned char)0);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dOfSmoothed(
+        NativeVolume<unsigned char>^ image,
+        float sigmaX, float sigmaY, float sigmaZ,
+        unsigned char lower, unsigned char upper,
+        NativeVolume<unsigned short>^ result,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dOfSmoothedVolume<unsigned char, unsigned short>(image, sigmaX, sigmaY, sigmaZ, lower, upper, result, options);
+      }
+
+      array<ComponentStatistics>^ ConnectedComponents::Find3dOfSmoothed(
+        NativeVolume<short>^ image,
+        float sigmaX, float sigmaY, float sigmaZ,
+        short lower, short upper,
+        NativeVolume<unsigned short>^ result,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dOfSmoothedVolume<short, unsigned short>(image, sigmaX, sigmaY, sigmaZ, lower, upper, result, options);
+      }
+
+      long long ConnectedComponents::KeepLargestComponent(
+        NativeVolume<unsigned char>^ mask,
+        unsigned char backgroundColour,
+        NativeVolume<unsigned char>^ result,
+        ConnectedComponentsOptions options)
+      {
+        CheckVolumes(mask, "mask", result, "result");
+        CheckOptions(options);
+        const long long count = KeepLargestComponentBuffers(mask->GetBuffer(), mask->DimX, mask->DimY, mask->DimZ, backgroundColour, result->GetBuffer(), options);
+        System::GC::KeepAlive(mask);
+        System::GC::KeepAlive(result);
+        return count;
+      }
+
+      int ConnectedComponents::RemoveSmallComponents(
+        NativeVolume<unsigned char>^ mask,
+        unsigned char backgroundColour,
+        NativeVolume<unsigned char>^ result,
+        ConnectedComponentsOptions options,
+        long long minimumVoxels)
+      {
+        if (minimumVoxels < 0)
+          throw gcnew System::ArgumentOutOfRangeException("minimumVoxels", "Minimum size must not be negative.");
+        CheckVolumes(mask, "mask", result, "result");
+        CheckOptions(options);
+        const int count = RemoveSmallComponentsBuffers(mask->GetBuffer(), mask->DimX, mask->DimY, mask->DimZ, backgroundColour, result->GetBuffer(), options, minimumVoxels);
+        System::GC::KeepAlive(mask);
+        System::GC::KeepAlive(result);
+        return count;
+      }
+
+      long long ConnectedComponents::FillHoles(
+        NativeVolume<unsigned char>^ mask,
+        unsigned char backgroundColour,
+        unsigned char foregroundColour,
+        NativeVolume<unsigned char>^ result,
+        ConnectedComponentsOptions options)
+      {
+        CheckVolumes(mask, "mask", result, "result");
+        CheckOptions(options);
+        const long long count = FillHolesBuffers(mask->GetBuffer(), mask->DimX, mask->DimY, mask->DimZ, backgroundColour, foregroundColour, result->GetBuffer(), options);
+        System::GC::KeepAlive(mask);
+        System::GC::KeepAlive(result);
+        return count;
+      }
+
+      // Labels each image of a batch into the result of the same index, as for one volume.
+      template<typename T, typename U>
+      static array<array<ComponentStatistics>^>^ Find3dWithStatisticsBatch(
+        array<NativeVolume<T>^>^ images,
+        T backgroundColour,
+        array<NativeVolume<U>^>^ results,
+        ConnectedComponentsOptions options,
+        createdataset::OperationProgress* progress = nullptr)
+      {
+        CheckBatch(images, "images", results, "results");
+        CheckOptions(options);
+        CheckBackgroundLabel<U>(options);
+        const std::vector<createdataset::BatchVolume> inputs = ToBatch(images, "images");
+        const std::vector<createdataset::BatchVolume> outputs = ToBatch(results, "results");
+        createdataset::InstrumentedCall call("ConnectedComponents.Find3dWithStatistics", TotalVoxels(inputs),
+          createdataset::resolveThreadCount(options.ThreadCount, std::numeric_limits<int>::max()));
+
+        std::vector<std::vector<createdataset::ComponentStatistics<T, U> > > statistics;
+        std::vector<std::vector<createdataset::ComponentGeometry> > geometry;
+        std::vector<std::vector<createdataset::ComponentGeometry> >* wanted = options.Geometry ? &geometry : nullptr;
+        try
+        {
+          switch (options.Connectivity)
+          {
+          case ComponentConnectivity::Edge:
+            statistics = createdataset::findConnectedComponentsBatch<T, U, createdataset::Connectivity::Edge>(inputs, backgroundColour, outputs, (U)options.BackgroundLabel, wanted, options.ThreadCount, progress);
+            break;
+          case ComponentConnectivity::Vertex:
+            statistics = createdataset::findConnectedComponentsBatch<T, U, createdataset::Connectivity::Vertex>(inputs, backgroundColour, outputs, (U)options.BackgroundLabel, wanted, options.ThreadCount, progress);
+            break;
+          default:
+            statistics = createdataset::findConnectedComponentsBatch<T, U, createdataset::Connectivity::Face>(inputs, backgroundColour, outputs, (U)options.BackgroundLabel, wanted, options.ThreadCount, progress);
+            break;
+          }
+        }
+        catch (createdataset::OperationCancelled&)
+        {
+          throw gcnew System::OperationCanceledException();
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+        System::GC::KeepAlive(images);
+        System::GC::KeepAlive(results);
+
+        auto result = gcnew array<array<ComponentStatistics>^>(images->Length);
+        for (int i = 0; i < result->Length; i++)
+          result[i] = ToManaged<T, U>(statistics[i], wanted == nullptr ? nullptr : &geometry[i], backgroundColour);
+        return result;
+      }
+
+      // ConnectedComponents::Find3dWithStatisticsAsync of a native volume.
+      template<typename T, typename U>
+      ref class Find3dOperation : NativeOperation<array<ComponentStatistics>^>
+      {
+      public:
+        Find3dOperation(NativeVolume<T>^ image, T backgroundColour, NativeVolume<U>^ result, ConnectedComponentsOptions options) :
+          image_(image), backgroundColour_(backgroundColour), result_(result), options_(options)
+        {
+        }
+
+      protected:
+        virtual array<ComponentStatistics>^ Run(createdataset::OperationProgress* progress) override
+        {
+          // The voxels and threads of the synchronous call, which records nothing inside this one
+          createdataset::InstrumentedCall call("ConnectedComponents.Find3dWithStatisticsAsync", image_->Length,
+            createdataset::resolveThreadCount(options_.ThreadCount, image_->DimZ));
+          return Find3dWithStatisticsVolume<T, U>(image_, backgroundColour_, result_, options_, progress);
+        }
+
+      private:
+        NativeVolume<T>^ image_;
+        T backgroundColour_;
+        NativeVolume<U>^ result_;
+        ConnectedComponentsOptions options_;
+      };
+
+      // ConnectedComponents::Find3dWithStatisticsAsync of a batch of native volumes.
+      template<typename T, typename U>
+      ref class Find3dBatchOperation : NativeOperation<array<array<ComponentStatistics>^>^>
+      {
+      public:
+        Find3dBatchOperation(array<NativeVolume<T>^>^ images, T backgroundColour, array<NativeVolume<U>^>^ results, ConnectedComponentsOptions options) :
+          images_(images), backgroundColour_(backgroundColour), results_(results), options_(options)
+        {
+        }
+
+      protected:
+        virtual array<array<ComponentStatistics>^>^ Run(createdataset::OperationProgress* progress) override
+        {
+          createdataset::InstrumentedCall call("ConnectedComponents.Find3dWithStatisticsAsync", TotalVoxels(ToBatch(images_, "images")),
+            createdataset::resolveThreadCount(options_.ThreadCount, std::numeric_limits<int>::max()));
+          return Find3dWithStatisticsBatch<T, U>(images_, backgroundColour_, results_, options_, progress);
+        }
+
+      private:
+        array<NativeVolume<T>^>^ images_;
+        T backgroundColour_;
+        array<NativeVolume<U>^>^ results_;
+        ConnectedComponentsOptions options_;
+      };
+
+      // Applies filter to each mask of a batch, writing the result of the same index, as for one
+      // volume, and returns what the filter returns for each.
+      static std::vector<size_t> FilterBatch(
+        array<NativeVolume<unsigned char>^>^ masks,
+        createdataset::ComponentFilter filter,
+        unsigned char backgroundColour,
+        unsigned char foregroundColour,
+        long long minimumVoxels,
+        array<NativeVolume<unsigned char>^>^ results,
+        ConnectedComponentsOptions options)
+      {
+        CheckBatch(masks, "masks", results, "results");
+        CheckOptions(options);
+        const std::vector<createdataset::BatchVolume> inputs = ToBatch(masks, "masks");
+        const std::vector<createdataset::BatchVolume> outputs = ToBatch(results, "results");
+        const char* const entryPoint =
+          filter == createdataset::ComponentFilter::KeepLargest ? "ConnectedComponents.KeepLargestComponent" :
+          filter == createdataset::ComponentFilter::RemoveSmall ? "ConnectedComponents.RemoveSmallComponents" : "ConnectedComponents.FillHoles";
+        createdataset::InstrumentedCall call(entryPoint, TotalVoxels(inputs), createdataset::resolveThreadCount(options.ThreadCount, std::numeric_limits<int>::max()));
+
+        std::vector<size_t> counts;
+        try
+        {
+          switch (options.Connectivity)
+          {
+          case ComponentConnectivity::Edge:
+            counts = createdataset::filterComponentsBatch<unsigned char, createdataset::Connectivity::Edge>(
+              inputs, filter, backgroundColour, foregroundColour, (size_t)minimumVoxels, outputs, options.ThreadCount);
+            break;
+          case ComponentConnectivity::Vertex:
+            counts = createdataset::filterComponentsBatch<unsigned char, createdataset::Connectivity::Vertex>(
+              inputs, filter, backgroundColour, foregroundColour, (size_t)minimumVoxels, outputs, options.ThreadCount);
+            break;
+          default:
+            counts = createdataset::filterComponentsBatch<unsigned char, createdataset::Connectivity::Face>(
+              inputs, filter, backgroundColour, foregroundColour, (size_t)minimumVoxels, outputs, options.ThreadCount);
+            break;
+          }
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+        System::GC::KeepAlive(masks);
+        System::GC::KeepAlive(results);
+        return counts;
+      }
+
+      array<array<ComponentStatistics>^>^ ConnectedComponents::Find3dWithStatistics(
+        array<NativeVolume<unsigned char>^>^ images,
+        unsigned char backgroundColour,
+        array<NativeVolume<unsigned short>^>^ results,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsBatch<unsigned char, unsigned short>(images, backgroundColour, results, options);
+      }
+
+      array<array<ComponentStatistics>^>^ ConnectedComponents::Find3dWithStatistics(
+        array<NativeVolume<unsigned char>^>^ images,
+        unsigned char backgroundColour,
+        array<NativeVolume<unsigned int>^>^ results,
+        ConnectedComponentsOptions options)
+      {
+        return Find3dWithStatisticsBatch<unsigned char, unsigned int>(images, backgroundColour, results, options);
+      }
+
+      System::Threading::Tasks::Task<array<ComponentStatistics>^>^ ConnectedComponents::Find3dWithStatisticsAsync(
+        NativeVolume<unsigned char>^ image,
+        unsigned char backgroundColour,
+        NativeVolume<unsigned short>^ result,
+        ConnectedComponentsOptions options,
+        System::IProgress<double>^ progress,
+        System::Threading::CancellationToken cancellationToken)
+      {
+        CheckVolumes(image, "image", result, "result");
+        CheckOptions(options);
+        CheckBackgroundLabel<unsigned short>(options);
+        return (gcnew Find3dOperation<unsigned char, unsigned short>(image, backgroundColour, result, options))->Start(progress, cancellationToken);
+      }
+
+      System::Threading::Tasks::Task<array<ComponentStatistics>^>^ ConnectedComponents::Find3dWithStatisticsAsync(
+        NativeVolume<unsigned char>^ image,
+        unsigned char backgroundColour,
+        NativeVolume<unsigned int>^ result,
+        ConnectedComponentsOptions options,
+        System::IProgress<double>^ progress,
+        System::Threading::CancellationToken cancellationToken)
+      {
+        CheckVolumes(image, "image", result, "result");
+        CheckOptions(options);
+        CheckBackgroundLabel<unsigned int>(options);
+        return (gcnew Find3dOperation<unsigned char, unsigned int>(image, backgroundColour, result, options))->Start(progress, cancellationToken);
+      }
+
+      System::Threading::Tasks::Task<array<array<ComponentStatistics>^>^>^ ConnectedComponents::Find3dWithStatisticsAsync(
+        array<NativeVolume<unsigned char>^>^ images,
+        unsigned char backgroundColour,
+        array<NativeVolume<unsigned short>^>^ results,
+        ConnectedComponentsOptions options,
+        System::IProgress<double>^ progress,
+        System::Threading::CancellationToken cancellationToken)
+      {
+        CheckBatch(images, "images", results, "results");
+        CheckOptions(options);
+        CheckBackgroundLabel<unsigned short>(options);
+        return (gcnew Find3dBatchOperation<unsigned char, unsigned short>(images, backgroundColour, results, options))->Start(progress, cancellationToken);
+      }
+
+      System::Threading::Tasks::Task<array<array<ComponentStatistics>^>^>^ ConnectedComponents::Find3dWithStatisticsAsync(
+        array<NativeVolume<unsigned char>^>^ images,
+        unsigned char backgroundColour,
+        array<NativeVolume<unsigned int>^>^ results,
+        ConnectedComponentsOptions options,
+        System::IProgress<double>^ progress,
+        System::Threading::CancellationToken cancellationToken)
+      {
+        CheckBatch(images, "images", results, "results");
+        CheckOptions(options);
+        CheckBackgroundLabel<unsigned int>(options);
+        return (gcnew Find3dBatchOperation<unsigned char, unsigned int>(images, backgroundColour, results, options))->Start(progress, cancellationToken);
+      }
+
+      array<long long>^ ConnectedComponents::KeepLargestComponent(
+        array<NativeVolume<unsigned char>^>^ masks,
+        unsigned char backgroundColour,
+        array<NativeVolume<unsigned char>^>^ results,
+        ConnectedComponentsOptions options)
+      {
+        const std::vector<size_t> counts = FilterBatch(masks, createdataset::ComponentFilter::KeepLargest, backgroundColour, backgroundColour, 0, results, options);
+        auto result = gcnew array<long long>((int)counts.size());
+        for (int i = 0; i < result->Length; i++)
+          result[i] = (long long)counts[i];
+        return result;
+      }
+
+      array<int>^ ConnectedComponents::RemoveSmallComponents(
+        array<NativeVolume<unsigned char>^>^ masks,
+        unsigned char backgroundColour,
+        array<NativeVolume<unsigned char>^>^ results,
+        ConnectedComponentsOptions options,
+        long long minimumVoxels)
+      {
+        if (minimumVoxels < 0)
+          throw gcnew System::ArgumentOutOfRangeException("minimumVoxels", "Minimum size must not be negative.");
+        const std::vector<size_t> counts = FilterBatch(masks, createdataset::ComponentFilter::RemoveSmall, backgroundColour, backgroundColour, minimumVoxels, results, options);
+        auto result = gcnew array<int>((int)counts.size());
+        for (int i = 0; i < result->Length; i++)
+          result[i] = (int)counts[i];
+        return result;
+      }
+
+      array<long long>^ ConnectedComponents::FillHoles(
+        array<NativeVolume<unsigned char>^>^ masks,
+        unsigned char backgroundColour,
+        unsigned char foregroundColour,
+        array<NativeVolume<unsigned char>^>^ results,
+        ConnectedComponentsOptions options)
+      {
+        const std::vector<size_t> counts = FilterBatch(masks, createdataset::ComponentFilter::FillHoles, backgroundColour, foregroundColour, 0, results, options);
+        auto result = gcnew array<long long>((int)counts.size());
+        for (int i = 0; i < result->Length; i++)
+          result[i] = (long long)counts[i];
+        return result;
+      }
+
+#pragma managed(push, off)
+      // The native labeller of StreamingConnectedComponents, for any connectivity.
+      class StreamingLabeller
+      {
+      public:
+        virtual ~StreamingLabeller()
+        {
+        }
+
+        virtual void addSlice(const unsigned char* slice, unsigned int* provisional) = 0;
+        virtual std::vector<NativeComponentStatistics> finish() = 0;
+        virtual void resolveSlice(const unsigned int* provisional, unsigned short* output) const = 0;
+      };
+
+      template<createdataset::Connectivity C>
+      class StreamingLabellerT : public StreamingLabeller
+      {
+        int width_;
+        createdataset::StreamingConnectedComponents<unsigned char, unsigned short, C> labeller_;
+
+      public:
+        StreamingLabellerT(int width, int height, unsigned char backgroundColour, unsigned short backgroundLabel) :
+          width_(width), labeller_(width, height, backgroundColour, backgroundLabel)
+        {
+        }
+
+        void addSlice(const unsigned char* slice, unsigned int* provisional) override
+        {
+          labeller_.addSlice(slice, width_ * sizeof(unsigned char), provisional, width_ * sizeof(unsigned int));
+        }
+
+        std::vector<NativeComponentStatistics> finish() override
+        {
+          return labeller_.finish();
+        }
+
+        void resolveSlice(const unsigned int* provisional, unsigned short* output) const override
+        {
+          labeller_.resolveSlice(provisional, width_ * sizeof(unsigned int), output, width_ * sizeof(unsigned short));
+        }
+      };
+#pragma managed(pop)
+
+      static StreamingLabeller* CreateLabeller(int width, int height, unsigned char backgroundColour, ConnectedComponentsOptions options)
+      {
+        if (width <= 0 || height <= 0)
+          throw gcnew System::ArgumentOutOfRangeException("width", "Dimensions must be positive.");
+        CheckBackgroundLabel<unsigned short>(options);
+
+        const unsigned short backgroundLabel = (unsigned short)options.BackgroundLabel;
+        switch (options.Connectivity)
+        {
+        case ComponentConnectivity::Face:
+          return new StreamingLabellerT<createdataset::Connectivity::Face>(width, height, backgroundColour, backgroundLabel);
+        case ComponentConnectivity::Edge:
+          return new StreamingLabellerT<createdataset::Connectivity::Edge>(width, height, backgroundColour, backgroundLabel);
+        case ComponentConnectivity::Vertex:
+          return new StreamingLabellerT<createdataset::Connectivity::Vertex>(width, height, backgroundColour, backgroundLabel);
+        default:
+          throw gcnew System::ArgumentOutOfRangeException("options", "Connectivity was out of range.");
+        }
+      }
+
+      StreamingConnectedComponents::StreamingConnectedComponents(int width, int height, unsigned char backgroundColour) :
+        width_(width), height_(height), backgroundColour_(backgroundColour),
+        labeller_(CreateLabeller(width, height, backgroundColour, ConnectedComponentsOptions()))
+      {
+      }
+
+      StreamingConnectedComponents::StreamingConnectedComponents(int width, int height, unsigned char backgroundColour, ConnectedComponentsOptions options) :
+        width_(width), height_(height), backgroundColour_(backgroundColour),
+        labeller_(CreateLabeller(width, height, backgroundColour, options))
+      {
+      }
+
+      StreamingConnectedComponents::~StreamingConnectedComponents()
+      {
+        this->!StreamingConnectedComponents();
+      }
+
+      StreamingConnectedComponents::!StreamingConnectedComponents()
+      {
+        delete labeller_;
+        labeller_ = nullptr;
+      }
+
+      void StreamingConnectedComponents::CheckSlice(System::Array^ slice, System::String^ name)
+      {
+        if (labeller_ == nullptr)
+          throw gcnew System::ObjectDisposedException("StreamingConnectedComponents");
+        if (slice == nullptr)
+          throw gcnew System::ArgumentNullException(name);
+        if (slice->LongLength != (long long)width_ * height_)
+          throw gcnew System::ArgumentException("Slices should have width * height elements.", name);
+      }
+
+      void StreamingConnectedComponents::AddSlice(array<unsigned char>^ slice, array<unsigned int>^ provisional)
+      {
+        CheckSlice(slice, "slice");
+        CheckSlice(provisional, "provisional");
+        createdataset::InstrumentedCall call("StreamingConnectedComponents.AddSlice", (long long)width_ * height_);
+
+        try
+        {
+          pin_ptr<unsigned char> sliceBuffer = &slice[0];
+          pin_ptr<unsigned int> provisionalBuffer = &provisional[0];
+          labeller_->addSlice(sliceBuffer, provisionalBuffer);
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      array<ComponentStatistics>^ StreamingConnectedComponents::Finish()
+      {
+        if (labeller_ == nullptr)
+          throw gcnew System::ObjectDisposedException("StreamingConnectedComponents");
+
+        createdataset::InstrumentedCall call("StreamingConnectedComponents.Finish");
+        try
+        {
+          return ToManaged<unsigned char, unsigned short>(labeller_->finish(), nullptr, backgroundColour_);
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      void StreamingConnectedComponents::ResolveSlice(array<unsigned int>^ provisional, array<unsigned short>^ result)
+      {
+        CheckSlice(provisional, "provisional");
+        CheckSlice(result, "result");
+        createdataset::InstrumentedCall call("StreamingConnectedComponents.ResolveSlice", (long long)width_ * height_);
+
+        try
+        {
+          pin_ptr<unsigned int> provisionalBuffer = &provisional[0];
+          pin_ptr<unsigned short> resultBuffer = &result[0];
+          labeller_->resolveSlice(provisionalBuffer, resultBuffer);
+        }
+        catch (std::out_of_range& oops)
+        {
+          throw gcnew System::ArgumentOutOfRangeException("provisional", gcnew System::String(oops.what()));
         }
         catch (std::exception& oops)
         {
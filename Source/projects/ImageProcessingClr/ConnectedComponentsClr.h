@@ -6,13 +6,64 @@
 
 #pragma once
 
+#include "NativeVolumeClr.h"
+
 namespace InnerEye { namespace CreateDataset {  namespace ImageProcessing
 {
   public value struct ComponentStatistics
   {
   public:
     unsigned long PixelCount;
-    unsigned char InputLabel;
+
+    // Colour of the voxels of the component in the image, of whichever pixel type that has
+    int InputLabel;
+
+    // The rest are set by Find3dWithStatistics only if ConnectedComponentsOptions.Geometry is set,
+    // and not for the background.
+
+    // Bounding box of the voxels of the component, inclusive
+    int MinimumX, MinimumY, MinimumZ;
+    int MaximumX, MaximumY, MaximumZ;
+
+    // Mean coordinates of the voxels of the component
+    double CentroidX, CentroidY, CentroidZ;
+
+    // Sum of the intensities of the voxels of the component, or zero if no intensities were given
+    double IntensitySum;
+
+    // The first voxel of the component in raster order that has a background voxel, or the edge of
+    // the volume, among its 26 neighbours, as for MorphologicalExtensions.IsSurfacePoint; -1 if none
+    int SurfaceX, SurfaceY, SurfaceZ;
+  };
+
+  // Which neighbours of a voxel are in the same component as it when they have the same colour.
+  public enum class ComponentConnectivity
+  {
+    // The 6 voxels that share a face with it
+    Face = 0,
+    // The 18 that share a face or an edge
+    Edge = 1,
+    // All 26, sharing a face, an edge or a corner
+    Vertex = 2
+  };
+
+  // Optional settings for ConnectedComponents. A default-constructed value gives the default behaviour.
+  public value struct ConnectedComponentsOptions
+  {
+    // Maximum number of threads to use, or 0 for one per processor. The labels do not depend on it.
+    int ThreadCount;
+
+    ComponentConnectivity Connectivity;
+
+    // Compute the bounding box, centroid and first surface voxel of each component in
+    // Find3dWithStatistics, while labelling, rather than in another pass over the volume.
+    bool Geometry;
+
+    // The label of the background voxels, 0 by default, which must fit the type of the labels.
+    // The components take the other labels in raster order from 0, and the statistics are indexed
+    // by label, so the background has an entry only if some component has a greater label.
+    // LabelsByClass expects 0. The mask filters do not write labels and ignore it.
+    unsigned int BackgroundLabel;
   };
 
   public ref class ConnectedComponents
@@ -20,11 +71,160 @@ namespace InnerEye { namespace CreateDataset {  namespace ImageProcessing
   public:
     // Find connected components in 3D volume using one pass unite-find approach and
     // label associated voxels in output volume. Voxels with the specified background colour
-    // are all assigned the background label.
-    // Returns the number of connected components (6-connected (aka face) components ie: diagnoal points are considered separate components) found, including the background class.
+    // are all assigned the background label. Components are numbered in raster order of their
+    // first voxel, on as many threads as there are processors.
+    // Returns the number of connected components found, including the background class. Components are 6-connected (aka face)
+    // unless options.Connectivity says otherwise, ie: by default diagnoal points are considered separate components.
     static int Find3d(array<unsigned char>^ image, int width, int height, int depth, unsigned char backgroundColour, array<unsigned short>^ result);
 
+    static int Find3d(array<unsigned char>^ image, int width, int height, int depth, unsigned char backgroundColour, array<unsigned short>^ result, ConnectedComponentsOptions options);
+
     static array<ComponentStatistics>^ Find3dWithStatistics(array<unsigned char>^ image, int width, int height, int depth, unsigned char backgroundColour, array<unsigned short>^ result);
-    // NB could easily extend to support different pixel types, image padding, etc.
+
+    static array<ComponentStatistics>^ Find3dWithStatistics(array<unsigned char>^ image, int width, int height, int depth, unsigned char backgroundColour, array<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    // As above, computing the geometry of each component whether or not options.Geometry is set,
+    // with IntensitySum the sum of intensities over the component. Intensities must have the same
+    // dimensions as image.
+    static array<ComponentStatistics>^ Find3dWithStatistics(array<unsigned char>^ image, int width, int height, int depth, unsigned char backgroundColour, array<unsigned short>^ result, ConnectedComponentsOptions options, array<short>^ intensities);
+
+    // As above for other pixel types, and for 32 bit labels, which allow as many components as
+    // there are runs of voxels of one colour along rows, up to 2^31 - 1, where 16 bit labels allow
+    // 65534. The components of each colour are found separately, so one call labels every
+    // structure of a multi-label image; LabelsByClass groups the labels by colour.
+    static int Find3d(array<unsigned char>^ image, int width, int height, int depth, unsigned char backgroundColour, array<unsigned int>^ result, ConnectedComponentsOptions options);
+
+    static int Find3d(array<short>^ image, int width, int height, int depth, short backgroundColour, array<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    static int Find3d(array<short>^ image, int width, int height, int depth, short backgroundColour, array<unsigned int>^ result, ConnectedComponentsOptions options);
+
+    static int Find3d(array<unsigned short>^ image, int width, int height, int depth, unsigned short backgroundColour, array<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    static int Find3d(array<unsigned short>^ image, int width, int height, int depth, unsigned short backgroundColour, array<unsigned int>^ result, ConnectedComponentsOptions options);
+
+    static array<ComponentStatistics>^ Find3dWithStatistics(array<unsigned char>^ image, int width, int height, int depth, unsigned char backgroundColour, array<unsigned int>^ result, ConnectedComponentsOptions options);
+
+    static array<ComponentStatistics>^ Find3dWithStatistics(array<short>^ image, int width, int height, int depth, short backgroundColour, array<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    static array<ComponentStatistics>^ Find3dWithStatistics(array<short>^ image, int width, int height, int depth, short backgroundColour, array<unsigned int>^ result, ConnectedComponentsOptions options);
+
+    static array<ComponentStatistics>^ Find3dWithStatistics(array<unsigned short>^ image, int width, int height, int depth, unsigned short backgroundColour, array<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    static array<ComponentStatistics>^ Find3dWithStatistics(array<unsigned short>^ image, int width, int height, int depth, unsigned short backgroundColour, array<unsigned int>^ result, ConnectedComponentsOptions options);
+
+    // The labels of the components of each colour, from the statistics of Find3dWithStatistics,
+    // in ascending order. The background, label 0 with the default BackgroundLabel, is left out.
+    static System::Collections::Generic::Dictionary<int, System::Collections::Generic::List<int>^>^ LabelsByClass(array<ComponentStatistics>^ statistics);
+
+    // Keeps only the largest component of mask, the first in raster order if several are the
+    // largest, writing it into result with every other voxel set to backgroundColour. Result may be
+    // mask itself. Returns the number of voxels in the component, zero if there is none. No label
+    // volume is made, so there is no limit on the number of components.
+    static long long KeepLargestComponent(array<unsigned char>^ mask, int width, int height, int depth, unsigned char backgroundColour, array<unsigned char>^ result, ConnectedComponentsOptions options);
+
+    // Sets the components of mask with fewer than minimumVoxels voxels to backgroundColour,
+    // writing the result into result, which may be mask itself. Returns the number of components
+    // removed.
+    static int RemoveSmallComponents(array<unsigned char>^ mask, int width, int height, int depth, unsigned char backgroundColour, array<unsigned char>^ result, ConnectedComponentsOptions options, long long minimumVoxels);
+
+    // Sets the holes of mask, the components of backgroundColour voxels with options.Connectivity
+    // that do not touch the edge of the volume, to foregroundColour, writing the result into
+    // result, which may be mask itself. Holes are found in 3D rather than slice by slice. Returns the
+    // number of voxels filled.
+    static long long FillHoles(array<unsigned char>^ mask, int width, int height, int depth, unsigned char backgroundColour, unsigned char foregroundColour, array<unsigned char>^ result, ConnectedComponentsOptions options);
+
+    // As above for native volumes of the same dimensions, which are neither pinned nor copied.
+    static int Find3d(NativeVolume<unsigned char>^ image, unsigned char backgroundColour, NativeVolume<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    static int Find3d(NativeVolume<unsigned char>^ image, unsigned char backgroundColour, NativeVolume<unsigned int>^ result, ConnectedComponentsOptions options);
+
+    static array<ComponentStatistics>^ Find3dWithStatistics(NativeVolume<unsigned char>^ image, unsigned char backgroundColour, NativeVolume<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    static array<ComponentStatistics>^ Find3dWithStatistics(NativeVolume<unsigned char>^ image, unsigned char backgroundColour, NativeVolume<unsigned int>^ result, ConnectedComponentsOptions options);
+
+    static long long KeepLargestComponent(NativeVolume<unsigned char>^ mask, unsigned char backgroundColour, NativeVolume<unsigned char>^ result, ConnectedComponentsOptions options);
+
+    static int RemoveSmallComponents(NativeVolume<unsigned char>^ mask, unsigned char backgroundColour, NativeVolume<unsigned char>^ result, ConnectedComponentsOptions options, long long minimumVoxels);
+
+    static long long FillHoles(NativeVolume<unsigned char>^ mask, unsigned char backgroundColour, unsigned char foregroundColour, NativeVolume<unsigned char>^ result, ConnectedComponentsOptions options);
+
+    // Smooths image with Gaussians of standard deviation sigmaX, sigmaY and sigmaZ voxels, as
+    // Convolution.GaussianSmooth3d, keeps the voxels of the result from lower to upper inclusive,
+    // and labels them, as Find3dWithStatistics of that mask with foreground 1 and background 0,
+    // in one pass that stores neither the smoothed volume nor the mask. options.Geometry must not be set.
+    static array<ComponentStatistics>^ Find3dOfSmoothed(NativeVolume<unsigned char>^ image, float sigmaX, float sigmaY, float sigmaZ, unsigned char lower, unsigned char upper, NativeVolume<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    static array<ComponentStatistics>^ Find3dOfSmoothed(NativeVolume<short>^ image, float sigmaX, float sigmaY, float sigmaZ, short lower, short upper, NativeVolume<unsigned short>^ result, ConnectedComponentsOptions options);
+
+    // As above for each native volume of a batch, where the volumes may have different dimensions
+    // and results[i] is the result for images[i] or masks[i]. With up to options.ThreadCount
+    // threads in all, small volumes are done at the same time on one thread each and large ones
+    // in turn on every thread, so a batch of the structures of a subject keeps every core busy.
+    // Each returns what the call for one volume would, for each volume of the batch; the results
+    // do not depend on the schedule. Results may be masks itself for the filters.
+    static array<array<ComponentStatistics>^>^ Find3dWithStatistics(array<NativeVolume<unsigned char>^>^ images, unsigned char backgroundColour, array<NativeVolume<unsigned short>^>^ results, ConnectedComponentsOptions options);
+
+    static array<array<ComponentStatistics>^>^ Find3dWithStatistics(array<NativeVolume<unsigned char>^>^ images, unsigned char backgroundColour, array<NativeVolume<unsigned int>^>^ results, ConnectedComponentsOptions options);
+
+    static array<long long>^ KeepLargestComponent(array<NativeVolume<unsigned char>^>^ masks, unsigned char backgroundColour, array<NativeVolume<unsigned char>^>^ results, ConnectedComponentsOptions options);
+
+    static array<int>^ RemoveSmallComponents(array<NativeVolume<unsigned char>^>^ masks, unsigned char backgroundColour, array<NativeVolume<unsigned char>^>^ results, ConnectedComponentsOptions options, long long minimumVoxels);
+
+    static array<long long>^ FillHoles(array<NativeVolume<unsigned char>^>^ masks, unsigned char backgroundColour, unsigned char foregroundColour, array<NativeVolume<unsigned char>^>^ results, ConnectedComponentsOptions options);
+
+    // As Find3dWithStatistics for a native volume or a batch of them, as a task on a thread of
+    // its own, so that the caller can read and write other volumes meanwhile. The volumes must not
+    // be used until the task has finished. The fraction done is reported to progress, if not
+    // null, after each step of labelling each slab of a volume, or each volume of a batch.
+    // Cancelling cancellationToken cancels the task at the next of those, leaving the results
+    // partly written.
+    static System::Threading::Tasks::Task<array<ComponentStatistics>^>^ Find3dWithStatisticsAsync(NativeVolume<unsigned char>^ image, unsigned char backgroundColour, NativeVolume<unsigned short>^ result, ConnectedComponentsOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+
+    static System::Threading::Tasks::Task<array<ComponentStatistics>^>^ Find3dWithStatisticsAsync(NativeVolume<unsigned char>^ image, unsigned char backgroundColour, NativeVolume<unsigned int>^ result, ConnectedComponentsOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+
+    static System::Threading::Tasks::Task<array<array<ComponentStatistics>^>^>^ Find3dWithStatisticsAsync(array<NativeVolume<unsigned char>^>^ images, unsigned char backgroundColour, array<NativeVolume<unsigned short>^>^ results, ConnectedComponentsOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+
+    static System::Threading::Tasks::Task<array<array<ComponentStatistics>^>^>^ Find3dWithStatisticsAsync(array<NativeVolume<unsigned char>^>^ images, unsigned char backgroundColour, array<NativeVolume<unsigned int>^>^ results, ConnectedComponentsOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+  };
+
+  class StreamingLabeller;
+
+  // Connected components of a volume that is given one slice at a time, for volumes too large to
+  // hold in memory with their labels. AddSlice labels each slice with provisional labels, which the
+  // caller keeps, for example on disk; after the last slice, Finish returns the statistics of the
+  // components and ResolveSlice turns each slice of provisional labels into the labels that Find3d
+  // would give the whole volume. Apart from the provisional labels, memory use is about two slices.
+  public ref class StreamingConnectedComponents
+  {
+  public:
+    StreamingConnectedComponents(int width, int height, unsigned char backgroundColour);
+
+    // Options.ThreadCount is ignored: slices are labelled on the calling thread.
+    StreamingConnectedComponents(int width, int height, unsigned char backgroundColour, ConnectedComponentsOptions options);
+
+    ~StreamingConnectedComponents();
+
+    !StreamingConnectedComponents();
+
+    // Labels the next slice, which must hold width*height voxels, into provisional.
+    void AddSlice(array<unsigned char>^ slice, array<unsigned int>^ provisional);
+
+    // Ends the volume, returning the statistics of its components as for Find3dWithStatistics.
+    array<ComponentStatistics>^ Finish();
+
+    // Converts a slice of provisional labels from AddSlice into final labels, after Finish. Throws
+    // ArgumentOutOfRangeException for a label that AddSlice did not give.
+    void ResolveSlice(array<unsigned int>^ provisional, array<unsigned short>^ result);
+
+  private:
+    void CheckSlice(System::Array^ slice, System::String^ name);
+
+    int width_, height_;
+    unsigned char backgroundColour_;
+    StreamingLabeller* labeller_;
   };
 } } }
\ No newline at end of file
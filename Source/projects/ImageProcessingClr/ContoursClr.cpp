@@ -0,0 +1,138 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "ContoursClr.h"
+
+#pragma managed(push, off)
+#include "contours.h"
+#include "Instrumentation.h"
+#pragma managed(pop)
+
+namespace InnerEye {  namespace CreateDataset { namespace ImageProcessing {
+
+      static void CheckVolume(array<unsigned char>^ volume, int dimX, int dimY, int dimZ, int threadCount)
+      {
+        if (volume == nullptr)
+          throw gcnew System::ArgumentNullException("volume");
+        if (dimX < 0 || dimY < 0 || dimZ < 0)
+          throw gcnew System::ArgumentOutOfRangeException("dimX", "Dimensions must not be negative.");
+        if (volume->LongLength != (long long)dimX * dimY * dimZ)
+          throw gcnew System::ArgumentException("The volume array should have dimX * dimY * dimZ elements.", "volume");
+        if (threadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("threadCount", "ThreadCount must not be negative.");
+      }
+
+      array<array<TracedPolygon^>^>^ SliceContours::TracePolygonsWithHoles(
+        array<unsigned char>^ volume,
+        int dimX, int dimY, int dimZ,
+        unsigned char foregroundId,
+        SliceOrientation orientation,
+        int firstSlice, int lastSlice,
+        int maxNestingLevel,
+        int threadCount)
+      {
+        CheckVolume(volume, dimX, dimY, dimZ, threadCount);
+        const int sliceCount = orientation == SliceOrientation::Axial ? dimZ : orientation == SliceOrientation::Coronal ? dimY : dimX;
+        if (firstSlice < 0 || lastSlice >= sliceCount || firstSlice > lastSlice + 1)
+          throw gcnew System::ArgumentOutOfRangeException("firstSlice", "The slices must be within the volume.");
+        createdataset::InstrumentedCall call("SliceContours.TracePolygonsWithHoles", volume->LongLength,
+          createdataset::resolveThreadCount(threadCount, std::max(lastSlice - firstSlice + 1, 1)));
+
+        // Slices of an empty volume have no polygons
+        std::vector<std::vector<createdataset::TracedPolygon>> polygons(std::max(lastSlice - firstSlice + 1, 0));
+        if (volume->Length > 0 && lastSlice >= firstSlice)
+        {
+          pin_ptr<unsigned char> buffer = nullptr;
+          buffer = &volume[0];
+          try
+          {
+            createdataset::tracePolygonsPerSlice(dimX, dimY, dimZ, buffer, dimX*dimY, dimX, 1,
+              (createdataset::SliceAxis)orientation, firstSlice, lastSlice, foregroundId, maxNestingLevel, polygons, threadCount);
+          }
+          catch (std::exception& oops)
+          {
+            throw gcnew System::Exception(gcnew System::String(oops.what()));
+          }
+        }
+
+        createdataset::InstrumentedStage stage("polygons");
+        auto result = gcnew array<array<TracedPolygon^>^>(std::max(lastSlice - firstSlice + 1, 0));
+        for (int i = 0; i < result->Length; i++)
+        {
+          const std::vector<createdataset::TracedPolygon>& slice = polygons[i];
+          result[i] = gcnew array<TracedPolygon^>((int)slice.size());
+          for (int p = 0; p < result[i]->Length; p++)
+          {
+            const createdataset::TracedPolygon& polygon = slice[p];
+            auto traced = gcnew TracedPolygon();
+            traced->Points = gcnew array<int>((int)polygon.points.size());
+            if (!polygon.points.empty())
+              System::Runtime::InteropServices::Marshal::Copy(System::IntPtr((void*)&polygon.points[0]), traced->Points, 0, traced->Points->Length);
+            traced->ForegroundCount = polygon.foreground;
+            traced->OtherCount = polygon.other;
+            traced->InsideOfPolygon = polygon.insideOf;
+            traced->IsInnerContour = polygon.inner;
+            traced->StartX = polygon.startX;
+            traced->StartY = polygon.startY;
+            traced->NestingLevel = polygon.nestingLevel;
+            traced->OuterIndex = polygon.outer;
+            result[i][p] = traced;
+          }
+        }
+        return result;
+      }
+
+      void SliceContours::FillPolygons(
+        array<unsigned char>^ volume,
+        int dimX, int dimY, int dimZ,
+        array<float>^ x, array<float>^ y,
+        array<int>^ starts, array<int>^ slices,
+        unsigned char value,
+        int threadCount)
+      {
+        CheckVolume(volume, dimX, dimY, dimZ, threadCount);
+        if (x == nullptr)
+          throw gcnew System::ArgumentNullException("x");
+        if (y == nullptr)
+          throw gcnew System::ArgumentNullException("y");
+        if (starts == nullptr)
+          throw gcnew System::ArgumentNullException("starts");
+        if (slices == nullptr)
+          throw gcnew System::ArgumentNullException("slices");
+        if (x->Length != y->Length)
+          throw gcnew System::ArgumentException("The x and y arrays should have the same length.", "y");
+        if (starts->Length != slices->Length + 1 || starts[0] != 0 || starts[slices->Length] != x->Length)
+          throw gcnew System::ArgumentException("The starts array should run from 0 to the number of points, with one more element than slices.", "starts");
+        // Checked here, as FillPolygon.Fill does, so that x and y are not empty when they are pinned
+        for (int p = 0; p < slices->Length; p++)
+        {
+          if (starts[p + 1] <= starts[p])
+            throw gcnew System::ArgumentOutOfRangeException("starts", "The polygon does not contain any points.");
+          if (slices[p] < 0 || slices[p] >= dimZ)
+            throw gcnew System::ArgumentOutOfRangeException("slices", "The Z slice must be within the Z dimensions.");
+        }
+        createdataset::InstrumentedCall call("SliceContours.FillPolygons", volume->LongLength, createdataset::resolveThreadCount(threadCount, slices->Length));
+        if (slices->Length == 0)
+          return;
+
+        pin_ptr<unsigned char> buffer = nullptr;
+        if (volume->Length > 0)
+          buffer = &volume[0];
+        pin_ptr<float> xs = &x[0];
+        pin_ptr<float> ys = &y[0];
+        pin_ptr<int> polygonStarts = &starts[0];
+        pin_ptr<int> polygonSlices = &slices[0];
+        try
+        {
+          createdataset::fillPolygonsPerSlice<unsigned char>(dimX, dimY, dimZ, buffer, dimX*dimY, dimX, 1,
+            xs, ys, polygonStarts, polygonSlices, slices->Length, value, threadCount);
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+} } }
@@ -0,0 +1,64 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // The orientation of slices through a volume, as SliceType: axial slices are x by y, coronal
+  // x by z and sagittal y by z.
+  public enum class SliceOrientation
+  {
+    Axial,
+    Coronal,
+    Sagittal
+  };
+
+  // A polygon traced around a region of a slice, with the fields of PolygonPoints.
+  public ref class TracedPolygon
+  {
+  public:
+    // The x and y of each point in turn.
+    property array<int>^ Points;
+
+    // The voxels on or inside the polygon of its own region's value and of the other value.
+    property unsigned int ForegroundCount;
+    property unsigned int OtherCount;
+
+    // The id of the polygon inside which this was found, or zero.
+    property unsigned short InsideOfPolygon;
+
+    // True for the contour of a hole.
+    property bool IsInnerContour;
+
+    property int StartX;
+    property int StartY;
+    property int NestingLevel;
+
+    // For a hole, the index among the polygons of its slice of the outer polygon it belongs to;
+    // -1 otherwise.
+    property int OuterIndex;
+  };
+
+  // Contour extraction and polygon filling slice by slice, as ExtractContours and FillPolygon do
+  // them, with slices read and written in place and processed in parallel.
+  public ref class SliceContours
+  {
+  public:
+    // The polygons around the regions of voxels equal to foregroundId in each slice from
+    // firstSlice to lastSlice of the given orientation, with holes and the inserts in them up to
+    // maxNestingLevel, exactly as ExtractContours.PolygonsWithHoles finds them: element i is
+    // those of slice firstSlice + i in the order found, where each hole names its outer polygon
+    // by OuterIndex. Uses up to threadCount threads, or one per processor for 0.
+    static array<array<TracedPolygon^>^>^ TracePolygonsWithHoles(array<unsigned char>^ volume, int dimX, int dimY, int dimZ, unsigned char foregroundId, SliceOrientation orientation, int firstSlice, int lastSlice, int maxNestingLevel, int threadCount);
+
+    // Sets every voxel of volume on or inside each polygon to value, as FillPolygon.Fill does on
+    // axial slices. Polygon p has the points from starts[p] to starts[p + 1] - 1 of x and y, and
+    // lies in axial slice slices[p]; starts has one more element than slices, and every polygon
+    // must have at least one point.
+    static void FillPolygons(array<unsigned char>^ volume, int dimX, int dimY, int dimZ, array<float>^ x, array<float>^ y, array<int>^ starts, array<int>^ slices, unsigned char value, int threadCount);
+  };
+} } }
@@ -5,33 +5,84 @@
  */
 
 #include "ConvolutionClr.h"
+#include "NativeBatch.h"
+#include "NativeOperation.h"
+
+#include <memory>
+#include <msclr/lock.h>
 
 #pragma managed(push, off)
 #include "convolution.h"
+#include "smoothing.h"
 #include "GaussianKernel1D.h"
+#include "ConvolutionPlan.h"
+#include "Instrumentation.h"
 #pragma managed(pop)
 
 namespace InnerEye {
   namespace CreateDataset {
     namespace ImageProcessing {
 
-      void Convolution::Convolve(array<float>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      ConvolutionRegion::ConvolutionRegion(int minimumX, int minimumY, int minimumZ, int maximumX, int maximumY, int maximumZ) :
+        MinimumX(minimumX), MinimumY(minimumY), MinimumZ(minimumZ), MaximumX(maximumX), MaximumY(maximumY), MaximumZ(maximumZ)
+      {
+      }
+
+      static createdataset::ConvolutionOptions ToNative(ConvolutionOptions options)
+      {
+        if (options.ThreadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("options", "ThreadCount must not be negative.");
+        if (options.Sampling != GaussianSampling::Point && options.Sampling != GaussianSampling::Integral)
+          throw gcnew System::ArgumentOutOfRangeException("options", "Sampling was out of range.");
+        if (options.Method != GaussianMethod::Auto && options.Method != GaussianMethod::Direct && options.Method != GaussianMethod::Recursive)
+          throw gcnew System::ArgumentOutOfRangeException("options", "Method was out of range.");
+        if (options.Mode < ConvolutionMode::Auto || options.Mode > ConvolutionMode::Avx512)
+          throw gcnew System::ArgumentOutOfRangeException("options", "Mode was out of range.");
+        if (!Convolution::IsModeSupported(options.Mode))
+          throw gcnew System::NotSupportedException("Mode is not supported on this processor.");
+
+        createdataset::ConvolutionOptions result;
+        result.mode = (createdataset::ConvolutionMode)options.Mode;
+        result.tiled = !options.Untiled;
+        result.threadCount = options.ThreadCount;
+        result.fixedPoint = options.FixedPoint;
+        return result;
+      }
+
+      static createdataset::Region3d ToNative(ConvolutionRegion region)
+      {
+        return createdataset::Region3d(region.MinimumX, region.MinimumY, region.MinimumZ, region.MaximumX, region.MaximumY, region.MaximumZ);
+      }
+
+      static void ToNative(array<Direction>^ directions, array<float>^ sigmas, std::vector<int>& nativeDirections, std::vector<float>& nativeSigmas)
       {
         if (directions->Length != sigmas->Length)
           throw gcnew System::Exception("Arrays of directions and sigmas should be of the same length.");
 
-        int leap = width*height*sizeof(float), stride = width*sizeof(float), hop=sizeof(float);
+        nativeDirections.resize(directions->Length);
+        nativeSigmas.resize(sigmas->Length);
+        for (int d = 0; d < directions->Length; d++)
+        {
+          nativeDirections[d] = (int)directions[d];
+          nativeSigmas[d] = sigmas[d];
+        }
+      }
+
+      static createdataset::ConvolutionPlan* CreatePlan(int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        createdataset::OperationProgress* progress = nullptr)
+      {
+        createdataset::InstrumentedCall call("ConvolutionPlan.ctor");
+        std::vector<int> nativeDirections;
+        std::vector<float> nativeSigmas;
+        ToNative(directions, sigmas, nativeDirections, nativeSigmas);
+
+        createdataset::ConvolutionOptions nativeOptions = ToNative(options);
+        nativeOptions.progress = progress;
 
-        pin_ptr<float> buffer = &data[0];
-        
         try
         {
-          for (int d = 0; d < directions->Length; d++)
-          {
-            createdataset::GaussianKernel1D kernel(sigmas[d]);
-            Direction direction = directions[d];
-            createdataset::convolve1d<float>(width, height, depth, (unsigned char*)buffer, leap, stride, hop, (int)direction, kernel.getData(), kernel.getRadius());
-          }
+          return new createdataset::ConvolutionPlan(width, height, depth, nativeDirections, nativeSigmas, nativeOptions,
+            (createdataset::GaussianSampling)options.Sampling, (createdataset::GaussianMethod)options.Method);
         }
         catch (std::exception& oops)
         {
@@ -39,23 +90,34 @@ namespace InnerEye {
         }
       }
 
-      void Convolution::Convolve(array<unsigned char>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      // Smooths region of source, which holds a whole volume of the dimensions of the plan, into
+      // destination, which holds just the region.
+      template<typename T>
+      static void ExecutePlan(createdataset::ConvolutionPlan& plan, array<T>^ source, array<T>^ destination, ConvolutionRegion region)
       {
-        if (directions->Length != sigmas->Length)
-          throw gcnew System::Exception("Arrays of directions and sigmas should be of the same length.");
+        const int width = plan.getWidth(), height = plan.getHeight(), depth = plan.getDepth();
+        if (source->Length != width*height*depth)
+          throw gcnew System::Exception("Length of source does not match the dimensions of the volume.");
+
+        const createdataset::Region3d nativeRegion = ToNative(region);
+        if (!nativeRegion.isInside(width, height, depth))
+          throw gcnew System::ArgumentOutOfRangeException("region", "Region must lie inside the volume.");
+        if (nativeRegion.isEmpty())
+          return;
+        if (destination->Length != nativeRegion.getWidth()*nativeRegion.getHeight()*nativeRegion.getDepth())
+          throw gcnew System::Exception("Length of destination does not match the size of the region.");
 
-        int leap = width*height*sizeof(unsigned char), stride = width*sizeof(unsigned char), hop = sizeof(unsigned char);
+        int leap = width*height*sizeof(T), stride = width*sizeof(T), hop = sizeof(T);
+        int destinationStride = nativeRegion.getWidth()*sizeof(T), destinationLeap = nativeRegion.getHeight()*destinationStride;
 
-        pin_ptr<unsigned char> buffer = &data[0];
+        createdataset::InstrumentedStage pin("pin");
+        pin_ptr<T> input = &source[0];
+        pin_ptr<T> output = &destination[0];
+        pin.stop();
 
         try
         {
-          for (int d = 0; d < directions->Length; d++)
-          {
-            createdataset::GaussianKernel1D kernel(sigmas[d]);
-            Direction direction = directions[d];
-            createdataset::convolve1d<unsigned char>(width, height, depth, (unsigned char*)buffer, leap, stride, hop, (int)direction, kernel.getData(), kernel.getRadius());
-          }
+          plan.execute<T>((const unsigned char*)input, leap, stride, hop, (unsigned char*)output, destinationLeap, destinationStride, hop, nativeRegion);
         }
         catch (std::exception& oops)
         {
@@ -63,28 +125,436 @@ namespace InnerEye {
         }
       }
 
-      void Convolution::Convolve(array<short>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      template<typename T>
+      static void ConvolveT(array<T>^ source, array<T>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionRegion region, ConvolutionOptions options)
       {
-        if (directions->Length != sigmas->Length)
-          throw gcnew System::Exception("Arrays of directions and sigmas should be of the same length.");
+        createdataset::InstrumentedCall call("Convolution.Convolve", (long long)width * height * depth, createdataset::resolveThreadCount(options.ThreadCount, depth));
+        std::unique_ptr<createdataset::ConvolutionPlan> plan(CreatePlan(width, height, depth, directions, sigmas, options));
+        ExecutePlan<T>(*plan, source, destination, region);
+      }
 
-        int leap = width*height*sizeof(short), stride = width*sizeof(short), hop = sizeof(short);
+      // Smooths a native volume in place with plan.
+      template<typename T>
+      static void ExecutePlan(createdataset::ConvolutionPlan& plan, NativeVolume<T>^ data)
+      {
+        if (data == nullptr)
+          throw gcnew System::ArgumentNullException("data");
+        if (data->DimX != plan.getWidth() || data->DimY != plan.getHeight() || data->DimZ != plan.getDepth())
+          throw gcnew System::ArgumentException("The dimensions of the volume do not match those of the plan.", "data");
+        unsigned char* buffer = data->GetBuffer();
+        if (data->Length == 0)
+          return;
 
-        pin_ptr<short> buffer = &data[0];
+        try
+        {
+          plan.execute<T>(buffer, data->Leap, data->Stride, sizeof(T));
+        }
+        catch (createdataset::OperationCancelled&)
+        {
+          throw gcnew System::OperationCanceledException();
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+
+        System::GC::KeepAlive(data);
+      }
+
+      template<typename T>
+      static void ConvolveVolume(NativeVolume<T>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        createdataset::OperationProgress* progress = nullptr)
+      {
+        if (data == nullptr)
+          throw gcnew System::ArgumentNullException("data");
+
+        createdataset::InstrumentedCall call("Convolution.Convolve", data->Length, createdataset::resolveThreadCount(options.ThreadCount, data->DimZ));
+        std::unique_ptr<createdataset::ConvolutionPlan> plan(CreatePlan(data->DimX, data->DimY, data->DimZ, directions, sigmas, options, progress));
+        ExecutePlan<T>(*plan, data);
+      }
+
+      template<typename T>
+      static void ConvolveBatch(array<NativeVolume<T>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        createdataset::OperationProgress* progress = nullptr)
+      {
+        CheckBatch(volumes, "volumes", volumes, "volumes");
+        std::vector<int> nativeDirections;
+        std::vector<float> nativeSigmas;
+        ToNative(directions, sigmas, nativeDirections, nativeSigmas);
+        createdataset::ConvolutionOptions nativeOptions = ToNative(options);
+        nativeOptions.progress = progress;
+        const std::vector<createdataset::BatchVolume> batch = ToBatch(volumes, "volumes");
+        createdataset::InstrumentedCall call("Convolution.Convolve", TotalVoxels(batch),
+          createdataset::resolveThreadCount(options.ThreadCount, std::numeric_limits<int>::max()));
 
         try
         {
-          for (int d = 0; d < directions->Length; d++)
-          {
-            createdataset::GaussianKernel1D kernel(sigmas[d]);
-            Direction direction = directions[d];
-            createdataset::convolve1d<short>(width, height, depth, (unsigned char*)buffer, leap, stride, hop, (int)direction, kernel.getData(), kernel.getRadius());
-          }
+          createdataset::convolveBatch<T>(batch, nativeDirections, nativeSigmas, nativeOptions,
+            (createdataset::GaussianSampling)options.Sampling, (createdataset::GaussianMethod)options.Method);
+        }
+        catch (createdataset::OperationCancelled&)
+        {
+          throw gcnew System::OperationCanceledException();
         }
         catch (std::exception& oops)
         {
           throw gcnew System::Exception(gcnew System::String(oops.what()));
         }
+
+        System::GC::KeepAlive(volumes);
+      }
+
+      // Convolution::ConvolveAsync of a native volume, or of a batch of them if volumes is not null.
+      template<typename T>
+      ref class ConvolveOperation : NativeOperation<System::Object^>
+      {
+      public:
+        ConvolveOperation(NativeVolume<T>^ data, array<NativeVolume<T>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options) :
+          data_(data), volumes_(volumes), directions_(directions), sigmas_(sigmas), options_(options)
+        {
+        }
+
+      protected:
+        virtual System::Object^ Run(createdataset::OperationProgress* progress) override
+        {
+          // The voxels and threads of the synchronous call, which records nothing inside this one
+          const bool batch = volumes_ != nullptr;
+          createdataset::InstrumentedCall call("Convolution.ConvolveAsync", batch ? TotalVoxels(ToBatch(volumes_, "volumes")) : data_->Length,
+            createdataset::resolveThreadCount(options_.ThreadCount, batch ? std::numeric_limits<int>::max() : data_->DimZ));
+          if (volumes_ == nullptr)
+            ConvolveVolume<T>(data_, directions_, sigmas_, options_, progress);
+          else
+            ConvolveBatch<T>(volumes_, directions_, sigmas_, options_, progress);
+          return nullptr;
+        }
+
+      private:
+        NativeVolume<T>^ data_;
+        array<NativeVolume<T>^>^ volumes_;
+        array<Direction>^ directions_;
+        array<float>^ sigmas_;
+        ConvolutionOptions options_;
+      };
+
+      // Throws for the arguments of ConvolveAsync that the synchronous methods would throw for.
+      static void CheckConvolveArguments(array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        std::vector<int> nativeDirections;
+        std::vector<float> nativeSigmas;
+        ToNative(directions, sigmas, nativeDirections, nativeSigmas);
+        ToNative(options);
+      }
+
+      template<typename T>
+      static System::Threading::Tasks::Task^ ConvolveVolumeAsync(NativeVolume<T>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+      {
+        if (data == nullptr)
+          throw gcnew System::ArgumentNullException("data");
+        CheckConvolveArguments(directions, sigmas, options);
+        return (gcnew ConvolveOperation<T>(data, nullptr, directions, sigmas, options))->Start(progress, cancellationToken);
+      }
+
+      template<typename T>
+      static System::Threading::Tasks::Task^ ConvolveBatchAsync(array<NativeVolume<T>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+      {
+        CheckBatch(volumes, "volumes", volumes, "volumes");
+        CheckConvolveArguments(directions, sigmas, options);
+        return (gcnew ConvolveOperation<T>(nullptr, volumes, directions, sigmas, options))->Start(progress, cancellationToken);
+      }
+
+      template<typename T>
+      static void GaussianSmooth3dT(array<T>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ, ConvolutionOptions options)
+      {
+        createdataset::InstrumentedCall call("Convolution.GaussianSmooth3d", (long long)width * height * depth, createdataset::resolveThreadCount(options.ThreadCount, depth));
+        array<Direction>^ directions = gcnew array<Direction> { Direction::DirectionX, Direction::DirectionY, Direction::DirectionZ };
+        array<float>^ sigmas = gcnew array<float> { sigmaX, sigmaY, sigmaZ };
+        ConvolveT<T>(data, data, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), options);
+      }
+
+      bool Convolution::IsModeSupported(ConvolutionMode mode)
+      {
+        if (mode < ConvolutionMode::Auto || mode > ConvolutionMode::Avx512)
+          throw gcnew System::ArgumentOutOfRangeException("mode");
+
+        return createdataset::isConvolutionModeSupported((createdataset::ConvolutionMode)mode);
+      }
+
+      void Convolution::Convolve(array<float>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      {
+        ConvolveT<float>(data, data, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), ConvolutionOptions());
+      }
+
+      void Convolution::Convolve(array<unsigned char>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      {
+        ConvolveT<unsigned char>(data, data, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), ConvolutionOptions());
+      }
+
+      void Convolution::Convolve(array<short>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      {
+        ConvolveT<short>(data, data, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), ConvolutionOptions());
+      }
+
+      void Convolution::Convolve(array<float>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveT<float>(data, data, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), options);
+      }
+
+      void Convolution::Convolve(array<unsigned char>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveT<unsigned char>(data, data, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), options);
+      }
+
+      void Convolution::Convolve(array<short>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveT<short>(data, data, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), options);
+      }
+
+      void Convolution::Convolve(array<float>^ source, array<float>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      {
+        ConvolveT<float>(source, destination, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), ConvolutionOptions());
+      }
+
+      void Convolution::Convolve(array<unsigned char>^ source, array<unsigned char>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      {
+        ConvolveT<unsigned char>(source, destination, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), ConvolutionOptions());
+      }
+
+      void Convolution::Convolve(array<short>^ source, array<short>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas)
+      {
+        ConvolveT<short>(source, destination, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), ConvolutionOptions());
+      }
+
+      void Convolution::Convolve(array<float>^ source, array<float>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveT<float>(source, destination, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), options);
+      }
+
+      void Convolution::Convolve(array<unsigned char>^ source, array<unsigned char>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveT<unsigned char>(source, destination, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), options);
+      }
+
+      void Convolution::Convolve(array<short>^ source, array<short>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveT<short>(source, destination, width, height, depth, directions, sigmas, ConvolutionRegion(0, 0, 0, width - 1, height - 1, depth - 1), options);
+      }
+
+      void Convolution::Convolve(array<float>^ source, array<float>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionRegion region, ConvolutionOptions options)
+      {
+        ConvolveT<float>(source, destination, width, height, depth, directions, sigmas, region, options);
+      }
+
+      void Convolution::Convolve(array<unsigned char>^ source, array<unsigned char>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionRegion region, ConvolutionOptions options)
+      {
+        ConvolveT<unsigned char>(source, destination, width, height, depth, directions, sigmas, region, options);
+      }
+
+      void Convolution::Convolve(array<short>^ source, array<short>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionRegion region, ConvolutionOptions options)
+      {
+        ConvolveT<short>(source, destination, width, height, depth, directions, sigmas, region, options);
+      }
+
+      void Convolution::GaussianSmooth3d(array<float>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ)
+      {
+        GaussianSmooth3dT<float>(data, width, height, depth, sigmaX, sigmaY, sigmaZ, ConvolutionOptions());
+      }
+
+      void Convolution::GaussianSmooth3d(array<unsigned char>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ)
+      {
+        GaussianSmooth3dT<unsigned char>(data, width, height, depth, sigmaX, sigmaY, sigmaZ, ConvolutionOptions());
+      }
+
+      void Convolution::GaussianSmooth3d(array<short>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ)
+      {
+        GaussianSmooth3dT<short>(data, width, height, depth, sigmaX, sigmaY, sigmaZ, ConvolutionOptions());
+      }
+
+      void Convolution::GaussianSmooth3d(array<float>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ, ConvolutionOptions options)
+      {
+        GaussianSmooth3dT<float>(data, width, height, depth, sigmaX, sigmaY, sigmaZ, options);
+      }
+
+      void Convolution::GaussianSmooth3d(array<unsigned char>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ, ConvolutionOptions options)
+      {
+        GaussianSmooth3dT<unsigned char>(data, width, height, depth, sigmaX, sigmaY, sigmaZ, options);
+      }
+
+      void Convolution::GaussianSmooth3d(array<short>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ, ConvolutionOptions options)
+      {
+        GaussianSmooth3dT<short>(data, width, height, depth, sigmaX, sigmaY, sigmaZ, options);
+      }
+
+      void Convolution::Convolve(NativeVolume<float>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveVolume<float>(data, directions, sigmas, options);
+      }
+
+      void Convolution::Convolve(NativeVolume<unsigned char>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveVolume<unsigned char>(data, directions, sigmas, options);
+      }
+
+      void Convolution::Convolve(NativeVolume<short>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveVolume<short>(data, directions, sigmas, options);
+      }
+
+      void Convolution::Convolve(array<NativeVolume<float>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveBatch<float>(volumes, directions, sigmas, options);
+      }
+
+      void Convolution::Convolve(array<NativeVolume<unsigned char>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveBatch<unsigned char>(volumes, directions, sigmas, options);
+      }
+
+      void Convolution::Convolve(array<NativeVolume<short>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options)
+      {
+        ConvolveBatch<short>(volumes, directions, sigmas, options);
+      }
+
+      System::Threading::Tasks::Task^ Convolution::ConvolveAsync(NativeVolume<float>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+      {
+        return ConvolveVolumeAsync<float>(data, directions, sigmas, options, progress, cancellationToken);
+      }
+
+      System::Threading::Tasks::Task^ Convolution::ConvolveAsync(NativeVolume<unsigned char>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+      {
+        return ConvolveVolumeAsync<unsigned char>(data, directions, sigmas, options, progress, cancellationToken);
+      }
+
+      System::Threading::Tasks::Task^ Convolution::ConvolveAsync(NativeVolume<short>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+      {
+        return ConvolveVolumeAsync<short>(data, directions, sigmas, options, progress, cancellationToken);
+      }
+
+      System::Threading::Tasks::Task^ Convolution::ConvolveAsync(array<NativeVolume<float>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+      {
+        return ConvolveBatchAsync<float>(volumes, directions, sigmas, options, progress, cancellationToken);
+      }
+
+      System::Threading::Tasks::Task^ Convolution::ConvolveAsync(array<NativeVolume<unsigned char>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+      {
+        return ConvolveBatchAsync<unsigned char>(volumes, directions, sigmas, options, progress, cancellationToken);
+      }
+
+      System::Threading::Tasks::Task^ Convolution::ConvolveAsync(array<NativeVolume<short>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+        System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+      {
+        return ConvolveBatchAsync<short>(volumes, directions, sigmas, options, progress, cancellationToken);
+      }
+
+      ConvolutionPlan::ConvolutionPlan(int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas) :
+        plan_(CreatePlan(width, height, depth, directions, sigmas, ConvolutionOptions()))
+      {
+      }
+
+      ConvolutionPlan::ConvolutionPlan(int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options) :
+        plan_(CreatePlan(width, height, depth, directions, sigmas, options))
+      {
+      }
+
+      ConvolutionPlan::~ConvolutionPlan()
+      {
+        this->!ConvolutionPlan();
+      }
+
+      ConvolutionPlan::!ConvolutionPlan()
+      {
+        delete plan_;
+        plan_ = nullptr;
+      }
+
+      template<typename T>
+      void ConvolutionPlan::ExecuteT(array<T>^ source, array<T>^ destination, ConvolutionRegion region)
+      {
+        msclr::lock lock(this);
+
+        if (plan_ == nullptr)
+          throw gcnew System::ObjectDisposedException("ConvolutionPlan");
+
+        createdataset::InstrumentedCall call("ConvolutionPlan.Execute", (long long)plan_->getWidth() * plan_->getHeight() * plan_->getDepth(),
+          createdataset::resolveThreadCount(plan_->getOptions().threadCount, plan_->getDepth()));
+        ExecutePlan<T>(*plan_, source, destination, region);
+
+        // The finalizer must not free the plan while it is in use
+        System::GC::KeepAlive(this);
+      }
+
+      void ConvolutionPlan::Execute(array<float>^ data)
+      {
+        ExecuteT<float>(data, data, WholeVolume());
+      }
+
+      void ConvolutionPlan::Execute(array<unsigned char>^ data)
+      {
+        ExecuteT<unsigned char>(data, data, WholeVolume());
+      }
+
+      void ConvolutionPlan::Execute(array<short>^ data)
+      {
+        ExecuteT<short>(data, data, WholeVolume());
+      }
+
+      void ConvolutionPlan::Execute(array<float>^ source, array<float>^ destination, ConvolutionRegion region)
+      {
+        ExecuteT<float>(source, destination, region);
+      }
+
+      void ConvolutionPlan::Execute(array<unsigned char>^ source, array<unsigned char>^ destination, ConvolutionRegion region)
+      {
+        ExecuteT<unsigned char>(source, destination, region);
+      }
+
+      void ConvolutionPlan::Execute(array<short>^ source, array<short>^ destination, ConvolutionRegion region)
+      {
+        ExecuteT<short>(source, destination, region);
+      }
+
+      template<typename T>
+      void ConvolutionPlan::ExecuteVolume(NativeVolume<T>^ data)
+      {
+        msclr::lock lock(this);
+
+        if (plan_ == nullptr)
+          throw gcnew System::ObjectDisposedException("ConvolutionPlan");
+
+        createdataset::InstrumentedCall call("ConvolutionPlan.Execute", (long long)plan_->getWidth() * plan_->getHeight() * plan_->getDepth(),
+          createdataset::resolveThreadCount(plan_->getOptions().threadCount, plan_->getDepth()));
+        ExecutePlan<T>(*plan_, data);
+
+        System::GC::KeepAlive(this);
+      }
+
+      void ConvolutionPlan::Execute(NativeVolume<float>^ data)
+      {
+        ExecuteVolume<float>(data);
+      }
+
+      void ConvolutionPlan::Execute(NativeVolume<unsigned char>^ data)
+      {
+        ExecuteVolume<unsigned char>(data);
+      }
+
+      void ConvolutionPlan::Execute(NativeVolume<short>^ data)
+      {
+        ExecuteVolume<short>(data);
+      }
+
+      ConvolutionRegion ConvolutionPlan::WholeVolume()
+      {
+        if (plan_ == nullptr)
+          throw gcnew System::ObjectDisposedException("ConvolutionPlan");
+
+        return ConvolutionRegion(0, 0, 0, plan_->getWidth() - 1, plan_->getHeight() - 1, plan_->getDepth() - 1);
       }
     }
   }
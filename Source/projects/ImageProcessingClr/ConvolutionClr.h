@@ -6,6 +6,10 @@
 
 #pragma once
 
+#include "NativeVolumeClr.h"
+
+namespace createdataset { class ConvolutionPlan; }
+
 namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
 
   public enum class Direction
@@ -13,18 +17,219 @@ namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
     DirectionX=0, DirectionY=1, DirectionZ=2
   };
 
+  // How the coefficients of a Gaussian kernel are computed from the continuous Gaussian.
+  public enum class GaussianSampling
+  {
+    // The density at the centre of each voxel
+    Point = 0,
+    // The integral of the density over each voxel, which is more accurate for sigma below about one voxel
+    Integral = 1
+  };
+
+  // How Gaussian smoothing is done along each direction.
+  public enum class GaussianMethod
+  {
+    // Recursive for sigma above about six voxels, where it is faster, and Direct otherwise
+    Auto = 0,
+    // Convolution with the sampled kernel, whose cost grows with sigma
+    Direct = 1,
+    // The recursive filter of Young and van Vliet, whose cost is the same for any sigma. Accurate
+    // to a few percent of the peak of the kernel, and not affected by Sampling. Sigma below half a
+    // voxel uses Direct.
+    Recursive = 2
+  };
+
+  // The instructions used to convolve each row, as ConvolutionMode of the native library. Every
+  // mode gives the same result to within rounding; the choice is for testing and measurement.
+  public enum class ConvolutionMode
+  {
+    // The fastest mode supported by this processor
+    Auto = 0,
+    // One multiply-add per tap, without SIMD
+    Reference = 1,
+    Sse = 2,
+    Avx2 = 3,
+    Avx512 = 4
+  };
+
+  // Optional settings for Convolution. A default-constructed value gives the default behaviour.
+  public value struct ConvolutionOptions
+  {
+    // Maximum number of threads to use, or 0 for one per processor. Set this to share the cores
+    // of one machine between concurrent jobs.
+    int ThreadCount;
+
+    GaussianSampling Sampling;
+
+    GaussianMethod Method;
+
+    // Convolve byte and short volumes in 16 bit fixed point rather than float, which is two to
+    // three times faster. Each voxel of a byte volume is within one of the float result for each
+    // direction, for sigma up to about 17. Ignored for float volumes.
+    bool FixedPoint;
+
+    // Must be supported by this processor (see Convolution::IsModeSupported).
+    ConvolutionMode Mode;
+
+    // Gather one strided row at a time in the Y and Z directions, rather than convolving blocks
+    // of neighbouring columns together. Slower; for testing and measurement.
+    bool Untiled;
+  };
+
+  // A box of voxels from minimum to maximum inclusive along each axis, as Region3D.
+  public value struct ConvolutionRegion
+  {
+    ConvolutionRegion(int minimumX, int minimumY, int minimumZ, int maximumX, int maximumY, int maximumZ);
+
+    int MinimumX, MinimumY, MinimumZ;
+    int MaximumX, MaximumY, MaximumZ;
+  };
+
   public ref class Convolution
   {
   public:
-    // TODO: Various improvements are possible:
-    // * Take a ROI as argument to avoid the need to extract subregion from managed array.
-    // * Support out-of-place convolution too?
-    // * Support arbtirary kernel in array.
+    // TODO: Support arbtirary kernel in array.
+
+    // Whether ConvolutionOptions::Mode can be used on this processor. Auto and Reference always can.
+    static bool IsModeSupported(ConvolutionMode mode);
 
     static void Convolve(array<float>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas);
 
     static void Convolve(array<unsigned char>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas);
 
     static void Convolve(array<short>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas);
+
+    static void Convolve(array<float>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    static void Convolve(array<unsigned char>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    static void Convolve(array<short>^ data, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    // Smooth source into destination, which must be the same size.
+    static void Convolve(array<float>^ source, array<float>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas);
+
+    static void Convolve(array<unsigned char>^ source, array<unsigned char>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas);
+
+    static void Convolve(array<short>^ source, array<short>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas);
+
+    static void Convolve(array<float>^ source, array<float>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    static void Convolve(array<unsigned char>^ source, array<unsigned char>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    static void Convolve(array<short>^ source, array<short>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    // Smooth just region of source into destination, which holds the voxels of the region in the
+    // same order as source. The result is the same as smoothing the whole volume, but only the
+    // voxels within a kernel radius of the region are read.
+    static void Convolve(array<float>^ source, array<float>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionRegion region, ConvolutionOptions options);
+
+    static void Convolve(array<unsigned char>^ source, array<unsigned char>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionRegion region, ConvolutionOptions options);
+
+    static void Convolve(array<short>^ source, array<short>^ destination, int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionRegion region, ConvolutionOptions options);
+
+    // Smooth with a 3D Gaussian in a single pass over the volume, without rounding to the pixel type
+    // between axes. Convolve uses this whenever directions holds each of X, Y and Z exactly once.
+    static void GaussianSmooth3d(array<float>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ);
+
+    static void GaussianSmooth3d(array<unsigned char>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ);
+
+    static void GaussianSmooth3d(array<short>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ);
+
+    static void GaussianSmooth3d(array<float>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ, ConvolutionOptions options);
+
+    static void GaussianSmooth3d(array<unsigned char>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ, ConvolutionOptions options);
+
+    static void GaussianSmooth3d(array<short>^ data, int width, int height, int depth, float sigmaX, float sigmaY, float sigmaZ, ConvolutionOptions options);
+
+    // Smooth a native volume in place, without pinning or copying it.
+    static void Convolve(NativeVolume<float>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    static void Convolve(NativeVolume<unsigned char>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    static void Convolve(NativeVolume<short>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    // Smooth each native volume of a batch in place, as above, where the volumes may have
+    // different dimensions. With up to options.ThreadCount threads in all, small volumes are
+    // smoothed at the same time on one thread each and large ones in turn on every thread, so a
+    // batch of the structures of a subject keeps every core busy. The result is that of smoothing
+    // each volume on its own.
+    static void Convolve(array<NativeVolume<float>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    static void Convolve(array<NativeVolume<unsigned char>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    static void Convolve(array<NativeVolume<short>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    // As Convolve for a native volume or a batch of them, as a task on a thread of its own, so
+    // that the caller can read and write other volumes meanwhile. The volumes must not be used
+    // until the task has finished. The fraction done is reported to progress, if not null, after
+    // each output slice of a single pass, each direction otherwise, or each volume of a batch.
+    // Cancelling cancellationToken cancels the task at the next of those, leaving the volumes
+    // partly smoothed.
+    static System::Threading::Tasks::Task^ ConvolveAsync(NativeVolume<float>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+
+    static System::Threading::Tasks::Task^ ConvolveAsync(NativeVolume<unsigned char>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+
+    static System::Threading::Tasks::Task^ ConvolveAsync(NativeVolume<short>^ data, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+
+    static System::Threading::Tasks::Task^ ConvolveAsync(array<NativeVolume<float>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+
+    static System::Threading::Tasks::Task^ ConvolveAsync(array<NativeVolume<unsigned char>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+
+    static System::Threading::Tasks::Task^ ConvolveAsync(array<NativeVolume<short>^>^ volumes, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options,
+      System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken);
+  };
+
+  // Gaussian smoothing of volumes of one size along a fixed list of directions, set up once and
+  // executed many times, as for Convolution::Convolve. Holds the kernels, the choice of SIMD
+  // instructions and the scratch memory of every thread, so that repeated calls with the same
+  // dimensions and sigmas do no setup. Calls to Execute on one plan are serialised; use one
+  // plan per thread to smooth several volumes concurrently.
+  public ref class ConvolutionPlan
+  {
+  public:
+    ConvolutionPlan(int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas);
+
+    ConvolutionPlan(int width, int height, int depth, array<Direction>^ directions, array<float>^ sigmas, ConvolutionOptions options);
+
+    ~ConvolutionPlan();
+
+    !ConvolutionPlan();
+
+    // Smooth data, which must hold width*height*depth voxels, in place.
+    void Execute(array<float>^ data);
+
+    void Execute(array<unsigned char>^ data);
+
+    void Execute(array<short>^ data);
+
+    // Smooth just region of source into destination, as for Convolution::Convolve.
+    void Execute(array<float>^ source, array<float>^ destination, ConvolutionRegion region);
+
+    void Execute(array<unsigned char>^ source, array<unsigned char>^ destination, ConvolutionRegion region);
+
+    void Execute(array<short>^ source, array<short>^ destination, ConvolutionRegion region);
+
+    // Smooth a native volume of the dimensions of the plan in place.
+    void Execute(NativeVolume<float>^ data);
+
+    void Execute(NativeVolume<unsigned char>^ data);
+
+    void Execute(NativeVolume<short>^ data);
+
+  private:
+    template<typename T>
+    void ExecuteT(array<T>^ source, array<T>^ destination, ConvolutionRegion region);
+
+    template<typename T>
+    void ExecuteVolume(NativeVolume<T>^ data);
+
+    ConvolutionRegion WholeVolume();
+
+    createdataset::ConvolutionPlan* plan_;
   };
 } } }
\ No newline at end of file
@@ -0,0 +1,112 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "DistanceTransformClr.h"
+
+#pragma managed(push, off)
+#include "distanceTransform.h"
+#include "Instrumentation.h"
+#pragma managed(pop)
+
+namespace InnerEye {  namespace CreateDataset { namespace ImageProcessing {
+
+      template<typename T>
+      static void EuclideanDistanceBuffers(
+        T* image,
+        int width, int height, int depth,
+        T backgroundColour,
+        double spacingX, double spacingY, double spacingZ,
+        float* result,
+        int threadCount)
+      {
+        createdataset::InstrumentedCall call("DistanceTransform.EuclideanDistance", (long long)width * height * depth, createdataset::resolveThreadCount(threadCount, depth));
+        try
+        {
+          createdataset::euclideanDistanceTransform<T>(width, height, depth,
+            (unsigned char*)image, width*height*sizeof(T), width*sizeof(T), sizeof(T), backgroundColour,
+            spacingX, spacingY, spacingZ,
+            (unsigned char*)result, width*height*sizeof(float), width*sizeof(float), sizeof(float), threadCount);
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      template<typename T>
+      static void EuclideanDistanceT(
+        array<T>^ image,
+        int width, int height, int depth,
+        T backgroundColour,
+        double spacingX, double spacingY, double spacingZ,
+        array<float>^ result,
+        int threadCount)
+      {
+        if (image == nullptr)
+          throw gcnew System::ArgumentNullException("image");
+        if (result == nullptr)
+          throw gcnew System::ArgumentNullException("result");
+        if (width < 0 || height < 0 || depth < 0)
+          throw gcnew System::ArgumentOutOfRangeException("width", "Dimensions must not be negative.");
+        if (!(spacingX > 0 && spacingY > 0 && spacingZ > 0))
+          throw gcnew System::ArgumentOutOfRangeException("spacingX", "Spacing must be positive.");
+        if (threadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("threadCount", "ThreadCount must not be negative.");
+
+        const long long voxelCount = (long long)width * height * depth;
+        if (image->LongLength != voxelCount || result->LongLength != voxelCount)
+          throw gcnew System::ArgumentException("The image and result arrays should have width * height * depth elements.");
+        if (voxelCount == 0)
+          return;
+
+        pin_ptr<T> inputBuffer = &image[0];
+        pin_ptr<float> outputBuffer = &result[0];
+        EuclideanDistanceBuffers<T>(inputBuffer, width, height, depth, backgroundColour, spacingX, spacingY, spacingZ, outputBuffer, threadCount);
+      }
+
+      void DistanceTransform::EuclideanDistance(
+        array<unsigned char>^ mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour,
+        double spacingX, double spacingY, double spacingZ,
+        array<float>^ result,
+        int threadCount)
+      {
+        EuclideanDistanceT<unsigned char>(mask, width, height, depth, backgroundColour, spacingX, spacingY, spacingZ, result, threadCount);
+      }
+
+      void DistanceTransform::EuclideanDistance(
+        array<short>^ image,
+        int width, int height, int depth,
+        short backgroundColour,
+        double spacingX, double spacingY, double spacingZ,
+        array<float>^ result,
+        int threadCount)
+      {
+        EuclideanDistanceT<short>(image, width, height, depth, backgroundColour, spacingX, spacingY, spacingZ, result, threadCount);
+      }
+
+      void DistanceTransform::EuclideanDistance(
+        NativeVolume<unsigned char>^ mask,
+        unsigned char backgroundColour,
+        NativeVolume<float>^ result,
+        int threadCount)
+      {
+        if (mask == nullptr)
+          throw gcnew System::ArgumentNullException("mask");
+        if (result == nullptr)
+          throw gcnew System::ArgumentNullException("result");
+        if (mask->DimX != result->DimX || mask->DimY != result->DimY || mask->DimZ != result->DimZ)
+          throw gcnew System::ArgumentException("The volumes should have the same dimensions.", "result");
+        if (threadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("threadCount", "ThreadCount must not be negative.");
+
+        EuclideanDistanceBuffers<unsigned char>(mask->GetBuffer(), mask->DimX, mask->DimY, mask->DimZ, backgroundColour,
+          mask->SpacingX, mask->SpacingY, mask->SpacingZ, (float*)result->GetBuffer(), threadCount);
+        System::GC::KeepAlive(mask);
+        System::GC::KeepAlive(result);
+      }
+} } }
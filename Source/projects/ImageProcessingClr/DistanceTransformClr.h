@@ -0,0 +1,28 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include "NativeVolumeClr.h"
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // Exact Euclidean distance transforms, in three passes each linear in the number of voxels.
+  public ref class DistanceTransform
+  {
+  public:
+    // Writes to each voxel of result the distance, in the units of the spacing, to the nearest
+    // voxel of mask other than backgroundColour; zero for those voxels themselves, and
+    // float.MaxValue everywhere if there are none. Uses up to threadCount threads, or one per
+    // processor for 0.
+    static void EuclideanDistance(array<unsigned char>^ mask, int width, int height, int depth, unsigned char backgroundColour, double spacingX, double spacingY, double spacingZ, array<float>^ result, int threadCount);
+
+    static void EuclideanDistance(array<short>^ image, int width, int height, int depth, short backgroundColour, double spacingX, double spacingY, double spacingZ, array<float>^ result, int threadCount);
+
+    // As above for native volumes of the same dimensions, with the spacing of mask.
+    static void EuclideanDistance(NativeVolume<unsigned char>^ mask, unsigned char backgroundColour, NativeVolume<float>^ result, int threadCount);
+  };
+} } }
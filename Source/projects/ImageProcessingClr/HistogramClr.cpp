@@ -0,0 +1,85 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "HistogramClr.h"
+
+#pragma managed(push, off)
+#include "histogram.h"
+#include "Instrumentation.h"
+#include "parallel.h"
+#pragma managed(pop)
+
+namespace InnerEye {  namespace CreateDataset { namespace ImageProcessing {
+
+      static void CheckData(array<short>^ data, int step, int threadCount)
+      {
+        if (data == nullptr)
+          throw gcnew System::ArgumentNullException("data");
+        if (step < 1)
+          throw gcnew System::ArgumentOutOfRangeException("step", "Step must be positive.");
+        if (threadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("threadCount", "ThreadCount must not be negative.");
+      }
+
+      void Histogram::FindMinMax(array<short>^ data, int step, short% minimum, short% maximum, int threadCount)
+      {
+        CheckData(data, step, threadCount);
+        createdataset::InstrumentedCall call("Histogram.FindMinMax", data->Length / step, createdataset::resolveThreadCount(threadCount, data->Length / step));
+
+        short low = System::Int16::MaxValue, high = System::Int16::MinValue;
+        if (data->Length > 0)
+        {
+          pin_ptr<short> buffer = nullptr;
+          buffer = &data[0];
+          try
+          {
+            createdataset::findMinMax(buffer, data->Length, step, low, high, threadCount);
+          }
+          catch (std::exception& oops)
+          {
+            throw gcnew System::Exception(gcnew System::String(oops.what()));
+          }
+        }
+        minimum = low;
+        maximum = high;
+      }
+
+      void Histogram::Compute(array<short>^ data, int step, short minimum, short maximum, array<int>^ counts, int threadCount)
+      {
+        CheckData(data, step, threadCount);
+        if (counts == nullptr)
+          throw gcnew System::ArgumentNullException("counts");
+        if (counts->Length < 1)
+          throw gcnew System::ArgumentException("The histogram must have at least 1 bin.", "counts");
+        createdataset::InstrumentedCall call("Histogram.Compute", data->Length / step, createdataset::resolveThreadCount(threadCount, data->Length / step));
+
+        pin_ptr<short> buffer = nullptr;
+        if (data->Length > 0)
+          buffer = &data[0];
+        pin_ptr<int> bins = &counts[0];
+        try
+        {
+          createdataset::histogram(buffer, data->Length, step, minimum, maximum, counts->Length, bins, threadCount);
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      int Histogram::PercentileBin(array<int>^ counts, double fraction)
+      {
+        if (counts == nullptr)
+          throw gcnew System::ArgumentNullException("counts");
+        if (!(fraction >= 0 && fraction <= 1))
+          throw gcnew System::ArgumentOutOfRangeException("fraction", "Fraction must be from 0 to 1.");
+        if (counts->Length == 0)
+          return -1;
+
+        pin_ptr<int> bins = &counts[0];
+        return createdataset::percentileBin(bins, counts->Length, fraction);
+      }
+} } }
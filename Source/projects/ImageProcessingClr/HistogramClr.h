@@ -0,0 +1,28 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // Statistics of short volumes for automatic window and level, over every step-th voxel, with up
+  // to threadCount threads (0 for one per processor).
+  public ref class Histogram
+  {
+  public:
+    // The least and greatest values; short.MaxValue and short.MinValue for an empty array.
+    static void FindMinMax(array<short>^ data, int step, [System::Runtime::InteropServices::Out] short% minimum, [System::Runtime::InteropServices::Out] short% maximum, int threadCount);
+
+    // Counts the values into counts.Length equal bins spanning minimum to maximum, as
+    // AutoWindowLevelHelper.CreateHistogram does: values below and above fall in the first and
+    // last bin, and every count is zero if maximum is not above minimum.
+    static void Compute(array<short>^ data, int step, short minimum, short maximum, array<int>^ counts, int threadCount);
+
+    // The first bin at which the running total of counts reaches fraction of the total, for
+    // fraction from 0 to 1; -1 if every count is zero.
+    static int PercentileBin(array<int>^ counts, double fraction);
+  };
+} } }
@@ -0,0 +1,60 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "InstrumentationClr.h"
+
+#pragma managed(push, off)
+#include "Instrumentation.h"
+#pragma managed(pop)
+
+namespace InnerEye {
+  namespace CreateDataset {
+    namespace ImageProcessing {
+
+      bool Instrumentation::Enabled::get()
+      {
+        return createdataset::isInstrumentationEnabled();
+      }
+
+      void Instrumentation::Enabled::set(bool value)
+      {
+        createdataset::setInstrumentationEnabled(value);
+      }
+
+      array<StageTiming>^ Instrumentation::GetCounters()
+      {
+        std::vector<createdataset::StageCounters> counters;
+        try
+        {
+          counters = createdataset::getInstrumentationCounters();
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+
+        auto result = gcnew array<StageTiming>((int)counters.size());
+        for (int i = 0; i < result->Length; i++)
+        {
+          const createdataset::StageCounters& c = counters[i];
+          result[i].EntryPoint = gcnew System::String(c.entryPoint.c_str());
+          result[i].Stage = gcnew System::String(c.stage.c_str());
+          result[i].Calls = c.calls;
+          result[i].Milliseconds = c.milliseconds;
+          result[i].Voxels = c.voxels;
+          result[i].Threads = c.threads;
+          result[i].ScratchBytes = c.scratchBytes;
+        }
+        return result;
+      }
+
+      void Instrumentation::Reset()
+      {
+        createdataset::resetInstrumentationCounters();
+      }
+    }
+  }
+}
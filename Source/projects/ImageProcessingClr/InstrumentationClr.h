@@ -0,0 +1,48 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // The totals of one stage of one public method since the counters were last reset. The stage
+  // "total" is the whole of each call; the others are the parts of it, such as "convolve x" or
+  // "union-find". Stages that run on several threads at once add up to more than the call.
+  public value struct StageTiming
+  {
+  public:
+    // Such as "Convolution.Convolve", or empty for stages run outside any public method
+    System::String^ EntryPoint;
+    System::String^ Stage;
+    long long Calls;
+    double Milliseconds;
+    long long Voxels;
+
+    // The most threads used by any one call
+    int Threads;
+
+    // Scratch memory acquired while the stage ran, by any thread
+    long long ScratchBytes;
+  };
+
+  // Per-stage timing of the native image processing. Off by default, when it costs one test of a
+  // flag per stage; native builds with CREATEDATASET_INSTRUMENTATION defined as 0 leave it out.
+  public ref class Instrumentation
+  {
+  public:
+    // Records the stages of the calls that start after it is set.
+    static property bool Enabled
+    {
+      bool get();
+      void set(bool value);
+    }
+
+    // The counters of every stage in the order that each was first recorded.
+    static array<StageTiming>^ GetCounters();
+
+    static void Reset();
+  };
+} } }
@@ -0,0 +1,57 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "MemoryClr.h"
+
+#pragma managed(push, off)
+#include "Memory.h"
+#include "Instrumentation.h"
+#pragma managed(pop)
+
+namespace InnerEye {
+  namespace CreateDataset {
+    namespace ImageProcessing {
+
+      bool ScratchMemory::HugePages::get()
+      {
+        return createdataset::getScratchMemoryOptions().hugePages;
+      }
+
+      void ScratchMemory::HugePages::set(bool value)
+      {
+        createdataset::ScratchMemoryOptions options = createdataset::getScratchMemoryOptions();
+        options.hugePages = value;
+        createdataset::setScratchMemoryOptions(options);
+      }
+
+      long long ScratchMemory::CachedBytes::get()
+      {
+        return (long long)createdataset::getScratchMemoryOptions().cachedBytes;
+      }
+
+      void ScratchMemory::CachedBytes::set(long long value)
+      {
+        if (value < 0)
+          throw gcnew System::ArgumentOutOfRangeException("value", "CachedBytes must not be negative.");
+
+        createdataset::ScratchMemoryOptions options = createdataset::getScratchMemoryOptions();
+        options.cachedBytes = (size_t)value;
+        createdataset::setScratchMemoryOptions(options);
+      }
+
+      long long ScratchMemory::RetainedBytes::get()
+      {
+        return (long long)createdataset::getCachedScratchBytes();
+      }
+
+      void ScratchMemory::Trim()
+      {
+        createdataset::InstrumentedCall call("ScratchMemory.Trim");
+        createdataset::trimScratch();
+      }
+    }
+  }
+}
@@ -0,0 +1,42 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // Settings of the native scratch memory that holds the working arrays of ConnectedComponents.
+  // Large blocks are kept by the thread that releases them, up to CachedBytes for all threads
+  // together, and reused by its later calls, so repeated calls on one thread do not fault in new pages.
+  public ref class ScratchMemory
+  {
+  public:
+    // Back large blocks with 2 MB pages where the operating system gives them, which on Windows
+    // needs the process to hold SeLockMemoryPrivilege. Off by default.
+    static property bool HugePages
+    {
+      bool get();
+      void set(bool value);
+    }
+
+    // Most bytes of released blocks that all threads keep for reuse, 256 MB by default.
+    static property long long CachedBytes
+    {
+      long long get();
+      void set(long long value);
+    }
+
+    // Bytes of released blocks kept for reuse by all threads.
+    static property long long RetainedBytes
+    {
+      long long get();
+    }
+
+    // Returns the blocks kept by every thread, including the workers of batches and of the
+    // asynchronous methods, to the operating system.
+    static void Trim();
+  };
+} } }
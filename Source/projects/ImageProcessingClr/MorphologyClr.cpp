@@ -0,0 +1,180 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "MorphologyClr.h"
+
+#pragma managed(push, off)
+#include "morphology.h"
+#include "Instrumentation.h"
+#pragma managed(pop)
+
+namespace InnerEye {  namespace CreateDataset { namespace ImageProcessing {
+
+      static void CheckArguments(int radiusX, int radiusY, int radiusZ, int threadCount)
+      {
+        if (radiusX < 0 || radiusY < 0 || radiusZ < 0)
+          throw gcnew System::ArgumentOutOfRangeException("radiusX", "Radii must not be negative.");
+        if (threadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("threadCount", "ThreadCount must not be negative.");
+      }
+
+      static bool CheckArray(array<unsigned char>^ data, System::String^ name, int width, int height, int depth)
+      {
+        if (data == nullptr)
+          throw gcnew System::ArgumentNullException(name);
+        if (width < 0 || height < 0 || depth < 0)
+          throw gcnew System::ArgumentOutOfRangeException("width", "Dimensions must not be negative.");
+        if (data->LongLength != (long long)width * height * depth)
+          throw gcnew System::ArgumentException("The array should have width * height * depth elements.", name);
+        return data->LongLength > 0;
+      }
+
+      static void CheckVolume(NativeVolume<unsigned char>^ mask, NativeVolume<unsigned char>^ volume, System::String^ name)
+      {
+        if (volume == nullptr)
+          throw gcnew System::ArgumentNullException(name);
+        if (volume->DimX != mask->DimX || volume->DimY != mask->DimY || volume->DimZ != mask->DimZ)
+          throw gcnew System::ArgumentException("The volumes should have the same dimensions.", name);
+      }
+
+      static void DilateBuffers(
+        unsigned char* mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour, unsigned char foregroundColour,
+        int radiusX, int radiusY, int radiusZ,
+        unsigned char* restriction,
+        unsigned char* result,
+        int threadCount)
+      {
+        createdataset::InstrumentedCall call("MaskMorphology.Dilate", (long long)width * height * depth, createdataset::resolveThreadCount(threadCount, depth));
+        const int leap = width*height, stride = width;
+        try
+        {
+          createdataset::dilate<unsigned char>(width, height, depth,
+            mask, leap, stride, 1, backgroundColour, foregroundColour, radiusX, radiusY, radiusZ,
+            restriction, leap, stride, 1, foregroundColour, result, leap, stride, 1, threadCount);
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      static void ErodeBuffers(
+        unsigned char* mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour, unsigned char foregroundColour,
+        int radiusX, int radiusY, int radiusZ,
+        unsigned char* result,
+        int threadCount)
+      {
+        createdataset::InstrumentedCall call("MaskMorphology.Erode", (long long)width * height * depth, createdataset::resolveThreadCount(threadCount, depth));
+        const int leap = width*height, stride = width;
+        try
+        {
+          createdataset::erode<unsigned char>(width, height, depth,
+            mask, leap, stride, 1, backgroundColour, foregroundColour, radiusX, radiusY, radiusZ,
+            result, leap, stride, 1, threadCount);
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      void MaskMorphology::Dilate(
+        array<unsigned char>^ mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour, unsigned char foregroundColour,
+        int radiusX, int radiusY, int radiusZ,
+        array<unsigned char>^ restriction,
+        array<unsigned char>^ result,
+        int threadCount)
+      {
+        CheckArguments(radiusX, radiusY, radiusZ, threadCount);
+        CheckArray(result, "result", width, height, depth);
+        if (restriction != nullptr)
+          CheckArray(restriction, "restriction", width, height, depth);
+        if (!CheckArray(mask, "mask", width, height, depth))
+          return;
+
+        pin_ptr<unsigned char> inputBuffer = &mask[0];
+        pin_ptr<unsigned char> restrictionBuffer = nullptr;
+        if (restriction != nullptr)
+          restrictionBuffer = &restriction[0];
+        pin_ptr<unsigned char> outputBuffer = &result[0];
+        DilateBuffers(inputBuffer, width, height, depth, backgroundColour, foregroundColour, radiusX, radiusY, radiusZ, restrictionBuffer, outputBuffer, threadCount);
+      }
+
+      void MaskMorphology::Erode(
+        array<unsigned char>^ mask,
+        int width, int height, int depth,
+        unsigned char backgroundColour, unsigned char foregroundColour,
+        int radiusX, int radiusY, int radiusZ,
+        array<unsigned char>^ result,
+        int threadCount)
+      {
+        CheckArguments(radiusX, radiusY, radiusZ, threadCount);
+        CheckArray(result, "result", width, height, depth);
+        if (!CheckArray(mask, "mask", width, height, depth))
+          return;
+
+        pin_ptr<unsigned char> inputBuffer = &mask[0];
+        pin_ptr<unsigned char> outputBuffer = &result[0];
+        ErodeBuffers(inputBuffer, width, height, depth, backgroundColour, foregroundColour, radiusX, radiusY, radiusZ, outputBuffer, threadCount);
+      }
+
+      void MaskMorphology::Dilate(
+        NativeVolume<unsigned char>^ mask,
+        unsigned char backgroundColour, unsigned char foregroundColour,
+        double marginX, double marginY, double marginZ,
+        NativeVolume<unsigned char>^ restriction,
+        NativeVolume<unsigned char>^ result,
+        int threadCount)
+      {
+        if (mask == nullptr)
+          throw gcnew System::ArgumentNullException("mask");
+        CheckVolume(mask, result, "result");
+        if (restriction != nullptr)
+          CheckVolume(mask, restriction, "restriction");
+        const int radiusX = MarginToVoxels(marginX, mask->SpacingX), radiusY = MarginToVoxels(marginY, mask->SpacingY), radiusZ = MarginToVoxels(marginZ, mask->SpacingZ);
+        CheckArguments(radiusX, radiusY, radiusZ, threadCount);
+
+        unsigned char* restrictionBuffer = nullptr;
+        if (restriction != nullptr)
+          restrictionBuffer = restriction->GetBuffer();
+        DilateBuffers(mask->GetBuffer(), mask->DimX, mask->DimY, mask->DimZ, backgroundColour, foregroundColour, radiusX, radiusY, radiusZ,
+          restrictionBuffer, result->GetBuffer(), threadCount);
+        System::GC::KeepAlive(mask);
+        System::GC::KeepAlive(restriction);
+        System::GC::KeepAlive(result);
+      }
+
+      void MaskMorphology::Erode(
+        NativeVolume<unsigned char>^ mask,
+        unsigned char backgroundColour, unsigned char foregroundColour,
+        double marginX, double marginY, double marginZ,
+        NativeVolume<unsigned char>^ result,
+        int threadCount)
+      {
+        if (mask == nullptr)
+          throw gcnew System::ArgumentNullException("mask");
+        CheckVolume(mask, result, "result");
+        const int radiusX = MarginToVoxels(marginX, mask->SpacingX), radiusY = MarginToVoxels(marginY, mask->SpacingY), radiusZ = MarginToVoxels(marginZ, mask->SpacingZ);
+        CheckArguments(radiusX, radiusY, radiusZ, threadCount);
+
+        ErodeBuffers(mask->GetBuffer(), mask->DimX, mask->DimY, mask->DimZ, backgroundColour, foregroundColour, radiusX, radiusY, radiusZ, result->GetBuffer(), threadCount);
+        System::GC::KeepAlive(mask);
+        System::GC::KeepAlive(result);
+      }
+
+      int MaskMorphology::MarginToVoxels(double margin, double spacing)
+      {
+        if (!(spacing > 0))
+          throw gcnew System::ArgumentOutOfRangeException("spacing", "Spacing must be positive.");
+        return (int)System::Math::Round(margin / spacing);
+      }
+} } }
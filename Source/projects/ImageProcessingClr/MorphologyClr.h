@@ -0,0 +1,42 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include "NativeVolumeClr.h"
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // Binary dilation and erosion of masks by the ellipsoid of MorphologicalExtensions, in time
+  // linear in the number of voxels whatever its radii. A radius of zero leaves that axis out.
+  public ref class MaskMorphology
+  {
+  public:
+    // Writes foregroundColour to each voxel of result that is in mask, the voxels other than
+    // backgroundColour, or within the ellipsoid with radii of radiusX, radiusY and radiusZ voxels
+    // of it, and backgroundColour to the rest. If restriction is not null the mask grows only into
+    // its voxels of foregroundColour, as MorphologicalExtensions.Dilate does. Result may be mask
+    // itself. Uses up to threadCount threads, or one per processor for 0.
+    static void Dilate(array<unsigned char>^ mask, int width, int height, int depth, unsigned char backgroundColour, unsigned char foregroundColour, int radiusX, int radiusY, int radiusZ, array<unsigned char>^ restriction, array<unsigned char>^ result, int threadCount);
+
+    // Removes from mask its surface, the voxels with a neighbour among the 26 along the axes with
+    // a non-zero radius that is background or outside the volume, and the voxels within the
+    // ellipsoid with radii one less than radiusX, radiusY and radiusZ of the surface, as
+    // MorphologicalExtensions.Erode does. Writes foregroundColour for the voxels left and
+    // backgroundColour for the rest into result, which may be mask itself.
+    static void Erode(array<unsigned char>^ mask, int width, int height, int depth, unsigned char backgroundColour, unsigned char foregroundColour, int radiusX, int radiusY, int radiusZ, array<unsigned char>^ result, int threadCount);
+
+    // As above for native volumes, with margins in the units of their spacing rounded to whole
+    // voxels by MarginToVoxels. Restriction may be null.
+    static void Dilate(NativeVolume<unsigned char>^ mask, unsigned char backgroundColour, unsigned char foregroundColour, double marginX, double marginY, double marginZ, NativeVolume<unsigned char>^ restriction, NativeVolume<unsigned char>^ result, int threadCount);
+
+    static void Erode(NativeVolume<unsigned char>^ mask, unsigned char backgroundColour, unsigned char foregroundColour, double marginX, double marginY, double marginZ, NativeVolume<unsigned char>^ result, int threadCount);
+
+    // The radius in voxels of a margin along an axis with the given spacing, rounded to the
+    // nearest whole voxel as Math.Round does.
+    static int MarginToVoxels(double margin, double spacing);
+  };
+} } }
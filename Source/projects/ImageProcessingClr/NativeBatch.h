@@ -0,0 +1,74 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include "NativeVolumeClr.h"
+
+#pragma managed(push, off)
+#include "batch.h"
+#pragma managed(pop)
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // The layouts of a batch of native volumes for the native batch functions, throwing unless
+  // every volume is there. Callers keep the array alive until the batch has finished.
+  template<typename T>
+  std::vector<createdataset::BatchVolume> ToBatch(array<NativeVolume<T>^>^ volumes, System::String^ name)
+  {
+    if (volumes == nullptr)
+      throw gcnew System::ArgumentNullException(name);
+
+    std::vector<createdataset::BatchVolume> result(volumes->Length);
+    for (int i = 0; i < volumes->Length; i++)
+    {
+      NativeVolume<T>^ volume = volumes[i];
+      if (volume == nullptr)
+        throw gcnew System::ArgumentException("The batch must not hold null volumes.", name);
+      result[i].width = volume->DimX;
+      result[i].height = volume->DimY;
+      result[i].depth = volume->DimZ;
+      result[i].buffer = volume->GetBuffer();
+      result[i].leap = volume->Leap;
+      result[i].stride = volume->Stride;
+    }
+    return result;
+  }
+
+  // The number of voxels of every volume of a batch.
+  inline long long TotalVoxels(const std::vector<createdataset::BatchVolume>& volumes)
+  {
+    long long total = 0;
+    for (size_t i = 0; i < volumes.size(); i++)
+      total += (long long)volumes[i].voxels();
+    return total;
+  }
+
+  // Throws unless outputs holds a volume of the dimensions of each of inputs, and no volume is
+  // in the batch twice other than as both the input and the output of one job, since jobs run
+  // at the same time. Outputs may be inputs itself, for jobs in place.
+  template<typename A, typename B>
+  void CheckBatch(array<NativeVolume<A>^>^ inputs, System::String^ inputsName, array<NativeVolume<B>^>^ outputs, System::String^ outputsName)
+  {
+    if (inputs == nullptr)
+      throw gcnew System::ArgumentNullException(inputsName);
+    if (outputs == nullptr)
+      throw gcnew System::ArgumentNullException(outputsName);
+    if (inputs->Length != outputs->Length)
+      throw gcnew System::ArgumentException("The batches should have the same number of volumes.", outputsName);
+
+    auto seen = gcnew System::Collections::Generic::HashSet<System::Object^>();
+    for (int i = 0; i < inputs->Length; i++)
+    {
+      if (inputs[i] == nullptr || outputs[i] == nullptr)
+        throw gcnew System::ArgumentException("The batch must not hold null volumes.", inputs[i] == nullptr ? inputsName : outputsName);
+      if (inputs[i]->DimX != outputs[i]->DimX || inputs[i]->DimY != outputs[i]->DimY || inputs[i]->DimZ != outputs[i]->DimZ)
+        throw gcnew System::ArgumentException("Each output should have the dimensions of its input.", outputsName);
+      if (!seen->Add(inputs[i]) || (!System::Object::ReferenceEquals(inputs[i], outputs[i]) && !seen->Add(outputs[i])))
+        throw gcnew System::ArgumentException("A volume must not be in a batch more than once.", outputsName);
+    }
+  }
+} } }
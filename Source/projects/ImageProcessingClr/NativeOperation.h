@@ -0,0 +1,89 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vcclr.h>
+
+#pragma managed(push, off)
+#include "progress.h"
+#pragma managed(pop)
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // The callback of a native OperationProgress, giving the fraction done to the IProgress held
+  // by the gcroot at context. It is called from the threads of the native operation, which an
+  // exception must not unwind, so exceptions from the progress are dropped.
+  inline void ReportNativeProgress(void* context, double fraction)
+  {
+    try
+    {
+      (*(gcroot<System::IProgress<double>^>*)context)->Report(fraction);
+    }
+    catch (System::Exception^)
+    {
+    }
+  }
+
+  // A native operation run as a task, for the Async methods. The fraction done is reported to
+  // the progress, if any, and cancelling the token stops the operation at its next check, when
+  // the task is cancelled. The task runs on a thread of its own rather than one of the pool, as
+  // the operation keeps it, and the threads of the operation, busy until it is done. Derived
+  // classes hold the arguments, which the caller checks before starting the task, and do the
+  // work in Run, passing progress to the native code.
+  template<typename TResult>
+  ref class NativeOperation abstract
+  {
+  public:
+    System::Threading::Tasks::Task<TResult>^ Start(System::IProgress<double>^ progress, System::Threading::CancellationToken cancellationToken)
+    {
+      progress_ = progress;
+      cancellationToken_ = cancellationToken;
+      return System::Threading::Tasks::Task<TResult>::Factory->StartNew(
+        gcnew System::Func<TResult>(this, &NativeOperation<TResult>::Execute), cancellationToken,
+        System::Threading::Tasks::TaskCreationOptions::LongRunning, System::Threading::Tasks::TaskScheduler::Default);
+    }
+
+  protected:
+    // Does the work, throwing OperationCanceledException if progress is cancelled.
+    virtual TResult Run(createdataset::OperationProgress* progress) abstract;
+
+  private:
+    TResult Execute()
+    {
+      gcroot<System::IProgress<double>^> progress(progress_);
+      createdataset::OperationProgress nativeProgress(progress_ == nullptr ? nullptr : &ReportNativeProgress, &progress);
+      nativeProgress_ = &nativeProgress;
+      System::Threading::CancellationTokenRegistration registration =
+        cancellationToken_.Register(gcnew System::Action(this, &NativeOperation<TResult>::Cancel));
+      try
+      {
+        return Run(&nativeProgress);
+      }
+      catch (System::OperationCanceledException^)
+      {
+        // With the token, so that the task is cancelled rather than faulted
+        cancellationToken_.ThrowIfCancellationRequested();
+        throw;
+      }
+      finally
+      {
+        // Waits for a cancellation that has started, after which nativeProgress_ is not used
+        registration.Dispose();
+        nativeProgress_ = nullptr;
+      }
+    }
+
+    void Cancel()
+    {
+      nativeProgress_->cancel();
+    }
+
+    System::IProgress<double>^ progress_;
+    System::Threading::CancellationToken cancellationToken_;
+    createdataset::OperationProgress* nativeProgress_;
+  };
+} } }
@@ -0,0 +1,210 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "NativeVolumeClr.h"
+
+#include <new>
+#include <string.h>
+
+#pragma managed(push, off)
+#include "Instrumentation.h"
+#include "Memory.h"
+#include "threshold.h"
+#pragma managed(pop)
+
+namespace InnerEye {
+  namespace CreateDataset {
+    namespace ImageProcessing {
+
+      generic<typename T>
+      NativeVolume<T>::NativeVolume(int dimX, int dimY, int dimZ)
+      {
+        Initialise(dimX, dimY, dimZ, 1.0, 1.0, 1.0);
+      }
+
+      generic<typename T>
+      NativeVolume<T>::NativeVolume(int dimX, int dimY, int dimZ, double spacingX, double spacingY, double spacingZ)
+      {
+        Initialise(dimX, dimY, dimZ, spacingX, spacingY, spacingZ);
+      }
+
+      generic<typename T>
+      void NativeVolume<T>::Initialise(int dimX, int dimY, int dimZ, double spacingX, double spacingY, double spacingZ)
+      {
+        if (T::typeid != System::Byte::typeid && T::typeid != System::Int16::typeid && T::typeid != System::UInt16::typeid &&
+          T::typeid != System::UInt32::typeid && T::typeid != System::Single::typeid)
+          throw gcnew System::ArgumentException("Voxels must be byte, short, ushort, uint or float.");
+        if (dimX < 0 || dimY < 0 || dimZ < 0)
+          throw gcnew System::ArgumentOutOfRangeException("dimX", "Dimensions must not be negative.");
+
+        const long long size = System::Runtime::InteropServices::Marshal::SizeOf(T::typeid);
+        if (size * dimX * dimY > System::Int32::MaxValue)
+          throw gcnew System::ArgumentOutOfRangeException("dimX", "Slices must be smaller than 2 GB.");
+
+        createdataset::InstrumentedCall call("NativeVolume.NativeVolume", (long long)dimX * dimY * dimZ, createdataset::resolveThreadCount(0, dimZ));
+        dimX_ = dimX;
+        dimY_ = dimY;
+        dimZ_ = dimZ;
+        spacingX_ = spacingX;
+        spacingY_ = spacingY;
+        spacingZ_ = spacingZ;
+        stride_ = (int)(size * dimX);
+        leap_ = stride_ * dimY;
+        bytes_ = (long long)leap_ * dimZ;
+
+        try
+        {
+          data_ = (unsigned char*)createdataset::alignedAllocate((size_t)bytes_, 64);
+        }
+        catch (std::bad_alloc&)
+        {
+          throw gcnew System::OutOfMemoryException("Not enough memory for a native volume.");
+        }
+        createdataset::zeroBlocks(data_, dimZ, (size_t)leap_);
+        if (bytes_ > 0)
+          System::GC::AddMemoryPressure(bytes_);
+      }
+
+      generic<typename T>
+      NativeVolume<T>::~NativeVolume()
+      {
+        this->!NativeVolume();
+      }
+
+      generic<typename T>
+      NativeVolume<T>::!NativeVolume()
+      {
+        if (data_ == nullptr)
+          return;
+
+        createdataset::alignedFree(data_);
+        data_ = nullptr;
+        if (bytes_ > 0)
+          System::GC::RemoveMemoryPressure(bytes_);
+      }
+
+      generic<typename T>
+      NativeVolume<T>^ NativeVolume<T>::FromArray(array<T>^ data, int dimX, int dimY, int dimZ)
+      {
+        createdataset::InstrumentedCall call("NativeVolume.FromArray", (long long)dimX * dimY * dimZ);
+        auto result = gcnew NativeVolume<T>(dimX, dimY, dimZ);
+        result->CopyFrom(data);
+        return result;
+      }
+
+      generic<typename T>
+      unsigned char* NativeVolume<T>::GetBuffer()
+      {
+        if (data_ == nullptr)
+          throw gcnew System::ObjectDisposedException("NativeVolume");
+        return data_;
+      }
+
+      generic<typename T>
+      System::IntPtr NativeVolume<T>::Data::get()
+      {
+        return System::IntPtr(GetBuffer());
+      }
+
+      generic<typename T>
+      void NativeVolume<T>::CheckArray(System::Array^ data, System::String^ name)
+      {
+        if (data == nullptr)
+          throw gcnew System::ArgumentNullException(name);
+        if (data->LongLength != Length)
+          throw gcnew System::ArgumentException("The array should have DimX * DimY * DimZ elements.", name);
+      }
+
+      generic<typename T>
+      void NativeVolume<T>::CopyFrom(array<T>^ source)
+      {
+        CheckArray(source, "source");
+        unsigned char* buffer = GetBuffer();
+        createdataset::InstrumentedCall call("NativeVolume.CopyFrom", Length);
+        if (bytes_ == 0)
+          return;
+
+        auto handle = System::Runtime::InteropServices::GCHandle::Alloc(source, System::Runtime::InteropServices::GCHandleType::Pinned);
+        try
+        {
+          memcpy(buffer, handle.AddrOfPinnedObject().ToPointer(), (size_t)bytes_);
+        }
+        finally
+        {
+          handle.Free();
+        }
+        System::GC::KeepAlive(this);
+      }
+
+      generic<typename T>
+      void NativeVolume<T>::CopyTo(array<T>^ destination)
+      {
+        CheckArray(destination, "destination");
+        unsigned char* buffer = GetBuffer();
+        createdataset::InstrumentedCall call("NativeVolume.CopyTo", Length);
+        if (bytes_ == 0)
+          return;
+
+        auto handle = System::Runtime::InteropServices::GCHandle::Alloc(destination, System::Runtime::InteropServices::GCHandleType::Pinned);
+        try
+        {
+          memcpy(handle.AddrOfPinnedObject().ToPointer(), buffer, (size_t)bytes_);
+        }
+        finally
+        {
+          handle.Free();
+        }
+        System::GC::KeepAlive(this);
+      }
+
+      generic<typename T>
+      array<T>^ NativeVolume<T>::ToArray()
+      {
+        if (Length > System::Int32::MaxValue)
+          throw gcnew System::InvalidOperationException("The volume has too many voxels for an array.");
+        createdataset::InstrumentedCall call("NativeVolume.ToArray", Length);
+        auto result = gcnew array<T>((int)Length);
+        CopyTo(result);
+        return result;
+      }
+
+      template<typename T>
+      static void ThresholdT(NativeVolume<T>^ source, T lower, T upper, unsigned char foreground, unsigned char background, NativeVolume<unsigned char>^ result, int threadCount)
+      {
+        if (source == nullptr)
+          throw gcnew System::ArgumentNullException("source");
+        if (result == nullptr)
+          throw gcnew System::ArgumentNullException("result");
+        if (source->DimX != result->DimX || source->DimY != result->DimY || source->DimZ != result->DimZ)
+          throw gcnew System::ArgumentException("The volumes should have the same dimensions.", "result");
+        if (threadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("threadCount", "ThreadCount must not be negative.");
+
+        createdataset::InstrumentedCall call("VolumeOperations.Threshold", source->Length, createdataset::resolveThreadCount(threadCount, source->DimZ));
+        createdataset::threshold<T>(source->DimX, source->DimY, source->DimZ,
+          source->GetBuffer(), source->Leap, source->Stride, lower, upper, foreground, background,
+          result->GetBuffer(), result->Leap, result->Stride, threadCount);
+        System::GC::KeepAlive(source);
+        System::GC::KeepAlive(result);
+      }
+
+      void VolumeOperations::Threshold(NativeVolume<float>^ source, float lower, float upper, unsigned char foreground, unsigned char background, NativeVolume<unsigned char>^ result, int threadCount)
+      {
+        ThresholdT<float>(source, lower, upper, foreground, background, result, threadCount);
+      }
+
+      void VolumeOperations::Threshold(NativeVolume<short>^ source, short lower, short upper, unsigned char foreground, unsigned char background, NativeVolume<unsigned char>^ result, int threadCount)
+      {
+        ThresholdT<short>(source, lower, upper, foreground, background, result, threadCount);
+      }
+
+      void VolumeOperations::Threshold(NativeVolume<unsigned char>^ source, unsigned char lower, unsigned char upper, unsigned char foreground, unsigned char background, NativeVolume<unsigned char>^ result, int threadCount)
+      {
+        ThresholdT<unsigned char>(source, lower, upper, foreground, background, result, threadCount);
+      }
+    }
+  }
+}
@@ -0,0 +1,95 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // A volume of voxels of type T in unmanaged memory, aligned to 64 bytes, which Convolution,
+  // ConvolutionPlan, ConnectedComponents and VolumeOperations work on in place without pinning or
+  // copying. A chain of operations on NativeVolumes keeps every intermediate result out of the
+  // managed heap; copy in at the start with FromArray or CopyFrom, and out at the end with ToArray
+  // or CopyTo. T must be byte, short, ushort, uint or float.
+  //
+  // Voxel x, y, z is at Data + z*Leap + y*Stride + x*sizeof(T). Rows are contiguous, so Data can
+  // also be read and written directly from unsafe code.
+  generic<typename T> where T : value class
+  public ref class NativeVolume
+  {
+  public:
+    // A volume of zeros with spacing of one in each direction.
+    NativeVolume(int dimX, int dimY, int dimZ);
+
+    NativeVolume(int dimX, int dimY, int dimZ, double spacingX, double spacingY, double spacingZ);
+
+    ~NativeVolume();
+
+    !NativeVolume();
+
+    // A volume holding a copy of data, which must have dimX * dimY * dimZ elements.
+    static NativeVolume<T>^ FromArray(array<T>^ data, int dimX, int dimY, int dimZ);
+
+    property int DimX { int get() { return dimX_; } }
+    property int DimY { int get() { return dimY_; } }
+    property int DimZ { int get() { return dimZ_; } }
+
+    // The distance between the centres of voxels along each axis, carried alongside the data.
+    property double SpacingX { double get() { return spacingX_; } void set(double value) { spacingX_ = value; } }
+    property double SpacingY { double get() { return spacingY_; } void set(double value) { spacingY_ = value; } }
+    property double SpacingZ { double get() { return spacingZ_; } void set(double value) { spacingZ_ = value; } }
+
+    // Bytes between the starts of rows and of slices.
+    property int Stride { int get() { return stride_; } }
+    property int Leap { int get() { return leap_; } }
+
+    // Number of voxels.
+    property long long Length { long long get() { return (long long)dimX_ * dimY_ * dimZ_; } }
+
+    // Address of the first voxel. The memory is valid until the volume is disposed; use
+    // GC.KeepAlive on the volume after the last use of the address.
+    property System::IntPtr Data { System::IntPtr get(); }
+
+    // Copies source, which must have Length elements in the order of voxels above, into the volume.
+    void CopyFrom(array<T>^ source);
+
+    // Copies the volume into destination, which must have Length elements.
+    void CopyTo(array<T>^ destination);
+
+    // A new array of the voxels, for volumes of at most Int32.MaxValue voxels.
+    array<T>^ ToArray();
+
+  internal:
+    // The memory of the volume, throwing if it has been disposed. Callers keep the volume alive
+    // until they have finished with it.
+    unsigned char* GetBuffer();
+
+  private:
+    void Initialise(int dimX, int dimY, int dimZ, double spacingX, double spacingY, double spacingZ);
+
+    void CheckArray(System::Array^ data, System::String^ name);
+
+    int dimX_, dimY_, dimZ_;
+    double spacingX_, spacingY_, spacingZ_;
+    int stride_, leap_;
+    long long bytes_;
+    unsigned char* data_;
+  };
+
+  // Operations between native volumes, so that a chain of smoothing, labelling and filtering can
+  // stay in native memory throughout.
+  public ref class VolumeOperations
+  {
+  public:
+    // Sets each voxel of result to foreground where source is from lower to upper inclusive and to
+    // background elsewhere, with up to threadCount threads (0 for one per processor). Result must
+    // have the dimensions of source, and for bytes may be source itself.
+    static void Threshold(NativeVolume<float>^ source, float lower, float upper, unsigned char foreground, unsigned char background, NativeVolume<unsigned char>^ result, int threadCount);
+
+    static void Threshold(NativeVolume<short>^ source, short lower, short upper, unsigned char foreground, unsigned char background, NativeVolume<unsigned char>^ result, int threadCount);
+
+    static void Threshold(NativeVolume<unsigned char>^ source, unsigned char lower, unsigned char upper, unsigned char foreground, unsigned char background, NativeVolume<unsigned char>^ result, int threadCount);
+  };
+} } }
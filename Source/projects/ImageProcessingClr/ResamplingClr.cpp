@@ -0,0 +1,98 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#include "ResamplingClr.h"
+
+#pragma managed(push, off)
+#include "resampling.h"
+#include "Instrumentation.h"
+#pragma managed(pop)
+
+namespace InnerEye {  namespace CreateDataset { namespace ImageProcessing {
+
+      template<typename T>
+      static void ResampleLinearT(
+        array<T>^ input,
+        int inputDimX, int inputDimY, int inputDimZ,
+        array<T>^ output,
+        int dimX, int dimY, int dimZ,
+        double factorX, double factorY, double factorZ,
+        double shiftX, double shiftY, double shiftZ,
+        T outsideValue,
+        int threadCount)
+      {
+        if (input == nullptr)
+          throw gcnew System::ArgumentNullException("input");
+        if (output == nullptr)
+          throw gcnew System::ArgumentNullException("output");
+        if (inputDimX <= 0 || inputDimY <= 0 || inputDimZ <= 0)
+          throw gcnew System::ArgumentOutOfRangeException("inputDimX", "Input dimensions must be positive.");
+        if (dimX < 0 || dimY < 0 || dimZ < 0)
+          throw gcnew System::ArgumentOutOfRangeException("dimX", "Dimensions must not be negative.");
+        if (threadCount < 0)
+          throw gcnew System::ArgumentOutOfRangeException("threadCount", "ThreadCount must not be negative.");
+        if (input->LongLength != (long long)inputDimX * inputDimY * inputDimZ)
+          throw gcnew System::ArgumentException("The input array should have inputDimX * inputDimY * inputDimZ elements.", "input");
+
+        const long long voxelCount = (long long)dimX * dimY * dimZ;
+        if (output->LongLength != voxelCount)
+          throw gcnew System::ArgumentException("The output array should have dimX * dimY * dimZ elements.", "output");
+        createdataset::InstrumentedCall call("Resampling.ResampleLinear", voxelCount, createdataset::resolveThreadCount(threadCount, dimZ));
+        if (voxelCount == 0)
+          return;
+
+        pin_ptr<T> inputBuffer = &input[0];
+        pin_ptr<T> outputBuffer = &output[0];
+        try
+        {
+          createdataset::resampleLinear<T>(inputDimX, inputDimY, inputDimZ,
+            (unsigned char*)inputBuffer, inputDimX*inputDimY*sizeof(T), inputDimX*sizeof(T),
+            dimX, dimY, dimZ,
+            (unsigned char*)outputBuffer, dimX*dimY*sizeof(T), dimX*sizeof(T),
+            factorX, factorY, factorZ, shiftX, shiftY, shiftZ, outsideValue, threadCount);
+        }
+        catch (std::exception& oops)
+        {
+          throw gcnew System::Exception(gcnew System::String(oops.what()));
+        }
+      }
+
+      void Resampling::ResampleLinear(
+        array<unsigned char>^ input, int inputDimX, int inputDimY, int inputDimZ,
+        array<unsigned char>^ output, int dimX, int dimY, int dimZ,
+        double factorX, double factorY, double factorZ,
+        double shiftX, double shiftY, double shiftZ,
+        unsigned char outsideValue,
+        int threadCount)
+      {
+        ResampleLinearT<unsigned char>(input, inputDimX, inputDimY, inputDimZ, output, dimX, dimY, dimZ,
+          factorX, factorY, factorZ, shiftX, shiftY, shiftZ, outsideValue, threadCount);
+      }
+
+      void Resampling::ResampleLinear(
+        array<short>^ input, int inputDimX, int inputDimY, int inputDimZ,
+        array<short>^ output, int dimX, int dimY, int dimZ,
+        double factorX, double factorY, double factorZ,
+        double shiftX, double shiftY, double shiftZ,
+        short outsideValue,
+        int threadCount)
+      {
+        ResampleLinearT<short>(input, inputDimX, inputDimY, inputDimZ, output, dimX, dimY, dimZ,
+          factorX, factorY, factorZ, shiftX, shiftY, shiftZ, outsideValue, threadCount);
+      }
+
+      void Resampling::ResampleLinear(
+        array<float>^ input, int inputDimX, int inputDimY, int inputDimZ,
+        array<float>^ output, int dimX, int dimY, int dimZ,
+        double factorX, double factorY, double factorZ,
+        double shiftX, double shiftY, double shiftZ,
+        float outsideValue,
+        int threadCount)
+      {
+        ResampleLinearT<float>(input, inputDimX, inputDimY, inputDimZ, output, dimX, dimY, dimZ,
+          factorX, factorY, factorZ, shiftX, shiftY, shiftZ, outsideValue, threadCount);
+      }
+} } }
@@ -0,0 +1,27 @@
+/*  ------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+ *  ------------------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+namespace InnerEye { namespace CreateDataset { namespace ImageProcessing {
+
+  // Trilinear resampling of volumes in raster order onto a new grid.
+  public ref class Resampling
+  {
+  public:
+    // Fills output, of dimX * dimY * dimZ voxels, by trilinear interpolation of input, of
+    // inputDimX * inputDimY * inputDimZ voxels, where output voxel x, y, z is at input pixel
+    // position (x*factorX + shiftX, y*factorY + shiftY, z*factorZ + shiftZ), as
+    // GenericResampling.ResampleImage maps them. Positions within half a voxel of the input are
+    // clamped to it and those further out are outsideValue; integer types are rounded as
+    // Math.Round does. Uses up to threadCount threads, or one per processor for 0.
+    static void ResampleLinear(array<unsigned char>^ input, int inputDimX, int inputDimY, int inputDimZ, array<unsigned char>^ output, int dimX, int dimY, int dimZ, double factorX, double factorY, double factorZ, double shiftX, double shiftY, double shiftZ, unsigned char outsideValue, int threadCount);
+
+    static void ResampleLinear(array<short>^ input, int inputDimX, int inputDimY, int inputDimZ, array<short>^ output, int dimX, int dimY, int dimZ, double factorX, double factorY, double factorZ, double shiftX, double shiftY, double shiftZ, short outsideValue, int threadCount);
+
+    static void ResampleLinear(array<float>^ input, int inputDimX, int inputDimY, int inputDimZ, array<float>^ output, int dimX, int dimY, int dimZ, double factorX, double factorY, double factorZ, double shiftX, double shiftY, double shiftZ, float outsideValue, int threadCount);
+  };
+} } }
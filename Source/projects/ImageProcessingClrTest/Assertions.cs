@@ -0,0 +1,38 @@
+///  ------------------------------------------------------------------------------------------
+///  Copyright (c) Microsoft Corporation. All rights reserved.
+///  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+///  ------------------------------------------------------------------------------------------
+
+namespace ImageProcessingClrTest
+{
+    using System;
+    using Microsoft.VisualStudio.TestTools.UnitTesting;
+
+    // Assertions shared by the test classes.
+    internal static class Assertions
+    {
+        // Fails unless action throws T or a type derived from it, and returns what it threw.
+        public static T Throws<T>(Action action) where T : Exception
+        {
+            try
+            {
+                action();
+            }
+            catch (T e)
+            {
+                return e;
+            }
+
+            Assert.Fail("Expected exception of type {0} but no exception was thrown.", typeof(T));
+            return null;
+        }
+
+        // Fails unless action throws exactly T, rather than a type derived from it.
+        public static T ThrowsExactly<T>(Action action) where T : Exception
+        {
+            var e = Throws<T>(action);
+            Assert.AreEqual(typeof(T), e.GetType(), e.Message);
+            return e;
+        }
+    }
+}
@@ -4,6 +4,8 @@
 ///  ------------------------------------------------------------------------------------------
 
 ﻿using System;
+using System.Linq;
+using System.Threading;
 using Microsoft.VisualStudio.TestTools.UnitTesting;
 
 using InnerEye.CreateDataset.ImageProcessing;
@@ -261,5 +263,604 @@ namespace ImageProcessingClrTest
             }
            
         }
+
+        [TestMethod]
+        public void TestConnectedComponentsThreadCountDoesNotChangeResult()
+        {
+            const int W = 37, H = 29, D = 23;
+
+            // Sparse random labels, so that there are many components that cross the slabs
+            var random = new Random(7);
+            byte[] image = new byte[W * H * D];
+            for (var i = 0; i < image.Length; i++)
+                image[i] = random.Next(3) == 0 ? (byte)(1 + random.Next(3)) : (byte)0;
+
+            ushort[] expected = new ushort[image.Length];
+            var expectedStatistics = ConnectedComponents.Find3dWithStatistics(image, W, H, D, 0, expected, new ConnectedComponentsOptions { ThreadCount = 1 });
+
+            foreach (var threadCount in new[] { 2, 3, 8, 0 })
+            {
+                ushort[] result = new ushort[image.Length];
+                var statistics = ConnectedComponents.Find3dWithStatistics(image, W, H, D, 0, result, new ConnectedComponentsOptions { ThreadCount = threadCount });
+
+                CollectionAssert.AreEqual(expected, result);
+                Assert.AreEqual(expectedStatistics.Length, statistics.Length);
+                for (var i = 0; i < statistics.Length; i++)
+                {
+                    Assert.AreEqual(expectedStatistics[i].PixelCount, statistics[i].PixelCount);
+                    Assert.AreEqual(expectedStatistics[i].InputLabel, statistics[i].InputLabel);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestConnectedComponentsConnectivity()
+        {
+            const int W = 3, H = 3, D = 3;
+
+            // Voxels that share an edge, a corner with the second of them, and one that touches none of them
+            byte[] image = new byte[W * H * D];
+            image[0] = 1;
+            image[1 + W] = 1;
+            image[2 + 2 * W + W * H] = 1;
+            image[2 * W + 2 * W * H] = 1;
+
+            var expectedCounts = new[] { 5, 4, 3 };
+            var connectivities = new[] { ComponentConnectivity.Face, ComponentConnectivity.Edge, ComponentConnectivity.Vertex };
+            for (var i = 0; i < connectivities.Length; i++)
+            {
+                ushort[] result = new ushort[image.Length];
+                var count = ConnectedComponents.Find3d(image, W, H, D, 0, result, new ConnectedComponentsOptions { Connectivity = connectivities[i] });
+
+                Assert.AreEqual(expectedCounts[i], count);
+                Assert.AreEqual(1, result[0]);
+                Assert.AreEqual(expectedCounts[i] - 1, result[2 * W + 2 * W * H]);
+            }
+
+            ushort[] vertexResult = new ushort[image.Length];
+            ConnectedComponents.Find3d(image, W, H, D, 0, vertexResult, new ConnectedComponentsOptions { Connectivity = ComponentConnectivity.Vertex });
+            Assert.AreEqual(1, vertexResult[1 + W]);
+            Assert.AreEqual(1, vertexResult[2 + 2 * W + W * H]);
+        }
+
+        [TestMethod]
+        public void TestConnectedComponentsGeometry()
+        {
+            const int W = 6, H = 5, D = 4;
+
+            // A 3x2x2 box and a single voxel in the far corner, with intensity x + 10y + 100z
+            byte[] image = new byte[W * H * D];
+            short[] intensities = new short[W * H * D];
+            for (var z = 0; z < D; z++)
+                for (var y = 0; y < H; y++)
+                    for (var x = 0; x < W; x++)
+                    {
+                        var i = x + W * (y + H * z);
+                        image[i] = (byte)(x >= 1 && x <= 3 && y >= 1 && y <= 2 && z >= 1 && z <= 2 ? 1 : 0);
+                        intensities[i] = (short)(x + 10 * y + 100 * z);
+                    }
+            image[W * H * D - 1] = 2;
+
+            ushort[] result = new ushort[image.Length];
+            var statistics = ConnectedComponents.Find3dWithStatistics(image, W, H, D, 0, result, new ConnectedComponentsOptions(), intensities);
+
+            Assert.AreEqual(3, statistics.Length);
+            Assert.AreEqual(107u, statistics[0].PixelCount);
+
+            var box = statistics[1];
+            Assert.AreEqual(12u, box.PixelCount);
+            Assert.AreEqual(1, box.MinimumX);
+            Assert.AreEqual(1, box.MinimumY);
+            Assert.AreEqual(1, box.MinimumZ);
+            Assert.AreEqual(3, box.MaximumX);
+            Assert.AreEqual(2, box.MaximumY);
+            Assert.AreEqual(2, box.MaximumZ);
+            Assert.AreEqual(2.0, box.CentroidX, 1e-9);
+            Assert.AreEqual(1.5, box.CentroidY, 1e-9);
+            Assert.AreEqual(1.5, box.CentroidZ, 1e-9);
+            Assert.AreEqual(2004.0, box.IntensitySum, 1e-9);
+            Assert.AreEqual(1, box.SurfaceX);
+            Assert.AreEqual(1, box.SurfaceY);
+            Assert.AreEqual(1, box.SurfaceZ);
+
+            var corner = statistics[2];
+            Assert.AreEqual(2, corner.InputLabel);
+            Assert.AreEqual(5, corner.MinimumX);
+            Assert.AreEqual(5, corner.MaximumX);
+            Assert.AreEqual(4, corner.SurfaceY);
+            Assert.AreEqual(3, corner.SurfaceZ);
+            Assert.AreEqual(345.0, corner.IntensitySum, 1e-9);
+
+            // Geometry without intensities
+            var withoutIntensities = ConnectedComponents.Find3dWithStatistics(image, W, H, D, 0, result, new ConnectedComponentsOptions { Geometry = true });
+            Assert.AreEqual(2.0, withoutIntensities[1].CentroidX, 1e-9);
+            Assert.AreEqual(0.0, withoutIntensities[1].IntensitySum);
+        }
+
+        [TestMethod]
+        public void TestStreamingConnectedComponentsAgreesWithFind3d()
+        {
+            const int W = 23, H = 19, D = 17;
+
+            var random = new Random(11);
+            byte[] image = new byte[W * H * D];
+            for (var i = 0; i < image.Length; i++)
+                image[i] = random.Next(5) < 2 ? (byte)(1 + random.Next(2)) : (byte)0;
+
+            foreach (var connectivity in new[] { ComponentConnectivity.Face, ComponentConnectivity.Vertex })
+            {
+                var options = new ConnectedComponentsOptions { Connectivity = connectivity };
+                ushort[] expected = new ushort[image.Length];
+                var expectedStatistics = ConnectedComponents.Find3dWithStatistics(image, W, H, D, 0, expected, options);
+
+                using (var streaming = new StreamingConnectedComponents(W, H, 0, options))
+                {
+                    var provisional = new uint[D][];
+                    for (var z = 0; z < D; z++)
+                    {
+                        var slice = new byte[W * H];
+                        Array.Copy(image, z * W * H, slice, 0, W * H);
+                        provisional[z] = new uint[W * H];
+                        streaming.AddSlice(slice, provisional[z]);
+                    }
+
+                    var statistics = streaming.Finish();
+                    Assert.AreEqual(expectedStatistics.Length, statistics.Length);
+                    for (var i = 0; i < statistics.Length; i++)
+                    {
+                        Assert.AreEqual(expectedStatistics[i].PixelCount, statistics[i].PixelCount);
+                        Assert.AreEqual(expectedStatistics[i].InputLabel, statistics[i].InputLabel);
+                    }
+
+                    var result = new ushort[W * H];
+                    for (var z = 0; z < D; z++)
+                    {
+                        streaming.ResolveSlice(provisional[z], result);
+                        for (var i = 0; i < W * H; i++)
+                            Assert.AreEqual(expected[z * W * H + i], result[i]);
+                    }
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestConnectedComponentsNonZeroBackgroundLabel()
+        {
+            const int W = 23, H = 19, D = 7;
+            var random = new Random(2);
+            byte[] image = new byte[W * H * D];
+            for (var i = 0; i < image.Length; i++)
+                image[i] = random.Next(3) == 0 ? (byte)(1 + random.Next(2)) : (byte)0;
+
+            ushort[] labels = new ushort[image.Length];
+            var statistics = ConnectedComponents.Find3dWithStatistics(image, W, H, D, 0, labels, new ConnectedComponentsOptions());
+
+            foreach (var backgroundLabel in new uint[] { 5, ushort.MaxValue, uint.MaxValue })
+            {
+                foreach (var threadCount in new[] { 1, 4 })
+                {
+                    // Components take the labels from 0 in the same order, skipping the background label
+                    var options = new ConnectedComponentsOptions { BackgroundLabel = backgroundLabel, ThreadCount = threadCount };
+                    uint[] result;
+                    ComponentStatistics[] resultStatistics;
+                    if (backgroundLabel <= ushort.MaxValue)
+                    {
+                        var narrow = new ushort[image.Length];
+                        resultStatistics = ConnectedComponents.Find3dWithStatistics(image, W, H, D, 0, narrow, options);
+                        result = narrow.Select(l => (uint)l).ToArray();
+                    }
+                    else
+                    {
+                        result = new uint[image.Length];
+                        resultStatistics = ConnectedComponents.Find3dWithStatistics(image, W, H, D, 0, result, options);
+                    }
+
+                    var counts = new System.Collections.Generic.Dictionary<uint, long>();
+                    for (var i = 0; i < image.Length; i++)
+                    {
+                        var expected = labels[i] == 0 ? backgroundLabel : labels[i] - 1u < backgroundLabel ? labels[i] - 1u : labels[i];
+                        Assert.AreEqual(expected, result[i]);
+                        long count;
+                        counts.TryGetValue(result[i], out count);
+                        counts[result[i]] = count + 1;
+                    }
+
+                    // The statistics are indexed by label, and hold the background only below the last label
+                    Assert.AreEqual(backgroundLabel < statistics.Length ? statistics.Length : statistics.Length - 1, resultStatistics.Length);
+                    for (var label = 0u; label < resultStatistics.Length; label++)
+                    {
+                        Assert.AreEqual(counts.ContainsKey(label) ? counts[label] : 0, (long)resultStatistics[label].PixelCount);
+                        Assert.AreEqual(label == backgroundLabel ? 0 : image[Array.IndexOf(result, label)], resultStatistics[label].InputLabel);
+                    }
+                }
+            }
+
+            Assertions.Throws<ArgumentOutOfRangeException>(() => ConnectedComponents.Find3d(image, W, H, D, 0, labels,
+                new ConnectedComponentsOptions { BackgroundLabel = ushort.MaxValue + 1u }));
+        }
+
+        [TestMethod]
+        public void TestStreamingConnectedComponentsRejectsUnknownLabels()
+        {
+            const int W = 4, H = 2;
+            var slice = new byte[] { 1, 0, 1, 0, 0, 0, 0, 1 };
+            using (var streaming = new StreamingConnectedComponents(W, H, 0))
+            {
+                var provisional = new uint[W * H];
+                streaming.AddSlice(slice, provisional);
+                Assert.AreEqual(4, streaming.Finish().Length);
+
+                var result = new ushort[W * H];
+                streaming.ResolveSlice(provisional, result);
+                CollectionAssert.AreEqual(new ushort[] { 1, 0, 2, 0, 0, 0, 0, 3 }, result);
+
+                // A label that AddSlice did not give
+                provisional[0] = 1000;
+                Assertions.Throws<ArgumentOutOfRangeException>(() => streaming.ResolveSlice(provisional, result));
+            }
+        }
+
+        [TestMethod]
+        public void TestConnectedComponentsMaskFilters()
+        {
+            const int W = 5, H = 5, D = 5;
+
+            // A hollow 3x3x3 cube with a single voxel as its cavity, a pair of voxels and one voxel on its own
+            byte[] mask = new byte[W * H * D];
+            for (var z = 0; z < 3; z++)
+            {
+                for (var y = 0; y < 3; y++)
+                {
+                    for (var x = 0; x < 3; x++)
+                    {
+                        mask[x + y * W + z * W * H] = 1;
+                    }
+                }
+            }
+
+            var cavity = 1 + W + W * H;
+            mask[cavity] = 0;
+            mask[4 + 4 * W + 4 * W * H] = 1;
+            mask[4 + 4 * W + 3 * W * H] = 1;
+            mask[4 + 4 * W] = 1;
+
+            var options = new ConnectedComponentsOptions();
+
+            byte[] largest = new byte[mask.Length];
+            Assert.AreEqual(26L, ConnectedComponents.KeepLargestComponent(mask, W, H, D, 0, largest, options));
+            for (var i = 0; i < mask.Length; i++)
+            {
+                Assert.AreEqual(i < 3 + 2 * W + 2 * W * H && i % W < 3 && (i / W) % H < 3 ? mask[i] : 0, largest[i]);
+            }
+
+            byte[] large = (byte[])mask.Clone();
+            Assert.AreEqual(1, ConnectedComponents.RemoveSmallComponents(large, W, H, D, 0, large, options, 2));
+            Assert.AreEqual(0, large[4 + 4 * W]);
+            Assert.AreEqual(1, large[4 + 4 * W + 4 * W * H]);
+            Assert.AreEqual(1, large[0]);
+
+            byte[] filled = new byte[mask.Length];
+            Assert.AreEqual(1L, ConnectedComponents.FillHoles(mask, W, H, D, 0, 2, filled, options));
+            Assert.AreEqual(2, filled[cavity]);
+            filled[cavity] = mask[cavity];
+            CollectionAssert.AreEqual(mask, filled);
+        }
+
+        [TestMethod]
+        public void TestConnectedComponentsWideTypesAndClasses()
+        {
+            const int W = 400, H = 400, D = 1;
+
+            // A checkerboard of two structures has more components than 16 bit labels can hold
+            short[] image = new short[W * H * D];
+            for (var i = 0; i < image.Length; i++)
+            {
+                image[i] = (short)(((i % W) + (i / W)) % 2 == 0 ? -1000 : 3 + (i / W) % 2);
+            }
+
+            uint[] result = new uint[image.Length];
+            var statistics = ConnectedComponents.Find3dWithStatistics(image, W, H, D, -1000, result, new ConnectedComponentsOptions());
+            Assert.AreEqual(W * H / 2 + 1, statistics.Length);
+            Assert.AreEqual(0u, result[0]);
+            Assert.AreEqual(1u, result[1]);
+            Assert.AreEqual((uint)(W * H / 2), result[image.Length - 2]);
+            Assert.AreEqual(3, statistics[1].InputLabel);
+            Assert.AreEqual(-1000, statistics[0].InputLabel);
+
+            // The native overflow comes through as Exception itself, not a type derived from it
+            ushort[] narrow = new ushort[image.Length];
+            var overflow = Assertions.ThrowsExactly<Exception>(() => ConnectedComponents.Find3d(image, W, H, D, -1000, narrow, new ConnectedComponentsOptions()));
+            StringAssert.Contains(overflow.Message, "Too many components");
+
+            var labelsByClass = ConnectedComponents.LabelsByClass(statistics);
+            Assert.AreEqual(2, labelsByClass.Count);
+            Assert.AreEqual(W * H / 4, labelsByClass[3].Count);
+            Assert.AreEqual(W * H / 4, labelsByClass[4].Count);
+            Assert.AreEqual(1, labelsByClass[3][0]);
+            Assert.AreEqual(W / 2 + 1, labelsByClass[4][0]);
+        }
+
+        [TestMethod]
+        public void TestConnectedComponentsScratchMemoryDoesNotChangeResult()
+        {
+            // Large enough for the forest and runs to come from whole pages
+            const int W = 256, H = 256, D = 40;
+            var random = new Random(11);
+            byte[] image = new byte[W * H * D];
+            for (var i = 0; i < image.Length; i++)
+                image[i] = random.Next(2) == 0 ? (byte)1 : (byte)0;
+
+            ushort[] expected = new ushort[image.Length];
+            var expectedCount = ConnectedComponents.Find3d(image, W, H, D, 0, expected);
+
+            var hugePages = ScratchMemory.HugePages;
+            var cachedBytes = ScratchMemory.CachedBytes;
+            try
+            {
+                foreach (var settings in new[] { Tuple.Create(false, 0L), Tuple.Create(true, cachedBytes), Tuple.Create(true, cachedBytes) })
+                {
+                    ScratchMemory.HugePages = settings.Item1;
+                    ScratchMemory.CachedBytes = settings.Item2;
+
+                    ushort[] result = new ushort[image.Length];
+                    Assert.AreEqual(expectedCount, ConnectedComponents.Find3d(image, W, H, D, 0, result));
+                    CollectionAssert.AreEqual(expected, result);
+                }
+            }
+            finally
+            {
+                ScratchMemory.HugePages = hugePages;
+                ScratchMemory.CachedBytes = cachedBytes;
+                ScratchMemory.Trim();
+            }
+        }
+
+        [TestMethod]
+        public void TestScratchMemoryTrimReleasesBlocksOfWorkerThreads()
+        {
+            // The jobs of a batch run on OpenMP workers, which keep the blocks they release
+            const int W = 256, H = 256, D = 40, count = 4;
+            var random = new Random(13);
+            var masks = new NativeVolume<byte>[count];
+            var labels = new NativeVolume<ushort>[count];
+            var cachedBytes = ScratchMemory.CachedBytes;
+            try
+            {
+                for (var n = 0; n < count; n++)
+                {
+                    byte[] image = new byte[W * H * D];
+                    for (var i = 0; i < image.Length; i++)
+                        image[i] = random.Next(2) == 0 ? (byte)1 : (byte)0;
+                    masks[n] = NativeVolume<byte>.FromArray(image, W, H, D);
+                    labels[n] = new NativeVolume<ushort>(W, H, D);
+                }
+
+                ScratchMemory.CachedBytes = 1L << 30;
+                ScratchMemory.Trim();
+                Assert.AreEqual(0L, ScratchMemory.RetainedBytes);
+
+                ConnectedComponents.Find3dWithStatistics(masks, 0, labels, new ConnectedComponentsOptions { ThreadCount = count });
+                Assert.IsTrue(ScratchMemory.RetainedBytes > 0);
+                Assert.IsTrue(ScratchMemory.RetainedBytes <= ScratchMemory.CachedBytes);
+
+                ScratchMemory.Trim();
+                Assert.AreEqual(0L, ScratchMemory.RetainedBytes);
+            }
+            finally
+            {
+                ScratchMemory.CachedBytes = cachedBytes;
+                ScratchMemory.Trim();
+                for (var n = 0; n < count; n++)
+                {
+                    if (masks[n] != null)
+                        masks[n].Dispose();
+                    if (labels[n] != null)
+                        labels[n].Dispose();
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestConnectedComponentsNativeVolumeChain()
+        {
+            const int W = 60, H = 50, D = 20;
+            var random = new Random(5);
+            float[] image = new float[W * H * D];
+            for (var i = 0; i < image.Length; i++)
+                image[i] = (float)random.NextDouble() * 100;
+
+            var directions = new Direction[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ };
+            var sigmas = new float[] { 1.5f, 1.5f, 1.0f };
+
+            // Each step on arrays, copying in and out of native memory
+            float[] smoothed = (float[])image.Clone();
+            Convolution.Convolve(smoothed, W, H, D, directions, sigmas, new ConvolutionOptions());
+            byte[] expected = new byte[image.Length];
+            for (var i = 0; i < image.Length; i++)
+                expected[i] = smoothed[i] >= 50 ? (byte)1 : (byte)0;
+            var expectedVoxels = ConnectedComponents.KeepLargestComponent(expected, W, H, D, 0, expected, new ConnectedComponentsOptions());
+            uint[] expectedLabels = new uint[image.Length];
+            var expectedCount = ConnectedComponents.Find3d(expected, W, H, D, 0, expectedLabels, new ConnectedComponentsOptions());
+
+            // The same steps with every intermediate result in native memory
+            using (var volume = NativeVolume<float>.FromArray(image, W, H, D))
+            using (var mask = new NativeVolume<byte>(W, H, D))
+            using (var labels = new NativeVolume<uint>(W, H, D))
+            {
+                Convolution.Convolve(volume, directions, sigmas, new ConvolutionOptions());
+                VolumeOperations.Threshold(volume, 50, float.MaxValue, 1, 0, mask, 0);
+                Assert.AreEqual(expectedVoxels, ConnectedComponents.KeepLargestComponent(mask, 0, mask, new ConnectedComponentsOptions()));
+                Assert.AreEqual(expectedCount, ConnectedComponents.Find3d(mask, 0, labels, new ConnectedComponentsOptions()));
+
+                CollectionAssert.AreEqual(smoothed, volume.ToArray());
+                CollectionAssert.AreEqual(expected, mask.ToArray());
+                CollectionAssert.AreEqual(expectedLabels, labels.ToArray());
+                Assert.AreEqual(W * sizeof(float), volume.Stride);
+                Assert.AreEqual((long)(W * H * D), volume.Length);
+            }
+
+            using (var volumeOfOtherSize = new NativeVolume<byte>(W, H, D + 1))
+            using (var other = new NativeVolume<byte>(W, H, D))
+                Assertions.ThrowsExactly<ArgumentException>(() => ConnectedComponents.KeepLargestComponent(volumeOfOtherSize, 0, other, new ConnectedComponentsOptions()));
+        }
+
+        [TestMethod]
+        public void TestFind3dOfSmoothedAgreesWithSeparateSteps()
+        {
+            const int W = 45, H = 38, D = 17;
+            var random = new Random(11);
+            byte[] image = new byte[W * H * D];
+            for (var i = 0; i < image.Length; i++)
+                image[i] = random.Next(8) == 0 ? (byte)255 : (byte)0;
+
+            foreach (var connectivity in new[] { ComponentConnectivity.Face, ComponentConnectivity.Vertex })
+            {
+                var options = new ConnectedComponentsOptions { Connectivity = connectivity };
+
+                // Smoothed into a copy, thresholded into a mask and labelled
+                byte[] mask = (byte[])image.Clone();
+                Convolution.GaussianSmooth3d(mask, W, H, D, 0.7f, 0.7f, 0.5f);
+                for (var i = 0; i < mask.Length; i++)
+                    mask[i] = mask[i] >= 60 ? (byte)1 : (byte)0;
+                ushort[] expectedLabels = new ushort[image.Length];
+                var expected = ConnectedComponents.Find3dWithStatistics(mask, W, H, D, 0, expectedLabels, options);
+                Assert.IsTrue(expected.Length > 10);
+
+                using (var volume = NativeVolume<byte>.FromArray(image, W, H, D))
+                using (var labels = new NativeVolume<ushort>(W, H, D))
+                {
+                    var statistics = ConnectedComponents.Find3dOfSmoothed(volume, 0.7f, 0.7f, 0.5f, 60, 255, labels, options);
+                    CollectionAssert.AreEqual(expectedLabels, labels.ToArray());
+                    CollectionAssert.AreEqual(expected.Select(s => s.PixelCount).ToArray(), statistics.Select(s => s.PixelCount).ToArray());
+                    CollectionAssert.AreEqual(expected.Select(s => s.InputLabel).ToArray(), statistics.Select(s => s.InputLabel).ToArray());
+                    CollectionAssert.AreEqual(image, volume.ToArray());
+                }
+            }
+
+            using (var volume = new NativeVolume<byte>(W, H, D))
+            using (var labels = new NativeVolume<ushort>(W, H, D))
+                Assertions.ThrowsExactly<ArgumentException>(() => ConnectedComponents.Find3dOfSmoothed(volume, 1, 1, 1, 1, 255, labels, new ConnectedComponentsOptions { Geometry = true }));
+        }
+
+        [TestMethod]
+        public void TestBatchAgreesWithSingleVolumes()
+        {
+            // Many small structures of different sizes and one large volume, as in a subject
+            var random = new Random(11);
+            var directions = new Direction[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ };
+            var sigmas = new float[] { 1.0f, 1.5f, 0.5f };
+            var count = 25;
+            var images = new NativeVolume<float>[count];
+            var masks = new NativeVolume<byte>[count];
+            var labels = new NativeVolume<ushort>[count];
+            var expectedMasks = new byte[count][];
+            var expectedLabels = new ushort[count][];
+            var expectedStatistics = new ComponentStatistics[count][];
+            var expectedKept = new long[count];
+            var options = new ConnectedComponentsOptions { Connectivity = ComponentConnectivity.Edge, Geometry = true };
+            for (var n = 0; n < count; n++)
+            {
+                int W = n == 0 ? 120 : 10 + random.Next(30), H = n == 0 ? 100 : 10 + random.Next(20), D = n == 0 ? 40 : 3 + random.Next(10);
+                float[] image = new float[W * H * D];
+                for (var i = 0; i < image.Length; i++)
+                    image[i] = (float)random.NextDouble() * 100;
+                images[n] = NativeVolume<float>.FromArray(image, W, H, D);
+                masks[n] = new NativeVolume<byte>(W, H, D);
+                labels[n] = new NativeVolume<ushort>(W, H, D);
+
+                Convolution.Convolve(image, W, H, D, directions, sigmas, new ConvolutionOptions());
+                expectedMasks[n] = new byte[image.Length];
+                for (var i = 0; i < image.Length; i++)
+                    expectedMasks[n][i] = image[i] >= 50 ? (byte)1 : (byte)0;
+                expectedLabels[n] = new ushort[image.Length];
+                expectedStatistics[n] = ConnectedComponents.Find3dWithStatistics(expectedMasks[n], W, H, D, 0, expectedLabels[n], options);
+                expectedKept[n] = ConnectedComponents.KeepLargestComponent(expectedMasks[n], W, H, D, 0, expectedMasks[n], options);
+            }
+
+            Convolution.Convolve(images, directions, sigmas, new ConvolutionOptions());
+            for (var n = 0; n < count; n++)
+                VolumeOperations.Threshold(images[n], 50, float.MaxValue, 1, 0, masks[n], 0);
+            var statistics = ConnectedComponents.Find3dWithStatistics(masks, 0, labels, options);
+            var kept = ConnectedComponents.KeepLargestComponent(masks, 0, masks, options);
+
+            CollectionAssert.AreEqual(expectedKept, kept);
+            for (var n = 0; n < count; n++)
+            {
+                CollectionAssert.AreEqual(expectedLabels[n], labels[n].ToArray());
+                CollectionAssert.AreEqual(expectedStatistics[n], statistics[n]);
+                CollectionAssert.AreEqual(expectedMasks[n], masks[n].ToArray());
+            }
+
+            // Jobs run at the same time, so a volume must not be in a batch twice
+            Assertions.ThrowsExactly<ArgumentException>(() => ConnectedComponents.FillHoles(new[] { masks[1], masks[1] }, 0, 1, new[] { masks[1], masks[2] }, options));
+            for (var n = 0; n < count; n++)
+            {
+                images[n].Dispose();
+                masks[n].Dispose();
+                labels[n].Dispose();
+            }
+        }
+
+        [TestMethod]
+        public void TestAsyncOperationsAgreeWithSynchronousAndCancel()
+        {
+            const int W = 60, H = 50, D = 20;
+            var random = new Random(11);
+            float[] image = new float[W * H * D];
+            for (var i = 0; i < image.Length; i++)
+                image[i] = (float)random.NextDouble() * 100;
+
+            var directions = new Direction[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ };
+            var sigmas = new float[] { 1.5f, 1.5f, 1.0f };
+
+            using (var expected = NativeVolume<float>.FromArray(image, W, H, D))
+            using (var volume = NativeVolume<float>.FromArray(image, W, H, D))
+            using (var mask = new NativeVolume<byte>(W, H, D))
+            using (var expectedLabels = new NativeVolume<ushort>(W, H, D))
+            using (var labels = new NativeVolume<ushort>(W, H, D))
+            {
+                Convolution.Convolve(expected, directions, sigmas, new ConvolutionOptions());
+                var progress = new RecordingProgress(null);
+                Convolution.ConvolveAsync(volume, directions, sigmas, new ConvolutionOptions(), progress, CancellationToken.None).Wait();
+                CollectionAssert.AreEqual(expected.ToArray(), volume.ToArray());
+                Assert.AreEqual(1.0, progress.Last);
+
+                VolumeOperations.Threshold(volume, 50, float.MaxValue, 1, 0, mask, 0);
+                var expectedStatistics = ConnectedComponents.Find3dWithStatistics(mask, 0, expectedLabels, new ConnectedComponentsOptions());
+                var statistics = ConnectedComponents.Find3dWithStatisticsAsync(mask, 0, labels, new ConnectedComponentsOptions(), null, CancellationToken.None).Result;
+                CollectionAssert.AreEqual(expectedStatistics, statistics);
+                CollectionAssert.AreEqual(expectedLabels.ToArray(), labels.ToArray());
+
+                // Cancelling when the first slice is done cancels the task rather than faulting it
+                using (var source = new CancellationTokenSource())
+                {
+                    var task = Convolution.ConvolveAsync(volume, directions, sigmas, new ConvolutionOptions(), new RecordingProgress(source), source.Token);
+                    var thrown = Assertions.ThrowsExactly<AggregateException>(() => task.Wait());
+                    Assert.IsInstanceOfType(thrown.InnerException, typeof(OperationCanceledException));
+                    Assert.IsTrue(task.IsCanceled);
+                }
+            }
+        }
+
+        // Keeps the last fraction reported to it, and cancels source, if not null, at the first.
+        private sealed class RecordingProgress : IProgress<double>
+        {
+            private readonly CancellationTokenSource source;
+
+            public RecordingProgress(CancellationTokenSource source)
+            {
+                this.source = source;
+                Last = -1;
+            }
+
+            public double Last { get; private set; }
+
+            public void Report(double value)
+            {
+                Last = value;
+                if (source != null)
+                    source.Cancel();
+            }
+        }
     }
 }
\ No newline at end of file
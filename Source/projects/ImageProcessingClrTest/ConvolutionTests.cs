@@ -6,6 +6,8 @@
 ﻿namespace ImageProcessingClrTest
 {
     using System;
+    using System.Linq;
+    using System.Threading;
     using Microsoft.VisualStudio.TestTools.UnitTesting;
     using InnerEye.CreateDataset.ImageProcessing;
 
@@ -203,5 +205,499 @@
                 new Direction[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ },
                 new float[] { sigma_x, sigma_y, sigma_z });
         }
+
+        [TestMethod]
+        public void TestConvolutionAgreesWithDirectSum()
+        {
+            // Includes rows shorter than the kernel and kernels shorter than one SSE vector
+            var sizes = new[] { new[] { 13, 5, 4 }, new[] { 2, 3, 1 }, new[] { 1, 9, 6 }, new[] { 37, 2, 3 } };
+            var sigmas = new[] { 0.5f, 1.0f, 1.5f, 2.5f, 4.0f };
+            var rng = new Random(1234);
+
+            foreach (var size in sizes)
+            {
+                int W = size[0], H = size[1], D = size[2];
+                var image = new float[W * H * D];
+                for (int i = 0; i < image.Length; i++)
+                    image[i] = (float)rng.NextDouble();
+
+                foreach (var sigma in sigmas)
+                {
+                    foreach (var direction in new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ })
+                    {
+                        var expected = ConvolveDirectSum(image, W, H, D, direction, sigma);
+
+                        var actual = (float[])image.Clone();
+                        Convolution.Convolve(actual, W, H, D, new[] { direction }, new[] { sigma });
+
+                        for (int i = 0; i < image.Length; i++)
+                            Assert.AreEqual(expected[i], actual[i], 1e-5f, "W={0} H={1} D={2} sigma={3} direction={4}", W, H, D, sigma, direction);
+                    }
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestRecursiveConvolutionAgreesWithDirectSum()
+        {
+            const int W = 61, H = 40, D = 35;
+            var rng = new Random(2468);
+            var image = new float[W * H * D];
+            for (int i = 0; i < image.Length; i++)
+                image[i] = (float)rng.NextDouble();
+
+            foreach (var sigma in new[] { 3.0f, 8.0f, 25.0f })
+            {
+                foreach (var direction in new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ })
+                {
+                    var expected = ConvolveDirectSum(image, W, H, D, direction, sigma);
+
+                    var actual = (float[])image.Clone();
+                    Convolution.Convolve(actual, W, H, D, new[] { direction }, new[] { sigma }, new ConvolutionOptions { Method = GaussianMethod.Recursive });
+
+                    // The recursive filter only approximates the Gaussian, to within 2% of the range of the image
+                    for (int i = 0; i < image.Length; i++)
+                        Assert.AreEqual(expected[i], actual[i], 0.02f, "sigma={0} direction={1}", sigma, direction);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestFixedPointConvolutionAgreesWithFloat()
+        {
+            const int W = 45, H = 20, D = 11;
+            var rng = new Random(3579);
+            var image = new byte[W * H * D];
+            rng.NextBytes(image);
+            var whole = new ConvolutionRegion(0, 0, 0, W - 1, H - 1, D - 1);
+
+            foreach (var sigma in new[] { 0.0f, 0.5f, 1.0f, 2.5f })
+            {
+                foreach (var direction in new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ })
+                {
+                    var expected = new byte[image.Length];
+                    Convolution.Convolve(image, expected, W, H, D, new[] { direction }, new[] { sigma }, whole, new ConvolutionOptions());
+
+                    var actual = new byte[image.Length];
+                    Convolution.Convolve(image, actual, W, H, D, new[] { direction }, new[] { sigma }, whole, new ConvolutionOptions { FixedPoint = true });
+
+                    for (int i = 0; i < image.Length; i++)
+                        Assert.AreEqual(expected[i], actual[i], 1, "sigma={0} direction={1}", sigma, direction);
+                }
+            }
+
+            // The quantised kernel sums to exactly one
+            var constant = Enumerable.Repeat((short)-1234, W * H * D).ToArray();
+            Convolution.Convolve(constant, W, H, D, new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ }, new[] { 1.5f, 2.0f, 0.7f }, new ConvolutionOptions { FixedPoint = true });
+            foreach (var value in constant)
+                Assert.AreEqual((short)-1234, value);
+        }
+
+        [TestMethod]
+        public void TestFixedPointIsIgnoredForFloatVolumes()
+        {
+            // Float volumes are still smoothed along X, Y and Z in a single pass
+            const int W = 31, H = 24, D = 9;
+            var rng = new Random(2468);
+            var image = Enumerable.Range(0, W * H * D).Select(i => (float)rng.NextDouble() * 100.0f).ToArray();
+            var directions = new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ };
+            var sigmas = new[] { 1.5f, 2.0f, 0.7f };
+
+            var expected = (float[])image.Clone();
+            Convolution.Convolve(expected, W, H, D, directions, sigmas, new ConvolutionOptions());
+            var actual = (float[])image.Clone();
+            Convolution.Convolve(actual, W, H, D, directions, sigmas, new ConvolutionOptions { FixedPoint = true });
+            CollectionAssert.AreEqual(expected, actual);
+        }
+
+        [TestMethod]
+        public void TestConvolutionPreservesConstantImage()
+        {
+            // The kernels are normalised, so smoothing leaves a constant image unchanged however
+            // small sigma is, and a sigma of zero leaves any image unchanged
+            const int W = 17, H = 6, D = 5;
+            foreach (var sampling in new[] { GaussianSampling.Point, GaussianSampling.Integral })
+            {
+                foreach (var sigma in new[] { 0.3f, 0.7f, 1.0f, 6.0f, 40.0f })
+                {
+                    var image = Enumerable.Repeat(100.0f, W * H * D).ToArray();
+                    Convolution.GaussianSmooth3d(image, W, H, D, sigma, sigma, sigma, new ConvolutionOptions { Sampling = sampling });
+                    foreach (var value in image)
+                        Assert.AreEqual(100.0f, value, 1e-3f);
+                }
+            }
+
+            var rng = new Random(1357);
+            var random = new float[W * H * D];
+            for (int i = 0; i < random.Length; i++)
+                random[i] = (float)rng.NextDouble();
+            var unchanged = (float[])random.Clone();
+            Convolution.Convolve(unchanged, W, H, D, new[] { Direction.DirectionX, Direction.DirectionZ }, new[] { 0.0f, 0.0f });
+            CollectionAssert.AreEqual(random, unchanged);
+        }
+
+        [TestMethod]
+        public void TestGaussianSmooth3dAgreesWithSeparateAxes()
+        {
+            const int W = 45, H = 20, D = 11;
+            var rng = new Random(5678);
+            var image = new float[W * H * D];
+            for (int i = 0; i < image.Length; i++)
+                image[i] = (float)rng.NextDouble();
+
+            float sigma_x = 1.0f, sigma_y = 2.0f, sigma_z = 3.0f;
+
+            var expected = (float[])image.Clone();
+            Convolution.Convolve(expected, W, H, D, new[] { Direction.DirectionX }, new[] { sigma_x });
+            Convolution.Convolve(expected, W, H, D, new[] { Direction.DirectionY }, new[] { sigma_y });
+            Convolution.Convolve(expected, W, H, D, new[] { Direction.DirectionZ }, new[] { sigma_z });
+
+            var fused = (float[])image.Clone();
+            Convolution.GaussianSmooth3d(fused, W, H, D, sigma_x, sigma_y, sigma_z);
+
+            // Convolve dispatches to the fused pass when given all three axes, in any order
+            var dispatched = (float[])image.Clone();
+            Convolution.Convolve(
+                dispatched, W, H, D,
+                new Direction[] { Direction.DirectionZ, Direction.DirectionX, Direction.DirectionY },
+                new float[] { sigma_z, sigma_x, sigma_y });
+
+            for (int i = 0; i < image.Length; i++)
+            {
+                Assert.AreEqual(expected[i], fused[i], 1e-5f);
+                Assert.AreEqual(expected[i], dispatched[i], 1e-5f);
+            }
+        }
+
+        [TestMethod]
+        public void TestConvolutionThreadCountDoesNotChangeResult()
+        {
+            const int W = 37, H = 19, D = 7;
+            var rng = new Random(91);
+            var image = new short[W * H * D];
+            for (int i = 0; i < image.Length; i++)
+                image[i] = (short)rng.Next(-1000, 1000);
+
+            foreach (var direction in new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ })
+            {
+                var expected = (short[])image.Clone();
+                Convolution.Convolve(expected, W, H, D, new[] { direction }, new[] { 1.5f });
+
+                foreach (var threadCount in new[] { 1, 2, 5 })
+                {
+                    var actual = (short[])image.Clone();
+                    Convolution.Convolve(actual, W, H, D, new[] { direction }, new[] { 1.5f }, new ConvolutionOptions { ThreadCount = threadCount });
+                    CollectionAssert.AreEqual(expected, actual);
+                }
+            }
+
+            var smoothed = (short[])image.Clone();
+            Convolution.GaussianSmooth3d(smoothed, W, H, D, 1.0f, 2.0f, 1.5f);
+            var smoothedWithOneThread = (short[])image.Clone();
+            Convolution.GaussianSmooth3d(smoothedWithOneThread, W, H, D, 1.0f, 2.0f, 1.5f, new ConvolutionOptions { ThreadCount = 1 });
+            CollectionAssert.AreEqual(smoothed, smoothedWithOneThread);
+        }
+
+        [TestMethod]
+        public void TestConvolutionOfRegionAgreesWithWholeVolume()
+        {
+            const int W = 41, H = 23, D = 12;
+            var rng = new Random(2468);
+            var image = new short[W * H * D];
+            for (int i = 0; i < image.Length; i++)
+                image[i] = (short)rng.Next(-500, 500);
+            var original = (short[])image.Clone();
+
+            var cases = new[]
+            {
+                new { Directions = new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ }, Sigmas = new[] { 1.0f, 2.0f, 1.5f } },
+                new { Directions = new[] { Direction.DirectionY, Direction.DirectionZ, Direction.DirectionY }, Sigmas = new[] { 1.5f, 1.0f, 0.8f } },
+            };
+
+            var regions = new[]
+            {
+                new ConvolutionRegion(0, 0, 0, W - 1, H - 1, D - 1),
+                new ConvolutionRegion(7, 4, 3, 25, 17, 8),
+                new ConvolutionRegion(0, 20, 10, 2, 22, 11),
+                new ConvolutionRegion(40, 0, 5, 40, 22, 5),
+            };
+
+            foreach (var c in cases)
+            {
+                var expected = (short[])image.Clone();
+                Convolution.Convolve(expected, W, H, D, c.Directions, c.Sigmas);
+
+                foreach (var region in regions)
+                {
+                    int w = region.MaximumX - region.MinimumX + 1, h = region.MaximumY - region.MinimumY + 1, d = region.MaximumZ - region.MinimumZ + 1;
+                    var actual = new short[w * h * d];
+                    Convolution.Convolve(image, actual, W, H, D, c.Directions, c.Sigmas, region, new ConvolutionOptions());
+
+                    for (int z = 0; z < d; z++)
+                        for (int y = 0; y < h; y++)
+                            for (int x = 0; x < w; x++)
+                            {
+                                int index = (region.MinimumZ + z) * W * H + (region.MinimumY + y) * W + region.MinimumX + x;
+                                Assert.AreEqual(expected[index], actual[(z * h + y) * w + x]);
+                            }
+                }
+
+                var outOfPlace = new short[image.Length];
+                Convolution.Convolve(image, outOfPlace, W, H, D, c.Directions, c.Sigmas);
+                CollectionAssert.AreEqual(expected, outOfPlace);
+            }
+
+            // The source is only read
+            CollectionAssert.AreEqual(original, image);
+        }
+
+        [TestMethod]
+        public void TestConvolutionPlanAgreesWithConvolve()
+        {
+            const int W = 29, H = 17, D = 9;
+            var rng = new Random(4321);
+
+            var cases = new[]
+            {
+                new { Directions = new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ }, Sigmas = new[] { 1.0f, 2.0f, 1.5f } },
+                new { Directions = new[] { Direction.DirectionZ, Direction.DirectionY }, Sigmas = new[] { 2.5f, 0.8f } },
+            };
+
+            foreach (var c in cases)
+            {
+                using (var plan = new ConvolutionPlan(W, H, D, c.Directions, c.Sigmas))
+                {
+                    // The same plan gives the same result as Convolve every time it is executed
+                    for (int repeat = 0; repeat < 3; repeat++)
+                    {
+                        var image = new byte[W * H * D];
+                        rng.NextBytes(image);
+
+                        var expected = (byte[])image.Clone();
+                        Convolution.Convolve(expected, W, H, D, c.Directions, c.Sigmas);
+
+                        plan.Execute(image);
+                        CollectionAssert.AreEqual(expected, image);
+                    }
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestConvolutionPlanChecksArguments()
+        {
+            var plan = new ConvolutionPlan(4, 5, 6, new[] { Direction.DirectionX }, new[] { 1.0f });
+            Assertions.Throws<Exception>(() => plan.Execute(new float[4 * 5 * 7]));
+            plan.Dispose();
+            Assertions.Throws<ObjectDisposedException>(() => plan.Execute(new float[4 * 5 * 6]));
+
+            Assertions.Throws<Exception>(() => new ConvolutionPlan(4, 5, 6, new[] { Direction.DirectionX }, new[] { 1.0f, 2.0f }));
+        }
+
+        [TestMethod]
+        public void TestInstrumentationCountsStagesOnlyWhenEnabled()
+        {
+            const int W = 16, H = 8, D = 4;
+            var image = new float[W * H * D];
+            var direction = new[] { Direction.DirectionX };
+            var sigma = new[] { 1.0f };
+
+            Instrumentation.Reset();
+            Convolution.Convolve(image, W, H, D, direction, sigma);
+            Assert.AreEqual(0, Instrumentation.GetCounters().Length);
+
+            Instrumentation.Enabled = true;
+            try
+            {
+                Convolution.Convolve(image, W, H, D, direction, sigma);
+                Convolution.Convolve(image, W, H, D, direction, sigma);
+            }
+            finally
+            {
+                Instrumentation.Enabled = false;
+            }
+
+            var counters = Instrumentation.GetCounters().Where(c => c.EntryPoint == "Convolution.Convolve").ToArray();
+            var total = counters.Single(c => c.Stage == "total");
+            Assert.AreEqual(2, total.Calls);
+            Assert.AreEqual(2L * W * H * D, total.Voxels);
+            Assert.IsTrue(total.Threads >= 1);
+            Assert.IsTrue(total.Milliseconds >= 0);
+            Assert.AreEqual(2, counters.Single(c => c.Stage == "convolve x").Calls);
+
+            Instrumentation.Reset();
+            Assert.AreEqual(0, Instrumentation.GetCounters().Length);
+        }
+
+        [TestMethod]
+        public void TestConvolutionModesAgreeWithReference()
+        {
+            // Widths below each vector width, not a multiple of it, and shorter than the kernel of sigma 3
+            var widths = new[] { 1, 3, 5, 7, 9, 17, 33 };
+            var modes = new[] { ConvolutionMode.Reference, ConvolutionMode.Sse, ConvolutionMode.Avx2, ConvolutionMode.Avx512 };
+            var directionSets = new[]
+            {
+                new[] { Direction.DirectionX },
+                new[] { Direction.DirectionY },
+                new[] { Direction.DirectionZ },
+                new[] { Direction.DirectionX, Direction.DirectionY },
+                new[] { Direction.DirectionX, Direction.DirectionY, Direction.DirectionZ },
+            };
+            Assert.IsTrue(Convolution.IsModeSupported(ConvolutionMode.Auto));
+            Assert.IsTrue(Convolution.IsModeSupported(ConvolutionMode.Reference));
+
+            var random = new Random(17);
+            foreach (var W in widths)
+            {
+                int H = W + 2, D = 5;
+                var image = new float[W * H * D];
+                for (var i = 0; i < image.Length; i++)
+                    image[i] = (float)random.NextDouble() * 100;
+
+                foreach (var sigma in new[] { 0.7f, 3.0f })
+                {
+                    foreach (var directions in directionSets)
+                    {
+                        var sigmas = Enumerable.Repeat(sigma, directions.Length).ToArray();
+                        var expected = (float[])image.Clone();
+                        Convolution.Convolve(expected, W, H, D, directions, sigmas, new ConvolutionOptions { Mode = ConvolutionMode.Reference, Untiled = true });
+
+                        foreach (var mode in modes.Where(Convolution.IsModeSupported))
+                        {
+                            foreach (var untiled in new[] { false, true })
+                            {
+                                var result = (float[])image.Clone();
+                                Convolution.Convolve(result, W, H, D, directions, sigmas, new ConvolutionOptions { Mode = mode, Untiled = untiled });
+                                for (var i = 0; i < result.Length; i++)
+                                    Assert.AreEqual(expected[i], result[i], 1e-3f, "{0} untiled={1} width={2} sigma={3} directions={4}", mode, untiled, W, sigma, directions.Length);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        [TestMethod]
+        public void TestConvolutionModeMustBeSupported()
+        {
+            var image = new float[4 * 4 * 4];
+            var direction = new[] { Direction.DirectionX };
+            var sigma = new[] { 1.0f };
+            Assertions.Throws<ArgumentOutOfRangeException>(() => Convolution.Convolve(image, 4, 4, 4, direction, sigma, new ConvolutionOptions { Mode = (ConvolutionMode)5 }));
+            Assertions.Throws<ArgumentOutOfRangeException>(() => Convolution.IsModeSupported((ConvolutionMode)(-1)));
+            foreach (var mode in new[] { ConvolutionMode.Avx2, ConvolutionMode.Avx512 }.Where(m => !Convolution.IsModeSupported(m)))
+                Assertions.Throws<NotSupportedException>(() => Convolution.Convolve(image, 4, 4, 4, direction, sigma, new ConvolutionOptions { Mode = mode }));
+        }
+
+        [TestMethod]
+        public void TestInstrumentationCountsVoxelsAndThreadsOfConvolveAsync()
+        {
+            const int W = 16, H = 8, D = 4;
+            var direction = new[] { Direction.DirectionX };
+            var sigma = new[] { 1.0f };
+            var options = new ConvolutionOptions { ThreadCount = 2 };
+
+            Instrumentation.Reset();
+            Instrumentation.Enabled = true;
+            using (var volume = new NativeVolume<float>(W, H, D))
+            using (var other = new NativeVolume<float>(W, H, 2 * D))
+            {
+                try
+                {
+                    Convolution.ConvolveAsync(volume, direction, sigma, options, null, CancellationToken.None).Wait();
+                    Convolution.ConvolveAsync(new[] { volume, other }, direction, sigma, options, null, CancellationToken.None).Wait();
+                }
+                finally
+                {
+                    Instrumentation.Enabled = false;
+                }
+            }
+
+            // The synchronous calls inside the asynchronous ones record nothing of their own
+            var counters = Instrumentation.GetCounters();
+            Assert.IsFalse(counters.Any(c => c.EntryPoint == "Convolution.Convolve"));
+            var total = counters.Single(c => c.EntryPoint == "Convolution.ConvolveAsync" && c.Stage == "total");
+            Assert.AreEqual(2, total.Calls);
+            Assert.AreEqual(4L * W * H * D, total.Voxels);
+            Assert.AreEqual(2, total.Threads);
+
+            Instrumentation.Reset();
+        }
+
+        [TestMethod]
+        public void TestInstrumentationCountsNativeVolumesAndScratchMemory()
+        {
+            const int W = 16, H = 8, D = 4;
+
+            Instrumentation.Reset();
+            Instrumentation.Enabled = true;
+            try
+            {
+                using (var volume = new NativeVolume<byte>(W, H, D))
+                {
+                    volume.ToArray();
+                }
+                ScratchMemory.Trim();
+            }
+            finally
+            {
+                Instrumentation.Enabled = false;
+            }
+
+            var counters = Instrumentation.GetCounters();
+            var created = counters.Single(c => c.EntryPoint == "NativeVolume.NativeVolume" && c.Stage == "total");
+            Assert.AreEqual(1, created.Calls);
+            Assert.AreEqual((long)W * H * D, created.Voxels);
+            // CopyTo inside ToArray is recorded as part of it
+            Assert.AreEqual((long)W * H * D, counters.Single(c => c.EntryPoint == "NativeVolume.ToArray" && c.Stage == "total").Voxels);
+            Assert.IsFalse(counters.Any(c => c.EntryPoint == "NativeVolume.CopyTo"));
+            Assert.AreEqual(1, counters.Single(c => c.EntryPoint == "ScratchMemory.Trim" && c.Stage == "total").Calls);
+
+            Instrumentation.Reset();
+        }
+
+        // Convolves along one direction with Gaussian kernel of the same form as GaussianKernel1D,
+        // reflecting about the edges of the volume.
+        private static float[] ConvolveDirectSum(float[] image, int W, int H, int D, Direction direction, float sigma)
+        {
+            int radius = (int)Math.Floor(sigma * Math.Sqrt(2 * Math.Log(1 / 0.001)));
+            var kernel = new double[2 * radius + 1];
+            for (int x = -radius; x <= radius; x++)
+                kernel[radius + x] = Math.Exp(-0.5 * Math.Pow(x / sigma, 2));
+            double total = kernel.Sum();
+            for (int k = 0; k < kernel.Length; k++)
+                kernel[k] /= total;
+
+            var dims = new[] { W, H, D };
+            int axis = (int)direction;
+            int length = dims[axis];
+
+            var result = new float[image.Length];
+            for (int z = 0; z < D; z++)
+                for (int y = 0; y < H; y++)
+                    for (int x = 0; x < W; x++)
+                    {
+                        var position = new[] { x, y, z };
+                        double sum = 0;
+                        for (int k = -radius; k <= radius; k++)
+                        {
+                            var p = (int[])position.Clone();
+                            p[axis] = Reflect(position[axis] + k, length);
+                            sum += kernel[radius + k] * image[p[2] * W * H + p[1] * W + p[0]];
+                        }
+                        result[z * W * H + y * W + x] = (float)sum;
+                    }
+
+            return result;
+        }
+
+        private static int Reflect(int u, int length)
+        {
+            int period = 2 * length;
+            u %= period;
+            if (u < 0)
+                u += period;
+            return u < length ? u : period - 1 - u;
+        }
     }
 }
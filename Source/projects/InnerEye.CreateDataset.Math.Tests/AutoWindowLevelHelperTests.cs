@@ -0,0 +1,52 @@
+///  ------------------------------------------------------------------------------------------
+///  Copyright (c) Microsoft Corporation. All rights reserved.
+///  Licensed under the MIT License (MIT). See LICENSE in the repo root for license information.
+///  ------------------------------------------------------------------------------------------
+
+﻿namespace InnerEye.CreateDataset.Math.Tests
+{
+    using System;
+    using System.Linq;
+
+    using NUnit.Framework;
+
+    [TestFixture]
+    public class AutoWindowLevelHelperTests
+    {
+        [TestCase(0u)]
+        [TestCase(4u)]
+        public void NativeHistogramMatchesDirectCountTest(uint volumeSkip)
+        {
+            var random = new Random(11);
+            var volume = new short[300007];
+            for (var i = 0; i < volume.Length; i++)
+            {
+                volume[i] = (short)random.Next(-1500, 2500);
+            }
+
+            var minMax = AutoWindowLevelHelper.FindMinMax(volume, volumeSkip);
+            var sampled = volume.Where((value, index) => index % (volumeSkip + 1) == 0).ToArray();
+            Assert.AreEqual(sampled.Min(), minMax.Minimum);
+            Assert.AreEqual(sampled.Max(), minMax.Maximum);
+
+            // Clamped as for CT, so that values fall below and above the bins
+            var clamped = MinMax.Create((short)-1000, (short)2000);
+            var histogram = AutoWindowLevelHelper.CreateHistogram(volume, clamped, volumeSkip, 150);
+            var binSize = (double)clamped.Range() / 150;
+            var expected = new int[150];
+            foreach (var value in sampled)
+            {
+                var binPosition = (value - clamped.Minimum) / binSize;
+                expected[binPosition < 0 ? 0 : binPosition >= 150 ? 149 : (int)binPosition]++;
+            }
+
+            var counts = histogram.Select(bin => bin.Count).ToArray();
+            CollectionAssert.AreEqual(expected, counts);
+
+            var total = counts.Sum();
+            var median = AutoWindowLevelHelper.PercentileBin(histogram, 0.5).Index;
+            Assert.IsTrue(counts.Take(median + 1).Sum() >= total * 0.5);
+            Assert.IsTrue(counts.Take(median).Sum() < total * 0.5);
+        }
+    }
+}
@@ -91,5 +91,81 @@
             Assert.AreEqual(0, minMax.Minimum);
             Assert.AreEqual(99, minMax.Maximum);
         }
+
+        [Description("Tests that native contour extraction and filling give the same contours and voxels as the managed code.")]
+        [Test]
+        public void NativeContoursMatchManagedTest()
+        {
+            // Blobs with holes, and inserts inside the holes
+            var random = new Random(7);
+            var volume = new Volume3D<byte>(61, 47, 9, 1, 1, 1);
+            for (var n = 0; n < 40; n++)
+            {
+                var cx = random.Next(volume.DimX);
+                var cy = random.Next(volume.DimY);
+                var cz = random.Next(volume.DimZ);
+                var r = 2 + random.Next(8);
+                var color = (byte)(n % 3 == 2 ? 0 : 1);
+                for (var z = System.Math.Max(cz - 2, 0); z <= System.Math.Min(cz + 2, volume.DimZ - 1); z++)
+                {
+                    for (var y = System.Math.Max(cy - r, 0); y <= System.Math.Min(cy + r, volume.DimY - 1); y++)
+                    {
+                        for (var x = System.Math.Max(cx - r, 0); x <= System.Math.Min(cx + r, volume.DimX - 1); x++)
+                        {
+                            if ((x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r)
+                            {
+                                volume[x, y, z] = color;
+                            }
+                        }
+                    }
+                }
+            }
+
+            foreach (var sliceType in new[] { SliceType.Axial, SliceType.Coronal, SliceType.Sagittal })
+            {
+                var expected = ExtractContours.ContoursWithHolesPerSlice(volume, 1, sliceType);
+                var actual = volume.ContoursWithHolesPerSlice(1, sliceType);
+                CollectionAssert.AreEqual(expected.GetSlicesWithContours().OrderBy(x => x), actual.GetSlicesWithContours().OrderBy(x => x));
+                foreach (var slice in expected)
+                {
+                    CollectionAssert.AreEqual(slice.Value, actual.ContoursForSlice(slice.Key), $"{sliceType} slice {slice.Key}");
+                }
+            }
+
+            var contours = ExtractContours.ContoursWithHolesPerSlice(volume, 1);
+            var expectedFill = new Volume3D<byte>(volume.DimX, volume.DimY, volume.DimZ, 1, 1, 1);
+            FillPolygon.FillContours(expectedFill, contours, (byte)1);
+            var actualFill = new Volume3D<byte>(volume.DimX, volume.DimY, volume.DimZ, 1, 1, 1);
+            actualFill.Fill(contours, 1);
+            CollectionAssert.AreEqual(expectedFill.Array, actualFill.Array);
+        }
+
+        [Description("Tests that native filling rejects a polygon without points as the managed code does.")]
+        [Test]
+        public void NativeFillRejectsEmptyPolygonTest()
+        {
+            var contours = new ContoursPerSlice(new Dictionary<int, IReadOnlyList<ContourPolygon>>()
+            {
+                { 1, new[] { new ContourPolygon(new PointF[0], 0) } },
+            });
+            var expected = new Volume3D<byte>(5, 4, 3, 1, 1, 1);
+            Assert.Throws<ArgumentOutOfRangeException>(() => FillPolygon.FillContours(expected, contours, (byte)1));
+            var actual = new Volume3D<byte>(5, 4, 3, 1, 1, 1);
+            Assert.Throws<ArgumentOutOfRangeException>(() => actual.Fill(contours, 1));
+        }
+
+        [Description("Tests that native filling rejects a polygon outside the volume as the managed code does.")]
+        [Test]
+        public void NativeFillRejectsSliceOutsideVolumeTest()
+        {
+            var contours = new ContoursPerSlice(new Dictionary<int, IReadOnlyList<ContourPolygon>>()
+            {
+                { 3, new[] { new ContourPolygon(new[] { new PointF(1, 1), new PointF(3, 1), new PointF(3, 2) }, 0) } },
+            });
+            var expected = new Volume3D<byte>(5, 4, 3, 1, 1, 1);
+            Assert.Throws<ArgumentOutOfRangeException>(() => FillPolygon.FillContours(expected, contours, (byte)1));
+            var actual = new Volume3D<byte>(5, 4, 3, 1, 1, 1);
+            Assert.Throws<ArgumentOutOfRangeException>(() => actual.Fill(contours, 1));
+        }
     }
 }
@@ -45,6 +45,38 @@
 #endif
         }
 
+        [Test]
+        public void EuclideanDistance3DIsExactTest()
+        {
+            var mask = new Volume3D<byte>(20, 15, 10, 0.5, 1.0, 2.5);
+            mask[4, 5, 2] = 1;
+            mask[15, 10, 7] = 1;
+
+            var distanceMap = mask.EuclideanDistance(100, 100, 100);
+            for (var z = 0; z < mask.DimZ; z++)
+            {
+                for (var y = 0; y < mask.DimY; y++)
+                {
+                    for (var x = 0; x < mask.DimX; x++)
+                    {
+                        var first = Distance(x - 4, y - 5, z - 2, mask);
+                        var second = Distance(x - 15, y - 10, z - 7, mask);
+                        Assert.AreEqual(Math.Min(first, second), distanceMap[x, y, z], 1e-5);
+                    }
+                }
+            }
+
+            // Outside the box of the mask grown by the margins nothing is computed
+            var restricted = mask.EuclideanDistance(1, 1, 1);
+            Assert.AreEqual(float.MaxValue, restricted[0, 0, 0]);
+            Assert.AreEqual(0f, restricted[4, 5, 2]);
+        }
+
+        private static double Distance(int dx, int dy, int dz, Volume3D<byte> volume)
+        {
+            return Math.Sqrt(Math.Pow(dx * volume.SpacingX, 2) + Math.Pow(dy * volume.SpacingY, 2) + Math.Pow(dz * volume.SpacingZ, 2));
+        }
+
         public static void PrintByteArray(float[] img, int dimX, int dimY, string resultPath)
         {
             Bitmap plane = new Bitmap(dimX, dimY);
@@ -9,6 +9,7 @@
     using System.Linq;
     using MedLib.IO;
     using InnerEye.CreateDataset.Math;
+    using InnerEye.CreateDataset.Math.Morphology;
     using InnerEye.CreateDataset.Volumes;
     using NUnit.Framework;
     using System.IO;
@@ -131,6 +132,34 @@
             CollectionAssert.AreEqual(expectedNonEdgeSurfacePoints, ExtractSurfacePoints(volumeWithNonSurfacePointVoxels));
         }
 
+        [Test]
+        public void NativeDilateErodeMatchesStructuringElementTest()
+        {
+            var mask = new Volume3D<byte>(30, 26, 14, 1.0, 1.0, 2.0);
+            var restriction = mask.CreateSameSize<byte>();
+            mask.IterateSlices(p =>
+            {
+                var inFirst = p.x >= 6 && p.x < 14 && p.y >= 5 && p.y < 12 && p.z >= 4 && p.z < 9;
+                var inSecond = p.x >= 18 && p.x < 27 && p.y >= 15 && p.y < 22 && p.z >= 6 && p.z < 12;
+                mask[p.x, p.y, p.z] = inFirst || inSecond ? ModelConstants.MaskForegroundIntensity : ModelConstants.MaskBackgroundIntensity;
+                // Only foreground voxels of the restriction are open, not every non-zero one
+                restriction[p.x, p.y, p.z] = p.x < 20 ? ModelConstants.MaskForegroundIntensity : p.y % 2 == 0 ? (byte)2 : ModelConstants.MaskBackgroundIntensity;
+            });
+
+            // An explicit structuring element takes the managed path, with radii one less for erosion
+            foreach (var withRestriction in new[] { false, true })
+            {
+                var dilated = mask.Dilate(3.0, 2.0, 2.0, withRestriction ? restriction : null);
+                var painted = mask.Dilate(3.0, 2.0, 2.0, withRestriction ? restriction : null, new StructuringElement(3, 2, 1));
+                CollectionAssert.AreEqual(painted.Array, dilated.Array);
+            }
+
+            var eroded = mask.Erode(3.0, 2.0, 4.0);
+            var erodedByPainting = mask.Erode(3.0, 2.0, 4.0, new StructuringElement(2, 1, 1));
+            CollectionAssert.AreEqual(erodedByPainting.Array, eroded.Array);
+            Assert.Greater(eroded.Array.Count(v => v == ModelConstants.MaskForegroundIntensity), 0);
+        }
+
         private List<(int x, int y, int z)> ExtractSurfacePoints(Volume3D<byte> volume)
         {
             var surfacePoints = new List<(int x, int y, int z)>();
@@ -5,6 +5,7 @@
 
 ﻿namespace InnerEye.CreateDataset.Math.Tests
 {
+    using System;
     using System.Linq;
     using InnerEye.CreateDataset.Contours;
     using InnerEye.CreateDataset.Math;
@@ -44,6 +45,44 @@
             Assert.AreEqual(expectedReduction, output.Array.Sum(), $"{output.Array.Sum()}");
         }
 
+        [TestCase(37, 41, 9)]
+        [TestCase(120, 100, 25)]
+        [TestCase(60, 50, 3)]
+        public void NativeResampleLinearMatchesManagedTest(int dimX, int dimY, int dimZ)
+        {
+            // Short and byte volumes are resampled natively, double volumes still by the managed
+            // interpolation, which the native one rounds to the nearest integer as Math.Round does.
+            var random = new Random(7);
+            var shorts = new Volume3D<short>(80, 70, 12, 0.8, 0.9, 2.5);
+            var bytes = new Volume3D<byte>(80, 70, 12, 0.8, 0.9, 2.5);
+            var doubles = new Volume3D<double>(80, 70, 12, 0.8, 0.9, 2.5);
+            for (int i = 0; i < shorts.Length; i++)
+            {
+                shorts[i] = (short)random.Next(-1024, 3000);
+                doubles[i] = shorts[i];
+            }
+
+            var expected = doubles.ResampleLinear(dimX, dimY, dimZ);
+            var actual = shorts.ResampleLinear(dimX, dimY, dimZ);
+            for (int i = 0; i < expected.Length; i++)
+            {
+                Assert.AreEqual((short)Math.Round(expected[i]), actual[i], $"Short voxel {i}");
+            }
+
+            for (int i = 0; i < bytes.Length; i++)
+            {
+                bytes[i] = (byte)random.Next(0, 256);
+                doubles[i] = bytes[i];
+            }
+
+            expected = doubles.ResampleLinear(dimX, dimY, dimZ);
+            var actualBytes = bytes.ResampleLinear(dimX, dimY, dimZ);
+            for (int i = 0; i < expected.Length; i++)
+            {
+                Assert.AreEqual((byte)Math.Round(expected[i]), actualBytes[i], $"Byte voxel {i}");
+            }
+        }
+
         private static void PrintToPng(Volume3D<int> output, string name)
         {
 #if DEBUG
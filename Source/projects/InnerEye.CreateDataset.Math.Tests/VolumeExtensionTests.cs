@@ -389,5 +389,22 @@
             // slice should be returned.
             Assert.AreEqual((0,0), volume.SliceWithMostForeground(42));
         }
+
+        [Description("Tests that smoothing a mask into a new volume gives the same result as smoothing it in place.")]
+        [Test]
+        public void SmoothedImageMatchesSmoothInPlace()
+        {
+            var random = new Random(11);
+            var mask = new Volume3D<byte>(23, 19, 7, 1.0, 0.8, 2.5);
+            for (var i = 0; i < mask.Length; i++)
+            {
+                mask[i] = (byte)(random.Next(3) == 0 ? 255 : 0);
+            }
+
+            var smoothed = mask.SmoothedImage(1.5);
+            var inPlace = mask.Copy();
+            inPlace.SmoothInPlace(1.5f);
+            CollectionAssert.AreEqual(inPlace.Array, smoothed.Array);
+        }
     }
 }
@@ -9,6 +9,7 @@
     using System.Collections.Generic;
     using System.Diagnostics;
     using System.Linq;
+    using InnerEye.CreateDataset.ImageProcessing;
     using InnerEye.CreateDataset.Volumes;
 
     /// <summary>
@@ -107,13 +108,13 @@
         /// </summary>
         /// <param name="volume">The volume to calculate the window/ level from.</param>
         /// <param name="volumeSkip">
-        /// The number of items to skip over when computing the histogram (this is an optimisation to make the compute faster). 
-        /// If set to 0, the histogram will look at every voxel in the volume when computing the auto/ window level.
+        /// The number of items to skip over when computing the histogram. 
+        /// If set to 0, the default, the histogram will look at every voxel in the volume when computing the auto/ window level.
         /// If set to 1, this histogram will look at every other voxel etc.
         /// </param>
         /// <returns>A tuple of the Window (item 1) and Level (item 2)</returns>
         /// <exception cref="ArgumentNullException">The provided volume was null.</exception>
-        public static (int Window, int Level) ComputeMrAutoWindowLevel(short[] volume, uint volumeSkip = 5)
+        public static (int Window, int Level) ComputeMrAutoWindowLevel(short[] volume, uint volumeSkip = 0)
         {
             volume = volume ?? throw new ArgumentNullException(nameof(volume));
             var stopwatch = Stopwatch.StartNew();
@@ -146,13 +147,13 @@
         /// </summary>
         /// <param name="volume">The CT volume.</param>
         /// <param name="volumeSkip">
-        /// The number of items to skip over when computing the histogram (this is an optimisation to make the compute faster). 
-        /// If set to 0, the histogram will look at every voxel in the volume when computing the auto/ window level.
+        /// The number of items to skip over when computing the histogram. 
+        /// If set to 0, the default, the histogram will look at every voxel in the volume when computing the auto/ window level.
         /// If set to 1, this histogram will look at every other voxel etc.
         /// </param>
         /// <returns>A tuple of the Window (item 1) and Level (item 2)</returns>
         /// <exception cref="ArgumentNullException">The provided volume was null.</exception>
-        public static (int Window, int Level) ComputeCtAutoWindowLevel(short[] volume, uint volumeSkip = 5)
+        public static (int Window, int Level) ComputeCtAutoWindowLevel(short[] volume, uint volumeSkip = 0)
         {
             volume = volume ?? throw new ArgumentNullException(nameof(volume));
             var stopwatch = Stopwatch.StartNew();
@@ -240,6 +241,20 @@
             return histogram.Take(elementsToRetain).ToArray();
         }
 
+        /// <summary>
+        /// Finds the first bin of the histogram at which the running total of counts reaches the given fraction of
+        /// all counts, in a single pass over the bins. For example, a fraction of 0.5 gives the bin holding the median.
+        /// </summary>
+        /// <param name="histogram">The per-bin histogram, sorted by bin position, low values coming first.</param>
+        /// <param name="fraction">The fraction of the total count, between 0 and 1.</param>
+        /// <returns>The bin, or null if every count is zero.</returns>
+        public static HistogramBin PercentileBin(HistogramBin[] histogram, double fraction)
+        {
+            histogram = histogram ?? throw new ArgumentNullException(nameof(histogram));
+            var index = Histogram.PercentileBin(histogram.Select(bin => bin.Count).ToArray(), fraction);
+            return index < 0 ? null : histogram[index];
+        }
+
         /// <summary>
         /// Estimates window and level for MR images, by fitting an exponential curve for the low 
         /// values, discarding those, and computing mean and standard deviation from the rest.
@@ -402,16 +417,12 @@
                 return histogram;
             }
 
-            for (uint i = 0; i < volume.Length; i += volumeSkip + 1)
+            // Natively, in parallel: value v is counted in bin (int)((v - minMax.Minimum) / binSize), clamped to the first and last bin.
+            var counts = new int[histogramSize];
+            Histogram.Compute(volume, Step(volumeSkip), minMax.Minimum, minMax.Maximum, counts, 0);
+            for (var binIndex = 0; binIndex < histogramSize; binIndex++)
             {
-                var binPosition = (volume[i] - minMax.Minimum) / binSize;
-                var binIndex =
-                    binPosition < 0
-                    ? 0
-                    : binPosition >= histogramSize
-                    ? histogramSize - 1
-                    : (int)binPosition;
-                histogram[binIndex].Count++;
+                histogram[binIndex].Count = counts[binIndex];
             }
 
             return histogram;
@@ -430,26 +441,16 @@
         /// <returns>The tuple of min/ max shorts.</returns>
         public static MinMax<short> FindMinMax(short[] array, uint volumeSkip)
         {
-            var min = short.MaxValue;
-            var max = short.MinValue;
-            var current = short.MaxValue;
-
-            for (uint i = 0; i < array.Length; i += volumeSkip + 1)
-            {
-                current = array[i];
-
-                if (current < min)
-                {
-                    min = current;
-                }
-
-                if (current > max)
-                {
-                    max = current;
-                }
-            }
-
+            Histogram.FindMinMax(array, Step(volumeSkip), out var min, out var max, 0);
             return MinMax.Create(min, max);
         }
+
+        /// <summary>
+        /// The distance between the voxels looked at, when skipping over <paramref name="volumeSkip"/> voxels after each.
+        /// </summary>
+        private static int Step(uint volumeSkip)
+        {
+            return (int)Math.Min(volumeSkip + 1L, int.MaxValue);
+        }
     }
 }
\ No newline at end of file
@@ -9,8 +9,10 @@
     using System.Collections.Generic;
     using System.Drawing;
     using System.Linq;
+    using System.Threading.Tasks;
 
     using InnerEye.CreateDataset.Contours;
+    using InnerEye.CreateDataset.ImageProcessing;
     using InnerEye.CreateDataset.Volumes;
 
     /// <summary>
@@ -37,7 +39,54 @@
             bool filterEmptyContours = true,
             Region3D<int> regionOfInterest = null,
             ContourSmoothingType axialSmoothingType = ContourSmoothingType.Small)
-            => ExtractContours.ContoursWithHolesPerSlice(volume, foregroundId, sliceType, filterEmptyContours, regionOfInterest, axialSmoothingType);
+        {
+            volume = volume ?? throw new ArgumentNullException(nameof(volume));
+            var region = regionOfInterest ?? new Region3D<int>(0, 0, 0, volume.DimX - 1, volume.DimY - 1, volume.DimZ - 1);
+
+            // Only smooth the output on the axial slices, as ExtractContours does
+            var smoothingType = axialSmoothingType;
+            SliceOrientation orientation;
+            int startPoint;
+            int endPoint;
+            switch (sliceType)
+            {
+                case SliceType.Axial:
+                    orientation = SliceOrientation.Axial;
+                    startPoint = region.MinimumZ;
+                    endPoint = region.MaximumZ;
+                    break;
+                case SliceType.Coronal:
+                    orientation = SliceOrientation.Coronal;
+                    startPoint = region.MinimumY;
+                    endPoint = region.MaximumY;
+                    smoothingType = ContourSmoothingType.None;
+                    break;
+                case SliceType.Sagittal:
+                    orientation = SliceOrientation.Sagittal;
+                    startPoint = region.MinimumX;
+                    endPoint = region.MaximumX;
+                    smoothingType = ContourSmoothingType.None;
+                    break;
+                default:
+                    throw new ArgumentOutOfRangeException(nameof(sliceType), sliceType, null);
+            }
+
+            // The slices are traced in place and in parallel; just the smoothing stays managed.
+            var tracedPerSlice = SliceContours.TracePolygonsWithHoles(volume.Array, volume.DimX, volume.DimY, volume.DimZ,
+                foregroundId, orientation, startPoint, endPoint, ExtractContours.DefaultMaxPolygonNestingLevel, 0);
+            var arrayOfContours = new IReadOnlyList<ContourPolygon>[tracedPerSlice.Length];
+            Parallel.For(0, tracedPerSlice.Length, i =>
+            {
+                arrayOfContours[i] = ToInnerOuterPolygons(tracedPerSlice[i])
+                    .Select(x => new ContourPolygon(SmoothPolygon.Smooth(x, smoothingType), x.TotalPixels))
+                    .ToList();
+            });
+
+            return new ContoursPerSlice(
+                Enumerable.Range(0, arrayOfContours.Length)
+                    .Where(i => !filterEmptyContours || arrayOfContours[i].Count > 0)
+                    .ToDictionary(i => startPoint + i, i => arrayOfContours[i]));
+        }
 
         /// <summary>
         /// Extracts the contours around all voxel values in the volume that have the given foreground value.
@@ -84,6 +133,43 @@
         public static void Fill<T>(this Volume3D<T> volume, ContoursPerSlice contours, T value)
             => FillPolygon.FillContours(volume, contours, value);
 
+        /// <summary>
+        /// Modifies the present volume by filling all points that fall inside of the given contours,
+        /// using the provided fill value. Contours are filled on axial slices, in place and in parallel
+        /// over slices, with the same result as <see cref="FillPolygon.FillContours{T}(Volume3D{T}, ContoursPerSlice, T)"/>.
+        /// </summary>
+        /// <param name="volume">The volume that should be modified.</param>
+        /// <param name="contours">The contours per axial slice.</param>
+        /// <param name="value">The value that should be used to fill all points that fall inside of
+        /// the given contours.</param>
+        public static void Fill(this Volume3D<byte> volume, ContoursPerSlice contours, byte value)
+        {
+            volume = volume ?? throw new ArgumentNullException(nameof(volume));
+            contours = contours ?? throw new ArgumentNullException(nameof(contours));
+            var polygons = contours.SelectMany(slice => slice.Value.Select(contour => (slice.Key, contour.ContourPoints))).ToList();
+            var starts = new int[polygons.Count + 1];
+            var slices = new int[polygons.Count];
+            for (var p = 0; p < polygons.Count; p++)
+            {
+                slices[p] = polygons[p].Key;
+                starts[p + 1] = starts[p] + polygons[p].ContourPoints.Length;
+            }
+
+            var x = new float[starts[polygons.Count]];
+            var y = new float[x.Length];
+            for (var p = 0; p < polygons.Count; p++)
+            {
+                var points = polygons[p].ContourPoints;
+                for (var i = 0; i < points.Length; i++)
+                {
+                    x[starts[p] + i] = points[i].X;
+                    y[starts[p] + i] = points[i].Y;
+                }
+            }
+
+            SliceContours.FillPolygons(volume.Array, volume.DimX, volume.DimY, volume.DimZ, x, y, starts, slices, value, 0);
+        }
+
         /// <summary>
         /// Modifies the present volume by filling all points that fall inside of the given contours,
         /// using the provided fill value.
@@ -353,5 +439,47 @@
 
             return result;
         }
+
+        /// <summary>
+        /// Converts the polygons of one slice from native tracing into the outer polygons with their
+        /// holes, in the order of <see cref="ExtractContours.PolygonsWithHoles"/>.
+        /// </summary>
+        /// <param name="traced">The polygons of the slice in the order found, where each hole names its outer polygon.</param>
+        /// <returns></returns>
+        private static IReadOnlyList<InnerOuterPolygon> ToInnerOuterPolygons(TracedPolygon[] traced)
+        {
+            var result = new List<InnerOuterPolygon>();
+            var outerOf = new InnerOuterPolygon[traced.Length];
+            for (var index = 0; index < traced.Length; index++)
+            {
+                var polygon = traced[index];
+                var points = new Point[polygon.Points.Length / 2];
+                for (var i = 0; i < points.Length; i++)
+                {
+                    points[i] = new Point(polygon.Points[2 * i], polygon.Points[2 * i + 1]);
+                }
+
+                var polygonPoints = new PolygonPoints(
+                    points,
+                    new VoxelCounts(polygon.ForegroundCount, polygon.OtherCount),
+                    polygon.InsideOfPolygon,
+                    polygon.IsInnerContour,
+                    new Point(polygon.StartX, polygon.StartY))
+                {
+                    NestingLevel = polygon.NestingLevel,
+                };
+                if (polygon.OuterIndex < 0)
+                {
+                    outerOf[index] = new InnerOuterPolygon(polygonPoints);
+                    result.Add(outerOf[index]);
+                }
+                else
+                {
+                    outerOf[polygon.OuterIndex].AddInnerContour(polygonPoints);
+                }
+            }
+
+            return result;
+        }
     }
 }
\ No newline at end of file
@@ -71,8 +71,9 @@ namespace InnerEye.CreateDataset.Math
 
 
         /// <summary>
-        /// Creates a new volume with the provided Dilation/Erosion margins applied
-        /// The algorithm creates an ellipsoid structuring element (SE), extracts the surface poits of the ellipsoid, computes
+        /// Creates a new volume with the provided Dilation/Erosion margins applied.
+        /// With the default ellipsoid this is done by MaskMorphology in native code. For any other structuring element
+        /// the algorithm creates an ellipsoid structuring element (SE), extracts the surface poits of the ellipsoid, computes
         /// difference sets (see: StructuringElement.cs for further details) 
         /// and then paints the resulting volume on all the surface voxels.
         /// A connected components search is used to ensure the operation handles multiple components correctly
@@ -105,6 +106,25 @@ namespace InnerEye.CreateDataset.Math
                 return result;
             }
 
+            // The default ellipsoid is done natively, in time linear in the number of voxels
+            if (structuringElement == null)
+            {
+                if (isErosion)
+                {
+                    MaskMorphology.Erode(input.Array, input.DimX, input.DimY, input.DimZ,
+                        ModelConstants.MaskBackgroundIntensity, ModelConstants.MaskForegroundIntensity,
+                        xNumberOfPixels, yNumberOfPixels, zNumberOfPixels, result.Array, 0);
+                }
+                else
+                {
+                    MaskMorphology.Dilate(input.Array, input.DimX, input.DimY, input.DimZ,
+                        ModelConstants.MaskBackgroundIntensity, ModelConstants.MaskForegroundIntensity,
+                        xNumberOfPixels, yNumberOfPixels, zNumberOfPixels, restriction?.Array, result.Array, 0);
+                }
+
+                return result;
+            }
+
             // The dimensions in which the operation will be performed in
             bool dilationRequiredInX = xNumberOfPixels > 0;
             bool dilationRequiredInY = yNumberOfPixels > 0;
@@ -162,6 +182,23 @@ namespace InnerEye.CreateDataset.Math
             // Identify the connected components so that we can paint the ellipsoid fully, only once for each component
             var connectedComponentslabelMap = new Volume3D<ushort>(input.DimX, input.DimY, input.DimZ, input.SpacingX, input.SpacingY, input.SpacingZ);
 
+            // With the full neighbourhood, the first surface point of each component is found while labelling
+            if (traverseX && traverseY && traverseZ)
+            {
+                var statistics = ConnectedComponents.Find3dWithStatistics(input.Array, input.DimX, input.DimY, input.DimZ, ModelConstants.MaskBackgroundIntensity,
+                    connectedComponentslabelMap.Array, new ConnectedComponentsOptions { Geometry = true });
+
+                for (var i = 0; i < statistics.Length; i++)
+                {
+                    if (i != ModelConstants.MaskBackgroundIntensity && statistics[i].SurfaceX >= 0)
+                    {
+                        structuringElement.PaintAllForegroundPointsOntoVolume(result, restriction, label, statistics[i].SurfaceX, statistics[i].SurfaceY, statistics[i].SurfaceZ);
+                    }
+                }
+
+                return statistics.Length;
+            }
+
             // The number of face connected components
             int components = ConnectedComponents.Find3d(input.Array, input.DimX, input.DimY, input.DimZ, ModelConstants.MaskBackgroundIntensity, connectedComponentslabelMap.Array);
 
@@ -11,6 +11,7 @@
 namespace InnerEye.CreateDataset.Math
 {
 	using System;
+	using InnerEye.CreateDataset.ImageProcessing;
 	using InnerEye.CreateDataset.Volumes;
 
 	public static class ResamplingExtensions
@@ -255,7 +256,11 @@ namespace InnerEye.CreateDataset.Math
 			// When using linear resampling, the default value will not be used, can hence set to a default.
 			var outsideValue = default(float);
             var output = new Volume3D<float>(dimX, dimY, dimZ, spacingX, spacingY, spacingZ, input.Origin, input.Direction);
-            GenericResampling.ResampleImage(input, output, outsideValue, (x, y, z) => input.Linear(x, y, z, 0));
+            // The native resampling maps output voxels to the input as GenericResampling.ResampleImage does.
+            var shift = input.Transform.PhysicalToPixel(output.Origin);
+            Resampling.ResampleLinear(input.Array, input.DimX, input.DimY, input.DimZ, output.Array, dimX, dimY, dimZ,
+                output.SpacingX / input.SpacingX, output.SpacingY / input.SpacingY, output.SpacingZ / input.SpacingZ,
+                shift.X, shift.Y, shift.Z, outsideValue, 0);
             return output;
         }
         
@@ -569,7 +574,11 @@ namespace InnerEye.CreateDataset.Math
 			// When using linear resampling, the default value will not be used, can hence set to a default.
 			var outsideValue = default(short);
             var output = new Volume3D<short>(dimX, dimY, dimZ, spacingX, spacingY, spacingZ, input.Origin, input.Direction);
-            GenericResampling.ResampleImage(input, output, outsideValue, (x, y, z) => input.Linear(x, y, z, 0));
+            // The native resampling maps output voxels to the input as GenericResampling.ResampleImage does.
+            var shift = input.Transform.PhysicalToPixel(output.Origin);
+            Resampling.ResampleLinear(input.Array, input.DimX, input.DimY, input.DimZ, output.Array, dimX, dimY, dimZ,
+                output.SpacingX / input.SpacingX, output.SpacingY / input.SpacingY, output.SpacingZ / input.SpacingZ,
+                shift.X, shift.Y, shift.Z, outsideValue, 0);
             return output;
         }
         
@@ -726,7 +735,11 @@ namespace InnerEye.CreateDataset.Math
 			// When using linear resampling, the default value will not be used, can hence set to a default.
 			var outsideValue = default(byte);
             var output = new Volume3D<byte>(dimX, dimY, dimZ, spacingX, spacingY, spacingZ, input.Origin, input.Direction);
-            GenericResampling.ResampleImage(input, output, outsideValue, (x, y, z) => input.Linear(x, y, z, 0));
+            // The native resampling maps output voxels to the input as GenericResampling.ResampleImage does.
+            var shift = input.Transform.PhysicalToPixel(output.Origin);
+            Resampling.ResampleLinear(input.Array, input.DimX, input.DimY, input.DimZ, output.Array, dimX, dimY, dimZ,
+                output.SpacingX / input.SpacingX, output.SpacingY / input.SpacingY, output.SpacingZ / input.SpacingZ,
+                shift.X, shift.Y, shift.Z, outsideValue, 0);
             return output;
         }
         
@@ -281,18 +281,30 @@
         }
 
         public static Volume3D<byte> SmoothedImage(this Volume3D<byte> image, double sigma)
+            => image.SmoothedImage(sigma, new ConvolutionOptions());
+
+        /// <summary>
+        /// Gets the volume smoothed by a Gaussian, as <see cref="SmoothedImage(Volume3D{byte}, double)"/>,
+        /// with the given options. Set <see cref="ConvolutionOptions.FixedPoint"/> for a faster
+        /// result that is within one of the default along each axis.
+        /// </summary>
+        /// <param name="image"></param>
+        /// <param name="sigma"></param>
+        /// <param name="options"></param>
+        /// <returns></returns>
+        public static Volume3D<byte> SmoothedImage(this Volume3D<byte> image, double sigma, ConvolutionOptions options)
         {
-            var output = image.Copy();
-            Convolution.Convolve(output.Array, output.DimX, output.DimY, output.DimZ,
-                GetDirectionsForConvolution(), output.GetSigmasForConvolution((float)sigma));
+            var output = image.CreateSameSize<byte>();
+            Convolution.Convolve(image.Array, output.Array, image.DimX, image.DimY, image.DimZ,
+                GetDirectionsForConvolution(), image.GetSigmasForConvolution((float)sigma), options);
             return output;
         }
 
         public static Volume3D<float> SmoothedImage(this Volume3D<float> image, double sigma)
         {
-            var output = image.Copy();
-            Convolution.Convolve(output.Array, output.DimX, output.DimY, output.DimZ,
-                GetDirectionsForConvolution(), output.GetSigmasForConvolution((float)sigma));
+            var output = image.CreateSameSize<float>();
+            Convolution.Convolve(image.Array, output.Array, image.DimX, image.DimY, image.DimZ,
+                GetDirectionsForConvolution(), image.GetSigmasForConvolution((float)sigma));
             return output;
         }
 